@@ -0,0 +1,671 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// cl_bench.c -- timedemo frame statistics
+
+/*
+
+With timedemo 1, every client frame that draws a view is timed, split
+into the phases of benchphase_t by CL_BenchPhase calls around the parts
+of the frame.  When the demo ends the frame times are summarized.
+
+timedemo_runs N plays the demo N times, after timedemo_warmup runs that
+are played but not counted.  timedemo_report <name> writes the summary to
+benchmarks/<name>.json and every counted frame to benchmarks/<name>.csv.
+
+deltabench times the entity delta encoder and decoder over the frames the
+client is holding, so run it while a demo plays.
+
+*/
+
+#include "client.h"
+
+#include <features/features_cpu.h>
+
+cvar_t	*timedemo_runs;
+cvar_t	*timedemo_warmup;
+cvar_t	*timedemo_report;
+cvar_t	*timedemo_hitch;
+
+typedef struct
+{
+	int			run;
+	unsigned	total;
+	unsigned	phase[NUM_BENCH_PHASES];
+} benchframe_t;
+
+typedef struct
+{
+	int			frames;
+	float		seconds;
+	float		fps;
+	float		min, avg, p50, p95, p99, max;	// frame times in ms
+	float		phase[NUM_BENCH_PHASES];		// average ms
+	int			hitches;
+	int			worsthitch;						// frame number
+} benchstats_t;
+
+#define	MAX_BENCH_RUNS	64
+
+static const char *bench_phasenames[NUM_BENCH_PHASES] =
+{
+	"parse", "entities", "view", "refresh", "screen", "sound", "other"
+};
+
+static struct
+{
+	qboolean		active;			// timing the current frame
+	retro_time_t	framestart;
+	retro_time_t	phasestart;
+	int				phase;
+	unsigned		phasetime[NUM_BENCH_PHASES];
+	int				viewframes;		// cl.timedemo_frames at the frame start
+
+	char			demo[MAX_QPATH];
+	int				run;			// including warm up runs
+	int				runs, warmup;
+	qboolean		demoended;		// the server played the demo to its end
+
+	benchframe_t	*frames;		// counted runs only
+	int				numframes;
+	int				maxframes;
+	int				runstart;		// first frame of the current run
+
+	benchstats_t	stats[MAX_BENCH_RUNS];
+	int				numstats;
+} bench;
+
+/*
+================
+CL_BenchPhase
+
+Charges the time since the last call to the phase that was running and
+starts timing the given one
+================
+*/
+void CL_BenchPhase (int phase)
+{
+	retro_time_t	now;
+
+	if (!bench.active)
+		return;
+
+	now = cpu_features_get_time_usec ();
+	bench.phasetime[bench.phase] += now - bench.phasestart;
+	bench.phasestart = now;
+	bench.phase = phase;
+}
+
+/*
+================
+CL_BenchBeginFrame
+================
+*/
+void CL_BenchBeginFrame (void)
+{
+	bench.active = cl_timedemo->value != 0;
+	if (!bench.active)
+		return;
+
+	memset (bench.phasetime, 0, sizeof(bench.phasetime));
+	bench.framestart = bench.phasestart = cpu_features_get_time_usec ();
+	bench.phase = BENCH_OTHER;
+	bench.viewframes = cl.timedemo_frames;
+}
+
+/*
+================
+CL_BenchEndFrame
+
+Keeps the frame if it drew a view
+================
+*/
+void CL_BenchEndFrame (void)
+{
+	benchframe_t	*f;
+	benchframe_t	*old;
+
+	if (!bench.active)
+		return;
+	CL_BenchPhase (BENCH_OTHER);
+	bench.active = false;
+
+	if (cl.timedemo_frames == bench.viewframes)
+		return;		// still loading, or paused
+
+	// the first frame of a sequence of runs
+	if (!bench.run)
+	{
+		Q_strlcpy (bench.demo, Cvar_VariableString ("mapname"), sizeof(bench.demo));
+		bench.runs = timedemo_runs->value;
+		if (bench.runs < 1)
+			bench.runs = 1;
+		bench.warmup = timedemo_warmup->value;
+		if (bench.warmup < 0)
+			bench.warmup = 0;
+		if (bench.runs > MAX_BENCH_RUNS)
+			bench.runs = MAX_BENCH_RUNS;
+		bench.run = 1;
+		bench.numframes = bench.runstart = 0;
+		bench.numstats = 0;
+	}
+
+	if (bench.run <= bench.warmup)
+		return;
+
+	if (bench.numframes == bench.maxframes)
+	{
+		old = bench.frames;
+		bench.maxframes = bench.maxframes ? bench.maxframes * 2 : 4096;
+		bench.frames = Z_Malloc (bench.maxframes * sizeof(*bench.frames));
+		if (old)
+		{
+			memcpy (bench.frames, old, bench.numframes * sizeof(*bench.frames));
+			Z_Free (old);
+		}
+	}
+
+	f = &bench.frames[bench.numframes++];
+	f->run = bench.run - bench.warmup;
+	f->total = cpu_features_get_time_usec () - bench.framestart;
+	memcpy (f->phase, bench.phasetime, sizeof(f->phase));
+}
+
+static int CL_BenchCompare (const void *a, const void *b)
+{
+	unsigned	x = *(const unsigned *)a;
+	unsigned	y = *(const unsigned *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+================
+CL_BenchPercentile
+
+Nearest rank over sorted frame times, in ms
+================
+*/
+static float CL_BenchPercentile (const unsigned *sorted, int count, int percent)
+{
+	int		rank;
+
+	rank = (count * percent + 99) / 100;
+	if (rank < 1)
+		rank = 1;
+	return sorted[rank - 1] * 0.001f;
+}
+
+/*
+================
+CL_BenchStats
+
+Summarizes count frames.  A hitch is a frame that takes timedemo_hitch
+times as long as the median one.
+================
+*/
+static void CL_BenchStats (benchframe_t *frames, int count, benchstats_t *s)
+{
+	unsigned	*sorted;
+	double		total, phase[NUM_BENCH_PHASES];
+	unsigned	hitch, worst;
+	int			i, j;
+
+	memset (s, 0, sizeof(*s));
+	if (!count)
+		return;
+
+	sorted = Z_Malloc (count * sizeof(*sorted));
+	total = 0;
+	memset (phase, 0, sizeof(phase));
+	for (i=0 ; i<count ; i++)
+	{
+		sorted[i] = frames[i].total;
+		total += frames[i].total;
+		for (j=0 ; j<NUM_BENCH_PHASES ; j++)
+			phase[j] += frames[i].phase[j];
+	}
+	qsort (sorted, count, sizeof(*sorted), CL_BenchCompare);
+
+	s->frames = count;
+	s->seconds = total * 0.000001;
+	s->fps = total > 0 ? count / s->seconds : 0;
+	s->min = sorted[0] * 0.001f;
+	s->max = sorted[count-1] * 0.001f;
+	s->avg = total * 0.001 / count;
+	s->p50 = CL_BenchPercentile (sorted, count, 50);
+	s->p95 = CL_BenchPercentile (sorted, count, 95);
+	s->p99 = CL_BenchPercentile (sorted, count, 99);
+	for (j=0 ; j<NUM_BENCH_PHASES ; j++)
+		s->phase[j] = phase[j] * 0.001 / count;
+
+	hitch = s->p50 * 1000 * timedemo_hitch->value;
+	worst = 0;
+	s->worsthitch = -1;
+	for (i=0 ; i<count ; i++)
+	{
+		if (frames[i].total <= hitch)
+			continue;
+		s->hitches++;
+		if (frames[i].total > worst)
+		{
+			worst = frames[i].total;
+			s->worsthitch = i;
+		}
+	}
+
+	Z_Free (sorted);
+}
+
+/*
+================
+CL_BenchPrint
+================
+*/
+static void CL_BenchPrint (const char *title, benchstats_t *s)
+{
+	int		j;
+
+	Com_Printf ("%s: %i frames, %3.1f fps\n", title, s->frames, s->fps);
+	Com_Printf ("  ms min %.2f avg %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f\n",
+		s->min, s->avg, s->p50, s->p95, s->p99, s->max);
+	Com_Printf ("  ");
+	for (j=0 ; j<NUM_BENCH_PHASES ; j++)
+		Com_Printf ("%s %.2f ", bench_phasenames[j], s->phase[j]);
+	Com_Printf ("\n");
+	if (s->hitches)
+		Com_Printf ("  %i hitches, worst at frame %i\n", s->hitches, s->worsthitch);
+}
+
+/*
+================
+CL_BenchWriteStats
+================
+*/
+static void CL_BenchWriteStats (RFILE *f, benchstats_t *s)
+{
+	int		j;
+
+	rfprintf (f, "{\"frames\": %i, \"seconds\": %.3f, \"fps\": %.2f, "
+		"\"ms\": {\"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+		"\"hitches\": %i, \"worst_hitch_frame\": %i, \"phase_ms\": {",
+		s->frames, s->seconds, s->fps,
+		s->min, s->avg, s->p50, s->p95, s->p99, s->max,
+		s->hitches, s->worsthitch);
+	for (j=0 ; j<NUM_BENCH_PHASES ; j++)
+		rfprintf (f, "%s\"%s\": %.3f", j ? ", " : "", bench_phasenames[j], s->phase[j]);
+	rfprintf (f, "}}");
+}
+
+/*
+================
+CL_BenchWriteReport
+================
+*/
+static void CL_BenchWriteReport (benchstats_t *all, float fpsmean, float fpsdev)
+{
+	char		name[MAX_OSPATH];
+	RFILE		*f;
+	benchframe_t	*fr;
+	int			i, j;
+
+	Com_sprintf (name, sizeof(name), "%s/benchmarks/%s.json", FS_Gamedir(), timedemo_report->string);
+	FS_CreatePath (name);
+	f = rfopen (name, "w");
+	if (!f)
+	{
+		Com_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+	rfprintf (f, "{\n\"demo\": \"%s\",\n\"renderer\": \"%s\",\n\"width\": %i,\n\"height\": %i,\n",
+		bench.demo, Cvar_VariableString ("vid_ref"), viddef.width, viddef.height);
+	rfprintf (f, "\"warmup_runs\": %i,\n\"hitch_factor\": %g,\n", bench.warmup, timedemo_hitch->value);
+	rfprintf (f, "\"fps_mean\": %.2f,\n\"fps_stddev\": %.2f,\n\"all\": ", fpsmean, fpsdev);
+	CL_BenchWriteStats (f, all);
+	rfprintf (f, ",\n\"runs\": [\n");
+	for (i=0 ; i<bench.numstats ; i++)
+	{
+		CL_BenchWriteStats (f, &bench.stats[i]);
+		rfprintf (f, i < bench.numstats-1 ? ",\n" : "\n");
+	}
+	rfprintf (f, "]\n}\n");
+	rfclose (f);
+	Com_Printf ("wrote %s\n", name);
+
+	Com_sprintf (name, sizeof(name), "%s/benchmarks/%s.csv", FS_Gamedir(), timedemo_report->string);
+	f = rfopen (name, "w");
+	if (!f)
+	{
+		Com_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+	rfprintf (f, "run,frame,total_us");
+	for (j=0 ; j<NUM_BENCH_PHASES ; j++)
+		rfprintf (f, ",%s_us", bench_phasenames[j]);
+	rfprintf (f, "\n");
+	for (i=0, j=0, fr=bench.frames ; i<bench.numframes ; i++, fr++)
+	{
+		if (i && fr->run != fr[-1].run)
+			j = i;
+		rfprintf (f, "%i,%i,%u,%u,%u,%u,%u,%u,%u,%u\n", fr->run, i - j, fr->total,
+			fr->phase[0], fr->phase[1], fr->phase[2], fr->phase[3],
+			fr->phase[4], fr->phase[5], fr->phase[6]);
+	}
+	rfclose (f);
+	Com_Printf ("wrote %s\n", name);
+}
+
+/*
+================
+CL_DemoCompleted
+
+Called by the server when demo playback runs out of messages, so the
+disconnect that follows can be told apart from an aborted one
+================
+*/
+void CL_DemoCompleted (void)
+{
+	if (cl_timedemo && cl_timedemo->value)
+		bench.demoended = true;
+}
+
+/*
+================
+CL_BenchFinish
+
+Called on every disconnect during a timedemo.  After a demo that played
+to its end this starts the next run, or reports on all of them after
+the last.  Anything else (a typed disconnect, an error) drops the whole
+series.
+================
+*/
+void CL_BenchFinish (void)
+{
+	benchstats_t	all;
+	double			sum, sq;
+	int				time, i;
+
+	bench.active = false;
+
+	// the classic summary
+	time = Sys_Milliseconds () - cl.timedemo_start;
+	if (time > 0)
+		Com_Printf ("%i frames, %3.1f seconds: %3.1f fps\n", cl.timedemo_frames,
+		time/1000.0, cl.timedemo_frames*1000.0 / time);
+
+	if (!bench.demoended)
+	{
+		if (bench.run)
+			Com_Printf ("timedemo aborted, runs discarded\n");
+		if (bench.frames)
+			Z_Free (bench.frames);
+		memset (&bench, 0, sizeof(bench));
+		return;
+	}
+	bench.demoended = false;
+
+	if (!bench.run)
+		return;		// never drew anything
+
+	if (bench.run > bench.warmup && bench.numstats < MAX_BENCH_RUNS)
+	{
+		CL_BenchStats (bench.frames + bench.runstart, bench.numframes - bench.runstart,
+			&bench.stats[bench.numstats]);
+		CL_BenchPrint (va("run %i", bench.numstats + 1), &bench.stats[bench.numstats]);
+		bench.numstats++;
+		bench.runstart = bench.numframes;
+	}
+	else
+		Com_Printf ("warm up run %i done\n", bench.run);
+
+	if (bench.run < bench.warmup + bench.runs)
+	{
+		bench.run++;
+		Cbuf_AddText (va("demomap \"%s\"\n", bench.demo));
+		return;
+	}
+
+	// all runs done
+	CL_BenchStats (bench.frames, bench.numframes, &all);
+	sum = sq = 0;
+	for (i=0 ; i<bench.numstats ; i++)
+	{
+		sum += bench.stats[i].fps;
+		sq += bench.stats[i].fps * bench.stats[i].fps;
+	}
+	if (bench.numstats > 1)
+	{
+		CL_BenchPrint (va("%i runs", bench.numstats), &all);
+		sq = (sq - sum * sum / bench.numstats) / (bench.numstats - 1);
+		Com_Printf ("  fps per run %.2f +- %.2f\n", sum / bench.numstats, sq > 0 ? sqrt (sq) : 0);
+	}
+	else
+		sq = 0;
+
+	if (timedemo_report->string[0])
+		CL_BenchWriteReport (&all, bench.numstats ? sum / bench.numstats : 0, sq > 0 ? sqrt (sq) : 0);
+
+	if (bench.frames)
+		Z_Free (bench.frames);
+	memset (&bench, 0, sizeof(bench));
+}
+
+/*
+==============================================================================
+
+ENTITY DELTA BENCHMARK
+
+==============================================================================
+*/
+
+#define	MAX_DELTA_BYTES		64		// more than the largest entity delta
+
+/*
+================
+CL_DeltaBenchFrames
+
+Pairs up every entity in the frames still held with the state the server
+would have deltaed it from: the same entity in the previous frame, or its
+baseline when it wasn't there.  Returns the number of pairs.
+================
+*/
+static int CL_DeltaBenchFrames (entity_state_t *from, entity_state_t *to, qboolean *newentity, int *numframes)
+{
+	frame_t			*frame, *old;
+	entity_state_t	*s, *olds;
+	int				count;
+	int				i, j, oldnum;
+
+	count = 0;
+	*numframes = 0;
+	for (i=0 ; i<UPDATE_BACKUP ; i++)
+	{
+		frame = &cl.frames[i];
+		if (!frame->valid || cl.parse_entities - frame->parse_entities > MAX_PARSE_ENTITIES-128)
+			continue;
+		old = &cl.frames[(frame->serverframe-1) & UPDATE_MASK];
+		if (!old->valid || old->serverframe != frame->serverframe-1
+			|| cl.parse_entities - old->parse_entities > MAX_PARSE_ENTITIES-128)
+			old = NULL;
+
+		(*numframes)++;
+		oldnum = 0;
+		for (j=0 ; j<frame->num_entities && count<MAX_PARSE_ENTITIES ; j++)
+		{
+			s = &cl_parse_entities[(frame->parse_entities+j) & (MAX_PARSE_ENTITIES-1)];
+
+			// both frames are sorted by entity number
+			olds = NULL;
+			while (old && oldnum < old->num_entities)
+			{
+				olds = &cl_parse_entities[(old->parse_entities+oldnum) & (MAX_PARSE_ENTITIES-1)];
+				if (olds->number >= s->number)
+					break;
+				oldnum++;
+			}
+			if (olds && (oldnum == old->num_entities || olds->number != s->number))
+				olds = NULL;
+
+			if (olds)
+			{
+				from[count] = *olds;
+				newentity[count] = false;
+			}
+			else
+			{
+				from[count] = cl_entities[s->number].baseline;
+				newentity[count] = true;
+			}
+			to[count] = *s;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+================
+CL_DeltaBench_f
+
+deltabench [passes]
+================
+*/
+static void CL_DeltaBench_f (void)
+{
+	entity_state_t	*from, *to, state;
+	qboolean		*newentity, *sent;
+	sizebuf_t		msg;
+	byte			*data;
+	retro_time_t	start, encode, decode;
+	int				count, frames, passes;
+	int				i, pass, bits, number, b;
+	int				mismatches, size;
+
+	passes = Cmd_Argc () > 1 ? atoi (Cmd_Argv (1)) : 100;
+	if (passes < 1)
+		passes = 1;
+
+	from = Z_Malloc (MAX_PARSE_ENTITIES * sizeof(*from));
+	to = Z_Malloc (MAX_PARSE_ENTITIES * sizeof(*to));
+	newentity = Z_Malloc (MAX_PARSE_ENTITIES * sizeof(*newentity));
+	sent = Z_Malloc (MAX_PARSE_ENTITIES * sizeof(*sent));
+	data = Z_Malloc (MAX_PARSE_ENTITIES * MAX_DELTA_BYTES);
+
+	count = CL_DeltaBenchFrames (from, to, newentity, &frames);
+	if (!count)
+	{
+		Com_Printf ("deltabench: no frames, play a demo first\n");
+		goto done;
+	}
+
+	// the vectorized change mask has to agree with the plain one
+	mismatches = 0;
+	for (i=0 ; i<count ; i++)
+		if (MSG_EntityLanes (&from[i], &to[i]) != MSG_EntityLanes_C (&from[i], &to[i]))
+			mismatches++;
+
+	SZ_Init (&msg, data, MAX_PARSE_ENTITIES * MAX_DELTA_BYTES);
+
+	// deltas with nothing to send aren't written, so note which were
+	for (i=0 ; i<count ; i++)
+	{
+		size = msg.cursize;
+		MSG_WriteDeltaEntity (&from[i], &to[i], &msg, false, newentity[i]);
+		sent[i] = msg.cursize != size;
+	}
+
+	encode = 0;
+	decode = 0;
+	for (pass=0 ; pass<passes ; pass++)
+	{
+		SZ_Clear (&msg);
+		start = cpu_features_get_time_usec ();
+		for (i=0 ; i<count ; i++)
+			MSG_WriteDeltaEntity (&from[i], &to[i], &msg, false, newentity[i]);
+		encode += cpu_features_get_time_usec () - start;
+
+		MSG_BeginReading (&msg);
+		start = cpu_features_get_time_usec ();
+		for (i=0 ; i<count ; i++)
+		{
+			if (!sent[i])
+				continue;
+
+			bits = MSG_ReadByte (&msg);
+			if (bits & U_MOREBITS1)
+			{
+				b = MSG_ReadByte (&msg);
+				bits |= b<<8;
+			}
+			if (bits & U_MOREBITS2)
+			{
+				b = MSG_ReadByte (&msg);
+				bits |= b<<16;
+			}
+			if (bits & U_MOREBITS3)
+			{
+				b = MSG_ReadByte (&msg);
+				bits |= b<<24;
+			}
+			if (bits & U_NUMBER16)
+				number = MSG_ReadShort (&msg);
+			else
+				number = MSG_ReadByte (&msg);
+
+			MSG_ReadDeltaEntity (&msg, &from[i], &state, number, bits);
+		}
+		decode += cpu_features_get_time_usec () - start;
+	}
+
+	Com_Printf ("deltabench: %i deltas from %i frames, %i bytes, %i passes\n",
+		count, frames, msg.cursize, passes);
+	Com_Printf ("encode: %6.1f ns per delta, %7.1f MB/s\n",
+		encode * 1000.0 / ((double)count * passes),
+		encode ? (double)msg.cursize * passes / encode : 0.0);
+	Com_Printf ("decode: %6.1f ns per delta, %7.1f MB/s\n",
+		decode * 1000.0 / ((double)count * passes),
+		decode ? (double)msg.cursize * passes / decode : 0.0);
+	if (mismatches)
+		Com_Printf ("deltabench: %i change masks differ from the reference\n", mismatches);
+
+done:
+	Z_Free (data);
+	Z_Free (sent);
+	Z_Free (newentity);
+	Z_Free (to);
+	Z_Free (from);
+}
+
+/*
+================
+CL_BenchInit
+================
+*/
+void CL_BenchInit (void)
+{
+	timedemo_runs = Cvar_Get ("timedemo_runs", "1", 0);
+	timedemo_warmup = Cvar_Get ("timedemo_warmup", "0", 0);
+	timedemo_report = Cvar_Get ("timedemo_report", "", 0);
+	timedemo_hitch = Cvar_Get ("timedemo_hitch", "2", 0);
+
+	Cmd_AddCommand ("deltabench", CL_DeltaBench_f);
+}
@@ -19,10 +19,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include <libretro_file.h>
+#include <libretro_thread.h>
 
 #include "client.h"
 
 cvar_t *cin_force43;
+cvar_t *cin_prefetch;
 extern bool is_soft_render;
 
 typedef struct
@@ -31,6 +33,31 @@ typedef struct
 	int		count;
 } cblock_t;
 
+#define CIN_MAX_SAMPLES		(22050/14*4)
+#define CIN_MAX_COMPRESSED	0x20000
+#define CIN_COMPRESSED_PAD	64		/* zeroes after a frame, longest code is 32 bytes */
+#define CIN_QUEUE			8		/* most frames decoded ahead, power of two */
+
+typedef enum
+{
+	CINFRAME_OK,
+	CINFRAME_END,		/* last frame marker or end of file */
+	CINFRAME_BADSIZE	/* corrupt compressed frame size */
+} cinframestatus_t;
+
+/* one frame as it comes off the file, ready to show */
+typedef struct
+{
+	cinframestatus_t	status;
+	qboolean	newpalette;
+	byte		palette[768];
+	byte		*pic;			// width*height
+	int			piccount;
+	int			overread;
+	int			samplecount;
+	byte		samples[CIN_MAX_SAMPLES];
+} cinframe_t;
+
 typedef struct
 {
 	qboolean	restart_sound;
@@ -49,6 +76,21 @@ typedef struct
 
 	int		h_used[512];
 	int		h_count[512];
+
+	// first 8 bits of every code: low 9 bits are the symbol, or the
+	// node to carry on from, the rest are the bits used
+	unsigned short	*hlookup;	// [256][256]
+
+	// decoding, either on the main thread or ahead of it
+	byte		*compressed;
+	int			decodeframe;
+	cinframe_t	frames[CIN_QUEUE];
+	int			prefetch;
+
+	qthread_t	*thread;
+	volatile unsigned	write_pos;
+	volatile unsigned	read_pos;
+	volatile unsigned	quit;
 } cinematics_t;
 
 cinematics_t	cin;
@@ -158,6 +200,10 @@ SCR_StopCinematic
 */
 void SCR_StopCinematic (void)
 {
+	int		i;
+
+	SCR_StopCinematicDecoder ();
+
 	cl.cinematictime = 0;	// done
 	if (cin.pic)
 	{
@@ -184,6 +230,24 @@ void SCR_StopCinematic (void)
 		Z_Free (cin.hnodes1);
 		cin.hnodes1 = NULL;
 	}
+	if (cin.hlookup)
+	{
+		Z_Free (cin.hlookup);
+		cin.hlookup = NULL;
+	}
+	if (cin.compressed)
+	{
+		Z_Free (cin.compressed);
+		cin.compressed = NULL;
+	}
+	for (i=0 ; i<CIN_QUEUE ; i++)
+	{
+		if (cin.frames[i].pic)
+		{
+			Z_Free (cin.frames[i].pic);
+			cin.frames[i].pic = NULL;
+		}
+	}
 
 	// switch back down to 11 khz sound if necessary
 	if (cin.restart_sound)
@@ -243,6 +307,38 @@ int	SmallestNode1 (int numhnodes)
 }
 
 
+/*
+==================
+Huff1LookupInit
+
+Walks every tree with every 8 bit pattern so the decoder can take up to
+a byte of code in one step.  Like the old bitwise walk, every symbol but
+the first takes at least one bit, even when the tree is a lone leaf.
+==================
+*/
+static void Huff1LookupInit (void)
+{
+	int		prev, bits, used, node, index;
+
+	cin.hlookup = Z_Malloc (256*256*sizeof(cin.hlookup[0]));
+
+	for (prev=0 ; prev<256 ; prev++)
+	{
+		for (bits=0 ; bits<256 ; bits++)
+		{
+			node = cin.numhnodes1[prev];
+			used = 0;
+			do
+			{
+				index = prev*256*2 + (node-256)*2 + ((bits>>used)&1);
+				node = index >= 0 ? cin.hnodes1[index] : 0;
+				used++;
+			} while (node >= 256 && used < 8);
+			cin.hlookup[prev*256 + bits] = node | (used << 9);
+		}
+	}
+}
+
 /*
 ==================
 Huff1TableInit
@@ -294,194 +390,275 @@ void Huff1TableInit (void)
 
 		cin.numhnodes1[prev] = numhnodes-1;
 	}
+
+	Huff1LookupInit ();
 }
 
 /*
 ==================
 Huff1Decompress
+
+Decodes into out, returns the decompressed count.  Each symbol costs one
+table lookup, only codes longer than 8 bits walk the tree for the rest.
 ==================
 */
-cblock_t Huff1Decompress (cblock_t in)
+static int Huff1Decompress (cblock_t in, byte *out, int outsize, int *overread)
 {
 	byte		*input;
-	byte		*out_p;
-	int			nodenum;
-	int			count;
-	cblock_t	out;
-	int			inbyte;
-	int			*hnodes, *hnodesbase;
-//int		i;
+	int			count, total, bitpos, bits, entry, node, prev;
+	int			*hnodes;
 
 	// get decompressed count
 	count = in.data[0] + (in.data[1]<<8) + (in.data[2]<<16) + (in.data[3]<<24);
+	if (count > outsize || count < 0)
+		count = outsize;
+	total = count;
 	input = in.data + 4;
-	out_p = out.data = Z_Malloc (count);
 
-	// read bits
+	bitpos = 0;
+	prev = 0;
 
-	hnodesbase = cin.hnodes1 - 256*2;	// nodes 0-255 aren't stored
-
-	hnodes = hnodesbase;
-	nodenum = cin.numhnodes1[0];
-	while (count)
+	// only the first symbol can come for free
+	if (count && cin.numhnodes1[0] < 256)
 	{
-		inbyte = *input++;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
-		//-----------
-		if (nodenum < 256)
-		{
-			hnodes = hnodesbase + (nodenum<<9);
-			*out_p++ = nodenum;
-			if (!--count)
-				break;
-			nodenum = cin.numhnodes1[nodenum];
-		}
-		nodenum = hnodes[nodenum*2 + (inbyte&1)];
-		inbyte >>=1;
+		*out++ = prev = cin.numhnodes1[0];
+		count--;
 	}
 
-	if (input - in.data != in.count && input - in.data != in.count+1)
+	while (count--)
 	{
-		Com_Printf ("Decompression overread by %i", (input - in.data) - in.count);
+		if ((bitpos>>3) > in.count)
+			break;		// corrupt, don't run off the buffer
+
+		bits = (input[bitpos>>3] | (input[(bitpos>>3)+1]<<8)) >> (bitpos&7);
+		entry = cin.hlookup[prev*256 + (bits&255)];
+		node = entry & 511;
+		bitpos += entry >> 9;
+
+		if (node >= 256)
+		{	// long code, finish it a bit at a time
+			hnodes = cin.hnodes1 + prev*256*2;
+			do
+			{
+				node = hnodes[(node-256)*2 + ((input[bitpos>>3] >> (bitpos&7))&1)];
+				bitpos++;
+			} while (node >= 256);
+		}
+
+		*out++ = node;
+		prev = node;
 	}
-	out.count = out_p - out.data;
 
-	return out;
+	// the bitwise decoder always fetched the byte holding the next bit
+	*overread = total ? 4 + (bitpos>>3) + 1 - in.count : 4 - in.count;
+	if (*overread == 1)
+		*overread = 0;
+
+	return total;
 }
 
 /*
 ==================
-SCR_ReadNextFrame
+SCR_DecodeFrame
+
+Reads and decodes the next frame into f.  Only touches the file and cin
+state private to the decoder, so it can run on the decoder thread.
 ==================
 */
-byte *SCR_ReadNextFrame (void)
+static void SCR_DecodeFrame (cinframe_t *f)
 {
-	int		r;
-	int		command;
-	byte	samples[22050/14*4];
-	byte	compressed[0x20000];
-	int		size;
-	byte	*pic;
-	cblock_t	in, huf1;
-	int		start, end, count;
+	int			command;
+	int			size, samplesize;
+	int			start, end;
+	cblock_t	in;
+
+	f->newpalette = false;
+	f->samplecount = 0;
+	f->piccount = 0;
+	f->overread = 0;
 
 	// read the next frame
-	r = rfread (&command, 1, 4, cl.cinematic_file);
-	if (r == 0)		// we'll give it one more chance
-		r = rfread (&command, 1, 4, cl.cinematic_file);
+	if (rfread (&command, 1, 4, cl.cinematic_file) != 4)
+	{	// we'll give it one more chance
+		if (rfread (&command, 1, 4, cl.cinematic_file) != 4)
+		{
+			f->status = CINFRAME_END;
+			return;
+		}
+	}
 
-	if (r != 4){
-		return NULL;
-	}	
-		
 	command = LittleLong(command);
 	if (command == 2)
-		return NULL;	// last frame marker
+	{	// last frame marker
+		f->status = CINFRAME_END;
+		return;
+	}
 
 	if (command == 1)
 	{	// read palette
-		FS_Read (cl.cinematicpalette, sizeof(cl.cinematicpalette), cl.cinematic_file);
-		cl.cinematicpalette_active=0;	// dubious....  exposes an edge case
+		if (rfread (f->palette, 1, sizeof(f->palette), cl.cinematic_file) != sizeof(f->palette))
+		{
+			f->status = CINFRAME_END;
+			return;
+		}
+		f->newpalette = true;
 	}
 
 	// decompress the next frame
-	FS_Read (&size, 4, cl.cinematic_file);
+	if (rfread (&size, 1, 4, cl.cinematic_file) != 4)
+	{
+		f->status = CINFRAME_END;
+		return;
+	}
 	size = LittleLong(size);
-	if (size > sizeof(compressed) || size < 1)
-		Com_Error (ERR_DROP, "Bad compressed frame size");
-	FS_Read (compressed, size, cl.cinematic_file);
+	if (size > CIN_MAX_COMPRESSED || size < 1)
+	{
+		f->status = CINFRAME_BADSIZE;
+		return;
+	}
+	if (rfread (cin.compressed, 1, size, cl.cinematic_file) != size)
+	{
+		f->status = CINFRAME_END;
+		return;
+	}
+	memset (cin.compressed + size, 0, CIN_COMPRESSED_PAD);
 
 	// read sound
-	start = cl.cinematicframe*cin.s_rate/14;
-	end = (cl.cinematicframe+1)*cin.s_rate/14;
-	count = end - start;
+	start = cin.decodeframe*cin.s_rate/14;
+	end = (cin.decodeframe+1)*cin.s_rate/14;
+	f->samplecount = end - start;
+	samplesize = f->samplecount*cin.s_width*cin.s_channels;
+	if (samplesize > CIN_MAX_SAMPLES)
+	{
+		f->status = CINFRAME_BADSIZE;
+		return;
+	}
+	rfread (f->samples, 1, samplesize, cl.cinematic_file);
 
-	FS_Read (samples, count*cin.s_width*cin.s_channels, cl.cinematic_file);
+	in.data = cin.compressed;
+	in.count = size;
+	f->piccount = Huff1Decompress (in, f->pic, cin.width*cin.height, &f->overread);
 
-	S_RawSamples (count, cin.s_rate, cin.s_width, cin.s_channels, samples);
+	cin.decodeframe++;
+	f->status = CINFRAME_OK;
+}
 
-	in.data = compressed;
-	in.count = size;
+/*
+==================
+SCR_CinematicDecoder
+
+Stays up to cin_prefetch frames ahead of the player
+==================
+*/
+static void SCR_CinematicDecoder (void *data)
+{
+	unsigned	pos;
+	cinframe_t	*f;
+
+	while (!qatomic_load (&cin.quit))
+	{
+		pos = cin.write_pos;
+		if (pos - qatomic_load (&cin.read_pos) >= (unsigned)cin.prefetch)
+		{
+			qthread_sleep (2);
+			continue;
+		}
+
+		f = &cin.frames[pos & (CIN_QUEUE-1)];
+		SCR_DecodeFrame (f);
+		qatomic_store (&cin.write_pos, pos + 1);
+
+		if (f->status != CINFRAME_OK)
+			break;
+	}
+}
+
+/*
+==================
+SCR_StopCinematicDecoder
+
+Must be called before anything else touches cl.cinematic_file
+==================
+*/
+void SCR_StopCinematicDecoder (void)
+{
+	if (!cin.thread)
+		return;
+
+	qatomic_store (&cin.quit, 1);
+	qthread_join (cin.thread);
+	cin.thread = NULL;
+}
+
+/*
+==================
+SCR_StartCinematicDecoder
+==================
+*/
+static void SCR_StartCinematicDecoder (void)
+{
+	int		i;
+
+	cin.compressed = Z_Malloc (CIN_MAX_COMPRESSED + CIN_COMPRESSED_PAD);
+	cin.decodeframe = 0;
+	cin.write_pos = cin.read_pos = cin.quit = 0;
+
+	cin.prefetch = cin_prefetch->value;
+	if (cin.prefetch > CIN_QUEUE)
+		cin.prefetch = CIN_QUEUE;
+
+	for (i=0 ; i<CIN_QUEUE ; i++)
+		cin.frames[i].pic = Z_Malloc (cin.width*cin.height);
+
+	if (cin.prefetch > 0)
+		cin.thread = qthread_create (SCR_CinematicDecoder, NULL);
+}
+
+/*
+==================
+SCR_ReadNextFrame
+==================
+*/
+byte *SCR_ReadNextFrame (void)
+{
+	cinframe_t	*f;
+	byte	*pic;
+
+	if (cin.thread)
+	{
+		// normally already there, this only waits if the decoder fell behind
+		while (qatomic_load (&cin.write_pos) == cin.read_pos)
+			qthread_sleep (1);
+		f = &cin.frames[cin.read_pos & (CIN_QUEUE-1)];
+	}
+	else
+	{
+		f = &cin.frames[0];
+		SCR_DecodeFrame (f);
+	}
+
+	if (f->status == CINFRAME_END)
+		return NULL;
+	if (f->status == CINFRAME_BADSIZE)
+		Com_Error (ERR_DROP, "Bad compressed frame size");
+
+	if (f->newpalette)
+	{
+		memcpy (cl.cinematicpalette, f->palette, sizeof(cl.cinematicpalette));
+		cl.cinematicpalette_active=0;	// dubious....  exposes an edge case
+	}
+
+	if (f->overread)
+		Com_Printf ("Decompression overread by %i", f->overread);
+
+	S_RawSamples (f->samplecount, cin.s_rate, cin.s_width, cin.s_channels, f->samples);
 
-	huf1 = Huff1Decompress (in);
+	pic = Z_Malloc (f->piccount);
+	memcpy (pic, f->pic, f->piccount);
 
-	pic = huf1.data;
+	// hand the slot back to the decoder
+	if (cin.thread)
+		qatomic_store (&cin.read_pos, cin.read_pos + 1);
 
 	cl.cinematicframe++;
 
@@ -717,6 +894,7 @@ void SCR_PlayCinematic (char *arg)
 	cin.s_channels = LittleLong(cin.s_channels);
 
 	Huff1TableInit ();
+	SCR_StartCinematicDecoder ();
 
 	// switch up to 22 khz sound if necessary
 	old_khz = Cvar_VariableValue ("s_khz");
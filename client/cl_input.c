@@ -512,10 +512,21 @@ void CL_SendCmd (void)
 	checksumIndex = buf.cursize;
 	MSG_WriteByte (&buf, 0);
 
+	// the server has the keyframe request once it acknowledges it,
+	// the uncompressed frame comes back in the same packet
+	if (cls.demokeyrequest && cls.netchan.incoming_acknowledged >= cls.demokeyrequest)
+		cls.demokeyrequest = 0;
+
 	// let the server know what the last frame we
 	// got was, so the next message can be delta compressed
 	if (cl_nodelta->value || !cl.frame.valid || cls.demowaiting)
 		MSG_WriteLong (&buf, -1);	// no compression
+	else if (cls.demorecording && demo_keyframe->value > 0 && !cls.demokeyrequest
+		&& cl.frame.serverframe - cls.demokeyframe >= demo_keyframe->value * 10)
+	{
+		MSG_WriteLong (&buf, -1);	// a keyframe for the demo seek index
+		cls.demokeyrequest = cls.netchan.outgoing_sequence;
+	}
 	else
 		MSG_WriteLong (&buf, cl.frame.serverframe);
 
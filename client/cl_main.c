@@ -109,6 +109,23 @@ extern	cvar_t *allow_download_maps;
 //======================================================================
 
 
+/*
+====================
+CL_SendRecording
+
+A protocol 35 server sends messages past MAX_MSGLEN, which a .dm2 can't
+hold, unless it knows the client is recording
+====================
+*/
+static void CL_SendRecording (qboolean recording)
+{
+	if (cls.state < ca_connected || cls.netchan.protocol != PROTOCOL_VERSION_EXT)
+		return;
+
+	MSG_WriteChar (&cls.netchan.message, clc_stringcmd);
+	MSG_WriteString (&cls.netchan.message, recording ? "recording 1" : "recording 0");
+}
+
 /*
 ====================
 CL_WriteDemoMessage
@@ -118,13 +135,23 @@ Dumps the current net message, prefixed by the length
 */
 void CL_WriteDemoMessage (void)
 {
-	int		len, swlen;
+	// until the server has heard about the demo its messages can be too
+	// long for protocol 34 players, wait for the next uncompressed frame
+	if (net_message.cursize - 8 > MAX_MSGLEN)
+	{
+		cls.demowaiting = true;
+		return;
+	}
+
+	// an uncompressed frame is somewhere demo_seek can start from
+	if (cl.frame.valid && cl.frame.deltaframe <= 0 && cl.frame.serverframe != cls.demokeyframe)
+	{
+		Demo_WriteKeyframe (cls.demofile, cl.servercount, cl.frame.serverframe, cl.configstrings);
+		cls.demokeyframe = cl.frame.serverframe;
+	}
 
 	// the first eight bytes are just packet sequencing stuff
-	len = net_message.cursize-8;
-	swlen = LittleLong(len);
-	rfwrite (&swlen, 4, 1, cls.demofile);
-	rfwrite (net_message.data+8,	len, 1, cls.demofile);
+	Demo_WriteMessage (cls.demofile, net_message.data+8, net_message.cursize-8);
 }
 
 
@@ -137,8 +164,6 @@ stop recording a demo
 */
 void CL_Stop_f (void)
 {
-	int		len;
-
 	if (!cls.demorecording)
 	{
 		Com_Printf ("Not recording a demo.\n");
@@ -146,11 +171,11 @@ void CL_Stop_f (void)
 	}
 
 // finish up
-	len = -1;
-	rfwrite (&len, 4, 1, cls.demofile);
-	rfclose (cls.demofile);
+	Demo_CloseWrite (cls.demofile);
 	cls.demofile = NULL;
 	cls.demorecording = false;
+	CL_SendRecording (false);
+	FS_FlushMissCache ();
 	Com_Printf ("Stopped demo.\n");
 }
 
@@ -169,7 +194,6 @@ void CL_Record_f (void)
 	char	buf_data[MAX_MSGLEN];
 	sizebuf_t	buf;
 	int		i;
-	int		len;
 	entity_state_t	*ent;
 	entity_state_t	nullstate;
 
@@ -197,8 +221,7 @@ void CL_Record_f (void)
 	Com_sprintf (name, sizeof(name), "%s/demos/%s.dm2", FS_Gamedir(), Cmd_Argv(1));
 
 	Com_Printf ("recording to %s.\n", name);
-	FS_CreatePath (name);
-	cls.demofile = rfopen (name, "wb");
+	cls.demofile = Demo_OpenWrite (name, true);
 	if (!cls.demofile)
 	{
 		Com_Printf ("ERROR: couldn't open.\n");
@@ -208,6 +231,9 @@ void CL_Record_f (void)
 
 	// don't start saving messages until a non-delta compressed message is received
 	cls.demowaiting = true;
+	cls.demokeyframe = -1;
+	cls.demokeyrequest = 0;
+	CL_SendRecording (true);
 
 	//
 	// write out messages to hold the startup information
@@ -231,9 +257,7 @@ void CL_Record_f (void)
 		{
 			if (buf.cursize + strlen (cl.configstrings[i]) + 32 > buf.maxsize)
 			{	// write it out
-				len = LittleLong (buf.cursize);
-				rfwrite (&len, 4, 1, cls.demofile);
-				rfwrite (buf.data, buf.cursize, 1, cls.demofile);
+				Demo_WriteMessage (cls.demofile, buf.data, buf.cursize);
 				buf.cursize = 0;
 			}
 
@@ -254,9 +278,7 @@ void CL_Record_f (void)
 
 		if (buf.cursize + 64 > buf.maxsize)
 		{	// write it out
-			len = LittleLong (buf.cursize);
-			rfwrite (&len, 4, 1, cls.demofile);
-			rfwrite (buf.data, buf.cursize, 1, cls.demofile);
+			Demo_WriteMessage (cls.demofile, buf.data, buf.cursize);
 			buf.cursize = 0;
 		}
 
@@ -269,9 +291,7 @@ void CL_Record_f (void)
 
 	// write it to the demo file
 
-	len = LittleLong (buf.cursize);
-	rfwrite (&len, 4, 1, cls.demofile);
-	rfwrite (buf.data, buf.cursize, 1, cls.demofile);
+	Demo_WriteMessage (cls.demofile, buf.data, buf.cursize);
 
 	// the rest of the demo file will be individual frames
 }
@@ -441,8 +461,13 @@ void CL_SendConnectPacket (void)
 	port = Cvar_VariableValue ("qport");
 	userinfo_modified = false;
 
+	// a local server is this same build, a remote one has to offer it
+	cls.protocol = PROTOCOL_VERSION;
+	if (net_fragment->value && (NET_IsLocalAddress (adr) || cls.challengeext))
+		cls.protocol = PROTOCOL_VERSION_EXT;
+
 	Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
-		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
+		cls.protocol, port, cls.challenge, Cvar_Userinfo() );
 }
 
 /*
@@ -603,6 +628,7 @@ void CL_ClearState (void)
 	CL_ClearTEnts ();
 
 	// wipe the entire cl structure
+	SCR_StopCinematicDecoder ();
 	if (cl.cinematic_file)
 		rfclose (cl.cinematic_file);
 
@@ -630,14 +656,7 @@ void CL_Disconnect (void)
 		return;
 
 	if (cl_timedemo && cl_timedemo->value)
-	{
-		int	time;
-
-		time = Sys_Milliseconds () - cl.timedemo_start;
-		if (time > 0)
-			Com_Printf ("%i frames, %3.1f seconds: %3.1f fps\n", cl.timedemo_frames,
-			time/1000.0, cl.timedemo_frames*1000.0 / time);
-	}
+		CL_BenchFinish ();
 
 	VectorClear (cl.refdef.blend);
 	re.CinematicSetPalette(NULL);
@@ -891,6 +910,7 @@ void CL_ConnectionlessPacket (void)
 {
 	char	*s;
 	char	*c;
+	int		i;
 
 	MSG_BeginReading (&net_message);
 	MSG_ReadLong (&net_message);	// skip the -1
@@ -912,9 +932,13 @@ void CL_ConnectionlessPacket (void)
 			return;
 		}
 		Netchan_Setup (NS_CLIENT, &cls.netchan, net_from, cls.quakePort);
+		cls.demokeyrequest = 0;
+		cls.netchan.protocol = cls.protocol;
 		MSG_WriteChar (&cls.netchan.message, clc_stringcmd);
 		MSG_WriteString (&cls.netchan.message, "new");
 		cls.state = ca_connected;
+		if (cls.demorecording)
+			CL_SendRecording (true);
 		return;
 	}
 
@@ -958,6 +982,23 @@ void CL_ConnectionlessPacket (void)
 	if (!strcmp(c, "challenge"))
 	{
 		cls.challenge = atoi(Cmd_Argv(1));
+
+		// newer servers list the protocols they take as p=34,35
+		cls.challengeext = false;
+		for (i=2 ; i<Cmd_Argc() ; i++)
+		{
+			s = Cmd_Argv(i);
+			if (strncmp (s, "p=", 2))
+				continue;
+			for (s += 2 ; s ; s = strchr (s, ','))
+			{
+				if (*s == ',')
+					s++;
+				if (atoi (s) == PROTOCOL_VERSION_EXT)
+					cls.challengeext = true;
+			}
+		}
+
 		CL_SendConnectPacket ();
 		return;
 	}
@@ -1434,6 +1475,7 @@ void CL_InitLocal (void)
 // register our variables
 //
 	cin_force43 = Cvar_Get("cin_force43", "1", 0);
+	cin_prefetch = Cvar_Get("cin_prefetch", "4", CVAR_ARCHIVE);
 
 	cl_stereo_separation = Cvar_Get( "cl_stereo_separation", "0.4", CVAR_ARCHIVE );
 	cl_stereo = Cvar_Get( "cl_stereo", "0", 0 );
@@ -1475,6 +1517,7 @@ void CL_InitLocal (void)
 	cl_timeout = Cvar_Get ("cl_timeout", "120", 0);
 	cl_paused = Cvar_Get ("paused", "0", 0);
 	cl_timedemo = Cvar_Get ("timedemo", "0", 0);
+	CL_BenchInit ();
 
 	rcon_client_password = Cvar_Get ("rcon_password", "", 0);
 	rcon_address = Cvar_Get ("rcon_address", "", 0);
@@ -1607,6 +1650,8 @@ void CL_WriteConfiguration (void)
 	Key_WriteBindings (f);
 	rfclose (f);
 
+	FS_FlushMissCache ();
+
 	Cvar_WriteVariables (path);
 }
 
@@ -1726,6 +1771,8 @@ void CL_Frame (int msec)
 		//	return;			// framerate is too high
 	}
 
+	CL_BenchBeginFrame ();
+
 	// let the mouse activate or deactivate
 	IN_Frame ();
 
@@ -1748,7 +1795,9 @@ void CL_Frame (int msec)
 		cls.netchan.last_received = Sys_Milliseconds ();
 
 	// fetch results from server
+	CL_BenchPhase (BENCH_PARSE);
 	CL_ReadPackets ();
+	CL_BenchPhase (BENCH_OTHER);
 
 	// send a new command message to the server
 	CL_SendCommand ();
@@ -1764,12 +1813,15 @@ void CL_Frame (int msec)
 	// update the screen
 	if (host_speeds->value)
 		time_before_ref = Sys_Milliseconds ();
+	CL_BenchPhase (BENCH_SCREEN);
 	SCR_UpdateScreen ();
 	if (host_speeds->value)
 		time_after_ref = Sys_Milliseconds ();
 
 	// update audio
+	CL_BenchPhase (BENCH_SOUND);
 	S_Update (cl.refdef.vieworg, cl.v_forward, cl.v_right, cl.v_up);
+	CL_BenchPhase (BENCH_OTHER);
 
 	CDAudio_Update();
 
@@ -1780,6 +1832,7 @@ void CL_Frame (int msec)
 	SCR_RunConsole ();
 
 	cls.framecount++;
+	CL_BenchEndFrame ();
 
 	if ( log_stats->value )
 	{
@@ -274,6 +274,8 @@ void CL_ParseDownload (void)
 		if (r)
 			Com_Printf ("failed to rename.\n");
 
+		FS_FlushMissCache ();
+
 		cls.download = NULL;
 		cls.downloadpercent = 0;
 
@@ -344,6 +344,8 @@ void CL_PrepRefresh (void)
 	// the renderer can now free unneeded stuff
 	re.EndRegistration ();
 
+	FS_ReportMissCache ();
+
 	// clear any lines of console text
 	Con_ClearNotify ();
 
@@ -462,6 +464,8 @@ void V_RenderView( float stereo_separation )
 		cl.timedemo_frames++;
 	}
 
+	CL_BenchPhase (BENCH_VIEW);
+
 	// an invalid frame will just use the exact previous refdef
 	// we can't use the old frame if the video mode has changed, though...
 	if ( cl.frame.valid && (cl.force_refdef || !cl_paused->value) )
@@ -473,7 +477,9 @@ void V_RenderView( float stereo_separation )
 		// build a refresh entity list and calc cl.sim*
 		// this also calls CL_CalcViewValues which loads
 		// v_forward, etc.
+		CL_BenchPhase (BENCH_ENTITIES);
 		CL_AddEntities ();
+		CL_BenchPhase (BENCH_VIEW);
 
 		if (cl_testparticles->value)
 			V_TestParticles ();
@@ -539,7 +545,9 @@ void V_RenderView( float stereo_separation )
         qsort( cl.refdef.entities, cl.refdef.num_entities, sizeof( cl.refdef.entities[0] ), (int (*)(const void *, const void *))entitycmpfnc );
 	}
 
+	CL_BenchPhase (BENCH_REFRESH);
 	re.RenderFrame (&cl.refdef);
+	CL_BenchPhase (BENCH_SCREEN);
 	if (cl_stats->value)
 		Com_Printf ("ent:%i  lt:%i  part:%i\n", r_numentities, r_numdlights, r_numparticles);
 	if ( log_stats->value && ( log_stats_file != 0 ) )
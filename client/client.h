@@ -229,6 +229,8 @@ typedef struct
 	int			serverProtocol;		// in case we are doing some kind of version hack
 
 	int			challenge;			// from the server to use for connecting
+	qboolean	challengeext;		// the challenge offered PROTOCOL_VERSION_EXT
+	int			protocol;			// the netchan protocol asked for in connect
 
 	RFILE		*download;			// file transfer from server
 	char		downloadtempname[MAX_OSPATH];
@@ -240,7 +242,9 @@ typedef struct
 // demo recording info must be here, so it isn't cleared on level change
 	qboolean	demorecording;
 	qboolean	demowaiting;	// don't record until a non-delta message is received
-	RFILE		*demofile;
+	int			demokeyframe;	// serverframe of the last seek index keyframe
+	int			demokeyrequest;	// outgoing sequence that asked for one, 0 once acknowledged
+	demowriter_t	*demofile;
 } client_static_t;
 
 extern client_static_t	cls;
@@ -298,6 +302,7 @@ extern	cvar_t	*cl_timedemo;
 extern	cvar_t	*cl_vwep;
 
 extern	cvar_t	*cin_force43;
+extern	cvar_t	*cin_prefetch;
 
 typedef struct
 {
@@ -385,6 +390,8 @@ typedef struct particle_s
 // ========
 
 void CL_ClearEffects (void);
+void CL_ClearParticles (void);
+void CL_ClearDlights (void);
 void CL_ClearTEnts (void);
 void CL_BlasterTrail (vec3_t start, vec3_t end);
 void CL_QuadTrail (vec3_t start, vec3_t end);
@@ -502,6 +509,27 @@ void IN_CenterView (void);
 float CL_KeyState (kbutton_t *key);
 char *Key_KeynumToString (int keynum);
 
+//
+// cl_bench.c
+//
+typedef enum
+{
+	BENCH_PARSE,		// CL_ReadPackets
+	BENCH_ENTITIES,		// CL_AddEntities
+	BENCH_VIEW,			// the rest of V_RenderView
+	BENCH_REFRESH,		// re.RenderFrame
+	BENCH_SCREEN,		// the rest of SCR_UpdateScreen
+	BENCH_SOUND,		// S_Update
+	BENCH_OTHER,
+	NUM_BENCH_PHASES
+} benchphase_t;
+
+void CL_BenchInit (void);
+void CL_BenchBeginFrame (void);
+void CL_BenchPhase (int phase);
+void CL_BenchEndFrame (void);
+void CL_BenchFinish (void);
+
 //
 // cl_demo.c
 //
@@ -207,6 +207,10 @@ typedef struct
 	int		(*FS_LoadFile) (char *name, void **buf);
 	void	(*FS_FreeFile) (void *buf);
 
+	// where FS_LoadFile would read name from: the pak or file name,
+	// the offset in the pak and the length, -1 if there is no file
+	int		(*FS_FileSource) (char *name, char *source, int size, int *offset);
+
 	// gamedir will be the current directory that generated
 	// files should be stored to, ie: "f:\quake\id1"
 	char	*(*FS_Gamedir) (void);
@@ -58,6 +58,7 @@ void SCR_PlayCinematic (char *name);
 qboolean SCR_DrawCinematic (void);
 void SCR_RunCinematic (void);
 void SCR_StopCinematic (void);
+void SCR_StopCinematicDecoder (void);
 void SCR_FinishCinematic (void);
 
 float SCR_GetMenuScale(void);
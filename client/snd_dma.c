@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // snd_dma.c -- main control for any streaming sound output device
 
 #include <libretro_file.h>
+#include <features/features_cpu.h>
 
 #include "client.h"
 #include "snd_loc.h"
@@ -28,6 +29,7 @@ void S_Play(void);
 void S_SoundList(void);
 void S_Update_();
 void S_StopAllSounds(void);
+void S_MixBenchmark_f(void);
 
 
 // =======================================================================
@@ -41,7 +43,11 @@ void S_StopAllSounds(void);
 
 int			s_registration_sequence;
 
-channel_t   channels[MAX_CHANNELS];
+channel_t   *channels;
+int			s_numchannels;
+
+int			s_mixedvoices;
+int			s_virtualvoices;
 
 qboolean	snd_initialized = false;
 int			sound_started=0;
@@ -80,6 +86,11 @@ cvar_t		*s_khz;
 cvar_t		*s_show;
 cvar_t		*s_mixahead;
 cvar_t		*s_primary;
+cvar_t		*s_mixsimd;
+cvar_t		*s_channels;
+cvar_t		*s_virtualvol;
+cvar_t		*s_resample;
+cvar_t		*s_sfxcache;
 
 
 int		s_rawend;
@@ -106,6 +117,10 @@ void S_SoundInfo_f(void)
     Com_Printf("%5d submission_chunk\n", dma.submission_chunk);
     Com_Printf("%5d speed\n", dma.speed);
     Com_Printf("0x%x dma buffer\n", dma.buffer);
+    Com_Printf("%s mixer\n", (s_mixsimd->value && S_SIMDMixAvailable ()) ? "simd" : "integer");
+    Com_Printf("%5d channels\n", s_numchannels);
+    Com_Printf("%5d mixed voices\n", s_mixedvoices);
+    Com_Printf("%5d virtual voices\n", s_virtualvoices);
 }
 
 
@@ -133,15 +148,28 @@ void S_Init (void)
 		s_show = Cvar_Get ("s_show", "0", 0);
 		s_testsound = Cvar_Get ("s_testsound", "0", 0);
 		s_primary = Cvar_Get ("s_primary", "0", CVAR_ARCHIVE);	// win32 specific
+		s_mixsimd = Cvar_Get ("s_mixsimd", "1", CVAR_ARCHIVE);
+		s_channels = Cvar_Get ("s_channels", "128", CVAR_ARCHIVE);
+		s_virtualvol = Cvar_Get ("s_virtualvol", "4", CVAR_ARCHIVE);
+		s_resample = Cvar_Get ("s_resample", "1", CVAR_ARCHIVE);
+		s_sfxcache = Cvar_Get ("s_sfxcache", "1", CVAR_ARCHIVE);
 
 		Cmd_AddCommand("play", S_Play);
 		Cmd_AddCommand("stopsound", S_StopAllSounds);
 		Cmd_AddCommand("soundlist", S_SoundList);
 		Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+		Cmd_AddCommand("s_mixbench", S_MixBenchmark_f);
 
 		if (!SNDDMA_Init())
 			return;
 
+		s_numchannels = s_channels->value;
+		if (s_numchannels < MIN_CHANNELS)
+			s_numchannels = MIN_CHANNELS;
+		else if (s_numchannels > MAX_CHANNELS)
+			s_numchannels = MAX_CHANNELS;
+		channels = Z_Malloc (s_numchannels * sizeof(channel_t));
+
 		S_InitScaletable ();
 
 		sound_started = 1;
@@ -175,10 +203,15 @@ void S_Shutdown(void)
 
 	sound_started = 0;
 
+	Z_Free (channels);
+	channels = NULL;
+	s_numchannels = 0;
+
 	Cmd_RemoveCommand("play");
 	Cmd_RemoveCommand("stopsound");
 	Cmd_RemoveCommand("soundlist");
 	Cmd_RemoveCommand("soundinfo");
+	Cmd_RemoveCommand("s_mixbench");
 
 	// free all sounds
 	for (i=0, sfx=known_sfx ; i < num_sfx ; i++,sfx++)
@@ -372,6 +405,11 @@ void S_EndRegistration (void)
 /*
 =================
 S_PickChannel
+
+A sound from the same entity and channel always replaces the old one.
+Otherwise a free channel is used, then the voice with the lowest priority
+is stolen: inaudible voices first, then the quietest audible one, with the
+least time left breaking ties.  Monster sounds never steal player sounds.
 =================
 */
 channel_t *S_PickChannel(int entnum, int entchannel)
@@ -379,6 +417,7 @@ channel_t *S_PickChannel(int entnum, int entchannel)
     int			ch_idx;
     int			first_to_die;
     int			life_left;
+	int			priority, best_priority;
 	channel_t	*ch;
 
 	if (entchannel<0)
@@ -387,23 +426,38 @@ channel_t *S_PickChannel(int entnum, int entchannel)
 // Check for replacement sound, or find the best one to replace
     first_to_die = -1;
     life_left = 0x7fffffff;
-    for (ch_idx=0 ; ch_idx < MAX_CHANNELS ; ch_idx++)
+	best_priority = 0x7fffffff;
+    for (ch_idx=0, ch=channels ; ch_idx < s_numchannels ; ch_idx++, ch++)
     {
 		if (entchannel != 0		// channel 0 never overrides
-		&& channels[ch_idx].entnum == entnum
-		&& channels[ch_idx].entchannel == entchannel)
+		&& ch->entnum == entnum
+		&& ch->entchannel == entchannel)
 		{	// always override sound from same entity
 			first_to_die = ch_idx;
 			break;
 		}
 
-		// don't let monster sounds override player sounds
-		if (channels[ch_idx].entnum == cl.playernum+1 && entnum != cl.playernum+1 && channels[ch_idx].sfx)
-			continue;
+		if (!ch->sfx)
+		{	// free channels beat anything that is still playing
+			priority = -1;
+		}
+		else
+		{
+			// don't let monster sounds override player sounds
+			if (ch->entnum == cl.playernum+1 && entnum != cl.playernum+1)
+				continue;
+
+			if (ch->inaudible)
+				priority = 0;
+			else
+				priority = ch->leftvol > ch->rightvol ? ch->leftvol : ch->rightvol;
+		}
 
-		if (channels[ch_idx].end - paintedtime < life_left)
+		if (priority < best_priority
+		|| (priority == best_priority && ch->end - paintedtime < life_left))
 		{
-			life_left = channels[ch_idx].end - paintedtime;
+			best_priority = priority;
+			life_left = ch->end - paintedtime;
 			first_to_die = ch_idx;
 		}
    }
@@ -440,6 +494,17 @@ void S_SpatializeOrigin (vec3_t origin, float master_vol, float dist_mult, int *
 // calculate stereo seperation and distance attenuation
 	VectorSubtract(origin, listener_origin, source_vec);
 
+	// nothing is audible past this range, skip the normalize
+	if (dist_mult)
+	{
+		dist = SOUND_FULLVOLUME + 1.0 / dist_mult;
+		if (DotProduct(source_vec, source_vec) >= dist*dist)
+		{
+			*left_vol = *right_vol = 0;
+			return;
+		}
+	}
+
 	dist = VectorNormalize(source_vec);
 	dist -= SOUND_FULLVOLUME;
 	if (dist < 0)
@@ -471,6 +536,24 @@ void S_SpatializeOrigin (vec3_t origin, float master_vol, float dist_mult, int *
 		*left_vol = 0;
 }
 
+/*
+=================
+S_Inaudible
+
+Voices quieter than s_virtualvol on both sides are not mixed
+=================
+*/
+static qboolean S_Inaudible (int left_vol, int right_vol)
+{
+	int		threshold;
+
+	threshold = s_virtualvol->value;
+	if (threshold < 1)
+		threshold = 1;
+
+	return left_vol < threshold && right_vol < threshold;
+}
+
 /*
 =================
 S_Spatialize
@@ -485,17 +568,20 @@ void S_Spatialize(channel_t *ch)
 	{
 		ch->leftvol = ch->master_vol;
 		ch->rightvol = ch->master_vol;
-		return;
 	}
-
-	if (ch->fixed_origin)
+	else
 	{
-		VectorCopy (ch->origin, origin);
+		if (ch->fixed_origin)
+		{
+			VectorCopy (ch->origin, origin);
+		}
+		else
+			CL_GetEntitySoundOrigin (ch->entnum, origin);
+
+		S_SpatializeOrigin (origin, ch->master_vol, ch->dist_mult, &ch->leftvol, &ch->rightvol);
 	}
-	else
-		CL_GetEntitySoundOrigin (ch->entnum, origin);
 
-	S_SpatializeOrigin (origin, ch->master_vol, ch->dist_mult, &ch->leftvol, &ch->rightvol);
+	ch->inaudible = S_Inaudible (ch->leftvol, ch->rightvol);
 }           
 
 
@@ -805,7 +891,7 @@ void S_StopAllSounds(void)
 	}
 
 	// clear all the channels
-	memset(channels, 0, sizeof(channels));
+	memset(channels, 0, s_numchannels * sizeof(channel_t));
 
 	S_ClearBuffer ();
 }
@@ -879,8 +965,11 @@ void S_AddLoopSounds (void)
 			right_total += right;
 		}
 
-		if (left_total == 0 && right_total == 0)
-			continue;		// not audible
+		if (S_Inaudible (left_total, right_total))
+		{	// not audible, the position is derived from paintedtime anyway
+			s_virtualvoices++;
+			continue;
+		}
 
 		// allocate a channel
 		ch = S_PickChannel(0, 0);
@@ -1038,9 +1127,10 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 
 	combine = NULL;
 
-	// update spatialization for dynamic sounds	
+	// update spatialization for dynamic sounds, inaudible ones
+	// stay allocated as virtual voices so they resume in place
 	ch = channels;
-	for (i=0 ; i<MAX_CHANNELS; i++, ch++)
+	for (i=0 ; i<s_numchannels; i++, ch++)
 	{
 		if (!ch->sfx)
 			continue;
@@ -1050,16 +1140,24 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 			continue;
 		}
 		S_Spatialize(ch);         // respatialize channel
-		if (!ch->leftvol && !ch->rightvol)
-		{
-			memset (ch, 0, sizeof(*ch));
-			continue;
-		}
 	}
 
 	// add loopsounds
+	s_virtualvoices = 0;
 	S_AddLoopSounds ();
 
+	s_mixedvoices = 0;
+	ch = channels;
+	for (i=0 ; i<s_numchannels; i++, ch++)
+	{
+		if (!ch->sfx)
+			continue;
+		if (ch->inaudible)
+			s_virtualvoices++;
+		else
+			s_mixedvoices++;
+	}
+
 	//
 	// debugging output
 	//
@@ -1067,14 +1165,15 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	{
 		total = 0;
 		ch = channels;
-		for (i=0 ; i<MAX_CHANNELS; i++, ch++)
-			if (ch->sfx && (ch->leftvol || ch->rightvol) )
+		for (i=0 ; i<s_numchannels; i++, ch++)
+			if (ch->sfx && !ch->inaudible)
 			{
 				Com_Printf ("%3i %3i %s\n", ch->leftvol, ch->rightvol, ch->sfx->name);
 				total++;
 			}
 		
-		Com_Printf ("----(%i)---- painted: %i\n", total, paintedtime);
+		Com_Printf ("----(%i)---- painted: %i mixed: %i virtual: %i\n", total, paintedtime,
+			s_mixedvoices, s_virtualvoices);
 	}
 
 // mix some sound
@@ -1214,3 +1313,88 @@ void S_SoundList(void)
 	Com_Printf ("Total resident: %i\n", total);
 }
 
+
+/*
+==================
+S_MixBenchmark_f
+
+s_mixbench [sound] [seconds]
+Plays the sound looping on every channel and times the integer
+and vectorized mixers over the same amount of output
+==================
+*/
+static double S_MixBenchmarkRun (sfx_t *sfx, int samples)
+{
+	int			i;
+	channel_t	*ch;
+	retro_time_t	start;
+
+	memset (channels, 0, s_numchannels * sizeof(channel_t));
+	for (i=0, ch=channels ; i<s_numchannels ; i++, ch++)
+	{
+		ch->sfx = sfx;
+		ch->autosound = true;
+		ch->leftvol = 64 + (i * 37 & 127);
+		ch->rightvol = 64 + (i * 91 & 127);
+		ch->pos = (i * 1021) % sfx->cache->length;
+		ch->end = paintedtime + sfx->cache->length - ch->pos;
+	}
+
+	start = cpu_features_get_time_usec ();
+	S_PaintChannels (paintedtime + samples);
+	return (cpu_features_get_time_usec () - start) / 1000.0;
+}
+
+void S_MixBenchmark_f(void)
+{
+	sfx_t		*sfx;
+	char		*name;
+	float		seconds;
+	int			samples;
+	int			savedtime;
+	float		savedsimd;
+	double		ms;
+
+	if (!sound_started)
+	{
+		Com_Printf ("sound system not started\n");
+		return;
+	}
+
+	name = Cmd_Argc() > 1 ? Cmd_Argv(1) : "world/amb10.wav";
+	seconds = Cmd_Argc() > 2 ? atof(Cmd_Argv(2)) : 60;
+	if (seconds <= 0)
+		seconds = 60;
+
+	sfx = S_RegisterSound (name);
+	if (!sfx || !S_LoadSound (sfx))
+	{
+		Com_Printf ("s_mixbench: can't load %s\n", name);
+		return;
+	}
+
+	samples = seconds * dma.speed;
+	savedtime = paintedtime;
+	savedsimd = s_mixsimd->value;
+
+	Com_Printf ("mixing %i channels of %s (%i bit), %.1f seconds at %i Hz\n",
+		s_numchannels, name, sfx->cache->width*8, seconds, dma.speed);
+
+	s_mixsimd->value = 0;
+	ms = S_MixBenchmarkRun (sfx, samples);
+	Com_Printf ("integer mixer: %8.2f ms (%.3f ms per 1000 samples)\n", ms, ms * 1000 / samples);
+	paintedtime = savedtime;
+
+	if (S_SIMDMixAvailable ())
+	{
+		s_mixsimd->value = 1;
+		ms = S_MixBenchmarkRun (sfx, samples);
+		Com_Printf ("simd mixer:    %8.2f ms (%.3f ms per 1000 samples)\n", ms, ms * 1000 / samples);
+		paintedtime = savedtime;
+	}
+	else
+		Com_Printf ("simd mixer not available\n");
+
+	s_mixsimd->value = savedsimd;
+	S_StopAllSounds ();
+}
@@ -87,6 +87,7 @@ typedef struct
 	int			master_vol;		// 0-255 master volume
 	qboolean	fixed_origin;	// use origin instead of fetching entnum's origin
 	qboolean	autosound;		// from an entity->sound, cleared each frame
+	qboolean	inaudible;		// virtual voice, keeps its position but isn't mixed
 } channel_t;
 
 typedef struct
@@ -123,8 +124,13 @@ void	SNDDMA_Submit(void);
 
 //====================================================================
 
-#define	MAX_CHANNELS			32
-extern	channel_t   channels[MAX_CHANNELS];
+#define	MIN_CHANNELS			32
+#define	MAX_CHANNELS			1024
+extern	channel_t   *channels;
+extern	int			s_numchannels;		// size of the voice pool, from s_channels
+
+extern	int			s_mixedvoices;		// audible voices at the last update
+extern	int			s_virtualvoices;	// playing but inaudible voices at the last update
 
 extern	int		paintedtime;
 extern	int		s_rawend;
@@ -146,6 +152,11 @@ extern cvar_t	*s_show;
 extern cvar_t	*s_mixahead;
 extern cvar_t	*s_testsound;
 extern cvar_t	*s_primary;
+extern cvar_t	*s_mixsimd;
+extern cvar_t	*s_channels;
+extern cvar_t	*s_virtualvol;
+extern cvar_t	*s_resample;
+extern cvar_t	*s_sfxcache;
 
 wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength);
 
@@ -157,6 +168,9 @@ void S_IssuePlaysound (playsound_t *ps);
 
 void S_PaintChannels(int endtime);
 
+// true if the vectorized float mixer can be used on this cpu
+qboolean S_SIMDMixAvailable (void);
+
 // picks a channel based on priorities, empty slots, number of channels
 channel_t *S_PickChannel(int entnum, int entchannel);
 
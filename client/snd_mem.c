@@ -26,6 +26,113 @@ int			cache_full_cycle;
 
 byte *S_Alloc (int size);
 
+/*
+===============================================================================
+
+WINDOWED SINC RESAMPLING
+
+A Blackman windowed sinc evaluated at SINC_PHASES fractional positions,
+rebuilt whenever the input/output rate pair changes.
+
+===============================================================================
+*/
+
+#define	SINC_TAPS		16		// taps per output sample
+#define	SINC_PHASES		256		// fractional positions between input samples
+
+static float	sinc_table[SINC_PHASES+1][SINC_TAPS];
+static int		sinc_inrate, sinc_outrate;
+
+static void S_BuildSincTable (int inrate, int outrate)
+{
+	int		p, t;
+	double	cutoff, x, w, v, sum;
+	double	half;
+
+	if (sinc_inrate == inrate && sinc_outrate == outrate)
+		return;
+	sinc_inrate = inrate;
+	sinc_outrate = outrate;
+
+	// lowpass below the lower of the two nyquist frequencies
+	cutoff = 0.95;
+	if (outrate < inrate)
+		cutoff *= (double)outrate / inrate;
+
+	half = SINC_TAPS / 2;
+	for (p=0 ; p<=SINC_PHASES ; p++)
+	{
+		sum = 0;
+		for (t=0 ; t<SINC_TAPS ; t++)
+		{
+			x = t - (half - 1) - (double)p / SINC_PHASES;
+			w = 0.42 + 0.5*cos(M_PI*x/half) + 0.08*cos(2*M_PI*x/half);
+			if (x == 0)
+				v = cutoff;
+			else
+				v = sin(M_PI*cutoff*x) / (M_PI*x);
+			sinc_table[p][t] = v * w;
+			sum += v * w;
+		}
+		// unity gain at dc
+		for (t=0 ; t<SINC_TAPS ; t++)
+			sinc_table[p][t] /= sum;
+	}
+}
+
+static int S_SfxSample (byte *data, int inwidth, int inlength, int i)
+{
+	if (i < 0 || i >= inlength)
+		return 0;
+	if (inwidth == 2)
+		return LittleShort ( ((short *)data)[i] );
+	return (int)( (unsigned char)(data[i]) - 128) << 8;
+}
+
+static void S_ResampleSinc (sfxcache_t *sc, int inlength, int inwidth, byte *data, double stepscale)
+{
+	int		i, t;
+	int		base, phase;
+	int		sample;
+	double	pos;
+	float	*k;
+	float	sum;
+
+	for (i=0 ; i<sc->length ; i++)
+	{
+		pos = i * stepscale;
+		base = (int)pos;
+		phase = (int)((pos - base) * SINC_PHASES + 0.5);
+		k = sinc_table[phase];
+
+		sum = 0;
+		base -= SINC_TAPS/2 - 1;
+		if (base >= 0 && base + SINC_TAPS <= inlength && inwidth == 2)
+		{
+			short	*in = (short *)data + base;
+
+			for (t=0 ; t<SINC_TAPS ; t++)
+				sum += LittleShort (in[t]) * k[t];
+		}
+		else
+		{
+			for (t=0 ; t<SINC_TAPS ; t++)
+				sum += S_SfxSample (data, inwidth, inlength, base + t) * k[t];
+		}
+
+		sample = (int)(sum < 0 ? sum - 0.5f : sum + 0.5f);
+		if (sample > 0x7fff)
+			sample = 0x7fff;
+		else if (sample < -0x8000)
+			sample = -0x8000;
+
+		if (sc->width == 2)
+			((short *)sc->data)[i] = sample;
+		else
+			((signed char *)sc->data)[i] = sample >> 8;
+	}
+}
+
 /*
 ================
 ResampleSfx
@@ -34,6 +141,7 @@ ResampleSfx
 void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 {
 	int		outcount;
+	int		inlength;
 	int		srcsample;
 	float	stepscale;
 	int		i;
@@ -46,6 +154,7 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 
 	stepscale = (float)inrate / dma.speed;	// this is usually 0.5, 1, or 2
 
+	inlength = sc->length;
 	outcount = sc->length / stepscale;
 	sc->length = outcount;
 	if (sc->loopstart != -1)
@@ -67,6 +176,11 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 			((signed char *)sc->data)[i]
 			= (int)( (unsigned char)(data[i]) - 128);
 	}
+	else if (stepscale != 1 && s_resample->value)
+	{
+		S_BuildSincTable (inrate, dma.speed);
+		S_ResampleSinc (sc, inlength, inwidth, data, (double)inrate / dma.speed);
+	}
 	else
 	{
 // general case
@@ -88,6 +202,121 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 	}
 }
 
+/*
+===============================================================================
+
+SFX DISK CACHE
+
+Resampled sounds are stored under <gamedir>/sfxcache, named by the
+checksum of the wav file and the output format, so later loads only
+have to read the ready to mix samples back in.
+
+===============================================================================
+*/
+
+#define	SFXCACHE_IDENT		(('C'<<24)+('X'<<16)+('F'<<8)+'S')	// "SFXC", also catches byte order
+#define	SFXCACHE_VERSION	1
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	unsigned	checksum;
+	int			speed;
+	int			width;
+	int			resample;
+	int			length;
+	int			loopstart;
+} sfxcacheheader_t;
+
+static void S_SfxCachePath (char *path, int size, unsigned checksum, int width)
+{
+	Com_sprintf (path, size, "%s/sfxcache/%08x_%i_%i_%i.sfx", FS_Gamedir(),
+		checksum, dma.speed, width, s_resample->value ? 1 : 0);
+}
+
+/*
+================
+S_ReadSfxCache
+
+length is what ResampleSfx would make of the wav, a file that doesn't
+match it is ignored and the wav decoded again
+================
+*/
+static sfxcache_t *S_ReadSfxCache (sfx_t *s, unsigned checksum, int width, int length)
+{
+	char			path[MAX_OSPATH];
+	RFILE			*f;
+	sfxcacheheader_t	header;
+	sfxcache_t		*sc;
+	int				size;
+
+	S_SfxCachePath (path, sizeof(path), checksum, width);
+	f = rfopen (path, "rb");
+	if (!f)
+		return NULL;
+
+	if (rfread (&header, sizeof(header), 1, f) != 1
+		|| header.ident != SFXCACHE_IDENT
+		|| header.version != SFXCACHE_VERSION
+		|| header.checksum != checksum
+		|| header.speed != dma.speed
+		|| header.width != width
+		|| header.length <= 0
+		|| header.length != length
+		|| header.loopstart < -1
+		|| header.loopstart >= header.length)
+	{
+		rfclose (f);
+		return NULL;
+	}
+
+	size = header.length * header.width;
+	sc = s->cache = Z_Malloc (size + sizeof(sfxcache_t));
+	sc->length = header.length;
+	sc->loopstart = header.loopstart;
+	sc->speed = header.speed;
+	sc->width = header.width;
+	sc->stereo = 0;
+
+	if (rfread (sc->data, 1, size, f) != size)
+	{
+		rfclose (f);
+		Z_Free (sc);
+		s->cache = NULL;
+		return NULL;
+	}
+
+	rfclose (f);
+	return sc;
+}
+
+static void S_WriteSfxCache (sfxcache_t *sc, unsigned checksum)
+{
+	char			path[MAX_OSPATH];
+	RFILE			*f;
+	sfxcacheheader_t	header;
+
+	S_SfxCachePath (path, sizeof(path), checksum, sc->width);
+	FS_CreatePath (path);
+	f = rfopen (path, "wb");
+	if (!f)
+		return;
+
+	header.ident = SFXCACHE_IDENT;
+	header.version = SFXCACHE_VERSION;
+	header.checksum = checksum;
+	header.speed = sc->speed;
+	header.width = sc->width;
+	header.resample = s_resample->value ? 1 : 0;
+	header.length = sc->length;
+	header.loopstart = sc->loopstart;
+
+	rfwrite (&header, sizeof(header), 1, f);
+	rfwrite (sc->data, sc->length * sc->width, 1, f);
+	rfclose (f);
+}
+
 //=============================================================================
 
 /*
@@ -105,6 +334,8 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	sfxcache_t	*sc;
 	int		size;
 	char	*name;
+	qboolean	usecache;
+	unsigned	checksum = 0;
 
 	if (s->name[0] == '*')
 		return NULL;
@@ -147,6 +378,19 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	stepscale = (float)info.rate / dma.speed;	
 	len = info.samples / stepscale;
 
+	// only resampled sounds are worth caching
+	usecache = s_sfxcache->value && info.rate != dma.speed;
+	if (usecache)
+	{
+		checksum = Com_BlockChecksum (data, size);
+		sc = S_ReadSfxCache (s, checksum, s_loadas8bit->value ? 1 : info.width, len);
+		if (sc)
+		{
+			FS_FreeFile (data);
+			return sc;
+		}
+	}
+
 	len = len * info.width * info.channels;
 
 	sc = s->cache = Z_Malloc (len + sizeof(sfxcache_t));
@@ -164,6 +408,9 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
 
+	if (usecache)
+		S_WriteSfxCache (sc, checksum);
+
 	FS_FreeFile (data);
 
 	return sc;
@@ -19,15 +19,35 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // snd_mix.c -- portable code to mix sounds for snd_dma.c
 
+#include <features/features_cpu.h>
+
 #include "client.h"
 #include "snd_loc.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SND_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define SND_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(SND_SIMD_SSE2) || defined(SND_SIMD_NEON)
+#define SND_SIMD
+#endif
+
 #define	PAINTBUFFER_SIZE	2048
 portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
 int		snd_scaletable[32][256];
 int 	*snd_p, snd_linear_count, snd_vol;
 short	*snd_out;
 
+#ifdef SND_SIMD
+// interleaved left/right, same scale as paintbuffer (sample << 8)
+float	paintbuffer_f[PAINTBUFFER_SIZE*2];
+#endif
+qboolean	snd_simdmix;	// mixing into paintbuffer_f this frame
+
 void S_WriteLinearBlastStereo16 (void)
 {
 	int		i;
@@ -130,6 +150,130 @@ void S_TransferStereo16 (unsigned *pbuf, int endtime)
 	}
 }
 
+#ifdef SND_SIMD
+/*
+===================
+S_WriteLinearBlastStereo16_SIMD
+
+Converts count interleaved float samples to 16 bit with saturation
+===================
+*/
+static void S_WriteLinearBlastStereo16_SIMD (const float *in, short *out, int count)
+{
+	int		i;
+	int		val;
+
+	i = 0;
+#if defined(SND_SIMD_SSE2)
+	{
+		__m128	scale = _mm_set1_ps (1.0f/256);
+		__m128	hi = _mm_set1_ps (32767.0f);
+		__m128	lo = _mm_set1_ps (-32768.0f);
+		__m128i	a, b;
+
+		for ( ; i+8 <= count ; i+=8)
+		{
+			// clamp before the conversion, out of range values become 0x80000000
+			a = _mm_cvtps_epi32 (_mm_max_ps (_mm_min_ps (_mm_mul_ps (_mm_loadu_ps (in+i), scale), hi), lo));
+			b = _mm_cvtps_epi32 (_mm_max_ps (_mm_min_ps (_mm_mul_ps (_mm_loadu_ps (in+i+4), scale), hi), lo));
+			_mm_storeu_si128 ((__m128i *)(out+i), _mm_packs_epi32 (a, b));
+		}
+	}
+#elif defined(SND_SIMD_NEON)
+	for ( ; i+8 <= count ; i+=8)
+	{
+		// vcvtq and vqmovn both saturate
+		int32x4_t	a = vcvtq_s32_f32 (vmulq_n_f32 (vld1q_f32 (in+i), 1.0f/256));
+		int32x4_t	b = vcvtq_s32_f32 (vmulq_n_f32 (vld1q_f32 (in+i+4), 1.0f/256));
+		vst1q_s16 (out+i, vcombine_s16 (vqmovn_s32 (a), vqmovn_s32 (b)));
+	}
+#endif
+
+	for ( ; i<count ; i++)
+	{
+		val = (int)(in[i] * (1.0f/256));
+		if (val > 0x7fff)
+			val = 0x7fff;
+		else if (val < (short)0x8000)
+			val = (short)0x8000;
+		out[i] = val;
+	}
+}
+
+static void S_TransferStereo16_SIMD (unsigned *pbuf, int endtime)
+{
+	int		lpos;
+	int		lpaintedtime;
+	int		count;
+	float	*p;
+
+	p = paintbuffer_f;
+	lpaintedtime = paintedtime;
+
+	while (lpaintedtime < endtime)
+	{
+	// handle recirculating buffer issues
+		lpos = lpaintedtime & ((dma.samples>>1)-1);
+
+		count = (dma.samples>>1) - lpos;
+		if (lpaintedtime + count > endtime)
+			count = endtime - lpaintedtime;
+
+		S_WriteLinearBlastStereo16_SIMD (p, (short *) pbuf + (lpos<<1), count<<1);
+
+		p += count<<1;
+		lpaintedtime += count;
+	}
+}
+
+/*
+===================
+S_PaintBufferFromFloat
+
+Copies the float paint buffer back into the integer one so the
+general transfer cases can be used
+===================
+*/
+static void S_PaintBufferFromFloat (int endtime)
+{
+	int		i;
+	int		count;
+
+	count = endtime - paintedtime;
+	for (i=0 ; i<count ; i++)
+	{
+		paintbuffer[i].left = (int)paintbuffer_f[i*2];
+		paintbuffer[i].right = (int)paintbuffer_f[i*2+1];
+	}
+}
+#endif
+
+/*
+================
+S_SIMDMixAvailable
+
+True if this build has a vectorized mixer and the cpu supports it
+================
+*/
+qboolean S_SIMDMixAvailable (void)
+{
+#if defined(SND_SIMD_SSE2)
+	static int	features = -1;
+
+	if (features == -1)
+		features = (cpu_features_get() & RETRO_SIMD_SSE2) ? 1 : 0;
+	return features;
+#elif defined(SND_SIMD_NEON)
+	static int	features = -1;
+
+	if (features == -1)
+		features = (cpu_features_get() & RETRO_SIMD_NEON) ? 1 : 0;
+	return features;
+#else
+	return false;
+#endif
+}
+
 /*
 ===================
 S_TransferPaintBuffer
@@ -148,6 +292,18 @@ void S_TransferPaintBuffer(int endtime)
 
 	pbuf = (unsigned *)dma.buffer;
 
+#ifdef SND_SIMD
+	if (snd_simdmix)
+	{
+		if (dma.samplebits == 16 && dma.channels == 2 && !s_testsound->value)
+		{	// optimized case
+			S_TransferStereo16_SIMD (pbuf, endtime);
+			return;
+		}
+		S_PaintBufferFromFloat (endtime);
+	}
+#endif
+
 	if (s_testsound->value)
 	{
 		int		i;
@@ -216,6 +372,10 @@ CHANNEL MIXING
 
 void S_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
 void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime, int offset);
+#ifdef SND_SIMD
+void S_PaintChannelFrom8_SIMD (channel_t *ch, sfxcache_t *sc, int count, int offset);
+void S_PaintChannelFrom16_SIMD (channel_t *ch, sfxcache_t *sc, int count, int offset);
+#endif
 
 void S_PaintChannels(int endtime)
 {
@@ -227,6 +387,7 @@ void S_PaintChannels(int endtime)
 	playsound_t	*ps;
 
 	snd_vol = s_volume->value*256;
+	snd_simdmix = s_mixsimd->value && S_SIMDMixAvailable ();
 
 //Com_Printf ("%i to %i\n", paintedtime, endtime);
 	while (paintedtime < endtime)
@@ -254,6 +415,25 @@ void S_PaintChannels(int endtime)
 		}
 
 	// clear the paint buffer
+#ifdef SND_SIMD
+		if (snd_simdmix)
+		{
+			int		s;
+			int		stop;
+
+			stop = (end < s_rawend) ? end : s_rawend;
+
+			for (i=paintedtime ; i<stop ; i++)
+			{
+				s = i&(MAX_RAW_SAMPLES-1);
+				paintbuffer_f[(i-paintedtime)*2] = s_rawsamples[s].left;
+				paintbuffer_f[(i-paintedtime)*2+1] = s_rawsamples[s].right;
+			}
+			if (i < end)
+				memset(paintbuffer_f + (i-paintedtime)*2, 0, (end - i) * 2 * sizeof(float));
+		}
+		else
+#endif
 		if (s_rawend < paintedtime)
 		{
 //			Com_Printf ("clear\n");
@@ -285,13 +465,13 @@ void S_PaintChannels(int endtime)
 
 	// paint in the channels.
 		ch = channels;
-		for (i=0; i<MAX_CHANNELS ; i++, ch++)
+		for (i=0; i<s_numchannels ; i++, ch++)
 		{
 			ltime = paintedtime;
 		
 			while (ltime < end)
 			{
-				if (!ch->sfx || (!ch->leftvol && !ch->rightvol) )
+				if (!ch->sfx)
 					break;
 
 				// max painting is to the end of the buffer
@@ -305,8 +485,23 @@ void S_PaintChannels(int endtime)
 				if (!sc)
 					break;
 
-				if (count > 0 && ch->sfx)
+				if (count > 0 && ch->inaudible)
+				{	// virtual voices only advance
+					ch->pos += count;
+					ltime += count;
+				}
+				else if (count > 0 && ch->sfx)
 				{	
+#ifdef SND_SIMD
+					if (snd_simdmix)
+					{
+						if (sc->width == 1)
+							S_PaintChannelFrom8_SIMD(ch, sc, count, ltime - paintedtime);
+						else
+							S_PaintChannelFrom16_SIMD(ch, sc, count, ltime - paintedtime);
+					}
+					else
+#endif
 					if (sc->width == 1)// FIXME; 8 bit asm is wrong now
 						S_PaintChannelFrom8(ch, sc, count,  ltime - paintedtime);
 					else
@@ -488,3 +683,163 @@ void S_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count, int offset)
 	ch->pos += count;
 }
 
+
+#ifdef SND_SIMD
+/*
+===============================================================================
+
+VECTORIZED CHANNEL MIXING
+
+Each sample is scaled once and splatted into a left/right pair, then
+four stereo frames are accumulated into paintbuffer_f per iteration.
+
+===============================================================================
+*/
+
+void S_PaintChannelFrom8_SIMD (channel_t *ch, sfxcache_t *sc, int count, int offset)
+{
+	float	leftvol, rightvol;
+	signed char *sfx;
+	float	*samp;
+	int		i;
+
+	if (ch->leftvol > 255)
+		ch->leftvol = 255;
+	if (ch->rightvol > 255)
+		ch->rightvol = 255;
+
+	// same scale the lookup table path would pick
+	leftvol = snd_scaletable[ch->leftvol >> 11][1];
+	rightvol = snd_scaletable[ch->rightvol >> 11][1];
+	sfx = (signed char *)sc->data + ch->pos;
+
+	samp = &paintbuffer_f[offset*2];
+
+	i = 0;
+#if defined(SND_SIMD_SSE2)
+	{
+		__m128	vol = _mm_setr_ps (leftvol, rightvol, leftvol, rightvol);
+		__m128	data;
+		__m128i	b;
+		int		in;
+
+		for ( ; i+4 <= count ; i+=4, samp+=8)
+		{
+			memcpy (&in, sfx+i, sizeof(in));
+			b = _mm_cvtsi32_si128 (in);
+			b = _mm_unpacklo_epi8 (b, b);
+			b = _mm_srai_epi32 (_mm_unpacklo_epi16 (b, b), 24);
+			data = _mm_cvtepi32_ps (b);
+
+			_mm_storeu_ps (samp, _mm_add_ps (_mm_loadu_ps (samp),
+				_mm_mul_ps (_mm_unpacklo_ps (data, data), vol)));
+			_mm_storeu_ps (samp+4, _mm_add_ps (_mm_loadu_ps (samp+4),
+				_mm_mul_ps (_mm_unpackhi_ps (data, data), vol)));
+		}
+	}
+#elif defined(SND_SIMD_NEON)
+	{
+		float32x4_t	vol = { leftvol, rightvol, leftvol, rightvol };
+		float32x4x2_t	pair;
+		float32x4_t	data;
+		int8x8_t	b;
+
+		for ( ; i+8 <= count ; i+=8, samp+=16)
+		{
+			int16x8_t	w;
+
+			b = vld1_s8 (sfx+i);
+			w = vmovl_s8 (b);
+
+			data = vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (w)));
+			pair = vzipq_f32 (data, data);
+			vst1q_f32 (samp, vmlaq_f32 (vld1q_f32 (samp), pair.val[0], vol));
+			vst1q_f32 (samp+4, vmlaq_f32 (vld1q_f32 (samp+4), pair.val[1], vol));
+
+			data = vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (w)));
+			pair = vzipq_f32 (data, data);
+			vst1q_f32 (samp+8, vmlaq_f32 (vld1q_f32 (samp+8), pair.val[0], vol));
+			vst1q_f32 (samp+12, vmlaq_f32 (vld1q_f32 (samp+12), pair.val[1], vol));
+		}
+	}
+#endif
+
+	for ( ; i<count ; i++, samp+=2)
+	{
+		samp[0] += sfx[i] * leftvol;
+		samp[1] += sfx[i] * rightvol;
+	}
+
+	ch->pos += count;
+}
+
+void S_PaintChannelFrom16_SIMD (channel_t *ch, sfxcache_t *sc, int count, int offset)
+{
+	float	leftvol, rightvol;
+	signed short *sfx;
+	float	*samp;
+	int		i;
+
+	leftvol = ch->leftvol*snd_vol * (1.0f/256);
+	rightvol = ch->rightvol*snd_vol * (1.0f/256);
+	sfx = (signed short *)sc->data + ch->pos;
+
+	samp = &paintbuffer_f[offset*2];
+
+	i = 0;
+#if defined(SND_SIMD_SSE2)
+	{
+		__m128	vol = _mm_setr_ps (leftvol, rightvol, leftvol, rightvol);
+		__m128	data;
+		__m128i	w;
+
+		for ( ; i+8 <= count ; i+=8, samp+=16)
+		{
+			w = _mm_loadu_si128 ((const __m128i *)(sfx+i));
+
+			data = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (w, w), 16));
+			_mm_storeu_ps (samp, _mm_add_ps (_mm_loadu_ps (samp),
+				_mm_mul_ps (_mm_unpacklo_ps (data, data), vol)));
+			_mm_storeu_ps (samp+4, _mm_add_ps (_mm_loadu_ps (samp+4),
+				_mm_mul_ps (_mm_unpackhi_ps (data, data), vol)));
+
+			data = _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (w, w), 16));
+			_mm_storeu_ps (samp+8, _mm_add_ps (_mm_loadu_ps (samp+8),
+				_mm_mul_ps (_mm_unpacklo_ps (data, data), vol)));
+			_mm_storeu_ps (samp+12, _mm_add_ps (_mm_loadu_ps (samp+12),
+				_mm_mul_ps (_mm_unpackhi_ps (data, data), vol)));
+		}
+	}
+#elif defined(SND_SIMD_NEON)
+	{
+		float32x4_t	vol = { leftvol, rightvol, leftvol, rightvol };
+		float32x4x2_t	pair;
+		float32x4_t	data;
+		int16x8_t	w;
+
+		for ( ; i+8 <= count ; i+=8, samp+=16)
+		{
+			w = vld1q_s16 (sfx+i);
+
+			data = vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (w)));
+			pair = vzipq_f32 (data, data);
+			vst1q_f32 (samp, vmlaq_f32 (vld1q_f32 (samp), pair.val[0], vol));
+			vst1q_f32 (samp+4, vmlaq_f32 (vld1q_f32 (samp+4), pair.val[1], vol));
+
+			data = vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (w)));
+			pair = vzipq_f32 (data, data);
+			vst1q_f32 (samp+8, vmlaq_f32 (vld1q_f32 (samp+8), pair.val[0], vol));
+			vst1q_f32 (samp+12, vmlaq_f32 (vld1q_f32 (samp+12), pair.val[1], vol));
+		}
+	}
+#endif
+
+	for ( ; i<count ; i++, samp+=2)
+	{
+		samp[0] += sfx[i] * leftvol;
+		samp[1] += sfx[i] * rightvol;
+	}
+
+	ch->pos += count;
+}
+#endif
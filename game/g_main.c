@@ -81,6 +81,7 @@ cvar_t *sv_maplist;
 cvar_t *gib_on;
 
 cvar_t *aimfix;
+cvar_t *g_savetiming;
 
 void SpawnEntities(char *mapname, char *entities, char *spawnpoint);
 void ClientThink(edict_t *ent, usercmd_t *cmd);
@@ -94,6 +95,9 @@ void WriteGame(char *filename, qboolean autosave);
 void ReadGame(char *filename);
 void WriteLevel(char *filename);
 void ReadLevel(char *filename);
+int StateSize(void);
+int WriteState(byte *buf, int size);
+qboolean ReadState(const byte *buf, int size);
 void InitGame(void);
 void G_RunFrame(void);
 
@@ -127,6 +131,9 @@ GetGameAPI(game_import_t *import)
 	globals.ReadGame = ReadGame;
 	globals.WriteLevel = WriteLevel;
 	globals.ReadLevel = ReadLevel;
+	globals.StateSize = StateSize;
+	globals.WriteState = WriteState;
+	globals.ReadState = ReadState;
 
 	globals.ClientThink = ClientThink;
 	globals.ClientConnect = ClientConnect;
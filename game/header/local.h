@@ -543,6 +543,7 @@ extern cvar_t *flood_waitdelay;
 extern cvar_t *sv_maplist;
 
 extern cvar_t *aimfix;
+extern cvar_t *g_savetiming;
 
 #define world (&g_edicts[0])
 
@@ -234,6 +234,9 @@ int  randk(void);
 float frandk(void);
 float crandk(void);
 void randk_seed(void);
+int randk_statesize(void);
+void randk_writestate(void *buf);
+void randk_readstate(const void *buf);
 
 /*
  * ==============================================================
@@ -42,6 +42,11 @@
  * pointers are generated at each compilation / start of the
  * client, thus the pointers are always correct.
  *
+ * Since YQ2-4 the files are built in memory and written in
+ * one go, each name is stored once at the end of the file
+ * and the pointers are translated through hash maps. Older
+ * savegames can still be loaded.
+ *
  * Limitations:
  * While savegames survive recompilations of the game source
  * and bigger changes in the source, there are some limitation
@@ -65,6 +70,7 @@
  */
 
 #include <libretro_file.h>
+#include <features/features_cpu.h>
 
 #include "../header/local.h"
 
@@ -72,8 +78,15 @@
  * When ever the savegame version is changed, q2 will refuse to
  * load older savegames. This should be bumped if the files
  * in tables/ are changed, otherwise strange things may happen.
+ * YQ2-1 to YQ2-3 are still read by the old code below.
+ */
+#define SAVEGAMEVER "YQ2-4"
+
+/*
+ * Level files start with this instead
+ * of the edict size since YQ2-4.
  */
-#define SAVEGAMEVER "YQ2-3"
+#define LEVELMAGIC (('4' << 24) + ('L' << 16) + ('Q' << 8) + 'Y')
 
 #ifndef BUILD_DATE
 #define BUILD_DATE __DATE__
@@ -207,6 +220,182 @@ field_t clientfields[] = {
 
 /* ========================================================= */
 
+/*
+ * Hash maps from function and mmove_t
+ * pointers to their list entries and
+ * from the names back. Built once at
+ * startup, the linear scans through
+ * the lists were done for every
+ * pointer in every edict.
+ */
+#define NUM_FUNCTIONS (int)(sizeof(functionList) / sizeof(functionList[0]) - 1)
+#define NUM_MMOVES (int)(sizeof(mmoveList) / sizeof(mmoveList[0]) - 1)
+
+#define FUNCTION_HASH 4096
+#define MMOVE_HASH 1024
+
+typedef struct
+{
+	int count;
+	int mask;
+	const char **names;
+	void **ptrs;
+	short *byaddr; /* list index + 1, 0 is an empty slot */
+	short *byname;
+} savemap_t;
+
+static const char *funcnames[NUM_FUNCTIONS];
+static void *funcptrs[NUM_FUNCTIONS];
+static short funcbyaddr[FUNCTION_HASH];
+static short funcbyname[FUNCTION_HASH];
+
+static const char *mmovenames[NUM_MMOVES];
+static void *mmoveptrs[NUM_MMOVES];
+static short mmovebyaddr[MMOVE_HASH];
+static short mmovebyname[MMOVE_HASH];
+
+static savemap_t funcmap = {
+	NUM_FUNCTIONS, FUNCTION_HASH - 1, funcnames, funcptrs, funcbyaddr, funcbyname
+};
+
+static savemap_t mmovemap = {
+	NUM_MMOVES, MMOVE_HASH - 1, mmovenames, mmoveptrs, mmovebyaddr, mmovebyname
+};
+
+static unsigned
+HashAddress(const void *adr)
+{
+	size_t v;
+	unsigned h;
+
+	v = (size_t)adr;
+	h = (unsigned)v ^ (unsigned)(v >> 16 >> 16);
+	h *= 2654435761u;
+
+	return h ^ (h >> 16);
+}
+
+static unsigned
+HashName(const char *name)
+{
+	unsigned h;
+
+	for (h = 2166136261u; *name; name++)
+	{
+		h = (h ^ (byte)*name) * 16777619u;
+	}
+
+	return h;
+}
+
+static int
+SaveMap_FindAddress(const savemap_t *map, const void *adr)
+{
+	unsigned h;
+	int i;
+
+	for (h = HashAddress(adr) & map->mask; (i = map->byaddr[h]) != 0;
+		 h = (h + 1) & map->mask)
+	{
+		if (map->ptrs[i - 1] == adr)
+		{
+			return i - 1;
+		}
+	}
+
+	return -1;
+}
+
+static int
+SaveMap_FindName(const savemap_t *map, const char *name)
+{
+	unsigned h;
+	int i;
+
+	for (h = HashName(name) & map->mask; (i = map->byname[h]) != 0;
+		 h = (h + 1) & map->mask)
+	{
+		if (!strcmp(map->names[i - 1], name))
+		{
+			return i - 1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Duplicates keep the first entry,
+ * like the linear scans did.
+ */
+static void
+SaveMap_Build(savemap_t *map)
+{
+	unsigned h;
+	int i;
+
+	if (map->count * 2 > map->mask + 1)
+	{
+		gi.error("SaveMap_Build: %i entries don't fit the hash", map->count);
+	}
+
+	memset(map->byaddr, 0, (map->mask + 1) * sizeof(map->byaddr[0]));
+	memset(map->byname, 0, (map->mask + 1) * sizeof(map->byname[0]));
+
+	for (i = 0; i < map->count; i++)
+	{
+		if (SaveMap_FindAddress(map, map->ptrs[i]) < 0)
+		{
+			for (h = HashAddress(map->ptrs[i]) & map->mask; map->byaddr[h];
+				 h = (h + 1) & map->mask)
+			{
+			}
+
+			map->byaddr[h] = i + 1;
+		}
+
+		if (SaveMap_FindName(map, map->names[i]) < 0)
+		{
+			for (h = HashName(map->names[i]) & map->mask; map->byname[h];
+				 h = (h + 1) & map->mask)
+			{
+			}
+
+			map->byname[h] = i + 1;
+		}
+	}
+}
+
+static void
+InitSaveMaps(void)
+{
+	static qboolean built;
+	int i;
+
+	if (built)
+	{
+		return;
+	}
+
+	for (i = 0; i < NUM_FUNCTIONS; i++)
+	{
+		funcnames[i] = functionList[i].funcStr;
+		funcptrs[i] = functionList[i].funcPtr;
+	}
+
+	for (i = 0; i < NUM_MMOVES; i++)
+	{
+		mmovenames[i] = mmoveList[i].mmoveStr;
+		mmoveptrs[i] = mmoveList[i].mmovePtr;
+	}
+
+	SaveMap_Build(&funcmap);
+	SaveMap_Build(&mmovemap);
+	built = true;
+}
+
+/* ========================================================= */
+
 /*
  * This will be called when the dll is first loaded,
  * which only happens when a new game is started or
@@ -265,6 +454,10 @@ InitGame(void)
 
 	/* others */
 	aimfix = gi.cvar("aimfix", "0", CVAR_ARCHIVE);
+	g_savetiming = gi.cvar("g_savetiming", "0", 0);
+
+	/* pointer <-> name maps for savegames */
+	InitSaveMaps();
 
 	/* items */
 	InitItems();
@@ -286,71 +479,20 @@ InitGame(void)
 
 /* ========================================================= */
 
-/*
- * Helper function to get
- * the human readable function
- * definition by an address.
- * Called by WriteField1 and
- * WriteField2.
- */
-functionList_t *
-GetFunctionByAddress(byte *adr)
-{
-	int i;
-
-	for (i = 0; functionList[i].funcStr; i++)
-	{
-		if (functionList[i].funcPtr == adr)
-		{
-			return &functionList[i];
-		}
-	}
-
-	return NULL;
-}
-
 /*
  * Helper function to get the
  * pointer to a function by
  * it's human readable name.
- * Called by WriteField1 and
- * WriteField2.
+ * Called by ReadField.
  */
 byte *
 FindFunctionByName(char *name)
 {
 	int i;
 
-	for (i = 0; functionList[i].funcStr; i++)
-	{
-		if (!strcmp(name, functionList[i].funcStr))
-		{
-			return functionList[i].funcPtr;
-		}
-	}
-
-	return NULL;
-}
-
-/*
- * Helper function to get the
- * human readable definition of
- * a mmove_t struct by a pointer.
- */
-mmoveList_t *
-GetMmoveByAddress(mmove_t *adr)
-{
-	int i;
-
-	for (i = 0; mmoveList[i].mmoveStr; i++)
-	{
-		if (mmoveList[i].mmovePtr == adr)
-		{
-			return &mmoveList[i];
-		}
-	}
+	i = SaveMap_FindName(&funcmap, name);
 
-	return NULL;
+	return i < 0 ? NULL : functionList[i].funcPtr;
 }
 
 /*
@@ -363,34 +505,28 @@ FindMmoveByName(char *name)
 {
 	int i;
 
-	for (i = 0; mmoveList[i].mmoveStr; i++)
-	{
-		if (!strcmp(name, mmoveList[i].mmoveStr))
-		{
-			return mmoveList[i].mmovePtr;
-		}
-	}
+	i = SaveMap_FindName(&mmovemap, name);
 
-	return NULL;
+	return i < 0 ? NULL : mmoveList[i].mmovePtr;
 }
 
 
 /* ========================================================= */
 
 /*
- * The following two functions are
- * doing the dirty work to write the
- * data generated by the functions
- * below this block into files.
+ * This function does the dirty
+ * work to read the data from a
+ * file. The processing of the
+ * data is done in the functions
+ * below
  */
 void
-WriteField1(RFILE *f, field_t *field, byte *base)
+ReadField(RFILE *f, field_t *field, byte *base)
 {
 	void *p;
 	int len;
 	int index;
-	functionList_t *func;
-	mmoveList_t *mmove;
+	char funcStr[2048];
 
 	if (field->flags & FFL_SPAWNTEMP)
 	{
@@ -409,334 +545,861 @@ WriteField1(RFILE *f, field_t *field, byte *base)
 			break;
 
 		case F_LSTRING:
-		case F_GSTRING:
+			len = *(int *)p;
 
-			if (*(char **)p)
+			if (!len)
 			{
-				len = strlen(*(char **)p) + 1;
+				*(char **)p = NULL;
 			}
 			else
 			{
-				len = 0;
+				*(char **)p = gi.TagMalloc(32 + len, TAG_LEVEL);
+				rfread(*(char **)p, len, 1, f);
 			}
 
-			*(int *)p = len;
 			break;
 		case F_EDICT:
+			index = *(int *)p;
 
-			if (*(edict_t **)p == NULL)
+			if (index == -1)
 			{
-				index = -1;
+				*(edict_t **)p = NULL;
 			}
 			else
 			{
-				index = *(edict_t **)p - g_edicts;
+				*(edict_t **)p = &g_edicts[index];
 			}
 
-			*(int *)p = index;
 			break;
 		case F_CLIENT:
+			index = *(int *)p;
 
-			if (*(gclient_t **)p == NULL)
+			if (index == -1)
 			{
-				index = -1;
+				*(gclient_t **)p = NULL;
 			}
 			else
 			{
-				index = *(gclient_t **)p - game.clients;
+				*(gclient_t **)p = &game.clients[index];
 			}
 
-			*(int *)p = index;
 			break;
 		case F_ITEM:
+			index = *(int *)p;
 
-			if (*(edict_t **)p == NULL)
+			if (index == -1)
 			{
-				index = -1;
+				*(gitem_t **)p = NULL;
 			}
 			else
 			{
-				index = *(gitem_t **)p - itemlist;
+				*(gitem_t **)p = &itemlist[index];
 			}
 
-			*(int *)p = index;
 			break;
 		case F_FUNCTION:
+			len = *(int *)p;
 
-			if (*(byte **)p == NULL)
+			if (!len)
 			{
-				len = 0;
+				*(byte **)p = NULL;
 			}
 			else
 			{
-				func = GetFunctionByAddress (*(byte **)p);
+				if (len > sizeof(funcStr))
+				{
+					gi.error ("ReadField: function name is longer than buffer (%i chars)",
+							(int)sizeof(funcStr));
+				}
+
+				rfread (funcStr, len, 1, f);
 
-				if (!func)
+				if ( !(*(byte **)p = FindFunctionByName (funcStr)) )
 				{
-					gi.error ("WriteField1: function not in list, can't save game");
+					gi.error ("ReadField: function %s not found in table, can't load game", funcStr);
 				}
 
-				len = strlen(func->funcStr)+1;
 			}
-
-			*(int *)p = len;
 			break;
 		case F_MMOVE:
+			len = *(int *)p;
 
-			if (*(byte **)p == NULL)
+			if (!len)
 			{
-				len = 0;
+				*(byte **)p = NULL;
 			}
 			else
 			{
-				mmove = GetMmoveByAddress (*(mmove_t **)p);
-
-				if (!mmove)
+				if (len > sizeof(funcStr))
 				{
-					gi.error ("WriteField1: mmove not in list, can't save game");
+					gi.error ("ReadField: mmove name is longer than buffer (%i chars)",
+							(int)sizeof(funcStr));
 				}
 
-				len = strlen(mmove->mmoveStr)+1;
-			}
+				rfread (funcStr, len, 1, f);
 
-			*(int *)p = len;
+				if ( !(*(mmove_t **)p = FindMmoveByName (funcStr)) )
+				{
+					gi.error ("ReadField: mmove %s not found in table, can't load game", funcStr);
+				}
+			}
 			break;
+
 		default:
-			gi.error("WriteEdict: unknown field type");
+			gi.error("ReadEdict: unknown field type");
 	}
 }
 
-void
-WriteField2(RFILE *f, field_t *field, byte *base)
+/* ========================================================= */
+
+/*
+ * Since YQ2-4 savegames are built in
+ * memory and written with one call,
+ * and read back the same way. Blocks
+ * are copied whole, then the pointers
+ * inside are turned into indexes. The
+ * function and mmove_t names used are
+ * written once each at the end of the
+ * file, pointer fields hold an index
+ * into that list.
+ */
+typedef struct
 {
-	int len;
-	void *p;
-	functionList_t *func;
-	mmoveList_t *mmove;
+	byte *buffer; /* ours, kept between saves */
+	int buffersize;
+
+	byte *data; /* the buffer, or the one being read */
+	int maxsize;
+	int cursize;
+	int readcount;
+	const char *filename;
+
+	int numfuncs; /* names in this file */
+	int nummmoves;
+	short funcslot[NUM_FUNCTIONS]; /* list index -> file index + 1 */
+	short mmoveslot[NUM_MMOVES];
+	short funcorder[NUM_FUNCTIONS]; /* file index -> list index */
+	short mmoveorder[NUM_MMOVES];
+
+	qboolean state; /* errors are returned, not fatal */
+	qboolean failed;
+} savefile_t;
+
+static savefile_t sf;
+
+static void
+SF_Begin(const char *filename)
+{
+	sf.data = sf.buffer;
+	sf.maxsize = sf.buffersize;
+	sf.cursize = 0;
+	sf.readcount = 0;
+	sf.filename = filename;
+	sf.state = false;
+	sf.failed = false;
+	sf.numfuncs = 0;
+	sf.nummmoves = 0;
+	memset(sf.funcslot, 0, sizeof(sf.funcslot));
+	memset(sf.mmoveslot, 0, sizeof(sf.mmoveslot));
+}
 
-	if (field->flags & FFL_SPAWNTEMP)
-	{
-		return;
-	}
+/*
+ * Savegames are aborted with gi.error.
+ * Savestates are read and written
+ * outside of the server frame, so
+ * there's nothing to jump back to.
+ * They only note the error and the
+ * caller backs out.
+ */
+static void
+SF_Error(const char *fmt, ...)
+{
+	va_list argptr;
+	char msg[1024];
 
-	p = (void *)(base + field->ofs);
+	va_start(argptr, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, argptr);
+	va_end(argptr);
 
-	switch (field->type)
+	if (!sf.state)
 	{
-		case F_LSTRING:
+		gi.error("%s", msg);
+	}
 
-			if (*(char **)p)
-			{
-				len = strlen(*(char **)p) + 1;
-				rfwrite(*(char **)p, len, 1, f);
-			}
+	gi.dprintf("%s\n", msg);
+	sf.failed = true;
+}
 
-			break;
-		case F_FUNCTION:
+static void *
+SF_Alloc(int length)
+{
+	void *p;
+	int size;
 
-			if (*(byte **)p)
-			{
-				func = GetFunctionByAddress (*(byte **)p);
+	if (sf.cursize + length > sf.maxsize)
+	{
+		for (size = sf.maxsize ? sf.maxsize : 0x10000;
+			 size < sf.cursize + length; size *= 2)
+		{
+		}
 
-				if (!func)
-				{
-					gi.error ("WriteField2: function not in list, can't save game");
-				}
+		p = realloc(sf.buffer, size);
 
-				len = strlen(func->funcStr)+1;
-				rfwrite (func->funcStr, len, 1, f);
-			}
+		if (!p)
+		{
+			gi.error("%s: couldn't allocate %i bytes", sf.filename, size);
+		}
 
-			break;
-		case F_MMOVE:
+		sf.buffer = sf.data = p;
+		sf.buffersize = sf.maxsize = size;
+	}
 
-			if (*(byte **)p)
-			{
-				mmove = GetMmoveByAddress (*(mmove_t **)p);
-				if (!mmove)
-				{
-					gi.error ("WriteField2: mmove not in list, can't save game");
-				}
+	p = sf.data + sf.cursize;
+	sf.cursize += length;
 
-				len = strlen(mmove->mmoveStr)+1;
-				rfwrite (mmove->mmoveStr, len, 1, f);
-			}
+	return p;
+}
 
-			break;
-		default:
-			break;
-	}
+static void
+SF_Write(const void *data, int length)
+{
+	memcpy(SF_Alloc(length), data, length);
 }
 
-/* ========================================================= */
+static void
+SF_WriteInt(int i)
+{
+	SF_Write(&i, sizeof(i));
+}
 
-/*
- * This function does the dirty
- * work to read the data from a
- * file. The processing of the
- * data is done in the functions
- * below
- */
-void
-ReadField(RFILE *f, field_t *field, byte *base)
+static void *
+SF_Read(int length)
 {
 	void *p;
-	int len;
-	int index;
-	char funcStr[2048];
 
-	if (field->flags & FFL_SPAWNTEMP)
+	if (length < 0 || length > sf.cursize - sf.readcount)
 	{
-		return;
+		SF_Error("%s: savegame is truncated", sf.filename);
+		return NULL;
 	}
 
-	p = (void *)(base + field->ofs);
+	p = sf.data + sf.readcount;
+	sf.readcount += length;
 
-	switch (field->type)
-	{
-		case F_INT:
-		case F_FLOAT:
-		case F_ANGLEHACK:
-		case F_VECTOR:
-		case F_IGNORE:
-			break;
+	return p;
+}
 
-		case F_LSTRING:
-			len = *(int *)p;
+static int
+SF_ReadInt(void)
+{
+	const void *p;
+	int i;
 
-			if (!len)
-			{
-				*(char **)p = NULL;
-			}
-			else
+	if ((p = SF_Read(sizeof(i))) == NULL)
+	{
+		return 0;
+	}
+
+	memcpy(&i, p, sizeof(i));
+
+	return i;
+}
+
+static const char *
+SF_ReadString(void)
+{
+	const char *s;
+	byte *end;
+
+	end = memchr(sf.data + sf.readcount, 0, sf.cursize - sf.readcount);
+
+	if (!end)
+	{
+		SF_Error("%s: savegame is truncated", sf.filename);
+		return NULL;
+	}
+
+	s = (const char *)sf.data + sf.readcount;
+	sf.readcount = end + 1 - sf.data;
+
+	return s;
+}
+
+/*
+ * Writes the buffer to disk.
+ */
+static void
+SF_Save(void)
+{
+	RFILE *f;
+
+	f = rfopen(sf.filename, "wb");
+
+	if (!f)
+	{
+		gi.error("Couldn't open %s", sf.filename);
+	}
+
+	if (sf.cursize && rfwrite(sf.data, sf.cursize, 1, f) != 1)
+	{
+		rfclose(f);
+		gi.error("Couldn't write %s", sf.filename);
+	}
+
+	rfclose(f);
+}
+
+/*
+ * Reads a whole open file into the
+ * buffer, reading continues where
+ * the file was.
+ */
+static void
+SF_Load(RFILE *f)
+{
+	int64_t start, end;
+
+	start = rftell(f);
+	rfseek(f, 0, SEEK_END);
+	end = rftell(f);
+	rfseek(f, 0, SEEK_SET);
+
+	if (start < 0 || end < start || end > 0x7fffffff)
+	{
+		rfclose(f);
+		gi.error("%s: couldn't get the savegame size", sf.filename);
+	}
+
+	SF_Alloc((int)end);
+	sf.readcount = (int)start;
+
+	if (sf.cursize && rfread(sf.data, sf.cursize, 1, f) != 1)
+	{
+		rfclose(f);
+		gi.error("%s: savegame is truncated", sf.filename);
+	}
+
+	rfclose(f);
+}
+
+/*
+ * Stores an index in a pointer field,
+ * clearing the rest of the pointer so
+ * the files don't depend on where
+ * things happen to be in memory.
+ */
+static void
+SF_SetIndex(void *p, int index)
+{
+	memset(p, 0, sizeof(void *));
+	memcpy(p, &index, sizeof(index));
+}
+
+/*
+ * Copies a block into the file and
+ * turns the pointers in the copy
+ * into lengths or indexes. Blocks
+ * aren't aligned in the file, so the
+ * pointers are read from the source.
+ */
+static void
+SF_WriteBlock(field_t *fields, const void *block, int size)
+{
+	field_t *field;
+	byte *base;
+	void *p;
+	void *ptr;
+	int i;
+
+	base = SF_Alloc(size);
+	memcpy(base, block, size);
+
+	for (field = fields; field->name; field++)
+	{
+		if (field->flags & FFL_SPAWNTEMP)
+		{
+			continue;
+		}
+
+		p = base + field->ofs;
+
+		switch (field->type)
+		{
+			case F_INT:
+			case F_FLOAT:
+			case F_ANGLEHACK:
+			case F_VECTOR:
+			case F_IGNORE:
+				continue;
+			default:
+				break;
+		}
+
+		ptr = *(void * const *)((const byte *)block + field->ofs);
+
+		switch (field->type)
+		{
+			case F_LSTRING:
+			case F_GSTRING:
+				SF_SetIndex(p, ptr ? strlen(ptr) + 1 : 0);
+				break;
+			case F_EDICT:
+				SF_SetIndex(p, ptr ? (edict_t *)ptr - g_edicts : -1);
+				break;
+			case F_CLIENT:
+				SF_SetIndex(p, ptr ? (gclient_t *)ptr - game.clients : -1);
+				break;
+			case F_ITEM:
+				SF_SetIndex(p, ptr ? (gitem_t *)ptr - itemlist : -1);
+				break;
+			case F_FUNCTION:
+
+				if (!ptr)
+				{
+					SF_SetIndex(p, 0);
+					break;
+				}
+
+				if ((i = SaveMap_FindAddress(&funcmap, ptr)) < 0)
+				{
+					SF_Error("SF_WriteBlock: function not in list, can't save game");
+					SF_SetIndex(p, 0);
+					break;
+				}
+
+				if (!sf.funcslot[i])
+				{
+					sf.funcorder[sf.numfuncs++] = i;
+					sf.funcslot[i] = sf.numfuncs;
+				}
+
+				SF_SetIndex(p, sf.funcslot[i]);
+				break;
+			case F_MMOVE:
+
+				if (!ptr)
+				{
+					SF_SetIndex(p, 0);
+					break;
+				}
+
+				if ((i = SaveMap_FindAddress(&mmovemap, ptr)) < 0)
+				{
+					SF_Error("SF_WriteBlock: mmove not in list, can't save game");
+					SF_SetIndex(p, 0);
+					break;
+				}
+
+				if (!sf.mmoveslot[i])
+				{
+					sf.mmoveorder[sf.nummmoves++] = i;
+					sf.mmoveslot[i] = sf.nummmoves;
+				}
+
+				SF_SetIndex(p, sf.mmoveslot[i]);
+				break;
+			default:
+				SF_Error("SF_WriteBlock: unknown field type");
+				SF_SetIndex(p, 0);
+				break;
+		}
+	}
+}
+
+/*
+ * Bytes SF_WriteStrings will write.
+ */
+static int
+SF_StringsSize(field_t *fields, const byte *base)
+{
+	field_t *field;
+	char *s;
+	int size;
+
+	size = 0;
+
+	for (field = fields; field->name; field++)
+	{
+		if (field->flags & FFL_SPAWNTEMP)
+		{
+			continue;
+		}
+
+		if (field->type != F_LSTRING && field->type != F_GSTRING)
+		{
+			continue;
+		}
+
+		if ((s = *(char **)(base + field->ofs)) != NULL)
+		{
+			size += strlen(s) + 1;
+		}
+	}
+
+	return size;
+}
+
+/*
+ * Writes the strings of a block,
+ * they follow all the blocks.
+ */
+static void
+SF_WriteStrings(field_t *fields, const byte *base)
+{
+	field_t *field;
+	char *s;
+
+	for (field = fields; field->name; field++)
+	{
+		if (field->flags & FFL_SPAWNTEMP)
+		{
+			continue;
+		}
+
+		if (field->type != F_LSTRING && field->type != F_GSTRING)
+		{
+			continue;
+		}
+
+		if ((s = *(char **)(base + field->ofs)) != NULL)
+		{
+			SF_Write(s, strlen(s) + 1);
+		}
+	}
+}
+
+/*
+ * Writes the names of the functions
+ * and mmove_t structs used and puts
+ * their offset at ofs.
+ */
+static void
+SF_WriteNames(int ofs)
+{
+	const char *s;
+	int i;
+
+	memcpy(sf.data + ofs, &sf.cursize, sizeof(sf.cursize));
+
+	SF_WriteInt(sf.numfuncs);
+
+	for (i = 0; i < sf.numfuncs; i++)
+	{
+		s = functionList[sf.funcorder[i]].funcStr;
+		SF_Write(s, strlen(s) + 1);
+	}
+
+	SF_WriteInt(sf.nummmoves);
+
+	for (i = 0; i < sf.nummmoves; i++)
+	{
+		s = mmoveList[sf.mmoveorder[i]].mmoveStr;
+		SF_Write(s, strlen(s) + 1);
+	}
+}
+
+/*
+ * Looks up the names at the given
+ * offset, each one only once.
+ */
+static qboolean
+SF_ReadNames(int ofs)
+{
+	const char *s;
+	int readcount;
+	int i, n;
+
+	readcount = sf.readcount;
+
+	if (ofs < 0 || ofs > sf.cursize)
+	{
+		SF_Error("%s: savegame is truncated", sf.filename);
+		return false;
+	}
+
+	sf.readcount = ofs;
+
+	sf.numfuncs = SF_ReadInt();
+
+	if (sf.numfuncs < 0 || sf.numfuncs > NUM_FUNCTIONS)
+	{
+		SF_Error("%s: bad function count %i", sf.filename, sf.numfuncs);
+		return false;
+	}
+
+	for (i = 0; i < sf.numfuncs; i++)
+	{
+		if ((s = SF_ReadString()) == NULL)
+		{
+			return false;
+		}
+
+		if ((n = SaveMap_FindName(&funcmap, s)) < 0)
+		{
+			SF_Error("ReadField: function %s not found in table, can't load game", s);
+			return false;
+		}
+
+		sf.funcorder[i] = n;
+	}
+
+	sf.nummmoves = SF_ReadInt();
+
+	if (sf.nummmoves < 0 || sf.nummmoves > NUM_MMOVES)
+	{
+		SF_Error("%s: bad mmove count %i", sf.filename, sf.nummmoves);
+		return false;
+	}
+
+	for (i = 0; i < sf.nummmoves; i++)
+	{
+		if ((s = SF_ReadString()) == NULL)
+		{
+			return false;
+		}
+
+		if ((n = SaveMap_FindName(&mmovemap, s)) < 0)
+		{
+			SF_Error("ReadField: mmove %s not found in table, can't load game", s);
+			return false;
+		}
+
+		sf.mmoveorder[i] = n;
+	}
+
+	sf.readcount = readcount;
+
+	return !sf.failed;
+}
+
+static void
+SF_ReadBlock(void *block, int size)
+{
+	memcpy(block, SF_Read(size), size);
+}
+
+/*
+ * Checks a length or index
+ * stored in a pointer field.
+ */
+static qboolean
+SF_CheckIndex(const field_t *field, int index)
+{
+	switch (field->type)
+	{
+		case F_LSTRING:
+		case F_GSTRING:
+
+			if (index >= 0)
 			{
-				*(char **)p = gi.TagMalloc(32 + len, TAG_LEVEL);
-				rfread(*(char **)p, len, 1, f);
+				return true;
 			}
 
-			break;
+			SF_Error("%s: bad string length %i", sf.filename, index);
+			return false;
 		case F_EDICT:
-			index = *(int *)p;
 
-			if (index == -1)
+			if (index >= -1 && index < game.maxentities)
 			{
-				*(edict_t **)p = NULL;
-			}
-			else
-			{
-				*(edict_t **)p = &g_edicts[index];
+				return true;
 			}
 
-			break;
+			SF_Error("%s: bad edict index %i", sf.filename, index);
+			return false;
 		case F_CLIENT:
-			index = *(int *)p;
 
-			if (index == -1)
+			if (index >= -1 && index < game.maxclients)
 			{
-				*(gclient_t **)p = NULL;
-			}
-			else
-			{
-				*(gclient_t **)p = &game.clients[index];
+				return true;
 			}
 
-			break;
+			SF_Error("%s: bad client index %i", sf.filename, index);
+			return false;
 		case F_ITEM:
-			index = *(int *)p;
 
-			if (index == -1)
+			if (index >= -1 && index < game.num_items)
 			{
-				*(gitem_t **)p = NULL;
-			}
-			else
-			{
-				*(gitem_t **)p = &itemlist[index];
+				return true;
 			}
 
-			break;
+			SF_Error("%s: bad item index %i", sf.filename, index);
+			return false;
 		case F_FUNCTION:
-			len = *(int *)p;
 
-			if (!len)
+			if (index >= 0 && index <= sf.numfuncs)
 			{
-				*(byte **)p = NULL;
+				return true;
 			}
-			else
-			{
-				if (len > sizeof(funcStr))
-				{
-					gi.error ("ReadField: function name is longer than buffer (%i chars)",
-							(int)sizeof(funcStr));
-				}
-
-				rfread (funcStr, len, 1, f);
-
-				if ( !(*(byte **)p = FindFunctionByName (funcStr)) )
-				{
-					gi.error ("ReadField: function %s not found in table, can't load game", funcStr);
-				}
 
-			}
-			break;
+			SF_Error("%s: bad function index %i", sf.filename, index);
+			return false;
 		case F_MMOVE:
-			len = *(int *)p;
 
-			if (!len)
+			if (index >= 0 && index <= sf.nummmoves)
 			{
-				*(byte **)p = NULL;
+				return true;
 			}
-			else
-			{
-				if (len > sizeof(funcStr))
-				{
-					gi.error ("ReadField: mmove name is longer than buffer (%i chars)",
-							(int)sizeof(funcStr));
-				}
 
-				rfread (funcStr, len, 1, f);
+			SF_Error("%s: bad mmove index %i", sf.filename, index);
+			return false;
+		default:
+			SF_Error("SF_ReadFields: unknown field type");
+			return false;
+	}
+}
 
-				if ( !(*(mmove_t **)p = FindMmoveByName (funcStr)) )
-				{
-					gi.error ("ReadField: mmove %s not found in table, can't load game", funcStr);
-				}
+/*
+ * Checks the pointer fields of a
+ * block still in the buffer, and
+ * reads past its strings. Nothing
+ * is changed, so a bad savestate
+ * can be turned down before the
+ * level is touched.
+ */
+static qboolean
+SF_CheckFields(field_t *fields, const byte *block)
+{
+	field_t *field;
+	const char *s;
+	int index;
+
+	for (field = fields; field->name; field++)
+	{
+		if (field->flags & FFL_SPAWNTEMP)
+		{
+			continue;
+		}
+
+		switch (field->type)
+		{
+			case F_INT:
+			case F_FLOAT:
+			case F_ANGLEHACK:
+			case F_VECTOR:
+			case F_IGNORE:
+				continue;
+			default:
+				break;
+		}
+
+		memcpy(&index, block + field->ofs, sizeof(index));
+
+		if (!SF_CheckIndex(field, index))
+		{
+			return false;
+		}
+
+		if ((field->type == F_LSTRING || field->type == F_GSTRING) && index)
+		{
+			if ((s = SF_Read(index)) == NULL)
+			{
+				return false;
 			}
-			break;
 
-		default:
-			gi.error("ReadEdict: unknown field type");
+			if (s[index - 1])
+			{
+				SF_Error("%s: unterminated string", sf.filename);
+				return false;
+			}
+		}
 	}
-}
 
-/* ========================================================= */
+	return true;
+}
 
 /*
- * Write the client struct into a file.
+ * Turns the lengths and indexes in a
+ * block read by SF_ReadBlock back
+ * into pointers.
  */
-void
-WriteClient(RFILE *f, gclient_t *client)
+static void
+SF_ReadFields(field_t *fields, byte *base)
 {
 	field_t *field;
-	gclient_t temp;
-
-	/* all of the ints, floats, and vectors stay as they are */
-	temp = *client;
+	void *p;
+	const void *s;
+	int index;
 
-	/* change the pointers to indexes */
-	for (field = clientfields; field->name; field++)
+	for (field = fields; field->name; field++)
 	{
-		WriteField1(f, field, (byte *)&temp);
-	}
+		if (field->flags & FFL_SPAWNTEMP)
+		{
+			continue;
+		}
 
-	/* write the block */
-	rfwrite(&temp, sizeof(temp), 1, f);
+		switch (field->type)
+		{
+			case F_INT:
+			case F_FLOAT:
+			case F_ANGLEHACK:
+			case F_VECTOR:
+			case F_IGNORE:
+				continue;
+			default:
+				break;
+		}
 
-	/* now write any allocated data following the edict */
-	for (field = clientfields; field->name; field++)
+		p = base + field->ofs;
+		index = *(int *)p;
+
+		if (!SF_CheckIndex(field, index))
+		{
+			*(void **)p = NULL;
+			continue;
+		}
+
+		switch (field->type)
+		{
+			case F_LSTRING:
+			case F_GSTRING:
+
+				if (!index || (s = SF_Read(index)) == NULL)
+				{
+					*(char **)p = NULL;
+				}
+				else
+				{
+					*(char **)p = gi.TagMalloc(32 + index,
+							field->type == F_LSTRING ? TAG_LEVEL : TAG_GAME);
+					memcpy(*(char **)p, s, index);
+				}
+
+				break;
+			case F_EDICT:
+				*(edict_t **)p = index == -1 ? NULL : &g_edicts[index];
+				break;
+			case F_CLIENT:
+				*(gclient_t **)p = index == -1 ? NULL : &game.clients[index];
+				break;
+			case F_ITEM:
+				*(gitem_t **)p = index == -1 ? NULL : &itemlist[index];
+				break;
+			case F_FUNCTION:
+				*(byte **)p = index ? functionList[sf.funcorder[index - 1]].funcPtr : NULL;
+				break;
+			case F_MMOVE:
+				*(mmove_t **)p = index ? mmoveList[sf.mmoveorder[index - 1]].mmovePtr : NULL;
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+static void
+SF_Timing(const char *what, retro_time_t start, int count)
+{
+	if (!g_savetiming->value)
 	{
-		WriteField2(f, field, (byte *)client);
+		return;
 	}
+
+	gi.dprintf("%s %s: %i entries, %i bytes, %.2f ms\n", what, sf.filename,
+			count, sf.cursize, (cpu_features_get_time_usec() - start) * 0.001);
 }
 
+/* ========================================================= */
+
 /*
  * Read the client struct from a file
  */
@@ -775,24 +1438,22 @@ ReadClient(RFILE *f, gclient_t *client, short save_ver)
 void
 WriteGame(const char *filename, qboolean autosave)
 {
-	RFILE *f;
+	retro_time_t start;
+	int namesofs;
 	int i;
 	char str_ver[32];
 	char str_game[32];
 	char str_os[32];
 	char str_arch[32];
 
+	start = cpu_features_get_time_usec();
+
 	if (!autosave)
 	{
 		SaveClientData();
 	}
 
-	f = rfopen(filename, "wb");
-
-	if (!f)
-	{
-		gi.error("Couldn't open %s", filename);
-	}
+	SF_Begin(filename);
 
 	/* Savegame identification */
 	memset(str_ver, 0, sizeof(str_ver));
@@ -805,21 +1466,66 @@ WriteGame(const char *filename, qboolean autosave)
 	Q_strlcpy(str_os, YQ2OSTYPE, sizeof(str_os) - 1);
 	Q_strlcpy(str_arch, YQ2ARCH, sizeof(str_arch) - 1);
 
-	rfwrite(str_ver, sizeof(str_ver), 1, f);
-	rfwrite(str_game, sizeof(str_game), 1, f);
-	rfwrite(str_os, sizeof(str_os), 1, f);
-	rfwrite(str_arch, sizeof(str_arch), 1, f);
+	SF_Write(str_ver, sizeof(str_ver));
+	SF_Write(str_game, sizeof(str_game));
+	SF_Write(str_os, sizeof(str_os));
+	SF_Write(str_arch, sizeof(str_arch));
+
+	/* struct sizes for checking */
+	SF_WriteInt(sizeof(game_locals_t));
+	SF_WriteInt(sizeof(gclient_t));
+	namesofs = sf.cursize;
+	SF_WriteInt(0);
 
 	game.autosaved = autosave;
-	rfwrite(&game, sizeof(game), 1, f);
+	SF_Write(&game, sizeof(game));
 	game.autosaved = false;
 
 	for (i = 0; i < game.maxclients; i++)
 	{
-		WriteClient(f, &game.clients[i]);
+		SF_WriteBlock(clientfields, &game.clients[i], sizeof(gclient_t));
 	}
 
-	rfclose(f);
+	for (i = 0; i < game.maxclients; i++)
+	{
+		SF_WriteStrings(clientfields, (byte *)&game.clients[i]);
+	}
+
+	SF_WriteNames(namesofs);
+	SF_Save();
+
+	SF_Timing("WriteGame", start, game.maxclients);
+}
+
+/*
+ * Reads the rest of a YQ2-4 game
+ * file. Called by ReadGame.
+ */
+static void
+ReadGameBuffer(void)
+{
+	int i;
+
+	if (SF_ReadInt() != sizeof(game_locals_t) || SF_ReadInt() != sizeof(gclient_t))
+	{
+		gi.error("ReadGame: mismatched game or client size");
+	}
+
+	SF_ReadNames(SF_ReadInt());
+
+	SF_ReadBlock(&game, sizeof(game));
+	game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]),
+			TAG_GAME);
+
+	for (i = 0; i < game.maxclients; i++)
+	{
+		SF_ReadBlock(&game.clients[i], sizeof(gclient_t));
+	}
+
+	for (i = 0; i < game.maxclients; i++)
+	{
+		SF_ReadFields(clientfields, (byte *)&game.clients[i]);
+	}
 }
 
 /*
@@ -838,6 +1544,9 @@ ReadGame(const char *filename)
 	char str_arch[32];
 
 	short save_ver = 0;
+	retro_time_t start;
+
+	start = cpu_features_get_time_usec();
 
 	gi.FreeTags(TAG_GAME);
 
@@ -854,9 +1563,9 @@ ReadGame(const char *filename)
 	rfread(str_os, sizeof(str_os), 1, f);
 	rfread(str_arch, sizeof(str_arch), 1, f);
 
-	if (!strcmp(str_ver, SAVEGAMEVER))
+	if (!strcmp(str_ver, SAVEGAMEVER) || !strcmp(str_ver, "YQ2-3"))
 	{
-		save_ver = 3;
+		save_ver = !strcmp(str_ver, SAVEGAMEVER) ? 4 : 3;
 
 		if (strcmp(str_game, GAMEVERSION))
 		{
@@ -936,6 +1645,15 @@ ReadGame(const char *filename)
 	g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
 	globals.edicts = g_edicts;
 
+	if (save_ver >= 4)
+	{
+		SF_Begin(filename);
+		SF_Load(f);
+		ReadGameBuffer();
+		SF_Timing("ReadGame", start, game.maxclients);
+		return;
+	}
+
 	rfread(&game, sizeof(game), 1, f);
 	game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]),
 			TAG_GAME);
@@ -951,108 +1669,78 @@ ReadGame(const char *filename)
 /* ========================================================== */
 
 /*
- * Helper function to write the
- * edict into a file. Called by
- * WriteLevel.
+ * Writes the current level
+ * into a file.
  */
 void
-WriteEdict(RFILE *f, edict_t *ent)
+WriteLevel(const char *filename)
 {
-	field_t *field;
-	edict_t temp;
+	retro_time_t start;
+	int namesofs;
+	int count;
+	int i;
+	edict_t *ent;
 
-	/* all of the ints, floats, and vectors stay as they are */
-	temp = *ent;
+	start = cpu_features_get_time_usec();
 
-	/* change the pointers to lengths or indexes */
-	for (field = fields; field->name; field++)
-	{
-		WriteField1(f, field, (byte *)&temp);
-	}
+	SF_Begin(filename);
 
-	/* write the block */
-	rfwrite(&temp, sizeof(temp), 1, f);
+	/* write out struct sizes for checking */
+	SF_WriteInt(LEVELMAGIC);
+	SF_WriteInt(sizeof(edict_t));
+	SF_WriteInt(sizeof(level_locals_t));
+	namesofs = sf.cursize;
+	SF_WriteInt(0);
 
-	/* now write any allocated data following the edict */
-	for (field = fields; field->name; field++)
+	/* numbers of the entities in use */
+	for (i = 0, count = 0; i < globals.num_edicts; i++)
 	{
-		WriteField2(f, field, (byte *)ent);
+		if (g_edicts[i].inuse)
+		{
+			count++;
+		}
 	}
-}
 
-/*
- * Helper function to write the
- * level local data into a file.
- * Called by WriteLevel.
- */
-void
-WriteLevelLocals(RFILE *f)
-{
-	field_t *field;
-	level_locals_t temp;
+	SF_WriteInt(count);
 
-	/* all of the ints, floats, and vectors stay as they are */
-	temp = level;
-
-	/* change the pointers to lengths or indexes */
-	for (field = levelfields; field->name; field++)
+	for (i = 0; i < globals.num_edicts; i++)
 	{
-		WriteField1(f, field, (byte *)&temp);
+		if (g_edicts[i].inuse)
+		{
+			SF_WriteInt(i);
+		}
 	}
 
-	/* write the block */
-	rfwrite(&temp, sizeof(temp), 1, f);
+	/* level_locals_t and the entities */
+	SF_WriteBlock(levelfields, &level, sizeof(level));
 
-	/* now write any allocated data following the edict */
-	for (field = levelfields; field->name; field++)
+	for (i = 0; i < globals.num_edicts; i++)
 	{
-		WriteField2(f, field, (byte *)&level);
-	}
-}
-
-/*
- * Writes the current level
- * into a file.
- */
-void
-WriteLevel(const char *filename)
-{
-	int i;
-	edict_t *ent;
-	RFILE *f;
-
-	f = rfopen(filename, "wb");
+		ent = &g_edicts[i];
 
-	if (!f)
-	{
-		gi.error("Couldn't open %s", filename);
+		if (ent->inuse)
+		{
+			SF_WriteBlock(fields, ent, sizeof(edict_t));
+		}
 	}
 
-	/* write out edict size for checking */
-	i = sizeof(edict_t);
-	rfwrite(&i, sizeof(i), 1, f);
-
-	/* write out level_locals_t */
-	WriteLevelLocals(f);
+	/* and their strings */
+	SF_WriteStrings(levelfields, (byte *)&level);
 
-	/* write out all the entities */
 	for (i = 0; i < globals.num_edicts; i++)
 	{
 		ent = &g_edicts[i];
 
-		if (!ent->inuse)
+		if (ent->inuse)
 		{
-			continue;
+			SF_WriteStrings(fields, (byte *)ent);
 		}
-
-		rfwrite(&i, sizeof(i), 1, f);
-		WriteEdict(f, ent);
 	}
 
-	i = -1;
-	rfwrite(&i, sizeof(i), 1, f);
+	SF_WriteNames(namesofs);
+	SF_Save();
 
-	rfclose(f);
+	SF_Timing("WriteLevel", start, count);
 }
 
 /* ========================================================== */
@@ -1095,6 +1783,122 @@ ReadLevelLocals(RFILE *f)
 	}
 }
 
+/*
+ * Reads the rest of a level file
+ * from before YQ2-4. Called by
+ * ReadLevel.
+ */
+static void
+ReadLevelFile(RFILE *f)
+{
+	int entnum;
+	edict_t *ent;
+
+	/* load the level locals */
+	ReadLevelLocals(f);
+
+	/* load all the entities */
+	while (1)
+	{
+		if (rfread(&entnum, sizeof(entnum), 1, f) != 1)
+		{
+			rfclose(f);
+			gi.error("ReadLevel: failed to read entnum");
+		}
+
+		if (entnum == -1)
+		{
+			break;
+		}
+
+		if (entnum >= globals.num_edicts)
+		{
+			globals.num_edicts = entnum + 1;
+		}
+
+		ent = &g_edicts[entnum];
+		ReadEdict(f, ent);
+
+		/* let the server rebuild world links for this ent */
+		memset(&ent->area, 0, sizeof(ent->area));
+		gi.linkentity(ent);
+	}
+
+	rfclose(f);
+}
+
+/*
+ * Reads the rest of a YQ2-4 level
+ * file, returns the number of
+ * entities. Called by ReadLevel.
+ */
+static int
+ReadLevelBuffer(void)
+{
+	const byte *entnums;
+	int entnum;
+	int count;
+	int i;
+	edict_t *ent;
+
+	if (SF_ReadInt() != sizeof(edict_t))
+	{
+		gi.error("ReadLevel: mismatched edict size");
+	}
+
+	if (SF_ReadInt() != sizeof(level_locals_t))
+	{
+		gi.error("ReadLevel: mismatched level size");
+	}
+
+	SF_ReadNames(SF_ReadInt());
+
+	count = SF_ReadInt();
+
+	if (count < 0 || count > game.maxentities)
+	{
+		gi.error("ReadLevel: bad entity count %i", count);
+	}
+
+	entnums = SF_Read(count * sizeof(int));
+
+	/* load the level locals and the entities */
+	SF_ReadBlock(&level, sizeof(level));
+
+	for (i = 0; i < count; i++)
+	{
+		memcpy(&entnum, entnums + i * sizeof(int), sizeof(int));
+
+		if (entnum < 0 || entnum >= game.maxentities)
+		{
+			gi.error("ReadLevel: bad entnum %i", entnum);
+		}
+
+		if (entnum >= globals.num_edicts)
+		{
+			globals.num_edicts = entnum + 1;
+		}
+
+		SF_ReadBlock(&g_edicts[entnum], sizeof(edict_t));
+	}
+
+	/* then fix up their pointers */
+	SF_ReadFields(levelfields, (byte *)&level);
+
+	for (i = 0; i < count; i++)
+	{
+		memcpy(&entnum, entnums + i * sizeof(int), sizeof(int));
+		ent = &g_edicts[entnum];
+		SF_ReadFields(fields, (byte *)ent);
+
+		/* let the server rebuild world links for this ent */
+		memset(&ent->area, 0, sizeof(ent->area));
+		gi.linkentity(ent);
+	}
+
+	return count;
+}
+
 /*
  * Reads a level back into the memory.
  * SpawnEntities were already called
@@ -1107,11 +1911,14 @@ ReadLevelLocals(RFILE *f)
 void
 ReadLevel(const char *filename)
 {
-	int entnum;
+	retro_time_t start;
+	int count;
 	RFILE *f;
 	int i;
 	edict_t *ent;
 
+	start = cpu_features_get_time_usec();
+
 	f = rfopen(filename, "rb");
 
 	if (!f)
@@ -1130,44 +1937,24 @@ ReadLevel(const char *filename)
 	/* check edict size */
 	rfread(&i, sizeof(i), 1, f);
 
-	if (i != sizeof(edict_t))
+	if (i == LEVELMAGIC)
 	{
-		rfclose(f);
-		gi.error("ReadLevel: mismatched edict size");
+		SF_Begin(filename);
+		SF_Load(f);
+		count = ReadLevelBuffer();
+		SF_Timing("ReadLevel", start, count);
 	}
-
-	/* load the level locals */
-	ReadLevelLocals(f);
-
-	/* load all the entities */
-	while (1)
+	else
 	{
-		if (rfread(&entnum, sizeof(entnum), 1, f) != 1)
+		if (i != sizeof(edict_t))
 		{
 			rfclose(f);
-			gi.error("ReadLevel: failed to read entnum");
-		}
-
-		if (entnum == -1)
-		{
-			break;
+			gi.error("ReadLevel: mismatched edict size");
 		}
 
-		if (entnum >= globals.num_edicts)
-		{
-			globals.num_edicts = entnum + 1;
-		}
-
-		ent = &g_edicts[entnum];
-		ReadEdict(f, ent);
-
-		/* let the server rebuild world links for this ent */
-		memset(&ent->area, 0, sizeof(ent->area));
-		gi.linkentity(ent);
+		ReadLevelFile(f);
 	}
 
-	rfclose(f);
-
 	/* mark all clients as unconnected */
 	for (i = 0; i < maxclients->value; i++)
 	{
@@ -1196,3 +1983,303 @@ ReadLevel(const char *filename)
 		}
 	}
 }
+
+/* ========================================================== */
+
+/*
+ * Savestates for the frontend. The
+ * game and the level are written to
+ * memory like a YQ2-4 savegame, so
+ * this is fast enough to run every
+ * frame. Freed edicts are kept too,
+ * G_Spawn looks at their freetime.
+ * g_edicts and game.clients stay
+ * where they are, so states only
+ * load into the same game.
+ */
+#define STATEMAGIC (('2' << 24) + ('T' << 16) + ('S' << 8) + 'Y')
+
+/*
+ * Size of a state without the
+ * strings. The names cover both
+ * lists in the worst case.
+ */
+static int
+StateBlocksSize(int num_edicts)
+{
+	static int names;
+	int i;
+
+	if (!names)
+	{
+		for (i = 0; i < NUM_FUNCTIONS; i++)
+		{
+			names += strlen(functionList[i].funcStr) + 1;
+		}
+
+		for (i = 0; i < NUM_MMOVES; i++)
+		{
+			names += strlen(mmoveList[i].mmoveStr) + 1;
+		}
+	}
+
+	return 9 * sizeof(int) + sizeof(game_locals_t) + sizeof(level_locals_t)
+		+ game.maxclients * sizeof(gclient_t) + num_edicts * sizeof(edict_t)
+		+ randk_statesize() + 2 * sizeof(int) + names;
+}
+
+/*
+ * The strings get an allowance
+ * per entity.
+ */
+int
+StateSize(void)
+{
+	return StateBlocksSize(game.maxentities) + game.maxentities * 256;
+}
+
+int
+WriteState(byte *buf, int size)
+{
+	retro_time_t start;
+	int namesofs;
+	int i;
+
+	start = cpu_features_get_time_usec();
+
+	/* make sure it fits before writing
+	   into the frontend's buffer */
+	namesofs = StateBlocksSize(globals.num_edicts);
+
+	for (i = 0; i < game.maxclients; i++)
+	{
+		namesofs += SF_StringsSize(clientfields, (byte *)&game.clients[i]);
+	}
+
+	namesofs += SF_StringsSize(levelfields, (byte *)&level);
+
+	for (i = 0; i < globals.num_edicts; i++)
+	{
+		namesofs += SF_StringsSize(fields, (byte *)&g_edicts[i]);
+	}
+
+	if (namesofs > size)
+	{
+		gi.dprintf("WriteState: %i bytes needed, the buffer has %i\n",
+				namesofs, size);
+		return 0;
+	}
+
+	/* write straight into the frontend's buffer */
+	SF_Begin("savestate");
+	sf.state = true;
+	sf.data = buf;
+	sf.maxsize = size;
+
+	SF_WriteInt(STATEMAGIC);
+	SF_WriteInt(sizeof(game_locals_t));
+	SF_WriteInt(sizeof(gclient_t));
+	SF_WriteInt(sizeof(level_locals_t));
+	SF_WriteInt(sizeof(edict_t));
+	SF_WriteInt(game.maxclients);
+	SF_WriteInt(game.maxentities);
+	namesofs = sf.cursize;
+	SF_WriteInt(0);
+	SF_WriteInt(globals.num_edicts);
+
+	/* the blocks */
+	SF_Write(&game, sizeof(game));
+
+	for (i = 0; i < game.maxclients; i++)
+	{
+		SF_WriteBlock(clientfields, &game.clients[i], sizeof(gclient_t));
+	}
+
+	SF_WriteBlock(levelfields, &level, sizeof(level));
+
+	for (i = 0; i < globals.num_edicts; i++)
+	{
+		SF_WriteBlock(fields, &g_edicts[i], sizeof(edict_t));
+	}
+
+	/* their strings */
+	for (i = 0; i < game.maxclients; i++)
+	{
+		SF_WriteStrings(clientfields, (byte *)&game.clients[i]);
+	}
+
+	SF_WriteStrings(levelfields, (byte *)&level);
+
+	for (i = 0; i < globals.num_edicts; i++)
+	{
+		SF_WriteStrings(fields, (byte *)&g_edicts[i]);
+	}
+
+	randk_writestate(SF_Alloc(randk_statesize()));
+
+	SF_WriteNames(namesofs);
+
+	if (sf.failed)
+	{
+		return 0;
+	}
+
+	SF_Timing("WriteState", start, globals.num_edicts);
+
+	return sf.cursize;
+}
+
+/*
+ * The whole state is checked before
+ * anything is changed, a bad one
+ * leaves the game as it was. The
+ * server has unlinked all entities
+ * before this is called.
+ */
+qboolean
+ReadState(const byte *buf, int size)
+{
+	retro_time_t start;
+	game_locals_t keep;
+	const byte *block;
+	const void *randstate;
+	int blocks;
+	int namesofs;
+	int num_edicts;
+	int i;
+	edict_t *ent;
+
+	start = cpu_features_get_time_usec();
+
+	/* read straight from the frontend's buffer */
+	SF_Begin("savestate");
+	sf.state = true;
+	sf.data = (byte *)buf;
+	sf.maxsize = sf.cursize = size;
+
+	if (size < 9 * (int)sizeof(int)
+		|| SF_ReadInt() != STATEMAGIC
+		|| SF_ReadInt() != sizeof(game_locals_t)
+		|| SF_ReadInt() != sizeof(gclient_t)
+		|| SF_ReadInt() != sizeof(level_locals_t)
+		|| SF_ReadInt() != sizeof(edict_t)
+		|| SF_ReadInt() != game.maxclients
+		|| SF_ReadInt() != game.maxentities)
+	{
+		return false;
+	}
+
+	namesofs = SF_ReadInt();
+	num_edicts = SF_ReadInt();
+
+	if (num_edicts <= game.maxclients || num_edicts > game.maxentities)
+	{
+		return false;
+	}
+
+	if (!SF_ReadNames(namesofs))
+	{
+		return false;
+	}
+
+	/* check the blocks and step over
+	   their strings */
+	blocks = sf.readcount;
+
+	if (!SF_Read(sizeof(game_locals_t) + game.maxclients * sizeof(gclient_t)
+			+ sizeof(level_locals_t) + num_edicts * sizeof(edict_t)))
+	{
+		return false;
+	}
+
+	block = buf + blocks + sizeof(game_locals_t);
+
+	for (i = 0; i < game.maxclients; i++, block += sizeof(gclient_t))
+	{
+		if (!SF_CheckFields(clientfields, block))
+		{
+			return false;
+		}
+	}
+
+	if (!SF_CheckFields(levelfields, block))
+	{
+		return false;
+	}
+
+	block += sizeof(level_locals_t);
+
+	for (i = 0; i < num_edicts; i++, block += sizeof(edict_t))
+	{
+		if (!SF_CheckFields(fields, block))
+		{
+			return false;
+		}
+	}
+
+	if ((randstate = SF_Read(randk_statesize())) == NULL)
+	{
+		return false;
+	}
+
+	/* nothing can go wrong from here on,
+	   everything allocated for the level
+	   is read back from the state */
+	sf.readcount = blocks;
+	gi.FreeTags(TAG_LEVEL);
+
+	keep = game;
+	SF_ReadBlock(&game, sizeof(game));
+	game.clients = keep.clients;
+	game.maxclients = keep.maxclients;
+	game.maxentities = keep.maxentities;
+	game.num_items = keep.num_items;
+
+	for (i = 0; i < game.maxclients; i++)
+	{
+		SF_ReadBlock(&game.clients[i], sizeof(gclient_t));
+	}
+
+	SF_ReadBlock(&level, sizeof(level));
+
+	/* edicts past the end stay cleared */
+	if (num_edicts < globals.num_edicts)
+	{
+		memset(g_edicts + num_edicts, 0,
+				(globals.num_edicts - num_edicts) * sizeof(g_edicts[0]));
+	}
+
+	globals.num_edicts = num_edicts;
+
+	SF_ReadBlock(g_edicts, num_edicts * sizeof(g_edicts[0]));
+
+	for (i = 0; i < game.maxclients; i++)
+	{
+		SF_ReadFields(clientfields, (byte *)&game.clients[i]);
+	}
+
+	SF_ReadFields(levelfields, (byte *)&level);
+
+	for (i = 0; i < num_edicts; i++)
+	{
+		ent = &g_edicts[i];
+		SF_ReadFields(fields, (byte *)ent);
+
+		/* client pointers aren't in the field
+		   list, they go by entity number */
+		ent->client = i >= 1 && i <= game.maxclients ? &game.clients[i - 1] : NULL;
+
+		memset(&ent->area, 0, sizeof(ent->area));
+
+		if (ent->inuse)
+		{
+			gi.linkentity(ent);
+		}
+	}
+
+	randk_readstate(randstate);
+
+	SF_Timing("ReadState", start, num_edicts);
+
+	return true;
+}
@@ -31,19 +31,12 @@ extern void ReadLevel ( const char * filename ) ;
 extern void ReadLevelLocals ( RFILE * f ) ;
 extern void ReadEdict ( RFILE * f , edict_t * ent ) ;
 extern void WriteLevel ( const char * filename ) ;
-extern void WriteLevelLocals ( RFILE * f ) ;
-extern void WriteEdict ( RFILE * f , edict_t * ent ) ;
 extern void ReadGame ( const char * filename ) ;
 extern void WriteGame ( const char * filename , qboolean autosave ) ;
 extern void ReadClient ( RFILE * f , gclient_t * client , short save_ver ) ;
-extern void WriteClient ( RFILE * f , gclient_t * client ) ;
 extern void ReadField ( RFILE * f , field_t * field , byte * base ) ;
-extern void WriteField2 ( RFILE * f , field_t * field , byte * base ) ;
-extern void WriteField1 ( RFILE * f , field_t * field , byte * base ) ;
 extern mmove_t * FindMmoveByName ( char * name ) ;
-extern mmoveList_t * GetMmoveByAddress ( mmove_t * adr ) ;
 extern byte * FindFunctionByName ( char * name ) ;
-extern functionList_t * GetFunctionByAddress ( byte * adr ) ;
 extern void InitGame ( void ) ;
 extern void Info_SetValueForKey ( char * s , char * key , char * value ) ;
 extern qboolean Info_Validate ( char * s ) ;
@@ -29,19 +29,12 @@
 {"ReadLevelLocals", (byte *)ReadLevelLocals},
 {"ReadEdict", (byte *)ReadEdict},
 {"WriteLevel", (byte *)WriteLevel},
-{"WriteLevelLocals", (byte *)WriteLevelLocals},
-{"WriteEdict", (byte *)WriteEdict},
 {"ReadGame", (byte *)ReadGame},
 {"WriteGame", (byte *)WriteGame},
 {"ReadClient", (byte *)ReadClient},
-{"WriteClient", (byte *)WriteClient},
 {"ReadField", (byte *)ReadField},
-{"WriteField2", (byte *)WriteField2},
-{"WriteField1", (byte *)WriteField1},
 {"FindMmoveByName", (byte *)FindMmoveByName},
-{"GetMmoveByAddress", (byte *)GetMmoveByAddress},
 {"FindFunctionByName", (byte *)FindFunctionByName},
-{"GetFunctionByAddress", (byte *)GetFunctionByAddress},
 {"InitGame", (byte *)InitGame},
 {"Info_SetValueForKey", (byte *)Info_SetValueForKey},
 {"Info_Validate", (byte *)Info_Validate},
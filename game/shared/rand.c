@@ -14,6 +14,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #define QSIZE 0x200000
 #define CNG (cng = 6906969069ULL * cng + 13579)
@@ -25,6 +26,14 @@ static int j;
 static uint64_t carry;
 static uint64_t xs;
 static uint64_t cng;
+static uint64_t count; /* numbers drawn, for savestates */
+
+/* where the last randk_seed() started */
+static int seed_j;
+static uint64_t seed_count;
+static uint64_t seed_carry;
+static uint64_t seed_xs;
+static uint64_t seed_cng;
 
 uint64_t
 B64MWC(void)
@@ -32,6 +41,7 @@ B64MWC(void)
 	uint64_t t, x;
 
 	j = (j + 1) & (QSIZE - 1);
+	count++;
 	x = QARY[j];
 	t = (x << 28) + carry;
 	carry = (x >> 36) - (t < x);
@@ -74,18 +84,34 @@ crandk(void)
 }
 
 /*
- * Seeds the PRNG
+ * Fills QARY[] from CNG+XS
  */
-void
-randk_seed(void)
+static void
+randk_fill(void)
 {
 	uint64_t i;
 
-	/* Seed QARY[] with CNG+XS: */
 	for (i = 0; i < QSIZE; i++)
 	{
 		QARY[i] = CNG + XS;
 	}
+}
+
+/*
+ * Seeds the PRNG
+ */
+void
+randk_seed(void)
+{
+	uint64_t i;
+
+	seed_j = j;
+	seed_count = count;
+	seed_carry = carry;
+	seed_xs = xs;
+	seed_cng = cng;
+
+	randk_fill();
 
 	/* Run through several rounds
 	   to warm up the state */
@@ -95,3 +121,183 @@ randk_seed(void)
 	}
 }
 
+
+/*
+ * Savestates keep the generator
+ * position, the part of QARY[] used
+ * next and where the last seed
+ * started. B64MWC() can be run
+ * backwards, so a state taken
+ * earlier on the same run gets the
+ * rest of QARY[] back by undoing
+ * the numbers drawn since. That
+ * covers rewind, run-ahead and
+ * netplay rollback. Any other state,
+ * like one sent to a netplay peer or
+ * loaded after a restart, is rebuilt
+ * by seeding again and drawing up to
+ * its count, which takes longer but
+ * gives the same numbers. The whole
+ * array is too big to copy every
+ * frame.
+ */
+#define RANDK_WINDOW 8192
+#define MWC_MULT ((1ULL << 28) - 1)
+
+typedef struct
+{
+	int j;
+	uint64_t count;
+	uint64_t carry;
+	uint64_t xs;
+	uint64_t cng;
+	int seed_j;
+	uint64_t seed_count;
+	uint64_t seed_carry;
+	uint64_t seed_xs;
+	uint64_t seed_cng;
+} randkhead_t;
+
+
+/*
+ * Undoes one B64MWC() call. The
+ * call turned QARY[j] and carry into
+ * carry * 2^64 + QARY[j] =
+ * x * (2^28 - 1) + old carry, and
+ * the old carry is always smaller
+ * than 2^28 - 1.
+ */
+static void
+B64MWC_Undo(void)
+{
+	uint64_t r, hi, lo;
+
+	/* (carry:QARY[j]) / MWC_MULT in 32 bit steps */
+	r = carry;
+	r = (r << 32) | (QARY[j] >> 32);
+	hi = r / MWC_MULT;
+	r %= MWC_MULT;
+	r = (r << 32) | (QARY[j] & 0xffffffff);
+	lo = r / MWC_MULT;
+	r %= MWC_MULT;
+
+	QARY[j] = (hi << 32) | lo;
+	carry = r;
+	j = (j - 1) & (QSIZE - 1);
+}
+
+int
+randk_statesize(void)
+{
+	return sizeof(randkhead_t) + RANDK_WINDOW * sizeof(uint64_t);
+}
+
+/*
+ * The state isn't aligned in the
+ * savestate, so it's copied in and
+ * out with memcpy.
+ */
+void
+randk_writestate(void *buf)
+{
+	randkhead_t head;
+	char *next;
+	int n;
+
+	head.j = j;
+	head.count = count;
+	head.carry = carry;
+	head.xs = xs;
+	head.cng = cng;
+	head.seed_j = seed_j;
+	head.seed_count = seed_count;
+	head.seed_carry = seed_carry;
+	head.seed_xs = seed_xs;
+	head.seed_cng = seed_cng;
+	memcpy(buf, &head, sizeof(head));
+
+	/* QARY[j + 1] onwards, wrapping around */
+	next = (char *)buf + sizeof(head);
+	n = QSIZE - 1 - j;
+
+	if (n >= RANDK_WINDOW)
+	{
+		memcpy(next, &QARY[j + 1], RANDK_WINDOW * sizeof(uint64_t));
+	}
+	else
+	{
+		memcpy(next, &QARY[j + 1], n * sizeof(uint64_t));
+		memcpy(next + n * sizeof(uint64_t), QARY,
+				(RANDK_WINDOW - n) * sizeof(uint64_t));
+	}
+}
+
+void
+randk_readstate(const void *buf)
+{
+	randkhead_t head;
+	const char *next;
+	uint64_t undo, i;
+	uint64_t word;
+	int restored;
+	int n;
+
+	memcpy(&head, buf, sizeof(head));
+	head.j &= QSIZE - 1;
+	head.seed_j &= QSIZE - 1;
+	next = (const char *)buf + sizeof(head);
+
+	/* walk back to the state's position
+	   if it was taken earlier on this run */
+	undo = count - head.count;
+	restored = 0;
+
+	if (head.count <= count && undo < QSIZE
+		&& ((j - head.j) & (QSIZE - 1)) == (int)undo)
+	{
+		for (i = 0; i < undo; i++)
+		{
+			B64MWC_Undo();
+		}
+
+		/* if the run was a different one
+		   the carry gives it away */
+		restored = (carry == head.carry);
+	}
+
+	/* otherwise seed like the state's
+	   run did and draw up to its count */
+	if (!restored && head.seed_count <= head.count)
+	{
+		j = head.seed_j;
+		count = head.seed_count;
+		carry = head.seed_carry;
+		xs = head.seed_xs;
+		cng = head.seed_cng;
+
+		seed_j = j;
+		seed_count = count;
+		seed_carry = carry;
+		seed_xs = xs;
+		seed_cng = cng;
+
+		randk_fill();
+
+		while (count < head.count)
+		{
+			randk();
+		}
+	}
+
+	j = head.j;
+	count = head.count;
+	carry = head.carry;
+	xs = head.xs;
+	cng = head.cng;
+
+	for (n = 0; n < RANDK_WINDOW; n++)
+	{
+		memcpy(&word, next + n * sizeof(uint64_t), sizeof(word));
+		QARY[(j + 1 + n) & (QSIZE - 1)] = word;
+	}
+}
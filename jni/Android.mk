@@ -4,7 +4,7 @@ HAVE_CDAUDIO := 1
 
 include $(LOCAL_PATH)/../Makefile.common
 
-COREFLAGS := -DINLINE=inline -DHAVE_STDINT_H -DHAVE_INTTYPES_H -D__LIBRETRO__ -DLIBRETRO -DHAVE_CDAUDIO -DHAVE_STB_VORBIS -DGAME_HARD_LINKED=1 -DREF_HARD_LINKED -fPIC
+COREFLAGS := -DINLINE=inline -DHAVE_STDINT_H -DHAVE_INTTYPES_H -D__LIBRETRO__ -DLIBRETRO -DHAVE_CDAUDIO -DHAVE_STB_VORBIS -DHAVE_QTHREADS -DGAME_HARD_LINKED=1 -DREF_HARD_LINKED -fPIC
 
 ifeq ($(basegame),xatrix)
 COREFLAGS += -DXATRIX
@@ -26,6 +26,7 @@
 
 #include <core_audio_mixer.h>
 #include <audio/audio_resampler.h>
+#include <libretro_thread.h>
 
 #ifdef HAVE_RWAV
 #include <formats/rwav.h>
@@ -64,6 +65,12 @@
 #define CORE_AUDIO_MIXER_MAX_VOICES     1
 #define CORE_AUDIO_MIXER_TEMP_BUFFER 8192
 
+/* Samples a decoder thread produces per pass */
+#define CORE_AUDIO_MIXER_STREAM_CHUNK 2048
+#define CORE_AUDIO_MIXER_STREAM_DEFAULT_FRAMES 16384
+
+typedef struct core_audio_mixer_stream core_audio_mixer_stream_t;
+
 struct core_audio_mixer_sound
 {
    enum core_audio_mixer_type type;
@@ -184,11 +191,54 @@ struct core_audio_mixer_voice
    float    volume;
    bool     repeat;
 
+   /* Set on a voice that is decoded by a background thread */
+   core_audio_mixer_stream_t *stream;
+   /* Set on the decoder's private copy of that voice */
+   core_audio_mixer_stream_t *owner;
+};
+
+/* A streamed voice is decoded ahead of time by its own thread into a
+ * single producer / single consumer ring, so the audio callback only
+ * has to copy samples out of it. */
+struct core_audio_mixer_stream
+{
+   core_audio_mixer_voice_t decoder;
+   qthread_t         *thread;
+   float             *ring;
+   unsigned           ring_size;     /* samples, power of two */
+   volatile unsigned  read_pos;      /* free running sample counts */
+   volatile unsigned  write_pos;
+   volatile unsigned  repeats;
+   volatile unsigned  finished;
+   volatile unsigned  quit;
+   unsigned           repeats_seen;
+   float              chunk[CORE_AUDIO_MIXER_STREAM_CHUNK];
 };
 
 /* TODO/FIXME - static globals */
 static struct core_audio_mixer_voice core_s_voices[CORE_AUDIO_MIXER_MAX_VOICES] = {0};
 static unsigned core_s_rate = 0;
+static unsigned core_s_stream_frames = CORE_AUDIO_MIXER_STREAM_DEFAULT_FRAMES;
+static unsigned core_s_underruns = 0;
+
+static void core_audio_mixer_stream_start(core_audio_mixer_voice_t *voice);
+static void core_audio_mixer_stream_free(core_audio_mixer_voice_t *voice);
+
+static void core_audio_mixer_voice_event(core_audio_mixer_voice_t *voice,
+      unsigned reason)
+{
+   /* Decoder threads only count the repeat, the callbacks are
+    * made by the mixer when the stream actually gets there */
+   if (voice->owner)
+   {
+      if (reason == CORE_AUDIO_MIXER_SOUND_REPEATED)
+         qatomic_add(&voice->owner->repeats, 1);
+      return;
+   }
+
+   if (voice->stop_cb)
+      voice->stop_cb(voice->sound, reason);
+}
 
 #ifdef HAVE_RWAV
 static bool wav_to_float(const rwav_t* wav, float** pcm, size_t samples_out)
@@ -319,7 +369,25 @@ void core_audio_mixer_done(void)
    unsigned i;
 
    for (i = 0; i < CORE_AUDIO_MIXER_MAX_VOICES; i++)
+   {
+      core_audio_mixer_stream_free(&core_s_voices[i]);
       core_s_voices[i].type = CORE_AUDIO_MIXER_TYPE_NONE;
+   }
+}
+
+void core_audio_mixer_set_stream_frames(unsigned frames)
+{
+   core_s_stream_frames = frames;
+}
+
+unsigned core_audio_mixer_get_stream_frames(void)
+{
+   return core_s_stream_frames;
+}
+
+unsigned core_audio_mixer_get_underruns(void)
+{
+   return core_s_underruns;
 }
 
 core_audio_mixer_sound_t* core_audio_mixer_load_wav(void *buffer, int32_t size,
@@ -871,6 +939,10 @@ core_audio_mixer_voice_t* core_audio_mixer_play(core_audio_mixer_sound_t* sound,
       voice->volume   = volume;
       voice->sound    = sound;
       voice->stop_cb  = stop_cb;
+      voice->stream   = NULL;
+      voice->owner    = NULL;
+
+      core_audio_mixer_stream_start(voice);
    }
    else
       voice = NULL;
@@ -888,6 +960,7 @@ void core_audio_mixer_stop(core_audio_mixer_voice_t* voice)
       stop_cb     = voice->stop_cb;
       sound       = voice->sound;
 
+      core_audio_mixer_stream_free(voice);
       voice->type = CORE_AUDIO_MIXER_TYPE_NONE;
 
       if (stop_cb)
@@ -915,8 +988,7 @@ again:
 
       if (voice->repeat)
       {
-         if (voice->stop_cb)
-            voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_REPEATED);
+         core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_REPEATED);
 
          buf_free                  -= pcm_available;
          pcm_available              = sound->types.wav.frames * 2;
@@ -925,8 +997,7 @@ again:
          goto again;
       }
 
-      if (voice->stop_cb)
-         voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_FINISHED);
+      core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_FINISHED);
 
       voice->type = CORE_AUDIO_MIXER_TYPE_NONE;
    }
@@ -964,15 +1035,13 @@ again:
       {
          if (voice->repeat)
          {
-            if (voice->stop_cb)
-               voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_REPEATED);
+            core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_REPEATED);
 
             stb_vorbis_seek_start(voice->types.ogg.stream);
             goto again;
          }
 
-         if (voice->stop_cb)
-            voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_FINISHED);
+         core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_FINISHED);
 
          voice->type = CORE_AUDIO_MIXER_TYPE_NONE;
          goto cleanup;
@@ -1042,15 +1111,13 @@ again:
       {
          if (voice->repeat)
          {
-            if (voice->stop_cb)
-               voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_REPEATED);
+            core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_REPEATED);
 
             replay_seek( voice->types.mod.stream, 0);
             goto again;
          }
 
-         if (voice->stop_cb)
-            voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_FINISHED);
+         core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_FINISHED);
 
          voice->type = CORE_AUDIO_MIXER_TYPE_NONE;
          return;
@@ -1106,15 +1173,13 @@ again:
       {
          if (voice->repeat)
          {
-            if (voice->stop_cb)
-               voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_REPEATED);
+            core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_REPEATED);
 
             drflac_seek_to_sample(voice->types.flac.stream,0);
             goto again;
          }
 
-         if (voice->stop_cb)
-            voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_FINISHED);
+         core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_FINISHED);
 
          voice->type = CORE_AUDIO_MIXER_TYPE_NONE;
          return;
@@ -1177,15 +1242,13 @@ again:
       {
          if (voice->repeat)
          {
-            if (voice->stop_cb)
-               voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_REPEATED);
+            core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_REPEATED);
 
             drmp3_seek_to_frame(&voice->types.mp3.stream,0);
             goto again;
          }
 
-         if (voice->stop_cb)
-            voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_FINISHED);
+         core_audio_mixer_voice_event(voice, CORE_AUDIO_MIXER_SOUND_FINISHED);
 
          voice->type = CORE_AUDIO_MIXER_TYPE_NONE;
          return;
@@ -1226,6 +1289,172 @@ again:
 }
 #endif
 
+static void core_audio_mixer_mix_voice(float* buffer, size_t num_frames,
+      core_audio_mixer_voice_t* voice, float volume)
+{
+   switch (voice->type)
+   {
+      case CORE_AUDIO_MIXER_TYPE_WAV:
+         core_audio_mixer_mix_wav(buffer, num_frames, voice, volume);
+         break;
+      case CORE_AUDIO_MIXER_TYPE_OGG:
+#ifdef HAVE_STB_VORBIS
+         core_audio_mixer_mix_ogg(buffer, num_frames, voice, volume);
+#endif
+         break;
+      case CORE_AUDIO_MIXER_TYPE_MOD:
+#ifdef HAVE_IBXM
+         core_audio_mixer_mix_mod(buffer, num_frames, voice, volume);
+#endif
+         break;
+      case CORE_AUDIO_MIXER_TYPE_FLAC:
+#ifdef HAVE_DR_FLAC
+         core_audio_mixer_mix_flac(buffer, num_frames, voice, volume);
+#endif
+         break;
+         case CORE_AUDIO_MIXER_TYPE_MP3:
+#ifdef HAVE_DR_MP3
+         core_audio_mixer_mix_mp3(buffer, num_frames, voice, volume);
+#endif
+         break;
+      case CORE_AUDIO_MIXER_TYPE_NONE:
+         break;
+   }
+}
+
+static void core_audio_mixer_stream_thread(void *data)
+{
+   unsigned i, pos, space;
+   core_audio_mixer_stream_t *stream = (core_audio_mixer_stream_t*)data;
+   unsigned mask                     = stream->ring_size - 1;
+
+   while (!qatomic_load(&stream->quit))
+   {
+      space = stream->ring_size -
+         (stream->write_pos - qatomic_load(&stream->read_pos));
+
+      if (space < CORE_AUDIO_MIXER_STREAM_CHUNK)
+      {
+         qthread_sleep(2);
+         continue;
+      }
+
+      memset(stream->chunk, 0, sizeof(stream->chunk));
+      core_audio_mixer_mix_voice(stream->chunk,
+            CORE_AUDIO_MIXER_STREAM_CHUNK / 2, &stream->decoder, 1.0f);
+
+      pos = stream->write_pos;
+      for (i = 0; i < CORE_AUDIO_MIXER_STREAM_CHUNK; i++)
+         stream->ring[(pos + i) & mask] = stream->chunk[i];
+      qatomic_store(&stream->write_pos, pos + CORE_AUDIO_MIXER_STREAM_CHUNK);
+
+      if (stream->decoder.type == CORE_AUDIO_MIXER_TYPE_NONE)
+      {
+         qatomic_store(&stream->finished, 1);
+         break;
+      }
+   }
+}
+
+/* Hands decoding of a freshly started voice to a background thread.
+ * Leaves the voice to be decoded in the audio callback on failure. */
+static void core_audio_mixer_stream_start(core_audio_mixer_voice_t *voice)
+{
+   unsigned size;
+   core_audio_mixer_stream_t *stream = NULL;
+
+   if (!core_s_stream_frames || voice->type == CORE_AUDIO_MIXER_TYPE_WAV)
+      return;
+
+   /* Round the ring up to a power of two, at least two chunks */
+   for (size = CORE_AUDIO_MIXER_STREAM_CHUNK * 2;
+         size < core_s_stream_frames * 2; size <<= 1);
+
+   stream = (core_audio_mixer_stream_t*)calloc(1, sizeof(*stream));
+   if (!stream)
+      return;
+
+   stream->ring = (float*)memalign_alloc(16, size * sizeof(float));
+   if (!stream->ring)
+   {
+      free(stream);
+      return;
+   }
+
+   stream->ring_size      = size;
+   stream->decoder        = *voice;
+   stream->decoder.owner  = stream;
+   stream->decoder.stream = NULL;
+
+   stream->thread = qthread_create(core_audio_mixer_stream_thread, stream);
+   if (!stream->thread)
+   {
+      memalign_free(stream->ring);
+      free(stream);
+      return;
+   }
+
+   voice->stream = stream;
+}
+
+static void core_audio_mixer_stream_free(core_audio_mixer_voice_t *voice)
+{
+   core_audio_mixer_stream_t *stream = voice->stream;
+
+   if (!stream)
+      return;
+
+   qatomic_store(&stream->quit, 1);
+   qthread_join(stream->thread);
+
+   /* Hand the decoder state back, so a later play on this
+    * voice releases the codec the same way as before */
+   voice->types  = stream->decoder.types;
+   voice->stream = NULL;
+
+   memalign_free(stream->ring);
+   free(stream);
+}
+
+static void core_audio_mixer_mix_stream(float* buffer, size_t num_frames,
+      core_audio_mixer_voice_t* voice,
+      float volume)
+{
+   unsigned i, pos, avail, count;
+   core_audio_mixer_stream_t *stream = voice->stream;
+   unsigned mask                     = stream->ring_size - 1;
+   unsigned need                     = (unsigned)(num_frames * 2);
+   unsigned repeats                  = qatomic_load(&stream->repeats);
+
+   for (; stream->repeats_seen != repeats; stream->repeats_seen++)
+      if (voice->stop_cb)
+         voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_REPEATED);
+
+   pos   = stream->read_pos;
+   avail = qatomic_load(&stream->write_pos) - pos;
+   count = (avail < need) ? avail : need;
+
+   for (i = 0; i < count; i++)
+      *buffer++ += stream->ring[(pos + i) & mask] * volume;
+
+   qatomic_store(&stream->read_pos, pos + count);
+
+   if (count < need)
+   {
+      if (qatomic_load(&stream->finished) &&
+            qatomic_load(&stream->write_pos) == stream->read_pos)
+      {
+         core_audio_mixer_stream_free(voice);
+         voice->type = CORE_AUDIO_MIXER_TYPE_NONE;
+
+         if (voice->stop_cb)
+            voice->stop_cb(voice->sound, CORE_AUDIO_MIXER_SOUND_FINISHED);
+      }
+      else if (pos + count)
+         core_s_underruns++;   /* not while the thread is still priming */
+   }
+}
+
 void core_audio_mixer_mix(float* buffer, size_t num_frames,
       float volume_override, bool override)
 {
@@ -1238,34 +1467,13 @@ void core_audio_mixer_mix(float* buffer, size_t num_frames,
    {
       float volume = (override) ? volume_override : voice->volume;
 
-      switch (voice->type)
-      {
-         case CORE_AUDIO_MIXER_TYPE_WAV:
-            core_audio_mixer_mix_wav(buffer, num_frames, voice, volume);
-            break;
-         case CORE_AUDIO_MIXER_TYPE_OGG:
-#ifdef HAVE_STB_VORBIS
-            core_audio_mixer_mix_ogg(buffer, num_frames, voice, volume);
-#endif
-            break;
-         case CORE_AUDIO_MIXER_TYPE_MOD:
-#ifdef HAVE_IBXM
-            core_audio_mixer_mix_mod(buffer, num_frames, voice, volume);
-#endif
-            break;
-         case CORE_AUDIO_MIXER_TYPE_FLAC:
-#ifdef HAVE_DR_FLAC
-            core_audio_mixer_mix_flac(buffer, num_frames, voice, volume);
-#endif
-            break;
-            case CORE_AUDIO_MIXER_TYPE_MP3:
-#ifdef HAVE_DR_MP3
-            core_audio_mixer_mix_mp3(buffer, num_frames, voice, volume);
-#endif
-            break;
-         case CORE_AUDIO_MIXER_TYPE_NONE:
-            break;
-      }
+      if (voice->type == CORE_AUDIO_MIXER_TYPE_NONE)
+         continue;
+
+      if (voice->stream)
+         core_audio_mixer_mix_stream(buffer, num_frames, voice, volume);
+      else
+         core_audio_mixer_mix_voice(buffer, num_frames, voice, volume);
    }
 
    for (j = 0, sample = buffer; j < num_frames * 2; j++, sample++)
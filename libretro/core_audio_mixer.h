@@ -85,6 +85,15 @@ void core_audio_mixer_voice_set_volume(core_audio_mixer_voice_t *voice, float va
 
 void core_audio_mixer_mix(float* buffer, size_t num_frames, float volume_override, bool override);
 
+/* Frames decoded ahead by the background thread of each streamed
+ * voice, 0 decodes in the mix call instead. Applies to voices started
+ * after the call. */
+void core_audio_mixer_set_stream_frames(unsigned frames);
+unsigned core_audio_mixer_get_stream_frames(void);
+
+/* Number of mix calls that found a stream's ring short of samples */
+unsigned core_audio_mixer_get_underruns(void);
+
 RETRO_END_DECLS
 
 #endif
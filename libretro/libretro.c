@@ -54,6 +54,7 @@ void *tex_buffer = NULL;
 
 bool cdaudio_enabled = true;
 float cdaudio_volume = 0.5f;
+unsigned cdaudio_stream_frames = 16384;
 
 float libretro_gamma = 1.0f;
 float libretro_hud_scale = 0.5f;
@@ -125,8 +126,9 @@ void ( APIENTRY * qglScalef )(GLfloat x, GLfloat y, GLfloat z);
 void ( APIENTRY * qglDepthFunc )(GLenum func);
 void ( APIENTRY * qglTexEnvi )(GLenum target, GLenum pname, GLint param);
 void ( APIENTRY * qglAlphaFunc )(GLenum func,  GLclampf ref);
+void ( APIENTRY * qglPixelStorei )(GLenum pname, GLint param);
 
-#define GL_FUNCS_NUM 44
+#define GL_FUNCS_NUM 45
 
 typedef struct api_entry{
 	void *ptr;
@@ -591,6 +593,7 @@ static bool initialize_gl()
 	funcs[41].ptr = qglDepthFunc          = hw_render.get_proc_address ("glDepthFunc");
 	funcs[42].ptr = qglTexEnvi            = hw_render.get_proc_address ("glTexEnvi");
 	funcs[43].ptr = qglAlphaFunc          = hw_render.get_proc_address ("glAlphaFunc");
+	funcs[44].ptr = qglPixelStorei        = hw_render.get_proc_address ("glPixelStorei");
 	
 	if (log_cb) {
 		int i;
@@ -778,9 +781,17 @@ void NET_Sleep(int msec)
 
 #define	MAX_LOOPBACK	4
 
+/*
+The loopback queues hand whole buffers around instead of copying packets
+in and out of them: a sent packet is gathered straight into a queue slot,
+and NET_GetLoopPacket trades that slot's buffer for the one net_message
+was using.  Every buffer is MAX_MSGLEN_EXT bytes so any of them can end
+up behind net_message, and so protocol 35 loopback messages never need
+to be fragmented.
+*/
 typedef struct
 {
-	byte	data[MAX_MSGLEN];
+	byte	*data;
 	int		datalen;
 } loopmsg_t;
 
@@ -791,11 +802,13 @@ typedef struct
 } loopback_t;
 
 loopback_t	loopbacks[2];
+static byte	loopback_buffers[2][MAX_LOOPBACK][MAX_MSGLEN_EXT];
 
 qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
 	int		i;
 	loopback_t	*loop;
+	byte	*data;
 
 	loop = &loopbacks[sock];
 
@@ -808,26 +821,40 @@ qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_me
 	i = loop->get & (MAX_LOOPBACK-1);
 	loop->get++;
 
-	memcpy (net_message->data, loop->msgs[i].data, loop->msgs[i].datalen);
+	data = net_message->data;
+	net_message->data = loop->msgs[i].data;
+	net_message->maxsize = MAX_MSGLEN_EXT;
 	net_message->cursize = loop->msgs[i].datalen;
+	loop->msgs[i].data = data;
 	*net_from = net_local_adr;
 	return true;
 
 }
 
 
-void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
+void NET_SendLoopPacket (netsrc_t sock, int numsegs, netseg_t *segs, netadr_t to)
 {
-	int		i;
+	int		i, j;
 	loopback_t	*loop;
+	loopmsg_t	*msg;
 
 	loop = &loopbacks[sock^1];
 
 	i = loop->send & (MAX_LOOPBACK-1);
 	loop->send++;
 
-	memcpy (loop->msgs[i].data, data, length);
-	loop->msgs[i].datalen = length;
+	msg = &loop->msgs[i];
+	if (!msg->data)
+		msg->data = loopback_buffers[sock^1][i];
+
+	msg->datalen = 0;
+	for (j=0 ; j<numsegs ; j++)
+	{
+		if (msg->datalen + segs[j].length > MAX_MSGLEN_EXT)
+			Com_Error (ERR_FATAL, "NET_SendLoopPacket: %i byte packet", msg->datalen + segs[j].length);
+		memcpy (msg->data + msg->datalen, segs[j].data, segs[j].length);
+		msg->datalen += segs[j].length;
+	}
 }
 
 qboolean	NET_CompareBaseAdr (netadr_t a, netadr_t b)
@@ -871,15 +898,32 @@ qboolean	NET_StringToAdr (char *s, netadr_t *a)
 	return true;
 }
 
-void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
+/*
+NET_SendPacketv sends one datagram made of several pieces.  Only the
+loopback driver exists here; a socket driver would pass the pieces to
+sendmsg as an iovec list.
+*/
+void NET_SendPacketv (netsrc_t sock, int numsegs, netseg_t *segs, netadr_t to)
 {
+	if (numsegs < 1 || numsegs > MAX_NETSEGS)
+		Com_Error (ERR_FATAL, "NET_SendPacketv: %i segments", numsegs);
+
 	if ( to.type == NA_LOOPBACK )
 	{
-		NET_SendLoopPacket (sock, length, data, to);
+		NET_SendLoopPacket (sock, numsegs, segs, to);
 		return;
 	}
 }
 
+void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
+{
+	netseg_t	seg;
+
+	seg.data = data;
+	seg.length = length;
+	NET_SendPacketv (sock, 1, &seg, to);
+}
+
 void	NET_Config (qboolean multiplayer)
 {
 }
@@ -1737,6 +1781,18 @@ static void update_variables(bool startup)
 
 		cdaudio_volume = volume_level / 100.0f;
 	}
+
+	var.key = "vitaquakeii_cdaudio_stream_buffer";
+	var.value = NULL;
+	cdaudio_stream_frames = 16384;
+
+	if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	{
+		if (strcmp(var.value, "disabled") == 0)
+			cdaudio_stream_frames = 0;
+		else
+			cdaudio_stream_frames = atoi(var.value);
+	}
 #endif
 
 	/* We need Qcommon_Init to be executed to be able to set Cvars */
@@ -2275,8 +2331,14 @@ void retro_run(void)
 	audio_callback();
 }
 
+extern void GL_FreeLightmapPages(void);
+
 void retro_unload_game(void)
 {
+#ifdef HAVE_OPENGL
+	if (!is_soft_render)
+		GL_FreeLightmapPages();
+#endif
 }
 
 unsigned retro_get_region(void)
@@ -2292,19 +2354,30 @@ bool retro_load_game_special(unsigned type, const struct retro_game_info *info,
    return false;
 }
 
+/* Frontends size their state buffers once, so report a fixed
+ * size that any level fits in rather than what the running level
+ * needs right now. The server state says how much of it is used. */
+#define SAVESTATE_SIZE (4 * 1024 * 1024)
+
 size_t retro_serialize_size(void)
 {
-   return 0;
+   int size = SV_StateSize();
+
+   return size > SAVESTATE_SIZE ? size : SAVESTATE_SIZE;
 }
 
 bool retro_serialize(void *data_, size_t size)
 {
-   return false;
+   if (size > 0x7fffffff)
+      size = 0x7fffffff;
+   return SV_WriteState((byte *)data_, (int)size) > 0;
 }
 
 bool retro_unserialize(const void *data_, size_t size)
 {
-   return false;
+   if (size > 0x7fffffff)
+      size = 0x7fffffff;
+   return SV_ReadState((const byte *)data_, (int)size);
 }
 
 void *retro_get_memory_data(unsigned id)
@@ -2656,6 +2729,7 @@ void    VID_Init (void)
    _ri.Sys_Error = VID_Error;
    _ri.FS_LoadFile = FS_LoadFile;
    _ri.FS_FreeFile = FS_FreeFile;
+   _ri.FS_FileSource = FS_FileSource;
    _ri.FS_Gamedir = FS_Gamedir;
    _ri.Vid_NewWindow = VID_NewWindow;
    _ri.Cvar_Get = Cvar_Get;
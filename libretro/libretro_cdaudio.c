@@ -8,12 +8,13 @@
 #include <core_audio_mixer.h>
 #endif
 
-#include "../game/q_shared.h"
+#include "../qcommon/qcommon.h"
 #include "../client/cdaudio.h"
 
 #if defined(HAVE_CDAUDIO)
 extern char g_music_dir[1024];
 extern bool cdaudio_enabled;
+extern unsigned cdaudio_stream_frames;
 
 static core_audio_mixer_sound_t *cdaudio_sound = NULL;
 static core_audio_mixer_voice_t *cdaudio_voice = NULL;
@@ -40,6 +41,13 @@ void cdaudio_stop_cb(core_audio_mixer_sound_t *sound, unsigned reason)
 
    cdaudio_playing = false;
 }
+
+static void cdaudio_info_f(void)
+{
+   Com_Printf("%s\n", cdaudio_playing ? "playing" : "not playing");
+   Com_Printf("%5u frames decoded ahead\n", core_audio_mixer_get_stream_frames());
+   Com_Printf("%5u underruns\n", core_audio_mixer_get_underruns());
+}
 #endif
 
 int CDAudio_Init(void)
@@ -47,6 +55,7 @@ int CDAudio_Init(void)
 #if defined(HAVE_CDAUDIO)
    core_audio_mixer_init(AUDIO_SAMPLE_RATE);
    cdaudio_reset();
+   Cmd_AddCommand("cdinfo", cdaudio_info_f);
    return 1;
 #else
    return 0;
@@ -58,6 +67,7 @@ void CDAudio_Shutdown(void)
 #if defined(HAVE_CDAUDIO)
    cdaudio_reset();
    core_audio_mixer_done();
+   Cmd_RemoveCommand("cdinfo");
 #endif
 }
 
@@ -107,6 +117,7 @@ void CDAudio_Play(int track, qboolean looping)
          goto error;
 
       /* Start 'playing' track file */
+      core_audio_mixer_set_stream_frames(cdaudio_stream_frames);
       cdaudio_voice = core_audio_mixer_play(cdaudio_sound,
             looping, 1.0f, "sinc", RESAMPLER_QUALITY_NORMAL,
             cdaudio_stop_cb);
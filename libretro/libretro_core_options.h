@@ -481,6 +481,23 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "50"
    },
+   {
+      "vitaquakeii_cdaudio_stream_buffer",
+      "Music Decode Buffer",
+      NULL,
+      "Decode music tracks on a background thread, this many audio frames ahead of playback. Larger buffers ride out longer decoding stalls. 'disabled' decodes in the audio callback.",
+      NULL,
+      NULL,
+      {
+         { "disabled", NULL },
+         { "4096",     NULL },
+         { "8192",     NULL },
+         { "16384",    NULL },
+         { "32768",    NULL },
+         { NULL, NULL },
+      },
+      "16384"
+   },
 #endif
    {
       "vitaquakeii_cl_run",
@@ -0,0 +1,104 @@
+/* libretro_thread.c -- threads for background decoding and i/o */
+
+#include <stdlib.h>
+
+#include <libretro_thread.h>
+
+#if defined(HAVE_QTHREADS)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+struct qthread
+{
+#if defined(_WIN32)
+   HANDLE     handle;
+#else
+   pthread_t  handle;
+#endif
+   void     (*entry)(void *);
+   void      *userdata;
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI qthread_wrapper(void *data)
+#else
+static void *qthread_wrapper(void *data)
+#endif
+{
+   qthread_t *thread = (qthread_t *)data;
+
+   thread->entry(thread->userdata);
+   return 0;
+}
+
+qthread_t *qthread_create(void (*entry)(void *), void *userdata)
+{
+   qthread_t *thread = (qthread_t *)calloc(1, sizeof(*thread));
+
+   if (!thread)
+      return NULL;
+
+   thread->entry    = entry;
+   thread->userdata = userdata;
+
+#if defined(_WIN32)
+   thread->handle   = CreateThread(NULL, 0, qthread_wrapper, thread, 0, NULL);
+   if (!thread->handle)
+#else
+   if (pthread_create(&thread->handle, NULL, qthread_wrapper, thread) != 0)
+#endif
+   {
+      free(thread);
+      return NULL;
+   }
+
+   return thread;
+}
+
+void qthread_join(qthread_t *thread)
+{
+   if (!thread)
+      return;
+
+#if defined(_WIN32)
+   WaitForSingleObject(thread->handle, INFINITE);
+   CloseHandle(thread->handle);
+#else
+   pthread_join(thread->handle, NULL);
+#endif
+   free(thread);
+}
+
+void qthread_sleep(int msec)
+{
+#if defined(_WIN32)
+   Sleep(msec);
+#else
+   struct timespec ts;
+
+   ts.tv_sec  = msec / 1000;
+   ts.tv_nsec = (msec % 1000) * 1000000;
+   nanosleep(&ts, NULL);
+#endif
+}
+
+#else
+
+qthread_t *qthread_create(void (*entry)(void *), void *userdata)
+{
+   return NULL;
+}
+
+void qthread_join(qthread_t *thread)
+{
+}
+
+void qthread_sleep(int msec)
+{
+}
+
+#endif
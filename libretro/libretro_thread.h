@@ -0,0 +1,35 @@
+#ifndef __LIBRETRO_THREAD_H
+#define __LIBRETRO_THREAD_H
+
+/* Minimal threading layer used by the background workers.
+ * Without HAVE_QTHREADS qthread_create() always fails and callers
+ * fall back to doing the work synchronously. */
+
+typedef struct qthread qthread_t;
+
+qthread_t *qthread_create(void (*entry)(void *), void *userdata);
+void qthread_join(qthread_t *thread);
+void qthread_sleep(int msec);
+
+/* Single word atomics, loads acquire and stores release */
+#if defined(_MSC_VER)
+#include <windows.h>
+static __inline unsigned qatomic_load(volatile unsigned *p)
+{
+   return (unsigned)InterlockedCompareExchange((volatile LONG *)p, 0, 0);
+}
+static __inline void qatomic_store(volatile unsigned *p, unsigned v)
+{
+   InterlockedExchange((volatile LONG *)p, (LONG)v);
+}
+static __inline unsigned qatomic_add(volatile unsigned *p, unsigned v)
+{
+   return (unsigned)InterlockedExchangeAdd((volatile LONG *)p, (LONG)v) + v;
+}
+#else
+#define qatomic_load(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define qatomic_store(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define qatomic_add(p, v)     __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#endif
+
+#endif
@@ -1739,6 +1739,43 @@ void	CM_ReadPortalState (RFILE *f)
 	FloodAreaConnections ();
 }
 
+/*
+===================
+CM_PortalStateSize
+
+Size of the portal state for savestates
+===================
+*/
+int		CM_PortalStateSize (void)
+{
+	return sizeof(portalopen);
+}
+
+/*
+===================
+CM_WritePortalStateBuffer
+===================
+*/
+void	CM_WritePortalStateBuffer (byte *buf)
+{
+	memcpy (buf, portalopen, sizeof(portalopen));
+}
+
+/*
+===================
+CM_ReadPortalStateBuffer
+
+Only refloods the areas if a portal changed
+===================
+*/
+void	CM_ReadPortalStateBuffer (const byte *buf)
+{
+	if (!memcmp (portalopen, buf, sizeof(portalopen)))
+		return;
+	memcpy (portalopen, buf, sizeof(portalopen));
+	FloodAreaConnections ();
+}
+
 /*
 =============
 CM_HeadnodeVisible
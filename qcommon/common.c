@@ -25,6 +25,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "../client/qmenu.h"
 #include <setjmp.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MSG_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
 #define	MAXPRINTMSG	4096
 
 #define MAX_NUM_ARGVS	50
@@ -499,44 +504,257 @@ void MSG_ReadDir (sizebuf_t *sb, vec3_t dir)
 }
 
 
+/*
+==============================================================================
+
+			ENTITY DELTA FIELDS
+
+An entity delta is described by a table of the fields in the order they
+go on the wire, and the writer, the reader and the size of a delta all
+come from it.  The change mask is built by comparing the two
+entity_state_t as 21 32-bit lanes: the origin and angle lanes compare as
+floats (so -0 and 0 are the same, and a NaN always differs, just as "!="
+did), everything else compares as ints.
+
+==============================================================================
+*/
+
+typedef enum
+{
+	DF_BYTE,
+	DF_SHORT,
+	DF_SIZED,		// byte, short, or long when both bits are set
+	DF_FRAME,		// byte and/or short
+	DF_COORD,
+	DF_ANGLE,
+	DF_POS
+} deltafieldtype_t;
+
+typedef struct
+{
+	int					bits;
+	int					offset;
+	deltafieldtype_t	type;
+} deltafield_t;
+
+#define	ESOFS(x)	(int)(size_t)&(((entity_state_t *)0)->x)
+
+static const deltafield_t entity_fields[] =
+{
+	{U_MODEL, ESOFS(modelindex), DF_BYTE},
+	{U_MODEL2, ESOFS(modelindex2), DF_BYTE},
+	{U_MODEL3, ESOFS(modelindex3), DF_BYTE},
+	{U_MODEL4, ESOFS(modelindex4), DF_BYTE},
+	{U_FRAME8|U_FRAME16, ESOFS(frame), DF_FRAME},
+	{U_SKIN8|U_SKIN16, ESOFS(skinnum), DF_SIZED},
+	{U_EFFECTS8|U_EFFECTS16, ESOFS(effects), DF_SIZED},
+	{U_RENDERFX8|U_RENDERFX16, ESOFS(renderfx), DF_SIZED},
+	{U_ORIGIN1, ESOFS(origin[0]), DF_COORD},
+	{U_ORIGIN2, ESOFS(origin[1]), DF_COORD},
+	{U_ORIGIN3, ESOFS(origin[2]), DF_COORD},
+	{U_ANGLE1, ESOFS(angles[0]), DF_ANGLE},
+	{U_ANGLE2, ESOFS(angles[1]), DF_ANGLE},
+	{U_ANGLE3, ESOFS(angles[2]), DF_ANGLE},
+	{U_OLDORIGIN, ESOFS(old_origin), DF_POS},
+	{U_SOUND, ESOFS(sound), DF_BYTE},
+	{U_EVENT, ESOFS(event), DF_BYTE},
+	{U_SOLID, ESOFS(solid), DF_SHORT}
+};
+
+#define	NUM_ENTITY_FIELDS	(int)(sizeof(entity_fields)/sizeof(entity_fields[0]))
+#define	NUM_ENTITY_LANES	(int)(sizeof(entity_state_t)/4)
+
+// lanes that compare as floats
+#define	LANES_FLOAT			(0x3ff & ~1)
+
+// lanes that map straight onto one header bit; frame, skin, effects and
+// renderfx pick their bits from the new value, and event isn't delta
+// compressed at all
+static const int lane_bits[NUM_ENTITY_LANES] =
+{
+	0,											// number
+	U_ORIGIN1, U_ORIGIN2, U_ORIGIN3,
+	U_ANGLE1, U_ANGLE2, U_ANGLE3,
+	0, 0, 0,									// old_origin
+	U_MODEL, U_MODEL2, U_MODEL3, U_MODEL4,
+	0, 0, 0, 0,									// frame, skinnum, effects, renderfx
+	U_SOLID, U_SOUND,
+	0											// event
+};
+
+#define	LANE_FRAME		14
+#define	LANE_SKIN		15
+#define	LANE_EFFECTS	16
+#define	LANE_RENDERFX	17
+
+// built from the tables above the first time a delta is written or read
+static qboolean	delta_tables;
+static int		delta_lanebits[5][16];		// header bits for four lanes at a time
+static unsigned	delta_fields[4][256];		// fields present, by header byte
+static int		delta_size[4][256];			// field bytes, by header byte
+
+// index of the lowest set bit
+static const byte debruijn_bit[32] =
+{
+	0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+	31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+};
+#define	LOWEST_BIT(x)	debruijn_bit[((unsigned)(((x) & -(x)) * 0x077CB531u)) >> 27]
+
 /*
 ==================
-MSG_WriteDeltaEntity
+MSG_BuildDeltaTables
+==================
+*/
+static void MSG_BuildDeltaTables (void)
+{
+	const deltafield_t	*f;
+	int					bitsize[32];
+	int					i, j, b, lo;
+
+	for (i=0 ; i<5 ; i++)
+		for (j=0 ; j<16 ; j++)
+			for (b=0 ; b<4 ; b++)
+				if ((j & (1<<b)) && i*4+b < NUM_ENTITY_LANES)
+					delta_lanebits[i][j] |= lane_bits[i*4+b];
+
+	// a pair of size bits costs one byte for the low bit and two for the
+	// high one; both together make a long, which MSG_DeltaFieldsSize fixes up
+	memset (bitsize, 0, sizeof(bitsize));
+	for (f=entity_fields ; f<entity_fields+NUM_ENTITY_FIELDS ; f++)
+	{
+		lo = f->bits & -f->bits;
+		for (b=0 ; b<32 ; b++)
+		{
+			if (!(f->bits & (1<<b)))
+				continue;
+			switch (f->type)
+			{
+			case DF_BYTE:
+			case DF_ANGLE:
+				bitsize[b] = 1;
+				break;
+			case DF_SHORT:
+			case DF_COORD:
+				bitsize[b] = 2;
+				break;
+			case DF_SIZED:
+			case DF_FRAME:
+				bitsize[b] = ((1<<b) == lo) ? 1 : 2;
+				break;
+			case DF_POS:
+				bitsize[b] = 6;
+				break;
+			}
+		}
+	}
 
-Writes part of a packetentities message.
-Can delta from either a baseline or a previous packet_entity
+	for (i=0 ; i<4 ; i++)
+	{
+		for (j=0 ; j<256 ; j++)
+		{
+			for (f=entity_fields ; f<entity_fields+NUM_ENTITY_FIELDS ; f++)
+				if (f->bits & (j << (i*8)))
+					delta_fields[i][j] |= 1 << (f - entity_fields);
+			for (b=0 ; b<8 ; b++)
+				if (j & (1<<b))
+					delta_size[i][j] += bitsize[i*8+b];
+		}
+	}
+
+	delta_tables = true;
+}
+
+/*
+==================
+MSG_EntityLanes_C
+
+Returns a mask with bit n set when lane n differs
 ==================
 */
-void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+unsigned MSG_EntityLanes_C (const entity_state_t *from, const entity_state_t *to)
+{
+	const int	*a, *b;
+	const float	*fa, *fb;
+	unsigned	mask;
+	int			i;
+
+	a = (const int *)from;
+	b = (const int *)to;
+	fa = (const float *)from;
+	fb = (const float *)to;
+
+	mask = 0;
+	for (i=0 ; i<NUM_ENTITY_LANES ; i++)
+	{
+		if (LANES_FLOAT & (1<<i))
+		{
+			if (fa[i] != fb[i])
+				mask |= 1<<i;
+		}
+		else if (a[i] != b[i])
+			mask |= 1<<i;
+	}
+
+	return mask;
+}
+
+#ifdef MSG_SIMD_SSE2
+unsigned MSG_EntityLanes (const entity_state_t *from, const entity_state_t *to)
+{
+	const float	*a, *b;
+	__m128i		ia, ib;
+	unsigned	idiff, fdiff;
+	int			i;
+
+	a = (const float *)from;
+	b = (const float *)to;
+
+	// lanes 0-19 four at a time, the event lane on its own
+	idiff = 0;
+	fdiff = 0;
+	for (i=0 ; i<20 ; i+=4)
+	{
+		ia = _mm_loadu_si128 ((const __m128i *)(a + i));
+		ib = _mm_loadu_si128 ((const __m128i *)(b + i));
+		idiff |= (~_mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (ia, ib))) & 15) << i;
+		if (i < 12)
+			fdiff |= _mm_movemask_ps (_mm_cmpneq_ps (_mm_loadu_ps (a + i), _mm_loadu_ps (b + i))) << i;
+	}
+	if (from->event != to->event)
+		idiff |= 1<<20;
+
+	return (idiff & ~LANES_FLOAT) | (fdiff & LANES_FLOAT);
+}
+#else
+unsigned MSG_EntityLanes (const entity_state_t *from, const entity_state_t *to)
+{
+	return MSG_EntityLanes_C (from, to);
+}
+#endif
+
+/*
+==================
+MSG_EntityBits
+
+The header bits for a delta, without the MOREBITS flags
+==================
+*/
+int MSG_EntityBits (const entity_state_t *from, const entity_state_t *to, unsigned lanes, qboolean newentity)
 {
 	int		bits;
 
-	if (!to->number)
-		Com_Error (ERR_FATAL, "Unset entity number");
-	if (to->number >= MAX_EDICTS)
-		Com_Error (ERR_FATAL, "Entity number >= MAX_EDICTS");
+	if (!delta_tables)
+		MSG_BuildDeltaTables ();
 
-// send an update
-	bits = 0;
+	bits = delta_lanebits[0][lanes & 15] | delta_lanebits[1][(lanes>>4) & 15]
+		| delta_lanebits[2][(lanes>>8) & 15] | delta_lanebits[3][(lanes>>12) & 15]
+		| delta_lanebits[4][(lanes>>16) & 15];
 
 	if (to->number >= 256)
 		bits |= U_NUMBER16;		// number8 is implicit otherwise
 
-	if (to->origin[0] != from->origin[0])
-		bits |= U_ORIGIN1;
-	if (to->origin[1] != from->origin[1])
-		bits |= U_ORIGIN2;
-	if (to->origin[2] != from->origin[2])
-		bits |= U_ORIGIN3;
-
-	if ( to->angles[0] != from->angles[0] )
-		bits |= U_ANGLE1;		
-	if ( to->angles[1] != from->angles[1] )
-		bits |= U_ANGLE2;
-	if ( to->angles[2] != from->angles[2] )
-		bits |= U_ANGLE3;
-		
-	if ( to->skinnum != from->skinnum )
+	if (lanes & (1<<LANE_SKIN))
 	{
 		if ((unsigned)to->skinnum < 256)
 			bits |= U_SKIN8;
@@ -545,8 +763,8 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		else
 			bits |= (U_SKIN8|U_SKIN16);
 	}
-		
-	if ( to->frame != from->frame )
+
+	if (lanes & (1<<LANE_FRAME))
 	{
 		if (to->frame < 256)
 			bits |= U_FRAME8;
@@ -554,7 +772,7 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 			bits |= U_FRAME16;
 	}
 
-	if ( to->effects != from->effects )
+	if (lanes & (1<<LANE_EFFECTS))
 	{
 		if (to->effects < 256)
 			bits |= U_EFFECTS8;
@@ -563,8 +781,8 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		else
 			bits |= U_EFFECTS8|U_EFFECTS16;
 	}
-	
-	if ( to->renderfx != from->renderfx )
+
+	if (lanes & (1<<LANE_RENDERFX))
 	{
 		if (to->renderfx < 256)
 			bits |= U_RENDERFX8;
@@ -573,29 +791,83 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		else
 			bits |= U_RENDERFX8|U_RENDERFX16;
 	}
-	
-	if ( to->solid != from->solid )
-		bits |= U_SOLID;
 
 	// event is not delta compressed, just 0 compressed
-	if ( to->event  )
+	if (to->event)
 		bits |= U_EVENT;
-	
-	if ( to->modelindex != from->modelindex )
-		bits |= U_MODEL;
-	if ( to->modelindex2 != from->modelindex2 )
-		bits |= U_MODEL2;
-	if ( to->modelindex3 != from->modelindex3 )
-		bits |= U_MODEL3;
-	if ( to->modelindex4 != from->modelindex4 )
-		bits |= U_MODEL4;
-
-	if ( to->sound != from->sound )
-		bits |= U_SOUND;
 
 	if (newentity || (to->renderfx & RF_BEAM))
 		bits |= U_OLDORIGIN;
 
+	return bits;
+}
+
+/*
+==================
+MSG_DeltaFieldsSize
+
+Bytes the fields selected by bits take on the wire
+==================
+*/
+static int MSG_DeltaFieldsSize (int bits)
+{
+	int		size;
+
+	size = delta_size[0][bits & 255] + delta_size[1][(bits>>8) & 255]
+		+ delta_size[2][(bits>>16) & 255] + delta_size[3][(bits>>24) & 255];
+
+	// a byte and a short make a long
+	if ((bits & (U_SKIN8|U_SKIN16)) == (U_SKIN8|U_SKIN16))
+		size++;
+	if ((bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16))
+		size++;
+	if ((bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16))
+		size++;
+
+	return size;
+}
+
+static unsigned MSG_DeltaFields (int bits)
+{
+	return delta_fields[0][bits & 255] | delta_fields[1][(bits>>8) & 255]
+		| delta_fields[2][(bits>>16) & 255] | delta_fields[3][(bits>>24) & 255];
+}
+
+#define	PUT_BYTE(p,c)	(*(p)++ = (byte)(c))
+#define	PUT_SHORT(p,c)	((p)[0] = (byte)((c)&0xff), (p)[1] = (byte)((c)>>8), (p) += 2)
+#define	PUT_LONG(p,c)	((p)[0] = (byte)((c)&0xff), (p)[1] = (byte)(((c)>>8)&0xff), \
+						(p)[2] = (byte)(((c)>>16)&0xff), (p)[3] = (byte)((c)>>24), (p) += 4)
+
+#define	GET_BYTE(p)		(*(p)++)
+#define	GET_SHORT(p)	((p) += 2, (short)((p)[-2] + ((p)[-1]<<8)))
+#define	GET_LONG(p)		((p) += 4, (int)((p)[-4] + ((p)[-3]<<8) + ((p)[-2]<<16) + ((unsigned)(p)[-1]<<24)))
+
+/*
+==================
+MSG_WriteDeltaEntity
+
+Writes part of a packetentities message.
+Can delta from either a baseline or a previous packet_entity
+==================
+*/
+void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+{
+	const deltafield_t	*f;
+	const byte			*field;
+	byte				*buf;
+	unsigned			fields;
+	int					bits, fb;
+	int					size;
+	int					i, c;
+
+	if (!to->number)
+		Com_Error (ERR_FATAL, "Unset entity number");
+	if (to->number >= MAX_EDICTS)
+		Com_Error (ERR_FATAL, "Entity number >= MAX_EDICTS");
+
+// send an update
+	bits = MSG_EntityBits (from, to, MSG_EntityLanes (from, to), newentity);
+
 	//
 	// write the message
 	//
@@ -611,94 +883,82 @@ void MSG_WriteDeltaEntity (entity_state_t *from, entity_state_t *to, sizebuf_t *
 	else if (bits & 0x0000ff00)
 		bits |= U_MOREBITS1;
 
-	MSG_WriteByte (msg,	bits&255 );
+	size = 2;		// first header byte and number8
+	if (bits & U_MOREBITS1)
+		size++;
+	if (bits & U_MOREBITS2)
+		size++;
+	if (bits & U_MOREBITS3)
+		size++;
+	if (bits & U_NUMBER16)
+		size++;
+	size += MSG_DeltaFieldsSize (bits);
 
-	if (bits & 0xff000000)
-	{
-		MSG_WriteByte (msg,	(bits>>8)&255 );
-		MSG_WriteByte (msg,	(bits>>16)&255 );
-		MSG_WriteByte (msg,	(bits>>24)&255 );
-	}
-	else if (bits & 0x00ff0000)
-	{
-		MSG_WriteByte (msg,	(bits>>8)&255 );
-		MSG_WriteByte (msg,	(bits>>16)&255 );
-	}
-	else if (bits & 0x0000ff00)
-	{
-		MSG_WriteByte (msg,	(bits>>8)&255 );
-	}
+	// one reservation for the whole delta
+	buf = SZ_GetSpace (msg, size);
 
-	//----------
+	PUT_BYTE (buf, bits&255);
+	if (bits & U_MOREBITS1)
+		PUT_BYTE (buf, (bits>>8)&255);
+	if (bits & U_MOREBITS2)
+		PUT_BYTE (buf, (bits>>16)&255);
+	if (bits & U_MOREBITS3)
+		PUT_BYTE (buf, (bits>>24)&255);
 
 	if (bits & U_NUMBER16)
-		MSG_WriteShort (msg, to->number);
+		PUT_SHORT (buf, to->number);
 	else
-		MSG_WriteByte (msg,	to->number);
-
-	if (bits & U_MODEL)
-		MSG_WriteByte (msg,	to->modelindex);
-	if (bits & U_MODEL2)
-		MSG_WriteByte (msg,	to->modelindex2);
-	if (bits & U_MODEL3)
-		MSG_WriteByte (msg,	to->modelindex3);
-	if (bits & U_MODEL4)
-		MSG_WriteByte (msg,	to->modelindex4);
-
-	if (bits & U_FRAME8)
-		MSG_WriteByte (msg, to->frame);
-	if (bits & U_FRAME16)
-		MSG_WriteShort (msg, to->frame);
-
-	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
-		MSG_WriteLong (msg, to->skinnum);
-	else if (bits & U_SKIN8)
-		MSG_WriteByte (msg, to->skinnum);
-	else if (bits & U_SKIN16)
-		MSG_WriteShort (msg, to->skinnum);
-
-
-	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
-		MSG_WriteLong (msg, to->effects);
-	else if (bits & U_EFFECTS8)
-		MSG_WriteByte (msg, to->effects);
-	else if (bits & U_EFFECTS16)
-		MSG_WriteShort (msg, to->effects);
-
-	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
-		MSG_WriteLong (msg, to->renderfx);
-	else if (bits & U_RENDERFX8)
-		MSG_WriteByte (msg, to->renderfx);
-	else if (bits & U_RENDERFX16)
-		MSG_WriteShort (msg, to->renderfx);
-
-	if (bits & U_ORIGIN1)
-		MSG_WriteCoord (msg, to->origin[0]);		
-	if (bits & U_ORIGIN2)
-		MSG_WriteCoord (msg, to->origin[1]);
-	if (bits & U_ORIGIN3)
-		MSG_WriteCoord (msg, to->origin[2]);
-
-	if (bits & U_ANGLE1)
-		MSG_WriteAngle(msg, to->angles[0]);
-	if (bits & U_ANGLE2)
-		MSG_WriteAngle(msg, to->angles[1]);
-	if (bits & U_ANGLE3)
-		MSG_WriteAngle(msg, to->angles[2]);
-
-	if (bits & U_OLDORIGIN)
+		PUT_BYTE (buf, to->number);
+
+	//----------
+
+	// only the fields that are present, in wire order
+	for (fields = MSG_DeltaFields (bits) ; fields ; fields &= fields - 1)
 	{
-		MSG_WriteCoord (msg, to->old_origin[0]);
-		MSG_WriteCoord (msg, to->old_origin[1]);
-		MSG_WriteCoord (msg, to->old_origin[2]);
-	}
+		f = &entity_fields[LOWEST_BIT(fields)];
+		fb = bits & f->bits;
+		field = (const byte *)to + f->offset;
 
-	if (bits & U_SOUND)
-		MSG_WriteByte (msg, to->sound);
-	if (bits & U_EVENT)
-		MSG_WriteByte (msg, to->event);
-	if (bits & U_SOLID)
-		MSG_WriteShort (msg, to->solid);
+		switch (f->type)
+		{
+		case DF_BYTE:
+			PUT_BYTE (buf, *(const int *)field);
+			break;
+		case DF_SHORT:
+			PUT_SHORT (buf, *(const int *)field);
+			break;
+		case DF_SIZED:
+			c = *(const int *)field;
+			if (fb == f->bits)
+				PUT_LONG (buf, c);
+			else if (fb & (f->bits & -f->bits))
+				PUT_BYTE (buf, c);
+			else
+				PUT_SHORT (buf, c);
+			break;
+		case DF_FRAME:
+			c = *(const int *)field;
+			if (fb & U_FRAME8)
+				PUT_BYTE (buf, c);
+			if (fb & U_FRAME16)
+				PUT_SHORT (buf, c);
+			break;
+		case DF_COORD:
+			c = (int)(*(const float *)field*8);
+			PUT_SHORT (buf, c);
+			break;
+		case DF_ANGLE:
+			PUT_BYTE (buf, (int)(*(const float *)field*256/360) & 255);
+			break;
+		case DF_POS:
+			for (i=0 ; i<3 ; i++)
+			{
+				c = (int)(((const float *)field)[i]*8);
+				PUT_SHORT (buf, c);
+			}
+			break;
+		}
+	}
 }
 
 
@@ -898,6 +1158,124 @@ void MSG_ReadDeltaUsercmd (sizebuf_t *msg_read, usercmd_t *from, usercmd_t *move
 }
 
 
+/*
+==================
+MSG_ReadDeltaEntity
+
+Can go from either a baseline or a previous packet_entity.  When the whole
+delta is in the message it is read straight out of the buffer, otherwise
+field by field so a short message reads the same -1s it always did.
+==================
+*/
+void MSG_ReadDeltaEntity (sizebuf_t *msg_read, entity_state_t *from, entity_state_t *to, int number, int bits)
+{
+	const deltafield_t	*f;
+	byte				*field;
+	byte				*buf;
+	unsigned			fields;
+	int					size, fb;
+	int					i;
+
+	// set everything to the state we are delta'ing from
+	*to = *from;
+
+	VectorCopy (from->origin, to->old_origin);
+	to->number = number;
+	to->event = 0;
+
+	if (!delta_tables)
+		MSG_BuildDeltaTables ();
+
+	fields = MSG_DeltaFields (bits);
+	size = MSG_DeltaFieldsSize (bits);
+	if (msg_read->readcount + size > msg_read->cursize)
+	{
+		for ( ; fields ; fields &= fields - 1)
+		{
+			f = &entity_fields[LOWEST_BIT(fields)];
+			fb = bits & f->bits;
+			field = (byte *)to + f->offset;
+			switch (f->type)
+			{
+			case DF_BYTE:
+				*(int *)field = MSG_ReadByte (msg_read);
+				break;
+			case DF_SHORT:
+				*(int *)field = MSG_ReadShort (msg_read);
+				break;
+			case DF_SIZED:
+				if (fb == f->bits)
+					*(int *)field = MSG_ReadLong (msg_read);
+				else if (fb & (f->bits & -f->bits))
+					*(int *)field = MSG_ReadByte (msg_read);
+				else
+					*(int *)field = MSG_ReadShort (msg_read);
+				break;
+			case DF_FRAME:
+				if (fb & U_FRAME8)
+					*(int *)field = MSG_ReadByte (msg_read);
+				if (fb & U_FRAME16)
+					*(int *)field = MSG_ReadShort (msg_read);
+				break;
+			case DF_COORD:
+				*(float *)field = MSG_ReadCoord (msg_read);
+				break;
+			case DF_ANGLE:
+				*(float *)field = MSG_ReadAngle (msg_read);
+				break;
+			case DF_POS:
+				MSG_ReadPos (msg_read, (float *)field);
+				break;
+			}
+		}
+		return;
+	}
+
+	buf = msg_read->data + msg_read->readcount;
+	msg_read->readcount += size;
+
+	for ( ; fields ; fields &= fields - 1)
+	{
+		f = &entity_fields[LOWEST_BIT(fields)];
+		fb = bits & f->bits;
+		field = (byte *)to + f->offset;
+		switch (f->type)
+		{
+		case DF_BYTE:
+			*(int *)field = GET_BYTE (buf);
+			break;
+		case DF_SHORT:
+			*(int *)field = GET_SHORT (buf);
+			break;
+		case DF_SIZED:
+			if (fb == f->bits)
+				*(int *)field = GET_LONG (buf);
+			else if (fb & (f->bits & -f->bits))
+				*(int *)field = GET_BYTE (buf);
+			else
+				*(int *)field = GET_SHORT (buf);
+			break;
+		case DF_FRAME:
+			if (fb & U_FRAME8)
+				*(int *)field = GET_BYTE (buf);
+			if (fb & U_FRAME16)
+				*(int *)field = GET_SHORT (buf);
+			break;
+		case DF_COORD:
+			*(float *)field = GET_SHORT (buf) * (1.0/8);
+			break;
+		case DF_ANGLE:
+			*(float *)field = (signed char)GET_BYTE (buf) * (360.0/256);
+			break;
+		case DF_POS:
+			for (i=0 ; i<3 ; i++)
+				((float *)field)[i] = GET_SHORT (buf) * (1.0/8);
+			break;
+		}
+	}
+}
+
+
 void MSG_ReadData (sizebuf_t *msg_read, void *data, int len)
 {
 	int		i;
@@ -1509,6 +1887,7 @@ void Qcommon_Init (int argc, char **argv)
 
 	NET_Init ();
 	Netchan_Init ();
+	Demo_Init ();
 
 	SV_Init ();
 	CL_Init ();
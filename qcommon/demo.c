@@ -0,0 +1,1277 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// demo.c -- buffered demo file writing and reading
+
+#include "qcommon.h"
+
+#include <libretro_thread.h>
+#include <features/features_cpu.h>
+
+/*
+
+A demo is a series of messages, each prefixed by a little endian length,
+ended by a length of -1.
+
+Recording hands each message to a writer.  The frame thread only copies it
+into a ring, and a writer thread gathers the ring into blocks and writes
+them out.  Without threads, or with demo_async 0, the blocks are filled
+and written from the frame thread instead.
+
+With demo_compress 0 the blocks are written as they are, so the file is
+an ordinary .dm2.  With demo_compress 1 the file starts with DEMO_MAGIC
+and a version, followed by blocks of
+
+	int		rawlength
+	int		packedlength	// == rawlength for a stored block
+	byte	data[packedlength]
+
+The packed data is a byte oriented LZ77 stream.  Each sequence is a token
+byte holding a literal count in the high nibble and a match length - 4 in
+the low nibble, either of which continues in following bytes (adding until
+a byte below 255) when it is 15.  The literals follow, then a two byte
+little endian match offset.  The last sequence of a block has only literals.
+
+Playback detects the format from the first four bytes, so old demos,
+uncompressed recordings and compressed recordings all play the same way.
+
+Client recording also writes a seek index next to the demo (name.idx),
+serverrecord demos can't be played back and get none.  Every
+demo_keyframe seconds the recorder asks for an uncompressed frame, and the
+index gets its offset in the message stream along with the configstrings
+that differ from the start of the demo at that point.  demo_seek moves
+playback to the nearest keyframe, restores those configstrings and goes
+on from there, so nothing before it has to be parsed.  Server frame
+numbers start over with every map, so keyframes are grouped by the
+servercount of their level and a seek stays in the level being played.
+
+*/
+
+#define	DEMO_MAGIC			(('Z'<<24)+('2'<<16)+('M'<<8)+'D')	// "DM2Z"
+#define	DEMO_VERSION		1
+
+#define	DEMO_BLOCK_SIZE		0x10000
+#define	DEMO_RING_SIZE		0x100000		// must be a power of two
+#define	DEMO_RING_MASK		(DEMO_RING_SIZE-1)
+
+// seek index records
+#define	IDX_MAGIC			(('X'<<24)+('D'<<16)+('I'<<8)+'D')	// "DIDX"
+#define	IDX_VERSION			2		// 1 has no level records
+
+#define	IDX_KEYFRAME		1	// long offset, long serverframe
+#define	IDX_BASE			2	// short configstring, string value before it first changed
+#define	IDX_VALUE			3	// short configstring, string value at the last keyframe
+#define	IDX_LEVEL			4	// long servercount of the keyframes that follow
+
+#define	DEMO_MINMATCH		4
+
+cvar_t	*demo_compress;
+cvar_t	*demo_async;
+cvar_t	*demo_keyframe;
+
+struct demowriter_s
+{
+	RFILE		*file;
+	qboolean	compress;
+
+	// filled by the frame thread, drained by the writer thread
+	qthread_t	*thread;
+	byte		*ring;
+	volatile unsigned	write_pos;
+	volatile unsigned	read_pos;
+	volatile unsigned	quit;
+
+	// only touched by whoever drains the ring
+	byte		*block;
+	int			blocksize;
+	byte		*packed;
+	int			*hash;
+	unsigned	filebytes;
+	qboolean	failed;
+
+	// frame thread statistics
+	int			messages;
+	unsigned	rawbytes;
+	int			stalls;
+	retro_time_t	usec;
+
+	// seek index, written from the frame thread
+	RFILE		*index;
+	char		(*basecs)[MAX_QPATH];	// configstrings at the first keyframe
+	byte		*touched;				// changed since the first keyframe
+	int			keyframes;
+	int			servercount;			// of the last keyframe
+};
+
+typedef struct
+{
+	int			offset;			// in the message stream
+	int			serverframe;
+	int			servercount;	// the level, 0 in version 1 indexes
+	int			firstvalue;
+	int			numvalues;
+} demokey_t;
+
+typedef struct
+{
+	int			index;
+	char		*string;
+} democs_t;
+
+struct demoreader_s
+{
+	RFILE		*file;
+	qboolean	compressed;
+
+	// the first four bytes of an uncompressed demo, read to check the magic
+	byte		head[4];
+	int			headlen;
+
+	int			base;		// file position of the demo start
+	byte		*block;
+	int			blocksize;
+	int			blockpos;
+	int			blockend;	// stream offset just past the current block
+	byte		*packed;
+
+	int			offset;		// stream offset of the next message
+
+	// seek index
+	byte		*indexdata;
+	demokey_t	*keys;
+	int			numkeys;
+	democs_t	*values;
+	int			numvalues;
+	char		**basecs;	// NULL for configstrings that never change
+
+	// configstrings still to be restored after a seek
+	demokey_t	*seekkey;
+	int			seekcs;
+	int			seekvalue;
+};
+
+/*
+==============================================================
+
+BLOCK COMPRESSION
+
+==============================================================
+*/
+
+static unsigned Demo_Read32 (const byte *p)
+{
+	unsigned	v;
+
+	memcpy (&v, p, 4);
+	return v;
+}
+
+/*
+==================
+Demo_WriteCount
+
+Writes the remainder of a literal or match count that didn't fit the
+token nibble.  Returns NULL if it doesn't fit the output.
+==================
+*/
+static byte *Demo_WriteCount (byte *op, byte *oend, int count)
+{
+	for ( ; count >= 255 ; count -= 255)
+	{
+		if (op >= oend)
+			return NULL;
+		*op++ = 255;
+	}
+	if (op >= oend)
+		return NULL;
+	*op++ = count;
+	return op;
+}
+
+/*
+==================
+Demo_WriteSequence
+==================
+*/
+static byte *Demo_WriteSequence (byte *op, byte *oend, const byte *lit, int litlen, int offset, int matchlen)
+{
+	byte	*token;
+
+	if (op >= oend)
+		return NULL;
+	token = op++;
+	*token = (litlen < 15 ? litlen : 15) << 4;
+	if (litlen >= 15 && !(op = Demo_WriteCount (op, oend, litlen - 15)))
+		return NULL;
+
+	if (litlen > oend - op)
+		return NULL;
+	memcpy (op, lit, litlen);
+	op += litlen;
+
+	if (!matchlen)
+		return op;		// last sequence
+
+	if (oend - op < 2)
+		return NULL;
+	*op++ = offset & 255;
+	*op++ = offset >> 8;
+
+	matchlen -= DEMO_MINMATCH;
+	*token |= matchlen < 15 ? matchlen : 15;
+	if (matchlen >= 15 && !(op = Demo_WriteCount (op, oend, matchlen - 15)))
+		return NULL;
+
+	return op;
+}
+
+/*
+==================
+Demo_Compress
+
+Returns the packed length, or 0 if the block doesn't get any smaller
+==================
+*/
+int Demo_Compress (const byte *in, int inlen, byte *out, int *hash)
+{
+	byte		*op, *oend;
+	int			ip, anchor, ref, len;
+	unsigned	v, h;
+
+	op = out;
+	oend = out + inlen;		// no point in packing past the raw size
+	for (h=0 ; h<(1<<DEMO_HASH_BITS) ; h++)
+		hash[h] = -1;
+
+	ip = anchor = 0;
+	while (ip + DEMO_MINMATCH <= inlen)
+	{
+		v = Demo_Read32 (in + ip);
+		h = (v * 2654435761u) >> (32 - DEMO_HASH_BITS);
+		ref = hash[h];
+		hash[h] = ip;
+
+		if (ref < 0 || ip - ref > 0xffff || Demo_Read32 (in + ref) != v)
+		{
+			ip++;
+			continue;
+		}
+
+		len = DEMO_MINMATCH;
+		while (ip + len < inlen && in[ref + len] == in[ip + len])
+			len++;
+
+		op = Demo_WriteSequence (op, oend, in + anchor, ip - anchor, ip - ref, len);
+		if (!op)
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+
+	if (anchor < inlen)
+	{
+		op = Demo_WriteSequence (op, oend, in + anchor, inlen - anchor, 0, 0);
+		if (!op)
+			return 0;
+	}
+
+	if (op - out >= inlen)
+		return 0;
+	return op - out;
+}
+
+/*
+==================
+Demo_ReadCount
+==================
+*/
+static const byte *Demo_ReadCount (const byte *ip, const byte *iend, int *count)
+{
+	int		b;
+
+	do
+	{
+		if (ip >= iend)
+			return NULL;
+		b = *ip++;
+		*count += b;
+	} while (b == 255);
+
+	return ip;
+}
+
+/*
+==================
+Demo_Decompress
+
+Returns the unpacked length, or -1 if the data is corrupt
+==================
+*/
+int Demo_Decompress (const byte *in, int inlen, byte *out, int outlen)
+{
+	const byte	*ip, *iend, *match;
+	byte		*op, *oend;
+	int			token, len, offset;
+
+	ip = in;
+	iend = in + inlen;
+	op = out;
+	oend = out + outlen;
+
+	while (ip < iend)
+	{
+		token = *ip++;
+
+		len = token >> 4;
+		if (len == 15 && !(ip = Demo_ReadCount (ip, iend, &len)))
+			return -1;
+		if (len > iend - ip || len > oend - op)
+			return -1;
+		memcpy (op, ip, len);
+		op += len;
+		ip += len;
+
+		if (ip == iend)
+			break;		// last sequence
+
+		if (iend - ip < 2)
+			return -1;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > op - out)
+			return -1;
+
+		len = token & 15;
+		if (len == 15 && !(ip = Demo_ReadCount (ip, iend, &len)))
+			return -1;
+		len += DEMO_MINMATCH;
+		if (len > oend - op)
+			return -1;
+
+		// matches may overlap what they produce
+		match = op - offset;
+		while (len--)
+			*op++ = *match++;
+	}
+
+	return op - out;
+}
+
+/*
+==============================================================
+
+WRITING
+
+==============================================================
+*/
+
+/*
+==================
+Demo_WriteFile
+==================
+*/
+static void Demo_WriteFile (demowriter_t *w, const void *data, int len)
+{
+	if (w->failed)
+		return;
+	if (rfwrite (data, len, 1, w->file) != 1)
+		w->failed = true;
+	w->filebytes += len;
+}
+
+/*
+==================
+Demo_FlushBlock
+==================
+*/
+static void Demo_FlushBlock (demowriter_t *w)
+{
+	int		header[2];
+	int		packedlen;
+
+	if (!w->blocksize)
+		return;
+
+	if (!w->compress)
+	{
+		Demo_WriteFile (w, w->block, w->blocksize);
+		w->blocksize = 0;
+		return;
+	}
+
+	packedlen = Demo_Compress (w->block, w->blocksize, w->packed, w->hash);
+
+	header[0] = LittleLong (w->blocksize);
+	header[1] = LittleLong (packedlen ? packedlen : w->blocksize);
+	Demo_WriteFile (w, header, sizeof(header));
+	if (packedlen)
+		Demo_WriteFile (w, w->packed, packedlen);
+	else
+		Demo_WriteFile (w, w->block, w->blocksize);
+
+	w->blocksize = 0;
+}
+
+/*
+==================
+Demo_Consume
+
+Gathers written bytes into blocks
+==================
+*/
+static void Demo_Consume (demowriter_t *w, const byte *data, int len)
+{
+	int		count;
+
+	while (len)
+	{
+		count = DEMO_BLOCK_SIZE - w->blocksize;
+		if (count > len)
+			count = len;
+		memcpy (w->block + w->blocksize, data, count);
+		w->blocksize += count;
+		data += count;
+		len -= count;
+
+		if (w->blocksize == DEMO_BLOCK_SIZE)
+			Demo_FlushBlock (w);
+	}
+}
+
+/*
+==================
+Demo_WriterThread
+==================
+*/
+static void Demo_WriterThread (void *data)
+{
+	demowriter_t	*w = (demowriter_t *)data;
+	unsigned		write_pos, read_pos, quit;
+	int				count;
+
+	read_pos = w->read_pos;
+	for ( ; ; )
+	{
+		// check quit first so the last pass sees everything before it
+		quit = qatomic_load (&w->quit);
+		write_pos = qatomic_load (&w->write_pos);
+
+		if (write_pos == read_pos)
+		{
+			if (quit)
+				break;
+			qthread_sleep (1);
+			continue;
+		}
+
+		count = write_pos - read_pos;
+		if (count > DEMO_RING_SIZE - (read_pos & DEMO_RING_MASK))
+			count = DEMO_RING_SIZE - (read_pos & DEMO_RING_MASK);
+		Demo_Consume (w, w->ring + (read_pos & DEMO_RING_MASK), count);
+
+		read_pos += count;
+		qatomic_store (&w->read_pos, read_pos);
+	}
+
+	Demo_FlushBlock (w);
+}
+
+/*
+==================
+Demo_Put
+
+Hands bytes to the writer thread, waiting if it has fallen a whole ring
+behind
+==================
+*/
+static void Demo_Put (demowriter_t *w, const void *data, int len)
+{
+	const byte	*in = (const byte *)data;
+	unsigned	write_pos;
+	int			count, space;
+
+	if (!w->thread)
+	{
+		Demo_Consume (w, in, len);
+		return;
+	}
+
+	write_pos = w->write_pos;
+	while (len)
+	{
+		space = DEMO_RING_SIZE - (write_pos - qatomic_load (&w->read_pos));
+		if (!space)
+		{
+			w->stalls++;
+			qthread_sleep (1);
+			continue;
+		}
+
+		count = DEMO_RING_SIZE - (write_pos & DEMO_RING_MASK);
+		if (count > space)
+			count = space;
+		if (count > len)
+			count = len;
+		memcpy (w->ring + (write_pos & DEMO_RING_MASK), in, count);
+
+		write_pos += count;
+		in += count;
+		len -= count;
+		qatomic_store (&w->write_pos, write_pos);
+	}
+}
+
+/*
+==================
+Demo_IndexName
+
+name.dm2 -> name.idx
+==================
+*/
+static void Demo_IndexName (char *name, char *out, int size)
+{
+	char	*ext;
+
+	Q_strlcpy (out, name, size - 4);
+	ext = strrchr (out, '.');
+	if (ext && !strchr (ext, '/'))
+		*ext = 0;
+	strcat (out, ".idx");
+}
+
+/*
+==================
+Demo_OpenWrite
+
+Creates the demo file, returns NULL if it can't be opened.  Without
+index, any seek index left from an earlier recording is removed.
+==================
+*/
+demowriter_t *Demo_OpenWrite (char *name, qboolean index)
+{
+	demowriter_t	*w;
+	RFILE			*f;
+	char			indexname[MAX_OSPATH];
+	int				header[2];
+
+	FS_CreatePath (name);
+	f = rfopen (name, "wb");
+	if (!f)
+		return NULL;
+
+	w = Z_Malloc (sizeof(*w));
+	w->file = f;
+	w->compress = demo_compress->value != 0;
+	w->block = Z_Malloc (DEMO_BLOCK_SIZE);
+	if (w->compress)
+	{
+		w->packed = Z_Malloc (DEMO_BLOCK_SIZE);
+		w->hash = Z_Malloc ((1<<DEMO_HASH_BITS) * sizeof(int));
+
+		header[0] = LittleLong (DEMO_MAGIC);
+		header[1] = LittleLong (DEMO_VERSION);
+		Demo_WriteFile (w, header, sizeof(header));
+	}
+
+	// replace any index left from an earlier recording
+	Demo_IndexName (name, indexname, sizeof(indexname));
+	if (index)
+		w->index = rfopen (indexname, "wb");
+	else
+		remove (indexname);
+	if (w->index)
+	{
+		header[0] = LittleLong (IDX_MAGIC);
+		header[1] = LittleLong (IDX_VERSION);
+		rfwrite (header, sizeof(header), 1, w->index);
+	}
+
+	if (demo_async->value)
+	{
+		w->ring = Z_Malloc (DEMO_RING_SIZE);
+		w->thread = qthread_create (Demo_WriterThread, w);
+		if (!w->thread)
+		{
+			Z_Free (w->ring);
+			w->ring = NULL;
+		}
+	}
+
+	return w;
+}
+
+/*
+==================
+Demo_WriteMessage
+
+Adds one length prefixed message to the demo
+==================
+*/
+void Demo_WriteMessage (demowriter_t *w, byte *data, int len)
+{
+	retro_time_t	start;
+	int				swlen;
+
+	start = cpu_features_get_time_usec ();
+
+	swlen = LittleLong (len);
+	Demo_Put (w, &swlen, 4);
+	Demo_Put (w, data, len);
+
+	w->messages++;
+	w->rawbytes += 4 + len;
+	w->usec += cpu_features_get_time_usec () - start;
+}
+
+/*
+==================
+Demo_IndexConfigstring
+==================
+*/
+static void Demo_IndexConfigstring (demowriter_t *w, int type, int index, char *string)
+{
+	byte	head[3];
+
+	head[0] = type;
+	head[1] = index & 255;
+	head[2] = index >> 8;
+	rfwrite (head, 3, 1, w->index);
+	rfwrite (string, strlen (string) + 1, 1, w->index);
+}
+
+/*
+==================
+Demo_WriteKeyframe
+
+Call before writing a message that holds an uncompressed frame
+==================
+*/
+void Demo_WriteKeyframe (demowriter_t *w, int servercount, int serverframe, char configstrings[][MAX_QPATH])
+{
+	byte	head[9];
+	int		i;
+
+	if (!w->index)
+		return;
+
+	if (!w->keyframes || servercount != w->servercount)
+	{
+		head[0] = IDX_LEVEL;
+		i = LittleLong (servercount);
+		memcpy (head + 1, &i, 4);
+		rfwrite (head, 5, 1, w->index);
+		w->servercount = servercount;
+	}
+
+	if (!w->basecs)
+	{
+		w->basecs = Z_Malloc (MAX_CONFIGSTRINGS * MAX_QPATH);
+		w->touched = Z_Malloc (MAX_CONFIGSTRINGS);
+		memcpy (w->basecs, configstrings, MAX_CONFIGSTRINGS * MAX_QPATH);
+	}
+
+	// the first time a configstring changes, keep what it was so a seek
+	// back to an earlier keyframe can put it back
+	for (i=0 ; i<MAX_CONFIGSTRINGS ; i++)
+	{
+		if (w->touched[i] || !strcmp (configstrings[i], w->basecs[i]))
+			continue;
+		w->touched[i] = true;
+		Demo_IndexConfigstring (w, IDX_BASE, i, w->basecs[i]);
+	}
+
+	head[0] = IDX_KEYFRAME;
+	i = LittleLong (w->rawbytes);
+	memcpy (head + 1, &i, 4);
+	i = LittleLong (serverframe);
+	memcpy (head + 5, &i, 4);
+	rfwrite (head, sizeof(head), 1, w->index);
+
+	for (i=0 ; i<MAX_CONFIGSTRINGS ; i++)
+		if (w->touched[i])
+			Demo_IndexConfigstring (w, IDX_VALUE, i, configstrings[i]);
+
+	w->keyframes++;
+}
+
+/*
+==================
+Demo_CloseWrite
+
+Ends the demo, waits for everything to reach the file and closes it
+==================
+*/
+void Demo_CloseWrite (demowriter_t *w)
+{
+	int		len;
+
+	len = -1;
+	Demo_Put (w, &len, 4);
+	w->rawbytes += 4;
+
+	if (w->thread)
+	{
+		qatomic_store (&w->quit, 1);
+		qthread_join (w->thread);
+	}
+	else
+		Demo_FlushBlock (w);
+
+	rfclose (w->file);
+	if (w->index)
+		rfclose (w->index);
+
+	if (w->failed)
+		Com_Printf ("WARNING: demo write failed, the file is incomplete.\n");
+	Com_Printf ("%i messages, %i keyframes, %i kb, %i kb on disk, %.2f usec per message in the frame%s\n",
+		w->messages, w->keyframes, w->rawbytes >> 10, w->filebytes >> 10,
+		w->messages ? (double)w->usec / w->messages : 0.0,
+		w->thread ? va(", %i stalls", w->stalls) : "");
+
+	if (w->ring)
+		Z_Free (w->ring);
+	if (w->packed)
+		Z_Free (w->packed);
+	if (w->hash)
+		Z_Free (w->hash);
+	if (w->basecs)
+		Z_Free (w->basecs);
+	if (w->touched)
+		Z_Free (w->touched);
+	Z_Free (w->block);
+	Z_Free (w);
+}
+
+/*
+==============================================================
+
+READING
+
+==============================================================
+*/
+
+/*
+==================
+Demo_ReadBlockHeader
+==================
+*/
+static qboolean Demo_ReadBlockHeader (demoreader_t *r, int *rawlen, int *packedlen)
+{
+	int		header[2];
+
+	if (rfread (header, sizeof(header), 1, r->file) != 1)
+		return false;
+	*rawlen = LittleLong (header[0]);
+	*packedlen = LittleLong (header[1]);
+	if (*rawlen <= 0 || *rawlen > DEMO_BLOCK_SIZE || *packedlen <= 0 || *packedlen > *rawlen)
+	{
+		Com_Printf ("WARNING: bad demo block\n");
+		return false;
+	}
+
+	return true;
+}
+
+/*
+==================
+Demo_ReadBlockData
+==================
+*/
+static qboolean Demo_ReadBlockData (demoreader_t *r, int rawlen, int packedlen)
+{
+	r->blocksize = r->blockpos = 0;
+
+	if (packedlen == rawlen)
+	{
+		if (rfread (r->block, rawlen, 1, r->file) != 1)
+			return false;
+	}
+	else
+	{
+		if (rfread (r->packed, packedlen, 1, r->file) != 1)
+			return false;
+		if (Demo_Decompress (r->packed, packedlen, r->block, rawlen) != rawlen)
+		{
+			Com_Printf ("WARNING: bad demo block\n");
+			return false;
+		}
+	}
+
+	r->blocksize = rawlen;
+	r->blockend += rawlen;
+	return true;
+}
+
+/*
+==================
+Demo_ReadBlock
+
+Loads the next block of a compressed demo
+==================
+*/
+static qboolean Demo_ReadBlock (demoreader_t *r)
+{
+	int		rawlen, packedlen;
+
+	r->blocksize = r->blockpos = 0;
+	if (!Demo_ReadBlockHeader (r, &rawlen, &packedlen))
+		return false;
+	return Demo_ReadBlockData (r, rawlen, packedlen);
+}
+
+/*
+==================
+Demo_Read
+
+Returns false if the demo ends first
+==================
+*/
+static qboolean Demo_Read (demoreader_t *r, void *data, int len)
+{
+	byte	*out = (byte *)data;
+	int		count;
+
+	if (!r->compressed)
+	{
+		count = r->headlen < len ? r->headlen : len;
+		if (count)
+		{
+			memcpy (out, r->head, count);
+			memmove (r->head, r->head + count, r->headlen - count);
+			r->headlen -= count;
+			out += count;
+			len -= count;
+		}
+		return !len || rfread (out, len, 1, r->file) == 1;
+	}
+
+	while (len)
+	{
+		if (r->blockpos == r->blocksize && !Demo_ReadBlock (r))
+			return false;
+
+		count = r->blocksize - r->blockpos;
+		if (count > len)
+			count = len;
+		memcpy (out, r->block + r->blockpos, count);
+		r->blockpos += count;
+		out += count;
+		len -= count;
+	}
+
+	return true;
+}
+
+/*
+==================
+Demo_SeekStream
+
+Moves to an offset in the message stream.  A compressed demo skips over
+whole blocks by their headers and only unpacks the one it lands in.
+==================
+*/
+static qboolean Demo_SeekStream (demoreader_t *r, int offset)
+{
+	int		rawlen, packedlen;
+
+	r->offset = offset;
+
+	if (!r->compressed)
+	{
+		r->headlen = 0;
+		return rfseek (r->file, r->base + offset, SEEK_SET) >= 0;
+	}
+
+	if (offset >= r->blockend - r->blocksize && offset < r->blockend)
+	{
+		r->blockpos = offset - (r->blockend - r->blocksize);
+		return true;
+	}
+
+	if (offset < r->blockend)
+	{	// start over from the first block
+		if (rfseek (r->file, r->base + 8, SEEK_SET) < 0)
+			return false;
+		r->blockend = 0;
+	}
+	r->blocksize = r->blockpos = 0;
+
+	for ( ; ; )
+	{
+		if (!Demo_ReadBlockHeader (r, &rawlen, &packedlen))
+			return false;
+		if (offset < r->blockend + rawlen)
+			break;
+		if (rfseek (r->file, packedlen, SEEK_CUR) < 0)
+			return false;
+		r->blockend += rawlen;
+	}
+
+	if (!Demo_ReadBlockData (r, rawlen, packedlen))
+		return false;
+	r->blockpos = offset - (r->blockend - r->blocksize);
+	return true;
+}
+
+/*
+==================
+Demo_OpenRead
+
+Takes over a file opened for playback.  Returns NULL (and closes the
+file) if it is a compressed demo this version can't read.
+==================
+*/
+demoreader_t *Demo_OpenRead (RFILE *f)
+{
+	demoreader_t	*r;
+	int				version;
+
+	r = Z_Malloc (sizeof(*r));
+	r->file = f;
+	r->base = rftell (f);
+
+	r->headlen = rfread (r->head, 1, 4, f);
+	if (r->headlen == 4 && LittleLong (Demo_Read32 (r->head)) == DEMO_MAGIC)
+	{
+		r->headlen = 0;
+		if (rfread (&version, 4, 1, f) != 1 || LittleLong (version) != DEMO_VERSION)
+		{
+			Com_Printf ("Unsupported compressed demo version\n");
+			rfclose (f);
+			Z_Free (r);
+			return NULL;
+		}
+
+		r->compressed = true;
+		r->block = Z_Malloc (DEMO_BLOCK_SIZE);
+		r->packed = Z_Malloc (DEMO_BLOCK_SIZE);
+	}
+	else if (r->headlen < 0)
+		r->headlen = 0;
+
+	return r;
+}
+
+/*
+==================
+Demo_ReadMessage
+
+Returns the length of the next message, or -1 at the end of the demo.
+The message is only read if it fits in maxlen.
+==================
+*/
+int Demo_ReadMessage (demoreader_t *r, byte *data, int maxlen)
+{
+	int		len;
+
+	if (!Demo_Read (r, &len, 4))
+		return -1;
+	r->offset += 4;
+	len = LittleLong (len);
+	if (len < 0)
+		return -1;
+	if (len > maxlen)
+		return len;
+	if (!Demo_Read (r, data, len))
+		return -1;
+	r->offset += len;
+
+	return len;
+}
+
+/*
+==================
+Demo_FreeIndex
+==================
+*/
+static void Demo_FreeIndex (demoreader_t *r)
+{
+	if (r->indexdata)
+		FS_FreeFile (r->indexdata);
+	if (r->keys)
+		Z_Free (r->keys);
+	if (r->values)
+		Z_Free (r->values);
+	if (r->basecs)
+		Z_Free (r->basecs);
+
+	r->indexdata = NULL;
+	r->keys = NULL;
+	r->values = NULL;
+	r->basecs = NULL;
+	r->numkeys = r->numvalues = 0;
+	r->seekkey = NULL;
+}
+
+/*
+==================
+Demo_ParseIndex
+
+Walks the records of an index, only counting them when the arrays are
+still NULL.  Returns false if the index is damaged.
+==================
+*/
+static qboolean Demo_ParseIndex (demoreader_t *r, byte *data, int len)
+{
+	sizebuf_t	msg;
+	demokey_t	*key;
+	int			type, index, offset, serverframe, servercount;
+	char		*s;
+	byte		*end;
+
+	memset (&msg, 0, sizeof(msg));
+	msg.data = data;
+	msg.cursize = msg.maxsize = len;
+	msg.readcount = 8;		// magic and version
+
+	key = NULL;
+	servercount = 0;
+	r->numkeys = r->numvalues = 0;
+
+	while (msg.readcount < msg.cursize)
+	{
+		type = MSG_ReadByte (&msg);
+		if (type == IDX_LEVEL)
+		{
+			servercount = MSG_ReadLong (&msg);
+			if (msg.readcount > msg.cursize)
+				return false;
+			continue;
+		}
+
+		if (type == IDX_KEYFRAME)
+		{
+			offset = MSG_ReadLong (&msg);
+			serverframe = MSG_ReadLong (&msg);
+			if (msg.readcount > msg.cursize || offset < 0)
+				return false;
+			if (r->keys)
+			{
+				key = &r->keys[r->numkeys];
+				key->offset = offset;
+				key->serverframe = serverframe;
+				key->servercount = servercount;
+				key->firstvalue = r->numvalues;
+				key->numvalues = 0;
+			}
+			r->numkeys++;
+			continue;
+		}
+
+		// a truncated index ends anywhere, check before looking
+		// for the end of the string
+		index = MSG_ReadShort (&msg);
+		if (msg.readcount > msg.cursize || index < 0 || index >= MAX_CONFIGSTRINGS)
+			return false;
+		s = (char *)msg.data + msg.readcount;
+		end = memchr (s, 0, msg.cursize - msg.readcount);
+		if (!end)
+			return false;
+		msg.readcount = end + 1 - msg.data;
+
+		if (type == IDX_BASE)
+		{
+			if (r->basecs)
+				r->basecs[index] = s;
+		}
+		else if (type == IDX_VALUE)
+		{
+			if (!r->numkeys)
+				return false;
+			if (r->values)
+			{
+				r->values[r->numvalues].index = index;
+				r->values[r->numvalues].string = s;
+				key->numvalues++;
+			}
+			r->numvalues++;
+		}
+		else
+			return false;
+	}
+
+	return true;
+}
+
+/*
+==================
+Demo_LoadIndex
+
+Loads the seek index written next to a demo, if there is one
+==================
+*/
+qboolean Demo_LoadIndex (demoreader_t *r, char *name)
+{
+	char	indexname[MAX_OSPATH];
+	byte	*data;
+	int		len;
+
+	Demo_FreeIndex (r);
+
+	Demo_IndexName (name, indexname, sizeof(indexname));
+	len = FS_LoadFile (indexname, (void **)&data);
+	if (!data)
+		return false;
+
+	if (len < 8 || LittleLong (Demo_Read32 (data)) != IDX_MAGIC
+		|| LittleLong (Demo_Read32 (data + 4)) < 1
+		|| LittleLong (Demo_Read32 (data + 4)) > IDX_VERSION
+		|| !Demo_ParseIndex (r, data, len))
+	{
+		Com_Printf ("WARNING: %s is damaged, demo_seek is disabled\n", indexname);
+		r->numkeys = r->numvalues = 0;
+		FS_FreeFile (data);
+		return false;
+	}
+	if (!r->numkeys)
+	{	// server demos have no keyframes
+		r->numvalues = 0;
+		FS_FreeFile (data);
+		return false;
+	}
+
+	r->indexdata = data;
+	r->keys = Z_Malloc (r->numkeys * sizeof(*r->keys));
+	if (r->numvalues)
+		r->values = Z_Malloc (r->numvalues * sizeof(*r->values));
+	r->basecs = Z_Malloc (MAX_CONFIGSTRINGS * sizeof(*r->basecs));
+	Demo_ParseIndex (r, data, len);
+
+	return true;
+}
+
+/*
+==================
+Demo_Seek
+
+Moves playback to the last keyframe at or before msec into the level
+being played.  Returns the time of that keyframe, or -1 if the demo has
+no index.
+==================
+*/
+int Demo_Seek (demoreader_t *r, int msec)
+{
+	demokey_t	*key, *first, *last;
+	int			serverframe;
+
+	if (!r->numkeys)
+		return -1;
+
+	// the level being played is the one of the last keyframe passed
+	for (key = r->keys ; key + 1 < r->keys + r->numkeys && key[1].offset <= r->offset ; key++)
+		;
+
+	first = last = key;
+	while (first > r->keys && first[-1].servercount == key->servercount)
+		first--;
+	while (last + 1 < r->keys + r->numkeys && last[1].servercount == key->servercount)
+		last++;
+
+	serverframe = first->serverframe + msec / 100;
+	for (key = first ; key < last && key[1].serverframe <= serverframe ; key++)
+		;
+
+	if (!Demo_SeekStream (r, key->offset))
+		return -1;
+
+	r->seekkey = key;
+	r->seekcs = 0;
+	r->seekvalue = 0;
+
+	return (key->serverframe - first->serverframe) * 100;
+}
+
+/*
+==================
+Demo_SeekConfigstrings
+
+After a seek, every configstring that changes anywhere in the demo has
+to be set to its value at the keyframe before playback goes on.  Adds as
+many as fit to msg, returns false once there are none left.
+==================
+*/
+qboolean Demo_SeekConfigstrings (demoreader_t *r, sizebuf_t *msg)
+{
+	demokey_t	*key;
+	democs_t	*value;
+	char		*s;
+	int			len;
+
+	key = r->seekkey;
+	if (!key)
+		return false;
+
+	for ( ; r->seekcs < MAX_CONFIGSTRINGS ; r->seekcs++)
+	{
+		if (!r->basecs[r->seekcs])
+			continue;		// never changes
+
+		// the keyframe values are in configstring order
+		value = NULL;
+		if (r->seekvalue < key->numvalues
+			&& r->values[key->firstvalue + r->seekvalue].index == r->seekcs)
+			value = &r->values[key->firstvalue + r->seekvalue];
+		s = value ? value->string : r->basecs[r->seekcs];
+
+		len = strlen (s) + 4;
+		if (len <= msg->maxsize)
+		{
+			if (msg->cursize + len > msg->maxsize)
+				break;
+			MSG_WriteByte (msg, svc_configstring);
+			MSG_WriteShort (msg, r->seekcs);
+			MSG_WriteString (msg, s);
+		}
+		if (value)
+			r->seekvalue++;
+	}
+
+	if (r->seekcs == MAX_CONFIGSTRINGS)
+		r->seekkey = NULL;
+
+	return msg->cursize != 0;
+}
+
+/*
+==================
+Demo_CloseRead
+==================
+*/
+void Demo_CloseRead (demoreader_t *r)
+{
+	rfclose (r->file);
+	Demo_FreeIndex (r);
+	if (r->block)
+		Z_Free (r->block);
+	if (r->packed)
+		Z_Free (r->packed);
+	Z_Free (r);
+}
+
+/*
+==================
+Demo_Init
+==================
+*/
+void Demo_Init (void)
+{
+	demo_compress = Cvar_Get ("demo_compress", "0", CVAR_ARCHIVE);
+	demo_async = Cvar_Get ("demo_async", "1", CVAR_ARCHIVE);
+	demo_keyframe = Cvar_Get ("demo_keyframe", "10", CVAR_ARCHIVE);
+}
@@ -84,6 +84,25 @@ typedef struct searchpath_s
 searchpath_t	*fs_searchpaths;
 searchpath_t	*fs_base_searchpaths;	// without gamedirs
 
+//
+// names FS_FOpenFile has already failed to find, so probes for
+// optional files (.tga/.jpg replacements, sounds, downloads) don't
+// walk every pak and directory again
+//
+#define	MISS_HASH_SIZE	1024
+#define	MAX_MISSES		8192
+
+typedef struct fsmiss_s
+{
+	struct fsmiss_s	*next;
+	char			name[1];	// variable sized
+} fsmiss_t;
+
+fsmiss_t	*fs_misshash[MISS_HASH_SIZE];
+int			fs_nummisses;
+int			fs_misshits;		// probes answered from the cache since the last report
+cvar_t		*fs_misscache;
+
 
 /*
 
@@ -153,6 +172,96 @@ void FS_FCloseFile (RFILE *f)
 }
 
 
+/*
+================
+FS_MissHash
+================
+*/
+static int FS_MissHash (char *name)
+{
+	unsigned	hash = 0;
+
+	while (*name)
+		hash = hash * 31 + *name++;
+
+	return hash & (MISS_HASH_SIZE-1);
+}
+
+/*
+================
+FS_FindMiss
+================
+*/
+static qboolean FS_FindMiss (char *name)
+{
+	fsmiss_t	*m;
+
+	for (m = fs_misshash[FS_MissHash (name)] ; m ; m = m->next)
+		if (!strcmp (m->name, name))
+			return true;
+
+	return false;
+}
+
+/*
+================
+FS_AddMiss
+================
+*/
+static void FS_AddMiss (char *name)
+{
+	fsmiss_t	*m;
+	int			hash;
+
+	if (fs_nummisses == MAX_MISSES)
+		FS_FlushMissCache ();
+
+	hash = FS_MissHash (name);
+	m = Z_Malloc (sizeof(*m) + strlen(name));
+	strcpy (m->name, name);
+	m->next = fs_misshash[hash];
+	fs_misshash[hash] = m;
+	fs_nummisses++;
+}
+
+/*
+================
+FS_FlushMissCache
+
+Must be called whenever a file may have appeared in the search path
+================
+*/
+void FS_FlushMissCache (void)
+{
+	fsmiss_t	*m, *next;
+	int			i;
+
+	for (i=0 ; i<MISS_HASH_SIZE ; i++)
+	{
+		for (m = fs_misshash[i] ; m ; m = next)
+		{
+			next = m->next;
+			Z_Free (m);
+		}
+		fs_misshash[i] = NULL;
+	}
+	fs_nummisses = 0;
+}
+
+/*
+================
+FS_ReportMissCache
+
+Prints and resets the number of probes the cache answered, called
+once a level has finished loading
+================
+*/
+void FS_ReportMissCache (void)
+{
+	Com_DPrintf ("%i missing file probes skipped, %i names cached\n", fs_misshits, fs_nummisses);
+	fs_misshits = 0;
+}
+
 // RAFAEL
 /*
 	Developer_searchpath
@@ -214,6 +323,13 @@ int FS_FOpenFile (char *filename, RFILE **file)
 
 	file_from_pak = 0;
 
+	if (fs_misscache && fs_misscache->value && FS_FindMiss (filename))
+	{
+		fs_misshits++;
+		*file = NULL;
+		return -1;
+	}
+
 	// check for links first
 	for (link = fs_links ; link ; link=link->next)
 	{
@@ -271,12 +387,90 @@ int FS_FOpenFile (char *filename, RFILE **file)
 	}
 	
 	Com_DPrintf ("FindFile: can't find %s\n", filename);
+
+	if (fs_misscache && fs_misscache->value)
+		FS_AddMiss (filename);
 	
 	*file = NULL;
 	return -1;
 }
 
 
+/*
+===========
+FS_FileSource
+
+Finds where FS_FOpenFile would read a file from without reading it.
+The pak or file name goes in source and *offset gets the position in
+the pak, 0 for a file of its own.  Returns the length, -1 if the file
+isn't in the search path.
+===========
+*/
+int FS_FileSource (char *filename, char *source, int size, int *offset)
+{
+	searchpath_t	*search;
+	char			netpath[MAX_OSPATH];
+	pack_t			*pak;
+	int				i, len;
+	filelink_t		*link;
+	RFILE			*f;
+
+	*offset = 0;
+
+	if (fs_misscache && fs_misscache->value && FS_FindMiss (filename))
+	{
+		fs_misshits++;
+		return -1;
+	}
+
+	for (link = fs_links ; link ; link=link->next)
+	{
+		if (!strncmp (filename, link->from, link->fromlength))
+		{
+			Com_sprintf (netpath, sizeof(netpath), "%s%s",link->to, filename+link->fromlength);
+			f = rfopen (netpath, "rb");
+			if (!f)
+				return -1;
+			len = FS_filelength (f);
+			rfclose (f);
+			Q_strlcpy (source, netpath, size);
+			return len;
+		}
+	}
+
+	for (search = fs_searchpaths ; search ; search = search->next)
+	{
+		if (search->pack)
+		{
+			pak = search->pack;
+			for (i=0 ; i<pak->numfiles ; i++)
+				if (!Q_strcasecmp (pak->files[i].name, filename))
+				{
+					Q_strlcpy (source, pak->filename, size);
+					*offset = pak->files[i].filepos;
+					return pak->files[i].filelen;
+				}
+		}
+		else
+		{
+			Com_sprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
+			f = rfopen (netpath, "rb");
+			if (!f)
+				continue;
+			len = FS_filelength (f);
+			rfclose (f);
+			Q_strlcpy (source, netpath, size);
+			return len;
+		}
+	}
+
+	if (fs_misscache && fs_misscache->value)
+		FS_AddMiss (filename);
+
+	return -1;
+}
+
+
 /*
 =================
 FS_ReadFile
@@ -534,6 +728,8 @@ void FS_SetGamedir (char *dir)
 		return;
 	}
 
+	FS_FlushMissCache ();
+
 	//
 	// free up any current game dir info
 	//
@@ -590,6 +786,8 @@ void FS_Link_f (void)
 		return;
 	}
 
+	FS_FlushMissCache ();
+
 	// see if the link already exists
 	prev = &fs_links;
 	for (l=fs_links ; l ; l=l->next)
@@ -737,6 +935,8 @@ void FS_Path_f (void)
 	Com_Printf ("\nLinks:\n");
 	for (l=fs_links ; l ; l=l->next)
 		Com_Printf ("%s : %s\n", l->from, l->to);
+
+	Com_Printf ("\n%i missing files cached\n", fs_nummisses);
 }
 
 /*
@@ -781,6 +981,8 @@ void FS_InitFilesystem (void)
 	Cmd_AddCommand ("link", FS_Link_f);
 	Cmd_AddCommand ("dir", FS_Dir_f );
 
+	fs_misscache = Cvar_Get ("fs_misscache", "1", 0);
+
 	//
 	// basedir <path>
 	// allows the game to run from outside the data tree
@@ -60,6 +60,17 @@ reliable acknowledgement numbers provides protection against malicious
 address spoofing.
 
 
+Protocol 35 channels (server to client only) can send a message larger
+than a datagram.  Bit 30 of the sequence then says a short follows the
+header: the low 14 bits are the offset of this piece in the message, bit
+14 is set when more pieces follow and bit 15 when the message is packed
+with Demo_Compress, as a short raw length and the packed data.  Every
+piece carries the same sequence numbers, and the receiver only processes
+the message once the last piece has arrived in order; losing a piece
+loses the whole message, like losing an ordinary packet.  Loopback has no
+packet size limit, so it gets whole messages and nothing is packed.
+
+
 The qport field is a workaround for bad address translating routers that
 sometimes remap the client's source port on a packet during gameplay.
 
@@ -77,10 +88,26 @@ unacknowledged reliable
 cvar_t		*showpackets;
 cvar_t		*showdrop;
 cvar_t		*qport;
+cvar_t		*net_fragment;
+cvar_t		*net_compress;
 
 netadr_t	net_from;
 sizebuf_t	net_message;
-byte		net_message_buffer[MAX_MSGLEN];
+byte		net_message_buffer[MAX_MSGLEN_EXT];
+
+#define	EXT_BIT				(1<<30)		// in the sequence: the ext short follows
+#define	EXT_OFFSET			0x3fff
+#define	EXT_MORE			(1<<14)
+#define	EXT_COMPRESSED		(1<<15)
+
+#define	FRAGMENT_SIZE		1280
+#define	COMPRESS_MIN		128		// smaller messages are sent as they are
+
+// only the client's single channel takes fragments, so one set of buffers
+static byte	fragment_buf[MAX_MSGLEN_EXT];
+static byte	packet_buf[MAX_MSGLEN_EXT];
+static byte	packed_buf[MAX_MSGLEN_EXT];
+static int	*compress_hash;
 
 /*
 ===============
@@ -98,6 +125,8 @@ void Netchan_Init (void)
 	showpackets = Cvar_Get ("showpackets", "0", 0);
 	showdrop = Cvar_Get ("showdrop", "0", 0);
 	qport = Cvar_Get ("qport", va("%i", port), CVAR_NOSET);
+	net_fragment = Cvar_Get ("net_fragment", "1", 0);
+	net_compress = Cvar_Get ("net_compress", "1", 0);
 }
 
 /*
@@ -109,17 +138,21 @@ Sends an out-of-band datagram
 */
 void Netchan_OutOfBand (int net_socket, netadr_t adr, int length, byte *data)
 {
-	sizebuf_t	send;
-	byte		send_buf[MAX_MSGLEN];
+	byte		header[4];
+	netseg_t	segs[MAX_NETSEGS];
 
 // write the packet header
-	SZ_Init (&send, send_buf, sizeof(send_buf));
-	
-	MSG_WriteLong (&send, -1);	// -1 sequence means out of band
-	SZ_Write (&send, data, length);
+	header[0] = header[1] = header[2] = header[3] = 0xff;	// -1 sequence means out of band
+
+	if (length > MAX_MSGLEN - 4)
+		Com_Error (ERR_FATAL, "Netchan_OutOfBand: %i is > full buffer size", length);
 
 // send the datagram
-	NET_SendPacket (net_socket, send.cursize, send.data, adr);
+	segs[0].data = header;
+	segs[0].length = 4;
+	segs[1].data = data;
+	segs[1].length = length;
+	NET_SendPacketv (net_socket, 2, segs, adr);
 }
 
 /*
@@ -162,6 +195,7 @@ void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int qport)
 
 	SZ_Init (&chan->message, chan->message_buf, sizeof(chan->message_buf));
 	chan->message.allowoverflow = true;
+	chan->reliable = chan->reliable_buf;
 }
 
 
@@ -200,6 +234,84 @@ qboolean Netchan_NeedReliable (netchan_t *chan)
 	return send_reliable;
 }
 
+/*
+===============
+Netchan_TransmitExt
+
+Sends a protocol 35 message, packed if that makes it smaller and split
+into fragments if it is still too large for one datagram.  segs[0] is the
+header.  Returns the number of bytes sent.
+================
+*/
+static int Netchan_TransmitExt (netchan_t *chan, int numsegs, netseg_t *segs)
+{
+	byte		header[10];
+	netseg_t	frag[MAX_NETSEGS];
+	byte		*data;
+	int			i, length, packed;
+	int			offset, ext, sent;
+	unsigned	w1;
+
+	length = 0;
+	for (i=1 ; i<numsegs ; i++)
+	{
+		memcpy (packet_buf + length, segs[i].data, segs[i].length);
+		length += segs[i].length;
+	}
+	data = packet_buf;
+	ext = 0;
+
+	packed = 0;
+	if (net_compress->value && length >= COMPRESS_MIN)
+	{
+		if (!compress_hash)
+			compress_hash = Z_Malloc ((1<<DEMO_HASH_BITS) * sizeof(int));
+		packed = Demo_Compress (packet_buf, length, packed_buf + 2, compress_hash);
+	}
+	if (packed && packed + 2 < length)
+	{
+		packed_buf[0] = length & 0xff;
+		packed_buf[1] = length >> 8;
+		data = packed_buf;
+		length = packed + 2;
+		ext = EXT_COMPRESSED;
+	}
+
+	// the header with the ext bit set in the sequence
+	memcpy (header, segs[0].data, segs[0].length);
+	w1 = header[0] | (header[1]<<8) | (header[2]<<16) | ((unsigned)header[3]<<24);
+	w1 |= EXT_BIT;
+	header[0] = w1 & 0xff;
+	header[1] = (w1>>8) & 0xff;
+	header[2] = (w1>>16) & 0xff;
+	header[3] = w1>>24;
+
+	frag[0].data = header;
+	frag[0].length = segs[0].length + 2;
+
+	sent = 0;
+	offset = 0;
+	do
+	{
+		frag[1].data = data + offset;
+		frag[1].length = length - offset;
+		if (frag[1].length > FRAGMENT_SIZE)
+			frag[1].length = FRAGMENT_SIZE;
+
+		i = ext | offset;
+		if (offset + frag[1].length < length)
+			i |= EXT_MORE;
+		header[segs[0].length] = i & 0xff;
+		header[segs[0].length+1] = i >> 8;
+
+		NET_SendPacketv (chan->sock, 2, frag, chan->remote_address);
+		sent += frag[0].length + frag[1].length;
+		offset += frag[1].length;
+	} while (offset < length);
+
+	return sent;
+}
+
 /*
 ===============
 Netchan_Transmit
@@ -212,9 +324,11 @@ A 0 length will still generate a packet and deal with the reliable messages.
 */
 void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 {
-	sizebuf_t	send;
-	byte		send_buf[MAX_MSGLEN];
-	qboolean	send_reliable;
+	byte		header[10];
+	netseg_t	segs[MAX_NETSEGS];
+	int			numsegs, size, maxlen;
+	byte		*buf;
+	qboolean	send_reliable, ext;
 	unsigned	w1, w2;
 
 // check for message overflow
@@ -230,63 +344,178 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 
 	if (!chan->reliable_length && chan->message.cursize)
 	{
-		memcpy (chan->reliable_buf, chan->message_buf, chan->message.cursize);
+		// the message buffer becomes the reliable one and the old
+		// reliable buffer takes new messages
+		buf = chan->reliable;
+		chan->reliable = chan->message.data;
 		chan->reliable_length = chan->message.cursize;
+		chan->message.data = buf;
 		chan->message.cursize = 0;
 		chan->reliable_sequence ^= 1;
 	}
 
 
-// write the packet header
-	SZ_Init (&send, send_buf, sizeof(send_buf));
+	// protocol 35 servers can send messages past a datagram
+	ext = chan->protocol == PROTOCOL_VERSION_EXT && chan->sock == NS_SERVER;
+	maxlen = ext && !chan->demolimit ? MAX_MSGLEN_EXT : MAX_MSGLEN;
 
+// write the packet header
 	w1 = ( chan->outgoing_sequence & ~(1<<31) ) | (send_reliable<<31);
 	w2 = ( chan->incoming_sequence & ~(1<<31) ) | (chan->incoming_reliable_sequence<<31);
 
 	chan->outgoing_sequence++;
 	chan->last_sent = curtime;
 
-	MSG_WriteLong (&send, w1);
-	MSG_WriteLong (&send, w2);
+	header[0] = w1 & 0xff;
+	header[1] = (w1>>8) & 0xff;
+	header[2] = (w1>>16) & 0xff;
+	header[3] = w1>>24;
+	header[4] = w2 & 0xff;
+	header[5] = (w2>>8) & 0xff;
+	header[6] = (w2>>16) & 0xff;
+	header[7] = w2>>24;
+	size = 8;
 
 	// send the qport if we are a client
 	if (chan->sock == NS_CLIENT)
-		MSG_WriteShort (&send, qport->value);
+	{
+		w1 = (int)qport->value;
+		header[8] = w1 & 0xff;
+		header[9] = (w1>>8) & 0xff;
+		size = 10;
+	}
+
+	segs[0].data = header;
+	segs[0].length = size;
+	numsegs = 1;
 
-// copy the reliable message to the packet first
+// the reliable message goes in the packet first
 	if (send_reliable)
 	{
-		SZ_Write (&send, chan->reliable_buf, chan->reliable_length);
+		segs[numsegs].data = chan->reliable;
+		segs[numsegs].length = chan->reliable_length;
+		numsegs++;
+		size += chan->reliable_length;
 		chan->last_reliable_sequence = chan->outgoing_sequence;
 	}
 	
 // add the unreliable part if space is available
-	if (send.maxsize - send.cursize >= length)
-		SZ_Write (&send, data, length);
+	if (maxlen - size >= length)
+	{
+		segs[numsegs].data = data;
+		segs[numsegs].length = length;
+		numsegs++;
+		size += length;
+	}
 	else
 		Com_Printf ("Netchan_Transmit: dumped unreliable\n");
 
 // send the datagram
-	NET_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
+	if (ext && (size > MAX_MSGLEN || (size - segs[0].length >= COMPRESS_MIN && net_compress->value))
+		&& chan->remote_address.type != NA_LOOPBACK)
+		size = Netchan_TransmitExt (chan, numsegs, segs);
+	else
+		NET_SendPacketv (chan->sock, numsegs, segs, chan->remote_address);
+	chan->sent_length = size;
 
 	if (showpackets->value)
 	{
 		if (send_reliable)
 			Com_Printf ("send %4i : s=%i reliable=%i ack=%i rack=%i\n"
-				, send.cursize
+				, size
 				, chan->outgoing_sequence - 1
 				, chan->reliable_sequence
 				, chan->incoming_sequence
 				, chan->incoming_reliable_sequence);
 		else
 			Com_Printf ("send %4i : s=%i ack=%i rack=%i\n"
-				, send.cursize
+				, size
 				, chan->outgoing_sequence - 1
 				, chan->incoming_sequence
 				, chan->incoming_reliable_sequence);
 	}
 }
 
+/*
+=================
+Netchan_Reassemble
+
+Collects the pieces of a protocol 35 message.  When the last one is in,
+the whole message replaces the packet payload in msg and true is returned.
+=================
+*/
+static qboolean Netchan_Reassemble (netchan_t *chan, sizebuf_t *msg, int sequence)
+{
+	int		ext, offset, length, rawlength;
+	int		start;
+	byte	*data;
+
+	// only servers send these
+	if (chan->sock != NS_CLIENT)
+		return false;
+
+	ext = MSG_ReadShort (msg) & 0xffff;
+	offset = ext & EXT_OFFSET;
+	start = msg->readcount;
+	length = msg->cursize - start;
+	if (length < 0)
+		return false;
+
+	if (sequence != chan->fragment_sequence)
+	{
+		chan->fragment_sequence = sequence;
+		chan->fragment_length = 0;
+	}
+
+	if (offset != chan->fragment_length || offset + length > sizeof(fragment_buf))
+	{
+		if (showdrop->value)
+			Com_Printf ("%s:Dropped fragment %i of %i\n"
+				, NET_AdrToString (chan->remote_address)
+				, offset
+				, sequence);
+		chan->fragment_length = 0;
+		chan->fragment_sequence = -1;
+		return false;
+	}
+
+	memcpy (fragment_buf + offset, msg->data + start, length);
+	chan->fragment_length += length;
+	if (ext & EXT_MORE)
+		return false;
+
+	length = chan->fragment_length;
+	chan->fragment_length = 0;
+	chan->fragment_sequence = -1;
+
+	// the message goes where the payload of an ordinary packet would
+	start -= 2;
+	data = msg->data + start;
+	if (ext & EXT_COMPRESSED)
+	{
+		if (length < 2)
+			return false;
+		rawlength = fragment_buf[0] | (fragment_buf[1]<<8);
+		if (rawlength > msg->maxsize - start
+			|| Demo_Decompress (fragment_buf + 2, length - 2, data, rawlength) != rawlength)
+		{
+			Com_Printf ("%s:Bad compressed packet\n", NET_AdrToString (chan->remote_address));
+			return false;
+		}
+		length = rawlength;
+	}
+	else
+	{
+		if (length > msg->maxsize - start)
+			return false;
+		memcpy (data, fragment_buf, length);
+	}
+
+	msg->readcount = start;
+	msg->cursize = start + length;
+	return true;
+}
+
 /*
 =================
 Netchan_Process
@@ -300,6 +529,7 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 	unsigned	sequence, sequence_ack;
 	unsigned	reliable_ack, reliable_message;
 	int			qport;
+	qboolean	ext;
 
 // get sequence numbers		
 	MSG_BeginReading (msg);
@@ -316,6 +546,13 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 	sequence &= ~(1<<31);
 	sequence_ack &= ~(1<<31);	
 
+	ext = false;
+	if (chan->protocol == PROTOCOL_VERSION_EXT)
+	{
+		ext = (sequence & EXT_BIT) != 0;
+		sequence &= ~EXT_BIT;
+	}
+
 	if (showpackets->value)
 	{
 		if (reliable_message)
@@ -346,6 +583,12 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 		return false;
 	}
 
+//
+// put a fragmented or packed message back together
+//
+	if (ext && !Netchan_Reassemble (chan, msg, sequence))
+		return false;
+
 //
 // dropped packets don't keep the message from being used
 //
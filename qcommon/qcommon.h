@@ -107,6 +107,11 @@ void MSG_WriteAngle (sizebuf_t *sb, float f);
 void MSG_WriteAngle16 (sizebuf_t *sb, float f);
 void MSG_WriteDeltaUsercmd (sizebuf_t *sb, struct usercmd_s *from, struct usercmd_s *cmd);
 void MSG_WriteDeltaEntity (struct entity_state_s *from, struct entity_state_s *to, sizebuf_t *msg, qboolean force, qboolean newentity);
+// the lanes of an entity_state_t that changed, and the header bits they
+// turn into; MSG_EntityLanes_C is the reference for the vectorized version
+unsigned MSG_EntityLanes (const struct entity_state_s *from, const struct entity_state_s *to);
+unsigned MSG_EntityLanes_C (const struct entity_state_s *from, const struct entity_state_s *to);
+int MSG_EntityBits (const struct entity_state_s *from, const struct entity_state_s *to, unsigned lanes, qboolean newentity);
 void MSG_WriteDir (sizebuf_t *sb, vec3_t vector);
 
 
@@ -125,6 +130,7 @@ void	MSG_ReadPos (sizebuf_t *sb, vec3_t pos);
 float	MSG_ReadAngle (sizebuf_t *sb);
 float	MSG_ReadAngle16 (sizebuf_t *sb);
 void	MSG_ReadDeltaUsercmd (sizebuf_t *sb, struct usercmd_s *from, struct usercmd_s *cmd);
+void	MSG_ReadDeltaEntity (sizebuf_t *sb, struct entity_state_s *from, struct entity_state_s *to, int number, int bits);
 
 void	MSG_ReadDir (sizebuf_t *sb, vec3_t vector);
 
@@ -181,6 +187,11 @@ PROTOCOL
 
 #define	PROTOCOL_VERSION	34
 
+// 34 plus frames larger than a datagram, sent in fragments and optionally
+// compressed.  Servers offer it in their challenge reply and clients ask
+// for it in connect; the messages inside the channel are still 34.
+#define	PROTOCOL_VERSION_EXT	35
+
 //=========================================
 
 #define	PORT_MASTER	27900
@@ -527,6 +538,7 @@ NET
 #define	PORT_ANY	-1
 
 #define	MAX_MSGLEN		1400		// max length of a message
+#define	MAX_MSGLEN_EXT	16384		// max length of a fragmented protocol 35 message
 #define	PACKET_HEADER	10			// two ints and a short
 
 typedef enum {NA_LOOPBACK, NA_BROADCAST, NA_IP, NA_IPX, NA_BROADCAST_IPX} netadrtype_t;
@@ -548,8 +560,19 @@ void		NET_Shutdown (void);
 
 void		NET_Config (qboolean multiplayer);
 
+// one piece of an outgoing datagram; a packet is sent as a list of them
+// so the pieces don't have to be copied together first
+typedef struct
+{
+	void	*data;
+	int		length;
+} netseg_t;
+
+#define	MAX_NETSEGS		4		// most pieces NET_SendPacketv takes
+
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message);
 void		NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
+void		NET_SendPacketv (netsrc_t sock, int numsegs, netseg_t *segs, netadr_t to);
 
 qboolean	NET_CompareAdr (netadr_t a, netadr_t b);
 qboolean	NET_CompareBaseAdr (netadr_t a, netadr_t b);
@@ -589,18 +612,31 @@ typedef struct
 	int			reliable_sequence;			// single bit
 	int			last_reliable_sequence;		// sequence number of last send
 
+	int			protocol;			// PROTOCOL_VERSION_EXT allows fragments
+	qboolean	demolimit;			// keep protocol 35 messages to MAX_MSGLEN, the
+									// client is recording a demo
+	int			sent_length;		// bytes put on the wire by the last transmit
+
+// fragments of the message being reassembled
+	int			fragment_sequence;
+	int			fragment_length;
+
 // reliable staging and holding areas
 	sizebuf_t	message;		// writing buffer to send to server
 	byte		message_buf[MAX_MSGLEN-16];		// leave space for header
 
-// message is copied to this buffer when it is first transfered
+// message becomes the reliable message when it is first transfered, and
+// the buffers trade places instead of being copied
 	int			reliable_length;
+	byte		*reliable;		// message_buf or reliable_buf
 	byte		reliable_buf[MAX_MSGLEN-16];	// unacked reliable message
 } netchan_t;
 
 extern	netadr_t	net_from;
 extern	sizebuf_t	net_message;
-extern	byte		net_message_buffer[MAX_MSGLEN];
+extern	byte		net_message_buffer[MAX_MSGLEN_EXT];
+extern	cvar_t		*net_fragment;
+extern	cvar_t		*net_compress;
 
 
 void Netchan_Init (void);
@@ -671,6 +707,9 @@ qboolean	CM_HeadnodeVisible (int headnode, byte *visbits);
 
 void		CM_WritePortalState (RFILE *f);
 void		CM_ReadPortalState (RFILE *f);
+int			CM_PortalStateSize (void);
+void		CM_WritePortalStateBuffer (byte *buf);
+void		CM_ReadPortalStateBuffer (const byte *buf);
 
 /*
 ==============================================================
@@ -704,6 +743,9 @@ int		FS_FOpenFile (char *filename, RFILE **file);
 void	FS_FCloseFile (RFILE *f);
 // note: this can't be called from another DLL, due to MS libc issues
 
+int		FS_FileSource (char *filename, char *source, int size, int *offset);
+// the pak or file a name resolves to, and its length, without opening it
+
 int		FS_LoadFile (char *path, void **buffer);
 // a null buffer will just return the file length without loading
 // a -1 length is not present
@@ -716,6 +758,55 @@ void	FS_FreeFile (void *buffer);
 void	FS_CreatePath (char *path);
 int FS_filelength(RFILE* f);
 
+void	FS_FlushMissCache (void);
+// forget every cached "file not found", call after creating a file
+// that may be looked up through the search path
+void	FS_ReportMissCache (void);
+
+
+/*
+==============================================================
+
+DEMO FILES
+
+==============================================================
+*/
+
+typedef struct demowriter_s demowriter_t;
+typedef struct demoreader_s demoreader_t;
+
+extern	cvar_t	*demo_compress;
+extern	cvar_t	*demo_async;
+extern	cvar_t	*demo_keyframe;		// seconds between seek index keyframes
+
+void	Demo_Init (void);
+
+demowriter_t *Demo_OpenWrite (char *name, qboolean index);
+// index writes name.idx for demo_seek, only client demos can use one
+void	Demo_WriteMessage (demowriter_t *w, byte *data, int len);
+void	Demo_CloseWrite (demowriter_t *w);
+// writes the -1 terminator and waits for the writer to finish
+void	Demo_WriteKeyframe (demowriter_t *w, int servercount, int serverframe, char configstrings[][MAX_QPATH]);
+// call before writing a message that holds an uncompressed frame
+
+demoreader_t *Demo_OpenRead (RFILE *f);
+int		Demo_ReadMessage (demoreader_t *r, byte *data, int maxlen);
+// -1 at the end of the demo, a length over maxlen is returned unread
+void	Demo_CloseRead (demoreader_t *r);
+
+qboolean Demo_LoadIndex (demoreader_t *r, char *name);
+int		Demo_Seek (demoreader_t *r, int msec);
+// returns the time of the keyframe playback moved to, -1 without an index
+qboolean Demo_SeekConfigstrings (demoreader_t *r, sizebuf_t *msg);
+// after a seek, fills msg with configstrings to restore, false when done
+
+// the LZ77 coder of compressed demos, also used by the network channel
+#define	DEMO_HASH_BITS		14
+int		Demo_Compress (const byte *in, int inlen, byte *out, int *hash);
+// returns the packed length, 0 if it doesn't get smaller; hash holds 1<<DEMO_HASH_BITS ints
+int		Demo_Decompress (const byte *in, int inlen, byte *out, int outlen);
+// returns the unpacked length, -1 if the data is corrupt
+
 
 /*
 ==============================================================
@@ -820,10 +911,14 @@ void CL_Shutdown (void);
 void CL_Frame (int msec);
 void Con_Print (char *text);
 void SCR_BeginLoadingPlaque (void);
+void CL_DemoCompleted (void);
 
 void SV_Init (void);
 void SV_Shutdown (char *finalmsg, qboolean reconnect);
 void SV_Frame (int msec);
+int SV_StateSize (void);
+int SV_WriteState (byte *buf, int size);
+qboolean SV_ReadState (const byte *buf, int size);
 
 
 
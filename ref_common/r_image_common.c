@@ -135,67 +135,109 @@ typedef struct _TargaHeader {
 
 /*
 =============
-LoadTGA
+TGA_ParseHeader
+
+Returns a pointer to the first byte after the header
 =============
 */
-void LoadTGA (char *name, byte **pic, int *width, int *height)
+static byte *TGA_ParseHeader (byte *buffer, TargaHeader *targa_header)
 {
-	int		columns, rows, numPixels;
-	byte	*pixbuf;
-	int		row, column;
-	byte	*buf_p;
-	byte	*buffer;
-	int		length;
-	TargaHeader		targa_header;
-	byte			*targa_rgba;
-	byte tmp[2];
-
-	*pic = NULL;
-
-	/*
-	 * load the file
-	 */
-	length = ri.FS_LoadFile (name, (void **)&buffer);
-   (void)length;
-	if (!buffer)
-	{
-		ri.Con_Printf (PRINT_DEVELOPER, "Bad tga file %s\n", name);
-		return;
-	}
+	byte	*buf_p = buffer;
+	byte	tmp[2];
 
-	buf_p = buffer;
-
-	targa_header.id_length = *buf_p++;
-	targa_header.colormap_type = *buf_p++;
-	targa_header.image_type = *buf_p++;
+	targa_header->id_length = *buf_p++;
+	targa_header->colormap_type = *buf_p++;
+	targa_header->image_type = *buf_p++;
 	
 	tmp[0] = buf_p[0];
 	tmp[1] = buf_p[1];
-	targa_header.colormap_index = LittleShort ( *((short *)tmp) );
+	targa_header->colormap_index = LittleShort ( *((short *)tmp) );
 	buf_p+=2;
 	tmp[0] = buf_p[0];
 	tmp[1] = buf_p[1];
-	targa_header.colormap_length = LittleShort ( *((short *)tmp) );
+	targa_header->colormap_length = LittleShort ( *((short *)tmp) );
 	buf_p+=2;
-	targa_header.colormap_size = *buf_p++;
-	targa_header.x_origin = LittleShort ( *((short *)buf_p) );
+	targa_header->colormap_size = *buf_p++;
+	targa_header->x_origin = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.y_origin = LittleShort ( *((short *)buf_p) );
+	targa_header->y_origin = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.width = LittleShort ( *((short *)buf_p) );
+	targa_header->width = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.height = LittleShort ( *((short *)buf_p) );
+	targa_header->height = LittleShort ( *((short *)buf_p) );
 	buf_p+=2;
-	targa_header.pixel_size = *buf_p++;
-	targa_header.attributes = *buf_p++;
+	targa_header->pixel_size = *buf_p++;
+	targa_header->attributes = *buf_p++;
 
-	if (targa_header.image_type!=2 
-		&& targa_header.image_type!=10) 
-		ri.Sys_Error (ERR_DROP, "LoadTGA: Only type 2 and 10 targa RGB images supported\n");
+	return buf_p;
+}
 
-	if (targa_header.colormap_type !=0 
-		|| (targa_header.pixel_size!=32 && targa_header.pixel_size!=24))
-		ri.Sys_Error (ERR_DROP, "LoadTGA: Only 32 or 24 bit images supported (no colormaps)\n");
+/*
+=============
+TGA_Supported
+=============
+*/
+static qboolean TGA_Supported (TargaHeader *targa_header)
+{
+	if (targa_header->image_type!=2 
+		&& targa_header->image_type!=10) 
+		return false;
+
+	if (targa_header->colormap_type !=0 
+		|| (targa_header->pixel_size!=32 && targa_header->pixel_size!=24))
+		return false;
+
+	return true;
+}
+
+/*
+=============
+GetTGASize
+
+Reads the dimensions of a targa already in memory, false if
+DecodeTGA would not be able to decode it
+=============
+*/
+qboolean GetTGASize (byte *buffer, int length, int *width, int *height)
+{
+	TargaHeader		targa_header;
+
+	if (length < 18)
+		return false;
+
+	TGA_ParseHeader (buffer, &targa_header);
+	if (!TGA_Supported (&targa_header))
+		return false;
+
+	*width = targa_header.width;
+	*height = targa_header.height;
+
+	return true;
+}
+
+/*
+=============
+DecodeTGA
+
+Decodes a targa already in memory to 32 bit RGBA.  Touches no
+engine state, so it can be called from the texture workers.
+=============
+*/
+byte *DecodeTGA (byte *buffer, int length, int *width, int *height)
+{
+	int		columns, rows, numPixels;
+	byte	*pixbuf;
+	int		row, column;
+	byte	*buf_p;
+	TargaHeader		targa_header;
+	byte			*targa_rgba;
+
+	if (length < 18)
+		return NULL;
+
+	buf_p = TGA_ParseHeader (buffer, &targa_header);
+	if (!TGA_Supported (&targa_header))
+		return NULL;
 
 	columns = targa_header.width;
 	rows = targa_header.height;
@@ -207,7 +249,6 @@ void LoadTGA (char *name, byte **pic, int *width, int *height)
 		*height = rows;
 
 	targa_rgba = malloc (numPixels*4);
-	*pic = targa_rgba;
 
 	if (targa_header.id_length != 0)
 		buf_p += targa_header.id_length;  /* skip TARGA image comment */
@@ -351,39 +392,113 @@ breakOut:;
       }
    }
 
-	ri.FS_FreeFile (buffer);
+	return targa_rgba;
 }
 
 /*
-==============
-LoadJPG
-==============
+=============
+LoadTGA
+=============
 */
-void LoadJPG (char *filename, byte **pic, int *width, int *height)
+void LoadTGA (char *name, byte **pic, int *width, int *height)
 {
-	struct jpeg_decompress_struct	cinfo;
-	struct jpeg_error_mgr			jerr;
-	byte							*rawdata, *rgbadata, *scanline, *p, *q;
-	int							i;
+	byte	*buffer;
+	int		length;
+	TargaHeader		targa_header;
 
-	/* Load JPEG file into memory */
-	int rawsize = ri.FS_LoadFile(filename, (void **)&rawdata);
-	if (!rawdata)
+	*pic = NULL;
+
+	/*
+	 * load the file
+	 */
+	length = ri.FS_LoadFile (name, (void **)&buffer);
+	if (!buffer)
 	{
-		ri.Con_Printf (PRINT_DEVELOPER, "Bad jpg file %s\n", filename);
-		return;	
+		ri.Con_Printf (PRINT_DEVELOPER, "Bad tga file %s\n", name);
+		return;
 	}
 
+	TGA_ParseHeader (buffer, &targa_header);
+
+	if (targa_header.image_type!=2 
+		&& targa_header.image_type!=10) 
+		ri.Sys_Error (ERR_DROP, "LoadTGA: Only type 2 and 10 targa RGB images supported\n");
+
+	if (targa_header.colormap_type !=0 
+		|| (targa_header.pixel_size!=32 && targa_header.pixel_size!=24))
+		ri.Sys_Error (ERR_DROP, "LoadTGA: Only 32 or 24 bit images supported (no colormaps)\n");
+
+	*pic = DecodeTGA (buffer, length, width, height);
+
+	ri.FS_FreeFile (buffer);
+}
+
+/*
+==============
+JPG_CheckHeader
+==============
+*/
+static qboolean JPG_CheckHeader (byte *rawdata, int rawsize)
+{
 	/* Knightmare- check for bad data */
-	if (	rawdata[6] != 'J'
+	if (	rawsize < 10
+		||	rawdata[6] != 'J'
 		||	rawdata[7] != 'F'
 		||	rawdata[8] != 'I'
 		||	rawdata[9] != 'F')
-   {
-      ri.Con_Printf(PRINT_ALL, "Bad jpg file %s\n", filename);
-      ri.FS_FreeFile(rawdata);
-      return;
-   }
+		return false;
+
+	return true;
+}
+
+/*
+==============
+GetJPGSize
+
+Reads the dimensions of a jpeg already in memory, false if
+DecodeJPG would not be able to decode it
+==============
+*/
+qboolean GetJPGSize (byte *rawdata, int rawsize, int *width, int *height)
+{
+	struct jpeg_decompress_struct	cinfo;
+	struct jpeg_error_mgr			jerr;
+	qboolean						ok;
+
+	if (!JPG_CheckHeader (rawdata, rawsize))
+		return false;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, rawdata, rawsize);
+	jpeg_read_header(&cinfo, true);
+
+	ok = (cinfo.num_components == 3);
+	*width = cinfo.image_width;
+	*height = cinfo.image_height;
+
+	jpeg_destroy_decompress(&cinfo);
+
+	return ok;
+}
+
+/*
+==============
+DecodeJPG
+
+Decodes a jpeg already in memory to 32 bit RGBA.  Touches no
+engine state, so it can be called from the texture workers.
+==============
+*/
+byte *DecodeJPG (byte *rawdata, int rawsize, int *width, int *height)
+{
+	struct jpeg_decompress_struct	cinfo;
+	struct jpeg_error_mgr			jerr;
+	byte							*rgbadata, *scanline, *p, *q;
+	int							i;
+
+	if (!JPG_CheckHeader (rawdata, rawsize))
+		return NULL;
 
 	/* Initialise libJpeg Object */
 	cinfo.err = jpeg_std_error(&jerr);
@@ -401,20 +516,16 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 	/* Check Color Components */
 	if(cinfo.output_components != 3)
 	{
-		ri.Con_Printf(PRINT_ALL, "Invalid JPEG color components\n");
 		jpeg_destroy_decompress(&cinfo);
-		ri.FS_FreeFile(rawdata);
-		return;
+		return NULL;
 	}
 
 	/* Allocate Memory for decompressed image */
 	rgbadata = malloc(cinfo.output_width * cinfo.output_height * 4);
 	if(!rgbadata)
 	{
-		ri.Con_Printf(PRINT_ALL, "Insufficient RAM for JPEG buffer\n");
 		jpeg_destroy_decompress(&cinfo);
-		ri.FS_FreeFile(rawdata);
-		return;
+		return NULL;
 	}
 
 	/* Pass sizes to output */
@@ -424,11 +535,9 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 	scanline = malloc(cinfo.output_width * 3);
 	if(!scanline)
 	{
-		ri.Con_Printf(PRINT_ALL, "Insufficient RAM for JPEG scanline buffer\n");
 		free(rgbadata);
 		jpeg_destroy_decompress(&cinfo);
-		ri.FS_FreeFile(rawdata);
-		return;
+		return NULL;
 	}
 
 	/* Read Scanlines, and expand from RGB to RGBA */
@@ -458,9 +567,37 @@ void LoadJPG (char *filename, byte **pic, int *width, int *height)
 	/* Destroy JPEG object */
 	jpeg_destroy_decompress(&cinfo);
 
-	/* Free raw data buffer */
-	FS_FreeFile(rawdata);
+	return rgbadata;
+}
 
-	/* Return the 'rgbadata' */
-	*pic = rgbadata;
+/*
+==============
+LoadJPG
+==============
+*/
+void LoadJPG (char *filename, byte **pic, int *width, int *height)
+{
+	byte	*rawdata;
+
+	/* Load JPEG file into memory */
+	int rawsize = ri.FS_LoadFile(filename, (void **)&rawdata);
+	if (!rawdata)
+	{
+		ri.Con_Printf (PRINT_DEVELOPER, "Bad jpg file %s\n", filename);
+		return;	
+	}
+
+	if (!JPG_CheckHeader (rawdata, rawsize))
+	{
+		ri.Con_Printf(PRINT_ALL, "Bad jpg file %s\n", filename);
+		ri.FS_FreeFile(rawdata);
+		return;
+	}
+
+	*pic = DecodeJPG (rawdata, rawsize, width, height);
+	if (!*pic)
+		ri.Con_Printf(PRINT_ALL, "Invalid JPEG color components\n");
+
+	/* Free raw data buffer */
+	ri.FS_FreeFile(rawdata);
 }
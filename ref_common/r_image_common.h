@@ -7,4 +7,10 @@ void LoadPCX (char *filename, byte **pic, byte **palette, int *width, int *heigh
 void LoadTGA (char *name, byte **pic, int *width, int *height);
 void LoadJPG (char *filename, byte **pic, int *width, int *height);
 
+/* decoders for files already in memory, safe to call from worker threads */
+qboolean GetTGASize (byte *buffer, int length, int *width, int *height);
+byte *DecodeTGA (byte *buffer, int length, int *width, int *height);
+qboolean GetJPGSize (byte *rawdata, int rawsize, int *width, int *height);
+byte *DecodeJPG (byte *rawdata, int rawsize, int *width, int *height);
+
 #endif
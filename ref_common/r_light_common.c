@@ -0,0 +1,641 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/* r_light_common.c: lightmap building kernels for both renderers */
+
+#include <stdlib.h>
+#include <string.h>
+#include <features/features_cpu.h>
+
+#include "r_light_common.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+extern refimport_t ri;
+
+/*
+=================================================================
+
+REFERENCE KERNELS
+
+These are the loops the renderers used to run inline, and define
+the results the vectorized versions have to reproduce.
+
+=================================================================
+*/
+
+void RL_ScaleLightmapRGB_C (float *bl, const byte *lightmap, int size, const float *scale, qboolean add)
+{
+	int		i;
+
+	if (add)
+	{
+		for (i=0 ; i<size ; i++, bl+=3, lightmap+=3)
+		{
+			bl[0] += lightmap[0] * scale[0];
+			bl[1] += lightmap[1] * scale[1];
+			bl[2] += lightmap[2] * scale[2];
+		}
+	}
+	else
+	{
+		for (i=0 ; i<size ; i++, bl+=3, lightmap+=3)
+		{
+			bl[0] = lightmap[0] * scale[0];
+			bl[1] = lightmap[1] * scale[1];
+			bl[2] = lightmap[2] * scale[2];
+		}
+	}
+}
+
+void RL_AddDlightRGB_C (float *bl, const float *falloff, int size, const float *color)
+{
+	int		i;
+
+	for (i=0 ; i<size ; i++, bl+=3)
+	{
+		if (!falloff[i])
+			continue;
+		bl[0] += falloff[i] * color[0];
+		bl[1] += falloff[i] * color[1];
+		bl[2] += falloff[i] * color[2];
+	}
+}
+
+static void RL_FalloffRow (float *out, int s, int smax, float local0, int td, float rad, float minlight)
+{
+	int		sd;
+	float	dist;
+
+	for ( ; s<smax ; s++)
+	{
+		sd = local0 - s*16;
+		if (sd < 0)
+			sd = -sd;
+		if (sd > td)
+			dist = sd + (td>>1);
+		else
+			dist = td + (sd>>1);
+		out[s] = (dist < minlight) ? rad - dist : 0;
+	}
+}
+
+void RL_DlightFalloff_C (float *falloff, int smax, int tmax, float local0, float local1, float rad, float minlight)
+{
+	int		t, td;
+
+	for (t=0 ; t<tmax ; t++, falloff += smax)
+	{
+		td = local1 - t*16;
+		if (td < 0)
+			td = -td;
+		RL_FalloffRow (falloff, 0, smax, local0, td, rad, minlight);
+	}
+}
+
+static void RL_PackTexel (const float *bl, byte *dest)
+{
+	int		r, g, b, a, max;
+
+	r = (int)bl[0];
+	g = (int)bl[1];
+	b = (int)bl[2];
+
+	/* catch negative lights */
+	if (r < 0)
+		r = 0;
+	if (g < 0)
+		g = 0;
+	if (b < 0)
+		b = 0;
+
+	/* determine the brightest of the three color components */
+	if (r > g)
+		max = r;
+	else
+		max = g;
+	if (b > max)
+		max = b;
+
+	/* alpha is only used for mono lightmaps */
+	a = max;
+
+	/* rescale all the color components if the greatest exceeds 1.0 */
+	if (max > 255)
+	{
+		float t = 255.0F / max;
+
+		r = r*t;
+		g = g*t;
+		b = b*t;
+		a = a*t;
+	}
+
+	dest[0] = r;
+	dest[1] = g;
+	dest[2] = b;
+	dest[3] = a;
+}
+
+void RL_PackLightmapRGBA_C (const float *bl, byte *dest, int smax, int tmax, int stride)
+{
+	int		i, j;
+
+	stride -= (smax<<2);
+
+	for (i=0 ; i<tmax ; i++, dest += stride)
+	{
+		for (j=0 ; j<smax ; j++, bl += 3, dest += 4)
+			RL_PackTexel (bl, dest);
+	}
+}
+
+void RL_ScaleLightmap88_C (unsigned *bl, const byte *lightmap, int size, unsigned scale)
+{
+	int		i;
+
+	for (i=0 ; i<size ; i++)
+		bl[i] += lightmap[i] * scale;
+}
+
+void RL_ShadeLightmap88_C (unsigned *bl, int size, int shift)
+{
+	int		i, t;
+
+	/* bound, invert, and shift */
+	for (i=0 ; i<size ; i++)
+	{
+		t = (int)bl[i];
+		if (t < 0)
+			t = 0;
+		t = (255*256 - t) >> shift;
+
+		if (t < (1 << 6))
+			t = (1 << 6);
+
+		bl[i] = t;
+	}
+}
+
+/*
+=================================================================
+
+VECTORIZED KERNELS
+
+=================================================================
+*/
+
+#ifdef RL_SIMD_SSE2
+
+static inline __m128i RL_Select (__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+static inline __m128i RL_Max (__m128i a, __m128i b)
+{
+	return RL_Select (_mm_cmpgt_epi32 (a, b), a, b);
+}
+
+static inline __m128 RL_LoadBytes (const byte *p)
+{
+	int			v;
+	__m128i		zero = _mm_setzero_si128 ();
+
+	memcpy (&v, p, 4);
+	return _mm_cvtepi32_ps (_mm_unpacklo_epi16 (_mm_unpacklo_epi8 (_mm_cvtsi32_si128 (v), zero), zero));
+}
+
+#endif
+
+/*
+================
+RL_ScaleLightmapRGB
+
+Sets or adds one lightstyle's samples scaled by its colour
+================
+*/
+void RL_ScaleLightmapRGB (float *bl, const byte *lightmap, int size, const float *scale, qboolean add)
+{
+	int		i = 0;
+#ifdef RL_SIMD_SSE2
+	int		n = size*3;
+	__m128	s0 = _mm_setr_ps (scale[0], scale[1], scale[2], scale[0]);
+	__m128	s1 = _mm_setr_ps (scale[1], scale[2], scale[0], scale[1]);
+	__m128	s2 = _mm_setr_ps (scale[2], scale[0], scale[1], scale[2]);
+	__m128	a, b, c;
+
+	/* four texels per pass, the rgb pattern repeats every 12 floats */
+	for ( ; i+12 <= n ; i+=12)
+	{
+		a = _mm_mul_ps (RL_LoadBytes (lightmap+i), s0);
+		b = _mm_mul_ps (RL_LoadBytes (lightmap+i+4), s1);
+		c = _mm_mul_ps (RL_LoadBytes (lightmap+i+8), s2);
+		if (add)
+		{
+			a = _mm_add_ps (_mm_loadu_ps (bl+i), a);
+			b = _mm_add_ps (_mm_loadu_ps (bl+i+4), b);
+			c = _mm_add_ps (_mm_loadu_ps (bl+i+8), c);
+		}
+		_mm_storeu_ps (bl+i, a);
+		_mm_storeu_ps (bl+i+4, b);
+		_mm_storeu_ps (bl+i+8, c);
+	}
+	i /= 3;
+#endif
+	RL_ScaleLightmapRGB_C (bl+i*3, lightmap+i*3, size-i, scale, add);
+}
+
+/*
+================
+RL_AddDlightRGB
+================
+*/
+void RL_AddDlightRGB (float *bl, const float *falloff, int size, const float *color)
+{
+	int		i = 0;
+#ifdef RL_SIMD_SSE2
+	__m128	c0 = _mm_setr_ps (color[0], color[1], color[2], color[0]);
+	__m128	c1 = _mm_setr_ps (color[1], color[2], color[0], color[1]);
+	__m128	c2 = _mm_setr_ps (color[2], color[0], color[1], color[2]);
+	__m128	w;
+	float	*out;
+
+	/* adding a zero falloff leaves the sample as it was */
+	for ( ; i+4 <= size ; i+=4)
+	{
+		w = _mm_loadu_ps (falloff+i);
+		out = bl + i*3;
+		_mm_storeu_ps (out, _mm_add_ps (_mm_loadu_ps (out),
+				_mm_mul_ps (_mm_shuffle_ps (w, w, _MM_SHUFFLE(1,0,0,0)), c0)));
+		_mm_storeu_ps (out+4, _mm_add_ps (_mm_loadu_ps (out+4),
+				_mm_mul_ps (_mm_shuffle_ps (w, w, _MM_SHUFFLE(2,2,1,1)), c1)));
+		_mm_storeu_ps (out+8, _mm_add_ps (_mm_loadu_ps (out+8),
+				_mm_mul_ps (_mm_shuffle_ps (w, w, _MM_SHUFFLE(3,3,3,2)), c2)));
+	}
+#endif
+	RL_AddDlightRGB_C (bl+i*3, falloff+i, size-i, color);
+}
+
+/*
+================
+RL_DlightFalloff
+
+Uses the same octagonal distance approximation as the original
+per texel loops
+================
+*/
+void RL_DlightFalloff (float *falloff, int smax, int tmax, float local0, float local1, float rad, float minlight)
+{
+#ifdef RL_SIMD_SSE2
+	int		s, t, td;
+	__m128	steps = _mm_setr_ps (0, 16, 32, 48);
+	__m128	vlocal = _mm_set1_ps (local0);
+	__m128	vrad = _mm_set1_ps (rad);
+	__m128	vmin = _mm_set1_ps (minlight);
+	__m128i	sd, sign, vtd, vtdhalf;
+	__m128	dist;
+
+	for (t=0 ; t<tmax ; t++, falloff += smax)
+	{
+		td = local1 - t*16;
+		if (td < 0)
+			td = -td;
+		vtd = _mm_set1_epi32 (td);
+		vtdhalf = _mm_set1_epi32 (td>>1);
+
+		for (s=0 ; s+4 <= smax ; s+=4)
+		{
+			sd = _mm_cvttps_epi32 (_mm_sub_ps (vlocal, _mm_add_ps (_mm_set1_ps ((float)(s*16)), steps)));
+			sign = _mm_srai_epi32 (sd, 31);
+			sd = _mm_sub_epi32 (_mm_xor_si128 (sd, sign), sign);
+
+			dist = _mm_cvtepi32_ps (RL_Select (_mm_cmpgt_epi32 (sd, vtd),
+					_mm_add_epi32 (sd, vtdhalf),
+					_mm_add_epi32 (vtd, _mm_srai_epi32 (sd, 1))));
+
+			_mm_storeu_ps (falloff+s, _mm_and_ps (_mm_cmplt_ps (dist, vmin), _mm_sub_ps (vrad, dist)));
+		}
+
+		RL_FalloffRow (falloff, s, smax, local0, td, rad, minlight);
+	}
+#else
+	RL_DlightFalloff_C (falloff, smax, tmax, local0, local1, rad, minlight);
+#endif
+}
+
+/*
+================
+RL_PackLightmapRGBA
+
+Clamps blocklights into rgba texels, alpha is the brightest channel
+================
+*/
+void RL_PackLightmapRGBA (const float *bl, byte *dest, int smax, int tmax, int stride)
+{
+#ifdef RL_SIMD_SSE2
+	int		i, j;
+	__m128i	zero = _mm_setzero_si128 ();
+	__m128i	v255 = _mm_set1_epi32 (255);
+	__m128	f255 = _mm_set1_ps (255.0F);
+	__m128	v0, v1, v2, t;
+	__m128i	r, g, b, a, max, over;
+
+	stride -= (smax<<2);
+
+	for (i=0 ; i<tmax ; i++, dest += stride)
+	{
+		for (j=0 ; j+4 <= smax ; j+=4, bl += 12, dest += 16)
+		{
+			v0 = _mm_loadu_ps (bl);			/* r0 g0 b0 r1 */
+			v1 = _mm_loadu_ps (bl+4);		/* g1 b1 r2 g2 */
+			v2 = _mm_loadu_ps (bl+8);		/* b2 r3 g3 b3 */
+
+			r = _mm_cvttps_epi32 (_mm_shuffle_ps (_mm_shuffle_ps (v0, v0, _MM_SHUFFLE(3,3,3,0)),
+					_mm_shuffle_ps (v1, v2, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,1,0)));
+			g = _mm_cvttps_epi32 (_mm_shuffle_ps (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE(0,0,1,1)),
+					_mm_shuffle_ps (v1, v2, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0)));
+			b = _mm_cvttps_epi32 (_mm_shuffle_ps (_mm_shuffle_ps (v0, v1, _MM_SHUFFLE(1,1,2,2)),
+					_mm_shuffle_ps (v2, v2, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0)));
+
+			/* catch negative lights */
+			r = _mm_and_si128 (r, _mm_cmpgt_epi32 (r, zero));
+			g = _mm_and_si128 (g, _mm_cmpgt_epi32 (g, zero));
+			b = _mm_and_si128 (b, _mm_cmpgt_epi32 (b, zero));
+
+			max = RL_Max (RL_Max (r, g), b);
+
+			/* rescale where the brightest channel is over 1.0 */
+			over = _mm_cmpgt_epi32 (max, v255);
+			t = _mm_div_ps (f255, _mm_cvtepi32_ps (max));
+			r = RL_Select (over, _mm_cvttps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (r), t)), r);
+			g = RL_Select (over, _mm_cvttps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (g), t)), g);
+			b = RL_Select (over, _mm_cvttps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (b), t)), b);
+			a = RL_Select (over, _mm_cvttps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (max), t)), max);
+
+			_mm_storeu_si128 ((__m128i *)dest, _mm_or_si128 (_mm_or_si128 (r, _mm_slli_epi32 (g, 8)),
+					_mm_or_si128 (_mm_slli_epi32 (b, 16), _mm_slli_epi32 (a, 24))));
+		}
+
+		for ( ; j<smax ; j++, bl += 3, dest += 4)
+			RL_PackTexel (bl, dest);
+	}
+#else
+	RL_PackLightmapRGBA_C (bl, dest, smax, tmax, stride);
+#endif
+}
+
+/*
+================
+RL_ScaleLightmap88
+
+Adds one lightstyle's samples at an 8.8 scale
+================
+*/
+void RL_ScaleLightmap88 (unsigned *bl, const byte *lightmap, int size, unsigned scale)
+{
+	int		i = 0;
+#ifdef RL_SIMD_SSE2
+	/* 16x16 bit products built from the low and high halves */
+	if (scale < 0x10000)
+	{
+		__m128i	zero = _mm_setzero_si128 ();
+		__m128i	vscale = _mm_set1_epi16 ((short)scale);
+		__m128i	in, x, lo, hi;
+		int		k;
+
+		for ( ; i+16 <= size ; i+=16)
+		{
+			in = _mm_loadu_si128 ((const __m128i *)(lightmap+i));
+
+			for (k=0 ; k<2 ; k++)
+			{
+				x = k ? _mm_unpackhi_epi8 (in, zero) : _mm_unpacklo_epi8 (in, zero);
+				lo = _mm_mullo_epi16 (x, vscale);
+				hi = _mm_mulhi_epu16 (x, vscale);
+
+				_mm_storeu_si128 ((__m128i *)(bl+i+k*8), _mm_add_epi32 (
+						_mm_loadu_si128 ((__m128i *)(bl+i+k*8)), _mm_unpacklo_epi16 (lo, hi)));
+				_mm_storeu_si128 ((__m128i *)(bl+i+k*8+4), _mm_add_epi32 (
+						_mm_loadu_si128 ((__m128i *)(bl+i+k*8+4)), _mm_unpackhi_epi16 (lo, hi)));
+			}
+		}
+	}
+#endif
+	RL_ScaleLightmap88_C (bl+i, lightmap+i, size-i, scale);
+}
+
+/*
+================
+RL_ShadeLightmap88
+
+Bounds, inverts and shifts 8.8 light into the colormap range
+================
+*/
+void RL_ShadeLightmap88 (unsigned *bl, int size, int shift)
+{
+	int		i = 0;
+#ifdef RL_SIMD_SSE2
+	__m128i	zero = _mm_setzero_si128 ();
+	__m128i	full = _mm_set1_epi32 (255*256);
+	__m128i	lowest = _mm_set1_epi32 (1 << 6);
+	__m128i	count = _mm_cvtsi32_si128 (shift);
+	__m128i	t;
+
+	for ( ; i+4 <= size ; i+=4)
+	{
+		t = _mm_loadu_si128 ((__m128i *)(bl+i));
+		t = _mm_and_si128 (t, _mm_cmpgt_epi32 (t, zero));
+		t = _mm_sra_epi32 (_mm_sub_epi32 (full, t), count);
+		t = RL_Max (t, lowest);
+		_mm_storeu_si128 ((__m128i *)(bl+i), t);
+	}
+#endif
+	RL_ShadeLightmap88_C (bl+i, size-i, shift);
+}
+
+/*
+=================================================================
+
+TEST AND BENCHMARK
+
+=================================================================
+*/
+
+#define	RL_TEST_MAX		(18*18)		/* a little past the 17x17 surfaces get */
+#define	RL_BENCH_RUNS	20000
+
+static float RL_Random (float lo, float hi)
+{
+	return lo + (hi - lo) * (rand () & 0x7fff) / 32767.0f;
+}
+
+static void RL_RandomBytes (byte *p, int count)
+{
+	while (count--)
+		*p++ = rand () & 255;
+}
+
+static void RL_RandomBlocklights (float *bl, int count)
+{
+	int		i;
+
+	for (i=0 ; i<count ; i++)
+	{
+		switch (rand () & 3)
+		{
+		case 0:		bl[i] = RL_Random (-300, 0); break;		/* negative lights */
+		case 1:		bl[i] = RL_Random (256, 2000); break;	/* overbright */
+		default:	bl[i] = RL_Random (0, 255); break;
+		}
+	}
+}
+
+static void RL_Report (const char *name, int mismatches, int cases, retro_time_t ref, retro_time_t simd)
+{
+	ri.Con_Printf (PRINT_ALL, "%-12s %s %5i cases  %7i us reference  %7i us vectorized\n",
+			name, mismatches ? "MISMATCH" : "exact   ", cases, (int)ref, (int)simd);
+}
+
+/*
+================
+RL_LightmapTest_f
+
+Checks every vectorized kernel against its reference on random
+lightmaps of all sizes, then times both
+================
+*/
+void RL_LightmapTest_f (void)
+{
+	static byte		lightmap[RL_TEST_MAX*3];
+	static float	bl_ref[RL_TEST_MAX*3+4], bl_simd[RL_TEST_MAX*3+4];
+	static float	falloff_ref[RL_TEST_MAX], falloff_simd[RL_TEST_MAX];
+	static unsigned	bl88_ref[RL_TEST_MAX], bl88_simd[RL_TEST_MAX];
+	static byte		dest_ref[RL_TEST_MAX*4], dest_simd[RL_TEST_MAX*4];
+	float		scale[3], color[3], local0, local1, rad;
+	unsigned	scale88;
+	int			smax, tmax, size, i, cases;
+	int			bad[6];
+	retro_time_t		start, ref[6], simd[6];
+
+#ifndef RL_SIMD_SSE2
+	ri.Con_Printf (PRINT_ALL, "this build has no vectorized lightmap kernels, timing the reference only\n");
+#endif
+
+	memset (bad, 0, sizeof(bad));
+	cases = 0;
+	srand (1);
+
+	for (smax=1 ; smax<=18 ; smax++)
+	{
+		for (tmax=1 ; tmax<=18 ; tmax++)
+		{
+			size = smax*tmax;
+			cases++;
+
+			RL_RandomBytes (lightmap, size*3);
+			for (i=0 ; i<3 ; i++)
+			{
+				scale[i] = (rand () & 1) ? 1.0f : RL_Random (0, 3);
+				color[i] = RL_Random (0, 1);
+			}
+
+			/* style accumulation, first map then another on top */
+			RL_RandomBlocklights (bl_ref, size*3);
+			memcpy (bl_simd, bl_ref, sizeof(bl_ref));
+			RL_ScaleLightmapRGB_C (bl_ref, lightmap, size, scale, false);
+			RL_ScaleLightmapRGB (bl_simd, lightmap, size, scale, false);
+			RL_ScaleLightmapRGB_C (bl_ref, lightmap, size, color, true);
+			RL_ScaleLightmapRGB (bl_simd, lightmap, size, color, true);
+			bad[0] += memcmp (bl_ref, bl_simd, size*3*sizeof(float)) != 0;
+
+			/* dlight falloff and its contribution */
+			local0 = RL_Random (-64, smax*16 + 64);
+			local1 = RL_Random (-64, tmax*16 + 64);
+			rad = RL_Random (64, 400);
+			RL_DlightFalloff_C (falloff_ref, smax, tmax, local0, local1, rad, rad - 64);
+			RL_DlightFalloff (falloff_simd, smax, tmax, local0, local1, rad, rad - 64);
+			bad[1] += memcmp (falloff_ref, falloff_simd, size*sizeof(float)) != 0;
+
+			RL_AddDlightRGB_C (bl_ref, falloff_ref, size, color);
+			RL_AddDlightRGB (bl_simd, falloff_ref, size, color);
+			bad[2] += memcmp (bl_ref, bl_simd, size*3*sizeof(float)) != 0;
+
+			/* clamp and pack, into a wider block like the real stride */
+			RL_RandomBlocklights (bl_ref, size*3);
+			memset (dest_ref, 0, sizeof(dest_ref));
+			memset (dest_simd, 0, sizeof(dest_simd));
+			RL_PackLightmapRGBA_C (bl_ref, dest_ref, smax, tmax, smax*4);
+			RL_PackLightmapRGBA (bl_ref, dest_simd, smax, tmax, smax*4);
+			bad[3] += memcmp (dest_ref, dest_simd, size*4) != 0;
+
+			/* software renderer */
+			scale88 = rand () % 512;
+			for (i=0 ; i<size ; i++)
+				bl88_ref[i] = bl88_simd[i] = rand () % (300*256);
+			RL_ScaleLightmap88_C (bl88_ref, lightmap, size, scale88);
+			RL_ScaleLightmap88 (bl88_simd, lightmap, size, scale88);
+			bad[4] += memcmp (bl88_ref, bl88_simd, size*sizeof(unsigned)) != 0;
+
+			if (rand () & 1)
+				bl88_ref[0] = bl88_simd[0] = 0x80000000u;		/* "negative" after a dark light */
+			RL_ShadeLightmap88_C (bl88_ref, size, 2);
+			RL_ShadeLightmap88 (bl88_simd, size, 2);
+			bad[5] += memcmp (bl88_ref, bl88_simd, size*sizeof(unsigned)) != 0;
+		}
+	}
+
+	/* time a typical 17x17 surface */
+	smax = tmax = 17;
+	size = smax*tmax;
+	RL_RandomBytes (lightmap, size*3);
+	RL_RandomBlocklights (bl_ref, size*3);
+
+#define RL_TIME(slot, call) \
+	start = cpu_features_get_time_usec (); \
+	for (i=0 ; i<RL_BENCH_RUNS ; i++) \
+		call; \
+	slot = cpu_features_get_time_usec () - start;
+
+	RL_TIME (ref[0], RL_ScaleLightmapRGB_C (bl_simd, lightmap, size, scale, true));
+	RL_TIME (simd[0], RL_ScaleLightmapRGB (bl_simd, lightmap, size, scale, true));
+	RL_TIME (ref[1], RL_DlightFalloff_C (falloff_simd, smax, tmax, 100, 100, 300, 236));
+	RL_TIME (simd[1], RL_DlightFalloff (falloff_simd, smax, tmax, 100, 100, 300, 236));
+	RL_TIME (ref[2], RL_AddDlightRGB_C (bl_simd, falloff_simd, size, color));
+	RL_TIME (simd[2], RL_AddDlightRGB (bl_simd, falloff_simd, size, color));
+	RL_TIME (ref[3], RL_PackLightmapRGBA_C (bl_ref, dest_ref, smax, tmax, smax*4));
+	RL_TIME (simd[3], RL_PackLightmapRGBA (bl_ref, dest_simd, smax, tmax, smax*4));
+	RL_TIME (ref[4], RL_ScaleLightmap88_C (bl88_simd, lightmap, size, 256));
+	RL_TIME (simd[4], RL_ScaleLightmap88 (bl88_simd, lightmap, size, 256));
+	RL_TIME (ref[5], RL_ShadeLightmap88_C (bl88_ref, size, 2));
+	RL_TIME (simd[5], RL_ShadeLightmap88 (bl88_simd, size, 2));
+
+#undef RL_TIME
+
+	ri.Con_Printf (PRINT_ALL, "%i runs over a %ix%i lightmap:\n", RL_BENCH_RUNS, smax, tmax);
+	RL_Report ("styles", bad[0], cases, ref[0], simd[0]);
+	RL_Report ("falloff", bad[1], cases, ref[1], simd[1]);
+	RL_Report ("dlight", bad[2], cases, ref[2], simd[2]);
+	RL_Report ("pack", bad[3], cases, ref[3], simd[3]);
+	RL_Report ("styles 8.8", bad[4], cases, ref[4], simd[4]);
+	RL_Report ("shade 8.8", bad[5], cases, ref[5], simd[5]);
+}
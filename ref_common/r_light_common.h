@@ -0,0 +1,33 @@
+#ifndef R_LIGHT_COMMON_H
+#define R_LIGHT_COMMON_H
+
+#include "../client/ref.h"
+
+/*
+ * lightmap building kernels shared by both renderers.  They are
+ * vectorized when the compiler targets SSE2, and the _C versions are
+ * the reference they have to match bit for bit.
+ */
+
+/* gl: float rgb blocklights */
+void RL_ScaleLightmapRGB (float *bl, const byte *lightmap, int size, const float *scale, qboolean add);
+void RL_AddDlightRGB (float *bl, const float *falloff, int size, const float *color);
+void RL_PackLightmapRGBA (const float *bl, byte *dest, int smax, int tmax, int stride);
+
+/* soft: 8.8 fixed point blocklights */
+void RL_ScaleLightmap88 (unsigned *bl, const byte *lightmap, int size, unsigned scale);
+void RL_ShadeLightmap88 (unsigned *bl, int size, int shift);
+
+/* both: rad - dist where a dlight reaches a sample, 0 elsewhere */
+void RL_DlightFalloff (float *falloff, int smax, int tmax, float local0, float local1, float rad, float minlight);
+
+void RL_ScaleLightmapRGB_C (float *bl, const byte *lightmap, int size, const float *scale, qboolean add);
+void RL_AddDlightRGB_C (float *bl, const float *falloff, int size, const float *color);
+void RL_PackLightmapRGBA_C (const float *bl, byte *dest, int smax, int tmax, int stride);
+void RL_ScaleLightmap88_C (unsigned *bl, const byte *lightmap, int size, unsigned scale);
+void RL_ShadeLightmap88_C (unsigned *bl, int size, int shift);
+void RL_DlightFalloff_C (float *falloff, int smax, int tmax, float local0, float local1, float rad, float minlight);
+
+void RL_LightmapTest_f (void);
+
+#endif
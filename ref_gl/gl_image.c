@@ -18,6 +18,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <libretro_file.h>
+
 typedef struct
 {
 	unsigned		width, height;			/* coordinates from main game */
@@ -27,6 +29,8 @@ typedef struct
 #include <stdlib.h>
 #include <jpeglib.h>
 #include "../ref_common/r_image_common.h"
+#include <features/features_cpu.h>
+#include <libretro_thread.h>
 
 image_t		gltextures[MAX_GLTEXTURES];
 int			numgltextures = 0;
@@ -45,29 +49,15 @@ static void GL_LightScaleTexture (uint32_t *in, int inwidth,
 
 /*
 ===============
-GL_Upload32
+GL_ScaledSize
 
-Returns has_alpha
+Picks the power of two size a texture will be uploaded at
 ===============
 */
-int		upload_width, upload_height;
-qboolean uploaded_paletted;
-uint32_t	trans[512*256];
-uint32_t	scaled[1024*1024];
-
-qboolean GL_Upload32 (uint32_t *data, int width, int height,  qboolean mipmap)
+static void GL_ScaledSize (int width, int height, qboolean mipmap,
+      int *out_width, int *out_height)
 {
-#ifdef DEBUG
-	printf("GL_Upload32\n");
-#endif
-	int			samples;
-	
 	int			scaled_width, scaled_height;
-	int			i, c;
-	byte		*scan;
-	int comp;
-
-	uploaded_paletted = false;
 
 	for (scaled_width = 1 ; scaled_width < width ; scaled_width<<=1)
 		;
@@ -95,25 +85,69 @@ qboolean GL_Upload32 (uint32_t *data, int width, int height,  qboolean mipmap)
 		scaled_width = 1;
 	if (scaled_height < 1)
 		scaled_height = 1;
-	
-	upload_width = scaled_width;
-	upload_height = scaled_height;
 
-	if (scaled_width * scaled_height > sizeof(scaled)/4)
-		ri.Sys_Error (ERR_DROP, "GL_Upload32: too big");
+	*out_width = scaled_width;
+	*out_height = scaled_height;
+}
+
+/*
+===============
+GL_TextureSamples
+
+Scans the texture for any non-255 alpha
+===============
+*/
+static int GL_TextureSamples (uint32_t *data, int width, int height)
+{
+	int			i, c;
+	byte		*scan;
 
-	/* scan the texture for any non-255 alpha */
 	c = width*height;
 	scan = ((byte *)data) + 3;
-	samples = gl_solid_format;
 	for (i=0 ; i<c ; i++, scan += 4)
 	{
 		if ( *scan != 255 )
-		{
-			samples = gl_alpha_format;
-			break;
-		}
+			return gl_alpha_format;
+	}
+
+	return gl_solid_format;
+}
+
+/*
+===============
+GL_PrepareTexture
+
+Resamples and light scales data into out and returns whichever
+buffer should be uploaded.  Touches no GL state, so the image
+workers can call it.
+===============
+*/
+static uint32_t *GL_PrepareTexture (uint32_t *data, int width, int height,
+      int scaled_width, int scaled_height, qboolean mipmap, uint32_t *out)
+{
+	if (scaled_width == width && scaled_height == height)
+	{
+		if (!mipmap)
+			return data;
+		memcpy (out, data, width*height*4);
 	}
+	else
+		GL_ResampleTexture (data, width, height, out, scaled_width, scaled_height);
+
+	GL_LightScaleTexture (out, scaled_width, scaled_height, !mipmap );
+
+	return out;
+}
+
+/*
+===============
+GL_UploadPrepared
+===============
+*/
+static void GL_UploadPrepared (uint32_t *data, int scaled_width, int scaled_height,
+      int samples, qboolean mipmap)
+{
+	int comp;
 
 	if (samples == gl_solid_format)
 	    comp = gl_tex_solid_format;
@@ -126,23 +160,8 @@ qboolean GL_Upload32 (uint32_t *data, int width, int height,  qboolean mipmap)
 	    comp = samples;
 	}
 
-	if (scaled_width == width && scaled_height == height)
-	{
-		if (!mipmap)
-		{
-			qglTexImage2D (GL_TEXTURE_2D, 0, comp, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-			goto done;
-		}
-		memcpy (scaled, data, width*height*4);
-	}
-	else
-		GL_ResampleTexture (data, width, height, scaled, scaled_width, scaled_height);
-
-	GL_LightScaleTexture (scaled, scaled_width, scaled_height, !mipmap );
+	qglTexImage2D( GL_TEXTURE_2D, 0, comp, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
 
-	qglTexImage2D( GL_TEXTURE_2D, 0, comp, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled );
-
-done:
 	if (mipmap)
 	{
 		qglGenerateMipmap(GL_TEXTURE_2D);
@@ -154,28 +173,72 @@ done:
 		qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_max);
 		qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
 	}
-
-	return (samples == gl_alpha_format);
 }
 
-qboolean GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboolean is_sky )
+/*
+===============
+GL_Upload32
+
+Returns has_alpha
+===============
+*/
+int		upload_width, upload_height;
+qboolean uploaded_paletted;
+uint32_t	trans[512*256];
+uint32_t	scaled[1024*1024];
+
+/* what the last GL_Upload32 handed to GL, for the texture cache */
+static uint32_t	*upload_data;
+static int		upload_samples;
+
+qboolean GL_Upload32 (uint32_t *data, int width, int height,  qboolean mipmap)
 {
 #ifdef DEBUG
-	printf("GL_Upload8\n");
+	printf("GL_Upload32\n");
 #endif
-	
+	int			samples;
+	int			scaled_width, scaled_height;
+
+	uploaded_paletted = false;
+
+	GL_ScaledSize (width, height, mipmap, &scaled_width, &scaled_height);
+
+	upload_width = scaled_width;
+	upload_height = scaled_height;
+
+	if (scaled_width * scaled_height > sizeof(scaled)/4)
+		ri.Sys_Error (ERR_DROP, "GL_Upload32: too big");
+
+	samples = GL_TextureSamples (data, width, height);
+
+	upload_data = GL_PrepareTexture (data, width, height,
+			scaled_width, scaled_height, mipmap, scaled);
+	upload_samples = samples;
+
+	GL_UploadPrepared (upload_data, scaled_width, scaled_height, samples, mipmap);
+
+	return (samples == gl_alpha_format);
+}
+
+/*
+===============
+GL_Expand8
+
+Converts paletted pixels to RGBA, bleeding the colour of neighbouring
+pixels into transparent ones
+===============
+*/
+static void GL_Expand8 (byte *data, int width, int height, uint32_t *out)
+{
 	int			i, s;
 	int			p;
 
 	s = width*height;
 
-	if (s > sizeof(trans)/4)
-		ri.Sys_Error (ERR_DROP, "GL_Upload8: too large");
-	
 	for (i=0 ; i<s ; i++)
 	{
 		p = data[i];
-		trans[i] = d_refgl_8to24table[p];
+		out[i] = d_refgl_8to24table[p];
 
 		if (p == 255)
 		{
@@ -194,11 +257,23 @@ qboolean GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboole
 			else
 				p = 0;
 			/* copy RGB components */
-			((byte *)&trans[i])[0] = ((byte *)&d_refgl_8to24table[p])[0];
-			((byte *)&trans[i])[1] = ((byte *)&d_refgl_8to24table[p])[1];
-			((byte *)&trans[i])[2] = ((byte *)&d_refgl_8to24table[p])[2];
+			((byte *)&out[i])[0] = ((byte *)&d_refgl_8to24table[p])[0];
+			((byte *)&out[i])[1] = ((byte *)&d_refgl_8to24table[p])[1];
+			((byte *)&out[i])[2] = ((byte *)&d_refgl_8to24table[p])[2];
 		}
 	}
+}
+
+qboolean GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboolean is_sky )
+{
+#ifdef DEBUG
+	printf("GL_Upload8\n");
+#endif
+
+	if (width*height > sizeof(trans)/4)
+		ri.Sys_Error (ERR_DROP, "GL_Upload8: too large");
+
+	GL_Expand8 (data, width, height, trans);
 
 	return GL_Upload32 (trans, width, height, mipmap);
 
@@ -699,12 +774,12 @@ void GL_MipMap (byte *in, int width, int height)
 
 /*
 ================
-GL_LoadPic
+GL_AllocImage
 
-This is also used as an entry point for the generated r_notexture
+Finds a free image_t and fills in everything but the upload results
 ================
 */
-image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t type, int bits)
+static image_t *GL_AllocImage (char *name, int width, int height, imagetype_t type)
 {
 	image_t		*image;
 	int			i;
@@ -732,12 +807,505 @@ image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t t
 	image->height = height;
 	image->type = type;
 
+	image->texnum = TEXNUM_IMAGES + (image - gltextures);
+	image->sl = 0;
+	image->sh = 1;
+	image->tl = 0;
+	image->th = 1;
+
+	return image;
+}
+
+/*
+====================================================================
+
+TEXTURE CACHE
+
+Keeps the prepared (resampled and light scaled) level 0 pixels of
+recently uploaded images, so a lost GL context or a reload of the
+same map can go straight to glTexImage2D instead of reading and
+decoding every file again.  Mipmaps are generated by the driver, so
+level 0 is all that needs keeping.  Entries are keyed by name, by the
+pak or file the name resolves to along with its offset and length,
+and by everything that changes the prepared pixels; the least
+recently used ones are dropped once gl_texcache megabytes are in use.
+Everything is flushed when the game directory changes.
+
+With gl_texcache_disk set, entries are also written under
+<gamedir>/texcache, named by that source stamp and the settings key,
+and are read back when the RAM cache misses.  The source is never
+read to build the stamp, so a loose file edited in place without
+changing its length keeps its old disk entry.
+
+====================================================================
+*/
+
+#define	TEXCACHE_HASH_SIZE	256
+
+#define	TEXCACHE_IDENT		(('C'<<24)+('X'<<16)+('E'<<8)+'T')	/* "TEXC", also catches byte order */
+#define	TEXCACHE_VERSION	2
+
+typedef struct texcache_s
+{
+	struct texcache_s	*hashnext;
+	struct texcache_s	*prev, *next;	/* most recently used first */
+	char		name[MAX_QPATH];
+	unsigned	stamp;					/* where the source was found */
+	unsigned	key;
+	int			width, height;			/* source size */
+	int			upload_width, upload_height;
+	int			samples;
+	int			size;
+	uint32_t	data[1];				/* variable sized */
+} texcache_t;
+
+typedef struct
+{
+	int			ident;
+	int			version;
+	unsigned	stamp;
+	unsigned	key;
+	int			width, height;
+	int			upload_width, upload_height;
+	int			samples;
+} texcacheheader_t;
+
+static texcache_t	*texcache_hash[TEXCACHE_HASH_SIZE];
+static texcache_t	texcache_lru;			/* sentinel */
+static int			texcache_bytes;
+static int			texcache_hits;
+static char			texcache_gamedir[MAX_OSPATH];
+
+/*
+================
+GL_HashBlock
+================
+*/
+static unsigned GL_HashBlock (const void *data, int length, unsigned hash)
+{
+	const byte	*p = data;
+
+	while (length--)
+		hash = (hash ^ *p++) * 16777619;
+	return hash;
+}
+
+/*
+================
+GL_TexCacheKey
+
+Hashes everything besides the source pixels that ends up in the
+prepared texture
+================
+*/
+static unsigned GL_TexCacheKey (imagetype_t type)
+{
+	int		settings[5];
+	unsigned	hash;
+
+	settings[0] = type;
+	settings[1] = gl_picmip->value;
+	settings[2] = gl_round_down->value ? 1 : 0;
+	settings[3] = gl_solid_format;
+	settings[4] = gl_alpha_format;
+
+	hash = GL_HashBlock (settings, sizeof(settings), 2166136261u);
+	hash = GL_HashBlock (gammatable, sizeof(gammatable), hash);
+	hash = GL_HashBlock (intensitytable, sizeof(intensitytable), hash);
+	hash = GL_HashBlock (d_refgl_8to24table, sizeof(d_refgl_8to24table), hash);
+	return hash;
+}
+
+/*
+================
+GL_TexCacheStamp
+
+Hashes the name together with the pak or file it resolves to and the
+offset and length there, 0 if there is no such file
+================
+*/
+static unsigned GL_TexCacheStamp (char *name)
+{
+	char		source[MAX_OSPATH];
+	int			where[2];
+	unsigned	stamp;
+
+	where[1] = ri.FS_FileSource (name, source, sizeof(source), &where[0]);
+	if (where[1] < 0)
+		return 0;
+
+	stamp = GL_HashBlock (name, strlen(name), 2166136261u);
+	stamp = GL_HashBlock (source, strlen(source), stamp);
+	stamp = GL_HashBlock (where, sizeof(where), stamp);
+
+	return stamp ? stamp : 1;
+}
+
+static unsigned GL_TexCacheHashName (const char *name)
+{
+	return GL_HashBlock (name, strlen(name), 2166136261u) & (TEXCACHE_HASH_SIZE-1);
+}
+
+static void GL_TexCacheUnlink (texcache_t *entry)
+{
+	texcache_t	**prev;
+
+	for (prev = &texcache_hash[GL_TexCacheHashName(entry->name)] ; *prev ; prev = &(*prev)->hashnext)
+	{
+		if (*prev == entry)
+		{
+			*prev = entry->hashnext;
+			break;
+		}
+	}
+
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	texcache_bytes -= entry->size;
+	free (entry);
+}
+
+static void GL_TexCacheTouch (texcache_t *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+
+	entry->next = texcache_lru.next;
+	entry->prev = &texcache_lru;
+	texcache_lru.next->prev = entry;
+	texcache_lru.next = entry;
+}
+
+/*
+================
+GL_FlushTextureCache
+================
+*/
+void GL_FlushTextureCache (void)
+{
+	if (!texcache_lru.next)
+		return;
+
+	while (texcache_lru.next != &texcache_lru)
+		GL_TexCacheUnlink (texcache_lru.next);
+}
+
+/*
+================
+GL_TexCacheCheckGamedir
+
+Flushes the cache when game or fs_gamedir has moved the search path
+================
+*/
+static void GL_TexCacheCheckGamedir (void)
+{
+	char	*gamedir;
+
+	gamedir = ri.FS_Gamedir ();
+	if (!strcmp (gamedir, texcache_gamedir))
+		return;
+
+	GL_FlushTextureCache ();
+	Q_strlcpy (texcache_gamedir, gamedir, sizeof(texcache_gamedir));
+}
+
+static texcache_t *GL_TexCacheFind (char *name, unsigned stamp, unsigned key)
+{
+	texcache_t	*entry;
+
+	if (!texcache_lru.next)
+		return NULL;
+
+	for (entry = texcache_hash[GL_TexCacheHashName(name)] ; entry ; entry = entry->hashnext)
+	{
+		if (entry->stamp == stamp && entry->key == key && !strcmp (entry->name, name))
+		{
+			GL_TexCacheTouch (entry);
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+================
+GL_TexCacheAdd
+
+Copies prepared pixels into the cache, evicting old entries to stay
+inside the budget
+================
+*/
+static texcache_t *GL_TexCacheAdd (char *name, unsigned stamp, unsigned key, int width, int height,
+      uint32_t *data, int upload_width, int upload_height, int samples)
+{
+	texcache_t	*entry;
+	int			size, budget;
+	unsigned	hash;
+
+	budget = gl_texcache->value * 1024 * 1024;
+	size = upload_width * upload_height * 4;
+	if (size > budget)
+		return NULL;
+
+	if (!texcache_lru.next)
+		texcache_lru.next = texcache_lru.prev = &texcache_lru;
+
+	/* replace an older copy made with different settings */
+	hash = GL_TexCacheHashName (name);
+	for (entry = texcache_hash[hash] ; entry ; entry = entry->hashnext)
+	{
+		if (!strcmp (entry->name, name))
+		{
+			GL_TexCacheUnlink (entry);
+			break;
+		}
+	}
+
+	while (texcache_bytes + size > budget && texcache_lru.prev != &texcache_lru)
+		GL_TexCacheUnlink (texcache_lru.prev);
+
+	entry = malloc (sizeof(*entry) - sizeof(entry->data) + size);
+	if (!entry)
+		return NULL;
+
+	strcpy (entry->name, name);
+	entry->stamp = stamp;
+	entry->key = key;
+	entry->width = width;
+	entry->height = height;
+	entry->upload_width = upload_width;
+	entry->upload_height = upload_height;
+	entry->samples = samples;
+	entry->size = size;
+	memcpy (entry->data, data, size);
+
+	entry->hashnext = texcache_hash[hash];
+	texcache_hash[hash] = entry;
+	entry->next = texcache_lru.next;
+	entry->prev = &texcache_lru;
+	texcache_lru.next->prev = entry;
+	texcache_lru.next = entry;
+	texcache_bytes += size;
+
+	return entry;
+}
+
+static void GL_TexCachePath (char *path, int size, unsigned stamp, unsigned key)
+{
+	Com_sprintf (path, size, "%s/texcache/%08x_%08x.tex", ri.FS_Gamedir(), stamp, key);
+}
+
+static texcache_t *GL_ReadTexCache (char *name, unsigned stamp, unsigned key)
+{
+	char				path[MAX_OSPATH];
+	RFILE				*f;
+	texcacheheader_t	header;
+	texcache_t			*entry;
+	uint32_t			*data;
+	int					size;
+
+	GL_TexCachePath (path, sizeof(path), stamp, key);
+	f = rfopen (path, "rb");
+	if (!f)
+		return NULL;
+
+	if (rfread (&header, sizeof(header), 1, f) != 1
+		|| header.ident != TEXCACHE_IDENT
+		|| header.version != TEXCACHE_VERSION
+		|| header.stamp != stamp
+		|| header.key != key
+		|| header.upload_width <= 0 || header.upload_width > 1024
+		|| header.upload_height <= 0 || header.upload_height > 1024)
+	{
+		rfclose (f);
+		return NULL;
+	}
+
+	size = header.upload_width * header.upload_height * 4;
+	data = malloc (size);
+	if (!data)
+	{
+		rfclose (f);
+		return NULL;
+	}
+
+	if (rfread (data, 1, size, f) != size)
+	{
+		rfclose (f);
+		free (data);
+		return NULL;
+	}
+	rfclose (f);
+
+	entry = GL_TexCacheAdd (name, stamp, key, header.width, header.height, data,
+			header.upload_width, header.upload_height, header.samples);
+	free (data);
+
+	return entry;
+}
+
+static void GL_WriteTexCache (texcache_t *entry)
+{
+	char				path[MAX_OSPATH];
+	RFILE				*f;
+	texcacheheader_t	header;
+
+	GL_TexCachePath (path, sizeof(path), entry->stamp, entry->key);
+	f = rfopen (path, "rb");
+	if (f)
+	{
+		/* already there */
+		rfclose (f);
+		return;
+	}
+
+	Com_sprintf (path, sizeof(path), "%s/texcache", ri.FS_Gamedir());
+	Sys_Mkdir (path);
+	GL_TexCachePath (path, sizeof(path), entry->stamp, entry->key);
+	f = rfopen (path, "wb");
+	if (!f)
+		return;
+
+	header.ident = TEXCACHE_IDENT;
+	header.version = TEXCACHE_VERSION;
+	header.stamp = entry->stamp;
+	header.key = entry->key;
+	header.width = entry->width;
+	header.height = entry->height;
+	header.upload_width = entry->upload_width;
+	header.upload_height = entry->upload_height;
+	header.samples = entry->samples;
+
+	rfwrite (&header, sizeof(header), 1, f);
+	rfwrite (entry->data, entry->size, 1, f);
+	rfclose (f);
+}
+
+/*
+================
+GL_CacheTexture
+
+Remembers what was just uploaded for image
+================
+*/
+static void GL_CacheTexture (image_t *image, uint32_t *data, int samples)
+{
+	texcache_t	*entry;
+	unsigned	stamp;
+
+	if (gl_texcache->value <= 0 || image->name[0] == '*')
+		return;
+
+	GL_TexCacheCheckGamedir ();
+	stamp = GL_TexCacheStamp (image->name);
+	if (!stamp)
+		return;
+
+	entry = GL_TexCacheAdd (image->name, stamp, GL_TexCacheKey (image->type),
+			image->width, image->height, data,
+			image->upload_width, image->upload_height, samples);
+
+	if (entry && gl_texcache_disk->value)
+		GL_WriteTexCache (entry);
+}
+
+static texcache_t *GL_TexCacheLookup (char *name, imagetype_t type)
+{
+	texcache_t	*entry;
+	unsigned	stamp, key;
+
+	if (gl_texcache->value <= 0 || name[0] == '*')
+		return NULL;
+
+	GL_TexCacheCheckGamedir ();
+	stamp = GL_TexCacheStamp (name);
+	if (!stamp)
+		return NULL;
+
+	key = GL_TexCacheKey (type);
+	entry = GL_TexCacheFind (name, stamp, key);
+	if (!entry && gl_texcache_disk->value)
+		entry = GL_ReadTexCache (name, stamp, key);
+
+	return entry;
+}
+
+static void GL_UploadCacheEntry (image_t *image, texcache_t *entry)
+{
+	image->width = entry->width;
+	image->height = entry->height;
+
+	GL_Bind (image->texnum);
+	GL_UploadPrepared (entry->data, entry->upload_width, entry->upload_height,
+			entry->samples, (image->type != it_pic) && (image->type != it_sky));
+	image->has_alpha = (entry->samples == gl_alpha_format);
+	image->upload_width = entry->upload_width;
+	image->upload_height = entry->upload_height;
+	image->paletted = false;
+
+	texcache_hits++;
+}
+
+/*
+================
+GL_UploadCachedTexture
+
+Uploads image from the cache, returns false on a miss
+================
+*/
+static qboolean GL_UploadCachedTexture (image_t *image)
+{
+	texcache_t	*entry;
+
+	entry = GL_TexCacheLookup (image->name, image->type);
+	if (!entry)
+		return false;
+
+	GL_UploadCacheEntry (image, entry);
+	return true;
+}
+
+/*
+================
+GL_LoadCachedImage
+
+Creates a new image straight from the cache, NULL on a miss
+================
+*/
+static image_t *GL_LoadCachedImage (char *name, imagetype_t type)
+{
+	texcache_t	*entry;
+	image_t		*image;
+
+	entry = GL_TexCacheLookup (name, type);
+	if (!entry)
+		return NULL;
+
+	image = GL_AllocImage (name, entry->width, entry->height, type);
+	GL_UploadCacheEntry (image, entry);
+
+	return image;
+}
+
+/*
+================
+GL_LoadPic
+
+This is also used as an entry point for the generated r_notexture
+================
+*/
+image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t type, int bits)
+{
+	image_t		*image;
+
+	image = GL_AllocImage (name, width, height, type);
+
 	if (type == it_skin && bits == 8)
 		R_FloodFillSkin(pic, width, height);
 
 	/* load little pics into the scrap */
 	{
-		image->texnum = TEXNUM_IMAGES + (image - gltextures);
 		GL_Bind(image->texnum);
 		if (bits == 8) {
 			image->has_alpha = GL_Upload8 (pic, width, height, (image->type != it_pic) && (image->type != it_sky), image->type == it_sky );
@@ -747,15 +1315,322 @@ image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t t
 		image->upload_width = upload_width;		/* after power of 2 and scales */
 		image->upload_height = upload_height;
 		image->paletted = uploaded_paletted;
-		image->sl = 0;
-		image->sh = 1;
-		image->tl = 0;
-		image->th = 1;
 	}
 
+	GL_CacheTexture (image, upload_data, upload_samples);
+
 	return image;
 }
 
+/*
+====================================================================
+
+IMAGE DECODE JOBS
+
+While a map is being registered, world textures and skins are only
+read from disk on the main thread.  Decoding, palette expansion,
+resampling and light scaling run on worker threads, and the finished
+pixels are handed to glTexImage2D by R_EndRegistration.
+
+====================================================================
+*/
+
+#define	MAX_IMAGE_WORKERS	8
+
+typedef enum
+{
+	IMAGEJOB_TGA,
+	IMAGEJOB_JPG,
+	IMAGEJOB_WAL,
+	IMAGEJOB_PCX
+} imagejobformat_t;
+
+typedef struct
+{
+	image_t				*image;
+	imagejobformat_t	format;
+	qboolean			mipmap;
+	int					scaled_width, scaled_height;
+
+	byte				*file;		/* from FS_LoadFile, freed on the main thread */
+	int					filelen;
+	byte				*pic;		/* 8 bit pixels, inside file for .wal */
+
+	/* filled in by the worker */
+	uint32_t			*data;		/* what to upload */
+	uint32_t			*buffer;	/* malloced storage behind data */
+	int					samples;
+} imagejob_t;
+
+static imagejob_t	image_jobs[MAX_GLTEXTURES];
+static volatile unsigned	image_jobs_queued;		/* published to the workers */
+static volatile unsigned	image_jobs_claimed;
+static volatile unsigned	image_jobs_closed;
+
+static qthread_t	*image_workers[MAX_IMAGE_WORKERS];
+static int			image_numworkers;
+static qboolean		image_jobs_active;
+static int			image_jobs_starttime;
+
+/*
+================
+GL_RunImageJob
+
+Runs on a worker, must not touch GL or the filesystem
+================
+*/
+static void GL_RunImageJob (imagejob_t *job)
+{
+	image_t		*image = job->image;
+	uint32_t	*rgba = NULL;
+	int			width = image->width;
+	int			height = image->height;
+
+	switch (job->format)
+	{
+	case IMAGEJOB_TGA:
+		rgba = (uint32_t *)DecodeTGA (job->file, job->filelen, &width, &height);
+		break;
+	case IMAGEJOB_JPG:
+		rgba = (uint32_t *)DecodeJPG (job->file, job->filelen, &width, &height);
+		break;
+	case IMAGEJOB_WAL:
+	case IMAGEJOB_PCX:
+		if (image->type == it_skin)
+			R_FloodFillSkin (job->pic, width, height);
+		rgba = malloc (width*height*4);
+		if (rgba)
+			GL_Expand8 (job->pic, width, height, rgba);
+		break;
+	}
+
+	if (!rgba)
+		return;
+
+	job->samples = GL_TextureSamples (rgba, width, height);
+	job->buffer = malloc (job->scaled_width*job->scaled_height*4);
+	if (!job->buffer)
+	{
+		free (rgba);
+		return;
+	}
+
+	job->data = GL_PrepareTexture (rgba, width, height,
+			job->scaled_width, job->scaled_height, job->mipmap, job->buffer);
+
+	if (job->data == rgba)
+	{
+		free (job->buffer);
+		job->buffer = rgba;
+	}
+	else
+		free (rgba);
+}
+
+/*
+================
+GL_ImageWorker
+
+Each pass claims the next job index and waits for the main thread
+to publish it.  Exits once the queue is closed and the claimed
+index will never be filled.
+================
+*/
+static void GL_ImageWorker (void *unused)
+{
+	unsigned	i;
+
+	for (;;)
+	{
+		i = qatomic_add (&image_jobs_claimed, 1) - 1;
+
+		while (i >= qatomic_load (&image_jobs_queued))
+		{
+			if (qatomic_load (&image_jobs_closed) && i >= qatomic_load (&image_jobs_queued))
+				return;
+			qthread_sleep (1);
+		}
+
+		GL_RunImageJob (&image_jobs[i]);
+	}
+}
+
+/*
+================
+GL_BeginImageJobs
+
+Called by R_BeginRegistration
+================
+*/
+void GL_BeginImageJobs (void)
+{
+	int		i, numworkers;
+
+	/* a previous registration may have been dropped half way */
+	GL_FinishImageJobs ();
+
+	if (!gl_imagejobs->value)
+		return;
+
+	if (gl_imagejobs->value > 1)
+		numworkers = (int)gl_imagejobs->value;
+	else
+		numworkers = cpu_features_get_core_amount () - 1;
+	if (numworkers < 1)
+		numworkers = 1;
+	if (numworkers > MAX_IMAGE_WORKERS)
+		numworkers = MAX_IMAGE_WORKERS;
+
+	image_jobs_queued = 0;
+	image_jobs_claimed = 0;
+	image_jobs_closed = 0;
+
+	for (i=0 ; i<numworkers ; i++)
+	{
+		image_workers[i] = qthread_create (GL_ImageWorker, NULL);
+		if (!image_workers[i])
+			break;
+	}
+
+	image_numworkers = i;
+	image_jobs_active = (image_numworkers > 0);
+	image_jobs_starttime = Sys_Milliseconds ();
+}
+
+/*
+================
+GL_FinishImageJobs
+
+Waits for the workers and uploads everything they produced.  Called
+by R_EndRegistration, must be on the GL thread.
+================
+*/
+void GL_FinishImageJobs (void)
+{
+	int			i, time, numjobs;
+	imagejob_t	*job;
+
+	if (!image_jobs_active)
+		return;
+
+	time = Sys_Milliseconds ();
+
+	/* help out with whatever is left, then collect the workers */
+	qatomic_store (&image_jobs_closed, 1);
+	GL_ImageWorker (NULL);
+	for (i=0 ; i<image_numworkers ; i++)
+		qthread_join (image_workers[i]);
+
+	numjobs = image_jobs_queued;
+	for (i=0, job=image_jobs ; i<numjobs ; i++, job++)
+	{
+		image_t	*image = job->image;
+
+		if (job->data)
+		{
+			GL_Bind (image->texnum);
+			GL_UploadPrepared (job->data, job->scaled_width, job->scaled_height,
+					job->samples, job->mipmap);
+			image->has_alpha = (job->samples == gl_alpha_format);
+			image->upload_width = job->scaled_width;
+			image->upload_height = job->scaled_height;
+			image->paletted = false;
+			GL_CacheTexture (image, job->data, job->samples);
+		}
+		else
+			ri.Con_Printf (PRINT_ALL, "GL_FindImage: can't decode %s\n", image->name);
+
+		if (job->buffer)
+			free (job->buffer);
+		if (job->format == IMAGEJOB_PCX)
+			free (job->pic);
+		if (job->file)
+			ri.FS_FreeFile (job->file);
+		memset (job, 0, sizeof(*job));
+	}
+
+	ri.Con_Printf (PRINT_DEVELOPER, "%i images decoded on %i threads, %i ms to register, %i ms waiting and uploading\n",
+			numjobs, image_numworkers + 1, time - image_jobs_starttime, Sys_Milliseconds () - time);
+
+	image_numworkers = 0;
+	image_jobs_queued = 0;
+	image_jobs_active = false;
+}
+
+/*
+================
+GL_QueueImage
+
+Reads name and hands it to the workers.  Returns false if the caller
+has to load it synchronously instead; otherwise *out is the new
+image, or NULL if there is no such file.
+================
+*/
+static qboolean GL_QueueImage (char *name, imagetype_t type, imagejobformat_t format, image_t **out)
+{
+	imagejob_t	*job;
+	miptex_t	*mt;
+	byte		*file = NULL, *pic = NULL, *palette = NULL;
+	int			filelen = 0, width = 0, height = 0;
+
+	*out = NULL;
+
+	if (!image_jobs_active || (type != it_wall && type != it_skin))
+		return false;
+	if (image_jobs_queued == MAX_GLTEXTURES)
+		return false;
+
+	switch (format)
+	{
+	case IMAGEJOB_TGA:
+	case IMAGEJOB_JPG:
+		filelen = ri.FS_LoadFile (name, (void **)&file);
+		if (!file)
+			return true;
+		if ((format == IMAGEJOB_TGA && !GetTGASize (file, filelen, &width, &height))
+			|| (format == IMAGEJOB_JPG && !GetJPGSize (file, filelen, &width, &height)))
+		{
+			/* let the synchronous loader report it */
+			ri.FS_FreeFile (file);
+			return false;
+		}
+		break;
+	case IMAGEJOB_WAL:
+		ri.FS_LoadFile (name, (void **)&file);
+		if (!file)
+		{
+			ri.Con_Printf (PRINT_ALL, "GL_FindImage: can't load %s\n", name);
+			*out = r_notexture;
+			return true;
+		}
+		mt = (miptex_t *)file;
+		width = LittleLong (mt->width);
+		height = LittleLong (mt->height);
+		pic = file + LittleLong (mt->offsets[0]);
+		break;
+	case IMAGEJOB_PCX:
+		LoadPCX (name, &pic, &palette, &width, &height);
+		if (palette)
+			free (palette);
+		if (!pic)
+			return true;
+		break;
+	}
+
+	job = &image_jobs[image_jobs_queued];
+	job->image = GL_AllocImage (name, width, height, type);
+	job->format = format;
+	job->mipmap = true;		/* only walls and skins get here */
+	GL_ScaledSize (width, height, job->mipmap, &job->scaled_width, &job->scaled_height);
+	job->file = file;
+	job->filelen = filelen;
+	job->pic = pic;
+
+	qatomic_store (&image_jobs_queued, image_jobs_queued + 1);
+
+	*out = job->image;
+	return true;
+}
 
 /*
 ================
@@ -820,6 +1695,10 @@ image_t	*GL_FindImage (char *name, imagetype_t type, bool force)
       }
    }
 
+   image = GL_LoadCachedImage (name, type);
+   if (image)
+      return image;
+
    /*
     * load the pic from disk
     */
@@ -827,6 +1706,8 @@ image_t	*GL_FindImage (char *name, imagetype_t type, bool force)
    palette = NULL;
    if (!strcmp(name+len-4, ".tga"))
    {
+      if (GL_QueueImage (name, type, IMAGEJOB_TGA, &image))
+         return image;
       LoadTGA (name, &pic, &width, &height);
       if (!pic)
          return NULL; /* ri.Sys_Error (ERR_DROP, "GL_FindImage: can't load %s", name); */
@@ -834,6 +1715,8 @@ image_t	*GL_FindImage (char *name, imagetype_t type, bool force)
    }
    else if (!strcmp(name+len-4, ".jpg"))
    {
+      if (GL_QueueImage (name, type, IMAGEJOB_JPG, &image))
+         return image;
       LoadJPG(name, &pic, &width, &height);
       if (!pic)
          return NULL; /* ri.Sys_Error (ERR_DROP, "GL_FindImage: can't load %s", name); */
@@ -852,11 +1735,15 @@ image_t	*GL_FindImage (char *name, imagetype_t type, bool force)
       if (image)
          return image;
       if (!strcmp(name+len-4, ".pcx")) {
+         if (GL_QueueImage (name, type, IMAGEJOB_PCX, &image))
+            return image;
          LoadPCX (name, &pic, &palette, &width, &height);
          if (!pic)
             return NULL; /* ri.Sys_Error (ERR_DROP, "GL_FindImage: can't load %s", name); */
          image = GL_LoadPic (name, pic, width, height, type, 8);
       } else if (!strcmp(name+len-4, ".wal")) {
+         if (GL_QueueImage (name, type, IMAGEJOB_WAL, &image))
+            return image;
          image = GL_LoadWal (name);
       }
    }
@@ -1019,6 +1906,9 @@ void	GL_ShutdownImages (void)
 	int		i;
 	image_t	*image;
 
+	GL_FinishImageJobs ();
+	GL_FlushTextureCache ();
+
 	for (i=0, image=gltextures ; i<numgltextures ; i++, image++)
 	{
 		if (!image->registration_sequence)
@@ -1041,7 +1931,11 @@ void GL_ReloadPic (byte *pic, int bits, image_t *image)
 		} else {
 			GL_Upload32 ((uint32_t*)pic, image->width, image->height, (image->type != it_pic) && (image->type != it_sky) );	
 		}
+		image->upload_width = upload_width;
+		image->upload_height = upload_height;
 	}
+
+	GL_CacheTexture (image, upload_data, upload_samples);
 }
 
 void GL_ReloadWal (image_t *image)
@@ -1071,6 +1965,10 @@ void GL_ReuploadImage(image_t *image)
 	 */
 	byte *pic     = NULL;
 	byte *palette = NULL;
+
+	if (GL_UploadCachedTexture (image))
+		return;
+
 	if (!strcmp((image->name)+len-4, ".tga"))
 	{
 		LoadTGA (image->name, &pic, &width, &height);
@@ -1116,16 +2014,25 @@ void restore_textures()
 	image_t	*image;
 	int		x,y;
 	byte	data[8][8][4];
+	int		time, count;
 	
+	time = Sys_Milliseconds ();
+	count = 0;
+	texcache_hits = 0;
+
 	for (i=0, image=gltextures ; i<numgltextures ; i++, image++)
 	{
 		if (image->texnum) {
 			if ((!strcmp(image->name, "***r_notexture***"))||(!strcmp(image->name, "***particle***"))) continue;
 			printf("Restoring texture %d (%s)\n", image->texnum, image->name);
 			GL_ReuploadImage(image);
+			count++;
 		}
 	}
 
+	ri.Con_Printf (PRINT_ALL, "restored %i textures in %i ms, %i from the texture cache\n",
+			count, Sys_Milliseconds () - time, texcache_hits);
+
 	/*
 	 * particle texture
 	 */
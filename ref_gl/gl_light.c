@@ -25,6 +25,7 @@ typedef struct
 } viddef_t;
 
 #include "gl_local.h"
+#include "../ref_common/r_light_common.h"
 
 static int	r_dlightframecount;
 
@@ -374,6 +375,7 @@ void R_LightPoint (vec3_t p, vec3_t color)
 /*=================================================================== */
 
 static float s_blocklights[34*34*3];
+static float s_falloff[34*34];
 /*
 ===============
 R_AddDynamicLights
@@ -382,16 +384,12 @@ R_AddDynamicLights
 void R_AddDynamicLights (msurface_t *surf)
 {
 	int			lnum;
-	int			sd, td;
 	float		fdist, frad, fminlight;
 	vec3_t		impact, local;
-	int			s, t;
 	int			i;
 	int			smax, tmax;
 	mtexinfo_t	*tex;
 	dlight_t	*dl;
-	float		*pfBL;
-	float		fsacc, ftacc;
 
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
@@ -423,33 +421,8 @@ void R_AddDynamicLights (msurface_t *surf)
 		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3] - surf->texturemins[0];
 		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
 
-		pfBL = s_blocklights;
-		for (t = 0, ftacc = 0 ; t<tmax ; t++, ftacc += 16)
-		{
-			td = local[1] - ftacc;
-			if ( td < 0 )
-				td = -td;
-
-			for ( s=0, fsacc = 0 ; s<smax ; s++, fsacc += 16, pfBL += 3)
-			{
-				sd = Q_ftol( local[0] - fsacc );
-
-				if ( sd < 0 )
-					sd = -sd;
-
-				if (sd > td)
-					fdist = sd + (td>>1);
-				else
-					fdist = td + (sd>>1);
-
-				if ( fdist < fminlight )
-				{
-					pfBL[0] += ( frad - fdist ) * dl->color[0];
-					pfBL[1] += ( frad - fdist ) * dl->color[1];
-					pfBL[2] += ( frad - fdist ) * dl->color[2];
-				}
-			}
-		}
+		RL_DlightFalloff (s_falloff, smax, tmax, local[0], local[1], frad, fminlight);
+		RL_AddDlightRGB (s_blocklights, s_falloff, smax*tmax, dl->color);
 	}
 }
 
@@ -486,6 +459,7 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
    float		*bl;
    lightstyle_t	*style;
    int monolightmap;
+   int maps;
 
    if ( surf->texinfo->flags & (SURF_SKY|SURF_TRANS33|SURF_TRANS66|SURF_WARP) )
       ri.Sys_Error (ERR_DROP, "R_BuildLightMap called for non-lit surface");
@@ -499,8 +473,6 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
    /* set to full bright if no light data */
    if (!surf->samples)
    {
-      int maps;
-
       for (i=0 ; i<size*3 ; i++)
          s_blocklights[i] = 255;
       for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
@@ -519,77 +491,13 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
    lightmap = surf->samples;
 
    /* add all the lightmaps */
-   if ( nummaps == 1 )
+   for (maps = 0 ; maps < nummaps ; maps++)
    {
-      int maps;
-
-      for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
-            maps++)
-      {
-         bl = s_blocklights;
-
-         for (i=0 ; i<3 ; i++)
-            scale[i] = gl_modulate->value*r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
+      for (i=0 ; i<3 ; i++)
+         scale[i] = gl_modulate->value*r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
 
-         if ( scale[0] == 1.0F &&
-               scale[1] == 1.0F &&
-               scale[2] == 1.0F )
-         {
-            for (i=0 ; i<size ; i++, bl+=3)
-            {
-               bl[0] = lightmap[i*3+0];
-               bl[1] = lightmap[i*3+1];
-               bl[2] = lightmap[i*3+2];
-            }
-         }
-         else
-         {
-            for (i=0 ; i<size ; i++, bl+=3)
-            {
-               bl[0] = lightmap[i*3+0] * scale[0];
-               bl[1] = lightmap[i*3+1] * scale[1];
-               bl[2] = lightmap[i*3+2] * scale[2];
-            }
-         }
-         lightmap += size*3;		/* skip to next lightmap */
-      }
-   }
-   else
-   {
-      int maps;
-
-      memset( s_blocklights, 0, sizeof( s_blocklights[0] ) * size * 3 );
-
-      for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
-            maps++)
-      {
-         bl = s_blocklights;
-
-         for (i=0 ; i<3 ; i++)
-            scale[i] = gl_modulate->value*r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
-
-         if ( scale[0] == 1.0F &&
-               scale[1] == 1.0F &&
-               scale[2] == 1.0F )
-         {
-            for (i=0 ; i<size ; i++, bl+=3 )
-            {
-               bl[0] += lightmap[i*3+0];
-               bl[1] += lightmap[i*3+1];
-               bl[2] += lightmap[i*3+2];
-            }
-         }
-         else
-         {
-            for (i=0 ; i<size ; i++, bl+=3)
-            {
-               bl[0] += lightmap[i*3+0] * scale[0];
-               bl[1] += lightmap[i*3+1] * scale[1];
-               bl[2] += lightmap[i*3+2] * scale[2];
-            }
-         }
-         lightmap += size*3;		/* skip to next lightmap */
-      }
+      RL_ScaleLightmapRGB (s_blocklights, lightmap, size, scale, maps > 0);
+      lightmap += size*3;		/* skip to next lightmap */
    }
 
    /* add all the dynamic lights */
@@ -605,63 +513,7 @@ store:
 
    if ( monolightmap == '0' )
    {
-      for (i=0 ; i<tmax ; i++, dest += stride)
-      {
-         for (j=0 ; j<smax ; j++)
-         {
-
-            r = Q_ftol( bl[0] );
-            g = Q_ftol( bl[1] );
-            b = Q_ftol( bl[2] );
-
-            /* catch negative lights */
-            if (r < 0)
-               r = 0;
-            if (g < 0)
-               g = 0;
-            if (b < 0)
-               b = 0;
-
-            /*
-             ** determine the brightest of the three color components
-             */
-            if (r > g)
-               max = r;
-            else
-               max = g;
-            if (b > max)
-               max = b;
-
-            /*
-             ** alpha is ONLY used for the mono lightmap case.  For this reason
-             ** we set it to the brightest of the color components so that 
-             ** things don't get too dim.
-             */
-            a = max;
-
-            /*
-             ** rescale all the color components if the intensity of the greatest
-             ** channel exceeds 1.0
-             */
-            if (max > 255)
-            {
-               float t = 255.0F / max;
-
-               r = r*t;
-               g = g*t;
-               b = b*t;
-               a = a*t;
-            }
-
-            dest[0] = r;
-            dest[1] = g;
-            dest[2] = b;
-            dest[3] = a;
-
-            bl += 3;
-            dest += 4;
-         }
-      }
+      RL_PackLightmapRGBA (bl, dest, smax, tmax, stride + (smax<<2));
    }
    else
    {
@@ -140,7 +140,8 @@ extern	model_t		*currentmodel;
 extern	int			r_refgl_visframecount;
 extern	int			r_refgl_framecount;
 extern	cplane_t	frustum[4];
-extern	int			c_brush_polys, c_alias_polys;
+extern	int			c_brush_polys, c_alias_polys, c_brush_draws;
+extern	int			c_lightmap_bytes;
 
 
 extern	int			gl_filter_min, gl_filter_max;
@@ -192,6 +193,11 @@ extern	cvar_t	*gl_log;
 extern	cvar_t	*gl_lightmap;
 extern	cvar_t	*gl_shadows;
 extern	cvar_t	*gl_dynamic;
+extern	cvar_t	*gl_batchworld;
+extern	cvar_t	*gl_batchalias;
+extern	cvar_t	*gl_imagejobs;
+extern	cvar_t	*gl_texcache;
+extern	cvar_t	*gl_texcache_disk;
 extern  cvar_t  *gl_monolightmap;
 extern	cvar_t	*gl_nobind;
 extern	cvar_t	*gl_round_down;
@@ -304,6 +310,9 @@ struct image_s *R_RegisterSkin (char *name);
 void LoadPCX (char *filename, byte **pic, byte **palette, int *width, int *height);
 image_t *GL_LoadPic (char *name, byte *pic, int width, int height, imagetype_t type, int bits);
 image_t	*GL_FindImage (char *name, imagetype_t type, qboolean force);
+void	GL_BeginImageJobs (void);
+void	GL_FinishImageJobs (void);
+void	GL_FlushTextureCache (void);
 void	GL_TextureMode( char *string );
 void	GL_ImageList_f (void);
 
@@ -311,6 +320,7 @@ void	GL_SetTexturePalette( unsigned palette[256] );
 
 void	GL_InitImages (void);
 void	GL_ShutdownImages (void);
+void	GL_FreeLightmapPages (void);
 
 void	GL_FreeUnusedImages (void);
 
@@ -28,6 +28,14 @@ typedef struct
 
 #include "gl_local.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GL_SIMD_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define GL_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 /*
 =============================================================
 
@@ -84,12 +92,126 @@ void GL_LerpVerts( int nverts, dtrivertx_t *v, dtrivertx_t *ov, dtrivertx_t *ver
 
 }
 
+/*
+=============
+GL_LerpAliasMesh
+
+Blends the pre-decoded frames of an aliasmesh_t into s_lerped.
+oldmove is the origin change since the old frame, in model space.
+=============
+*/
+static void GL_LerpAliasMesh (aliasmesh_t *mesh, dmdl_t *paliashdr, dtrivertx_t *verts, float backlerp, vec3_t oldmove)
+{
+	int		i;
+	int		nverts = paliashdr->num_xyz;
+	float	frontlerp = 1.0 - backlerp;
+	float	*v = mesh->frames + currententity->frame * nverts * 4;
+	float	*ov = mesh->frames + currententity->oldframe * nverts * 4;
+	float	*lerp = s_lerped[0];
+	vec4_t	move;
+
+	move[0] = backlerp*oldmove[0];
+	move[1] = backlerp*oldmove[1];
+	move[2] = backlerp*oldmove[2];
+	move[3] = 0;
+
+#if defined(GL_SIMD_SSE)
+	{
+		__m128	f = _mm_set1_ps (frontlerp);
+		__m128	b = _mm_set1_ps (backlerp);
+		__m128	m = _mm_loadu_ps (move);
+
+		for (i=0 ; i<nverts ; i++, v+=4, ov+=4, lerp+=4)
+			_mm_storeu_ps (lerp, _mm_add_ps (_mm_add_ps (_mm_mul_ps (_mm_loadu_ps (v), f),
+					_mm_mul_ps (_mm_loadu_ps (ov), b)), m));
+	}
+#elif defined(GL_SIMD_NEON)
+	{
+		float32x4_t	m = vld1q_f32 (move);
+
+		for (i=0 ; i<nverts ; i++, v+=4, ov+=4, lerp+=4)
+			vst1q_f32 (lerp, vmlaq_n_f32 (vmlaq_n_f32 (m, vld1q_f32 (v), frontlerp), vld1q_f32 (ov), backlerp));
+	}
+#else
+	for (i=0 ; i<nverts ; i++, v+=4, ov+=4, lerp+=4)
+	{
+		lerp[0] = move[0] + ov[0]*backlerp + v[0]*frontlerp;
+		lerp[1] = move[1] + ov[1]*backlerp + v[1]*frontlerp;
+		lerp[2] = move[2] + ov[2]*backlerp + v[2]*frontlerp;
+	}
+#endif
+
+	if ( currententity->flags & ( RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM) )
+	{
+		for (i=0, lerp=s_lerped[0] ; i<nverts ; i++, lerp+=4)
+		{
+			float *normal = r_avertexnormals[verts[i].lightnormalindex];
+
+			lerp[0] += normal[0] * POWERSUIT_SCALE;
+			lerp[1] += normal[1] * POWERSUIT_SCALE;
+			lerp[2] += normal[2] * POWERSUIT_SCALE;
+		}
+	}
+}
+
+/*
+=============
+GL_DrawAliasMesh
+
+One indexed draw for the whole model, st comes straight from the mesh
+=============
+*/
+static void GL_DrawAliasMesh (aliasmesh_t *mesh, dtrivertx_t *verts, float alpha)
+{
+	int		i;
+	float	l, *p;
+	float	*pPos = gVertexBuffer;
+	float	*pColor = gColorBuffer;
+	unsigned short	*xyz = mesh->xyzindex;
+
+	if ( currententity->flags & ( RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE ) )
+	{
+		for (i=0 ; i<mesh->numverts ; i++)
+		{
+			p = s_lerped[xyz[i]];
+			*gVertexBuffer++ = p[0];
+			*gVertexBuffer++ = p[1];
+			*gVertexBuffer++ = p[2];
+			*gColorBuffer++ = shadelight[0];
+			*gColorBuffer++ = shadelight[1];
+			*gColorBuffer++ = shadelight[2];
+			*gColorBuffer++ = alpha;
+		}
+	}
+	else
+	{
+		for (i=0 ; i<mesh->numverts ; i++)
+		{
+			p = s_lerped[xyz[i]];
+			l = shadedots[verts[xyz[i]].lightnormalindex];
+			*gVertexBuffer++ = p[0];
+			*gVertexBuffer++ = p[1];
+			*gVertexBuffer++ = p[2];
+			*gColorBuffer++ = l*shadelight[0];
+			*gColorBuffer++ = l*shadelight[1];
+			*gColorBuffer++ = l*shadelight[2];
+			*gColorBuffer++ = alpha;
+		}
+	}
+
+	qglEnableClientState(GL_COLOR_ARRAY);
+	glVertexAttribPointerMapped(0, pPos);
+	glVertexAttribPointerMapped(1, mesh->st);
+	glVertexAttribPointerMapped(2, pColor);
+	qglDrawElements(GL_TRIANGLES, mesh->numindices, GL_UNSIGNED_SHORT, mesh->indices);
+	qglDisableClientState(GL_COLOR_ARRAY);
+}
+
 /*
 =============
 GL_DrawAliasFrameLerp
 
 interpolates between two frames and origins
-FIXME: batch lerp all vertexes
 =============
 */
 void GL_DrawAliasFrameLerp (dmdl_t *paliashdr, float backlerp)
@@ -142,6 +264,16 @@ void GL_DrawAliasFrameLerp (dmdl_t *paliashdr, float backlerp)
 	move[1] = -DotProduct (delta, vectors[1]);	/* left */
 	move[2] = DotProduct (delta, vectors[2]);	   /* up */
 
+	if (gl_batchalias->value && currentmodel->aliasmesh)
+	{
+		GL_LerpAliasMesh (currentmodel->aliasmesh, paliashdr, verts, backlerp, move);
+		GL_DrawAliasMesh (currentmodel->aliasmesh, verts, alpha);
+
+		if ( currententity->flags & ( RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM) )
+			qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		return;
+	}
+
 	VectorAdd (move, oldframe->translate, move);
 
 	for (i=0 ; i<3 ; i++)
@@ -274,31 +406,16 @@ void GL_DrawAliasShadow (dmdl_t *paliashdr, int posenum)
    qglStencilFunc(GL_EQUAL, 1, 2);
    qglStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
 
-   while (1)
+   if (gl_batchalias->value && currentmodel->aliasmesh)
    {
-      int c;
-
-      /* get the vertex count and primitive type */
-      count = *order++;
+      aliasmesh_t *mesh = currentmodel->aliasmesh;
+      int i;
 
-      if (!count)
-         break; /* done */
-
-      if (count < 0)
-      {
-         count = -count;
-         prim = GL_TRIANGLE_FAN;
-      }
-      else
-         prim = GL_TRIANGLE_STRIP;
-
-      c    = count;
       pPos = gVertexBuffer;
 
-      do
+      for (i = 0; i < mesh->numverts; i++)
       {
-         /* Normals and vertexes come from the frame list */
-         memcpy(point, s_lerped[order[2]], sizeof(point));
+         memcpy(point, s_lerped[mesh->xyzindex[i]], sizeof(point));
 
          point[0] -= shadevector[0] * (point[2] + lheight);
          point[1] -= shadevector[1] * (point[2] + lheight);
@@ -307,16 +424,59 @@ void GL_DrawAliasShadow (dmdl_t *paliashdr, int posenum)
          *gVertexBuffer++ = point[0];
          *gVertexBuffer++ = point[1];
          *gVertexBuffer++ = point[2];
-
-         order += 3;
       }
-      while (--count);
 
       qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
       glVertexAttribPointerMapped(0, pPos);
-      GL_DrawPolygon(prim, c);
+      qglDrawElements(GL_TRIANGLES, mesh->numindices, GL_UNSIGNED_SHORT, mesh->indices);
       qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
    }
+   else
+   {
+      while (1)
+      {
+         int c;
+
+         /* get the vertex count and primitive type */
+         count = *order++;
+
+         if (!count)
+            break; /* done */
+
+         if (count < 0)
+         {
+            count = -count;
+            prim = GL_TRIANGLE_FAN;
+         }
+         else
+            prim = GL_TRIANGLE_STRIP;
+
+         c    = count;
+         pPos = gVertexBuffer;
+
+         do
+         {
+            /* Normals and vertexes come from the frame list */
+            memcpy(point, s_lerped[order[2]], sizeof(point));
+
+            point[0] -= shadevector[0] * (point[2] + lheight);
+            point[1] -= shadevector[1] * (point[2] + lheight);
+            point[2] = height;
+
+            *gVertexBuffer++ = point[0];
+            *gVertexBuffer++ = point[1];
+            *gVertexBuffer++ = point[2];
+
+            order += 3;
+         }
+         while (--count);
+
+         qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+         glVertexAttribPointerMapped(0, pPos);
+         GL_DrawPolygon(prim, c);
+         qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+      }
+   }
 
    /* Stencilbuffer shadows (force enabled in libretro.c) */
    qglDisable(GL_STENCIL_TEST);
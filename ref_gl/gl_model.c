@@ -32,6 +32,7 @@ static int		modfilelen;
 static void Mod_LoadSpriteModel (model_t *mod, void *buffer);
 static void Mod_LoadBrushModel (model_t *mod, void *buffer);
 static void Mod_LoadAliasModel (model_t *mod, void *buffer);
+static int Mod_AliasHunkSize (void *buffer);
 #if 0
 model_t *Mod_LoadModel (model_t *mod, qboolean crash);
 #endif
@@ -253,7 +254,7 @@ model_t *Mod_ForName (char *name, qboolean crash)
 	switch (LittleLong(*(unsigned *)buf))
    {
       case IDALIASHEADER:
-         refgl_loadmodel->extradata = Hunk_Begin (0x200000);
+         refgl_loadmodel->extradata = Hunk_Begin (Mod_AliasHunkSize (buf));
          Mod_LoadAliasModel (mod, buf);
          break;
 
@@ -682,6 +683,7 @@ void GL_BuildPolygonFromSurface(msurface_t *fa);
 void GL_CreateSurfaceLightmap (msurface_t *surf);
 void GL_EndBuildingLightmaps (void);
 void GL_BeginBuildingLightmaps (model_t *m);
+void GL_BuildPolygonVertexBuffer (model_t *m);
 
 /*
 =================
@@ -763,6 +765,8 @@ static void Mod_LoadFaces (lump_t *l)
    }
 
    GL_EndBuildingLightmaps ();
+
+   GL_BuildPolygonVertexBuffer (refgl_loadmodel);
 }
 
 
@@ -1047,6 +1051,159 @@ ALIAS MODELS
 ==============================================================================
 */
 
+/*
+=================
+Mod_AliasHunkSize
+
+The file copy plus the decoded frames and the indexed mesh
+=================
+*/
+static int Mod_AliasHunkSize (void *buffer)
+{
+	dmdl_t	*pinmodel = (dmdl_t *)buffer;
+	int		ofs_end, num_xyz, num_frames, num_glcmds;
+
+	ofs_end = LittleLong (pinmodel->ofs_end);
+	num_xyz = LittleLong (pinmodel->num_xyz);
+	num_frames = LittleLong (pinmodel->num_frames);
+	num_glcmds = LittleLong (pinmodel->num_glcmds);
+
+	/* Mod_LoadAliasModel rejects these with a proper message */
+	if (ofs_end <= 0 || ofs_end > modfilelen
+		|| num_xyz <= 0 || num_xyz > MAX_VERTS
+		|| num_frames <= 0 || num_frames > MAX_FRAMES
+		|| num_glcmds <= 0 || num_glcmds > ofs_end/4)
+		return 0x200000;
+
+	return ofs_end
+		+ sizeof(aliasmesh_t)
+		+ num_frames*num_xyz*4*sizeof(float)
+		+ num_glcmds*sizeof(unsigned short)				/* indices */
+		+ (num_glcmds/3+1)*(2*sizeof(unsigned short) + 2*sizeof(float))	/* xyzindex, st */
+		+ 8*32;		/* Hunk_Alloc rounding */
+}
+
+/*
+=================
+Mod_BuildAliasMesh
+
+Turns the glcmd strips and fans into a single triangle list over
+vertexes that are unique in xyz and st, and decodes every frame to
+floats so drawing only has to blend them
+=================
+*/
+static void Mod_BuildAliasMesh (model_t *mod, dmdl_t *pheader)
+{
+	aliasmesh_t		*mesh;
+	daliasframe_t	*frame;
+	int				*order, *strip, *chain, *next;
+	int				i, j, count, maxverts, index_xyz;
+	float			s, t, *out;
+	qboolean		fan;
+
+	maxverts = pheader->num_glcmds / 3 + 1;
+	strip = malloc (maxverts * sizeof(int));
+	next = malloc (maxverts * sizeof(int));
+	chain = malloc (pheader->num_xyz * sizeof(int));
+	if (!strip || !next || !chain)
+		ri.Sys_Error (ERR_DROP, "Mod_BuildAliasMesh: out of memory");
+
+	mesh = Hunk_Alloc (sizeof(*mesh));
+	mesh->indices = Hunk_Alloc (pheader->num_glcmds * sizeof(unsigned short));
+	mesh->xyzindex = Hunk_Alloc (maxverts * sizeof(unsigned short));
+	mesh->st = Hunk_Alloc (maxverts * 2 * sizeof(float));
+	mesh->numverts = 0;
+	mesh->numindices = 0;
+
+	for (i=0 ; i<pheader->num_xyz ; i++)
+		chain[i] = -1;
+
+	order = (int *)((byte *)pheader + pheader->ofs_glcmds);
+	while (1)
+	{
+		count = *order++;
+		if (!count)
+			break;
+		fan = (count < 0);
+		if (fan)
+			count = -count;
+		if (mesh->numverts + count > maxverts)
+			ri.Sys_Error (ERR_DROP, "model %s has bad glcmds", mod->name);
+
+		/* find or add each vertex */
+		for (i=0 ; i<count ; i++, order+=3)
+		{
+			s = ((float *)order)[0];
+			t = ((float *)order)[1];
+			index_xyz = order[2];
+			if (index_xyz < 0 || index_xyz >= pheader->num_xyz)
+				ri.Sys_Error (ERR_DROP, "model %s has a bad glcmd vertex", mod->name);
+
+			for (j=chain[index_xyz] ; j != -1 ; j=next[j])
+			{
+				if (mesh->st[j*2+0] == s && mesh->st[j*2+1] == t)
+					break;
+			}
+			if (j == -1)
+			{
+				j = mesh->numverts++;
+				mesh->xyzindex[j] = index_xyz;
+				mesh->st[j*2+0] = s;
+				mesh->st[j*2+1] = t;
+				next[j] = chain[index_xyz];
+				chain[index_xyz] = j;
+			}
+			strip[i] = j;
+		}
+
+		/* same winding GL gives strips and fans */
+		for (i=2 ; i<count ; i++)
+		{
+			unsigned short	*tri = mesh->indices + mesh->numindices;
+
+			if (fan)
+			{
+				tri[0] = strip[0];
+				tri[1] = strip[i-1];
+			}
+			else if (i & 1)
+			{
+				tri[0] = strip[i-1];
+				tri[1] = strip[i-2];
+			}
+			else
+			{
+				tri[0] = strip[i-2];
+				tri[1] = strip[i-1];
+			}
+			tri[2] = strip[i];
+
+			if (tri[0] != tri[1] && tri[1] != tri[2] && tri[0] != tri[2])
+				mesh->numindices += 3;
+		}
+	}
+
+	free (strip);
+	free (next);
+	free (chain);
+
+	/* decode the frames */
+	mesh->frames = out = Hunk_Alloc (pheader->num_frames * pheader->num_xyz * 4 * sizeof(float));
+	for (i=0 ; i<pheader->num_frames ; i++)
+	{
+		frame = (daliasframe_t *)((byte *)pheader + pheader->ofs_frames + i * pheader->framesize);
+		for (j=0 ; j<pheader->num_xyz ; j++, out+=4)
+		{
+			out[0] = frame->translate[0] + frame->scale[0]*frame->verts[j].v[0];
+			out[1] = frame->translate[1] + frame->scale[1]*frame->verts[j].v[1];
+			out[2] = frame->translate[2] + frame->scale[2]*frame->verts[j].v[2];
+			out[3] = 0;
+		}
+	}
+
+	mod->aliasmesh = mesh;
+}
+
 /*
 =================
 Mod_LoadAliasModel
@@ -1153,6 +1310,8 @@ static void Mod_LoadAliasModel (model_t *mod, void *buffer)
 	for (i=0 ; i<pheader->num_glcmds ; i++)
 		poutcmd[i] = LittleLong (pincmd[i]);
 
+	Mod_BuildAliasMesh (mod, pheader);
+
 
 	/* register all skins */
 	memcpy ((char *)pheader + pheader->ofs_skins, (char *)pinmodel + pheader->ofs_skins,
@@ -1237,6 +1396,8 @@ void R_BeginRegistration (char *model)
 	r_oldviewcluster = -1;		/* force markleafs */
 
 	Mod_InitWalSizeList ();
+
+	GL_BeginImageJobs ();
 	
 	Com_sprintf (fullname, sizeof(fullname), "maps/%s.bsp", model);
 
@@ -1318,6 +1479,7 @@ void R_EndRegistration (void)
 		}
 	}
 
+	GL_FinishImageJobs ();
 	GL_FreeUnusedImages ();
 }
 
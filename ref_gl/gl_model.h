@@ -91,6 +91,7 @@ typedef struct glpoly_s
 	struct	glpoly_s	*chain;
 	int		numverts;
 	int		flags;			// for SURF_UNDERWATER (not needed anymore?)
+	int		firstvert;		// index into model->polyverts, -1 if not batched
 	float	verts[4][VERTEXSIZE];	// variable sized (xyz s1t1 s2t2)
 } glpoly_t;
 
@@ -165,6 +166,21 @@ typedef struct mleaf_s
 } mleaf_t;
 
 
+//===================================================================
+
+//
+// alias model as an indexed triangle list, built from the glcmds
+//
+typedef struct
+{
+	int			numverts;		// glcmd vertexes with the same xyz and st merged
+	int			numindices;
+	unsigned short	*indices;	// triangle list
+	unsigned short	*xyzindex;	// per vertex, into the frame verts
+	float		*st;			// per vertex s, t
+	float		*frames;		// num_frames * num_xyz decoded positions, 4 floats each
+} aliasmesh_t;
+
 //===================================================================
 
 //
@@ -237,8 +253,13 @@ typedef struct model_s
 
 	byte		*lightdata;
 
+	// static copy of every non-warped glpoly_t, drawn as indexed batches
+	int			numpolyverts;
+	float		*polyverts;
+
 	// for alias models and skins
 	image_t		*skins[MAX_MD2SKINS];
+	aliasmesh_t	*aliasmesh;
 
 	int			extradatasize;
 	void		*extradata;
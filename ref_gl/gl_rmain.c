@@ -24,6 +24,7 @@ typedef struct
 } viddef_t;
 
 #include "gl_local.h"
+#include "../ref_common/r_light_common.h"
 
 void R_Clear (void);
 
@@ -47,7 +48,8 @@ cplane_t	frustum[4];
 int			r_refgl_visframecount;	/* bumped when going to a new PVS */
 int			r_refgl_framecount;		/* used for dlight push checking */
 
-int			c_brush_polys, c_alias_polys;
+int			c_brush_polys, c_alias_polys, c_brush_draws;
+int			c_lightmap_bytes;
 
 float		v_blend[4];			/* final blending color */
 
@@ -111,6 +113,11 @@ cvar_t	*gl_lightmap;
 cvar_t	*gl_shadows;
 extern cvar_t	*gl_mode;
 cvar_t	*gl_dynamic;
+cvar_t	*gl_batchworld;
+cvar_t	*gl_batchalias;
+cvar_t	*gl_imagejobs;
+cvar_t	*gl_texcache;
+cvar_t	*gl_texcache_disk;
 cvar_t  *gl_monolightmap;
 cvar_t	*gl_modulate;
 cvar_t	*gl_nobind;
@@ -627,6 +634,8 @@ void R_SetupFrame (void)
 
 	c_brush_polys = 0;
 	c_alias_polys = 0;
+	c_brush_draws = 0;
+	c_lightmap_bytes = 0;
 
 	/* clear out the portion of the screen that the NOWORLDMODEL defines */
 	if ( r_newrefdef.rdflags & RDF_NOWORLDMODEL )
@@ -781,6 +790,8 @@ void R_RenderView (refdef_t *fd)
 	{
 		c_brush_polys = 0;
 		c_alias_polys = 0;
+		c_brush_draws = 0;
+		c_lightmap_bytes = 0;
 	}
 
 	R_PushDlights ();
@@ -807,11 +818,13 @@ void R_RenderView (refdef_t *fd)
 
 	if (r_speeds->value)
 	{
-		ri.Con_Printf (PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps\n",
+		ri.Con_Printf (PRINT_ALL, "%4i wpoly %4i wdraw %4i epoly %i tex %i lmaps %i lmbytes\n",
 			c_brush_polys, 
+			c_brush_draws, 
 			c_alias_polys, 
 			c_visible_textures, 
-			c_visible_lightmaps); 
+			c_visible_lightmaps,
+			c_lightmap_bytes); 
 	}
 }
 
@@ -968,6 +981,11 @@ void R_Register( void )
 	gl_lightmap = ri.Cvar_Get ("gl_lightmap", "0", 0);
 	gl_shadows = ri.Cvar_Get ("gl_shadows", "0", CVAR_ARCHIVE );
 	gl_dynamic = ri.Cvar_Get ("gl_dynamic", "1", 0);
+	gl_batchworld = ri.Cvar_Get ("gl_batchworld", "1", 0);
+	gl_batchalias = ri.Cvar_Get ("gl_batchalias", "1", 0);
+	gl_imagejobs = ri.Cvar_Get ("gl_imagejobs", "1", CVAR_ARCHIVE);
+	gl_texcache = ri.Cvar_Get ("gl_texcache", "32", CVAR_ARCHIVE);
+	gl_texcache_disk = ri.Cvar_Get ("gl_texcache_disk", "0", CVAR_ARCHIVE);
 	gl_nobind = ri.Cvar_Get ("gl_nobind", "0", 0);
 	gl_round_down = ri.Cvar_Get ("gl_round_down", "0", 0);
 	gl_picmip = ri.Cvar_Get ("gl_picmip", "0", 0);
@@ -1018,6 +1036,7 @@ void R_Register( void )
 	ri.Cmd_AddCommand( "screenshot", GL_ScreenShot_f );
 	ri.Cmd_AddCommand( "modellist", Mod_Modellist_f );
 	ri.Cmd_AddCommand( "gl_strings", GL_Strings_f );
+	ri.Cmd_AddCommand( "lightmap_test", RL_LightmapTest_f );
 }
 
 /*
@@ -1153,10 +1172,12 @@ static void R_Shutdown (void)
 	ri.Cmd_RemoveCommand ("screenshot");
 	ri.Cmd_RemoveCommand ("imagelist");
 	ri.Cmd_RemoveCommand ("gl_strings");
+	ri.Cmd_RemoveCommand ("lightmap_test");
 
 	Mod_FreeAll ();
 
 	GL_ShutdownImages ();
+	GL_FreeLightmapPages ();
 
 	/*
 	** shut down OS specific OpenGL stuff like contexts, etc.
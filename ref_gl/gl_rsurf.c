@@ -46,6 +46,11 @@ int		c_visible_textures;
 
 #define GL_LIGHTMAP_FORMAT GL_RGBA
 
+typedef struct
+{
+	int		x0, y0, x1, y1;		/* empty when x1 <= x0 */
+} lmrect_t;
+
 typedef struct
 {
 	int internal_format;
@@ -58,6 +63,11 @@ typedef struct
 	/* the lightmap texture data needs to be kept in
 	 * main memory so texsubimage can update properly */
 	byte		lightmap_buffer[4*BLOCK_WIDTH*BLOCK_HEIGHT];
+
+	/* copies of the static pages, lightstyle changes are rebuilt
+	 * in place and each page sends up one dirty rectangle */
+	byte		*lightmap_pages[MAX_LIGHTMAPS];
+	lmrect_t	dirty[MAX_LIGHTMAPS];
 } gllightmapstate_t;
 
 static gllightmapstate_t gl_lms;
@@ -65,6 +75,8 @@ static gllightmapstate_t gl_lms;
 
 static void		LM_InitBlock( void );
 static void		LM_UploadBlock( qboolean dynamic );
+static void		LM_MarkDirty( int page, int x, int y, int w, int h );
+static void		LM_UploadDirtyPages( void );
 static qboolean	LM_AllocBlock (int w, int h, int *x, int *y);
 
 extern void R_SetCacheState( msurface_t *surf );
@@ -102,6 +114,134 @@ image_t *R_TextureAnimation (mtexinfo_t *tex)
 	return tex->image;
 }
 
+/*
+=============================================================
+
+	WORLD BATCHING
+
+Every non-warped polygon of a map is copied once into
+currentmodel->polyverts at load time.  Visible polygons that share
+a texture (or a lightmap in the blend pass) are then appended as
+triangle lists to r_batch and flushed with a single glDrawElements.
+
+=============================================================
+*/
+
+#define	MAX_BATCH_INDICES	(16384*3)
+
+typedef struct
+{
+	float		*verts;
+	int			texcoord;		/* 3 = diffuse st, 5 = lightmap st */
+	int			numindices;
+	unsigned	indices[MAX_BATCH_INDICES];
+} glbatch_t;
+
+static glbatch_t	r_batch;
+
+/*
+================
+R_FlushBatch
+================
+*/
+static void R_FlushBatch (void)
+{
+	if (!r_batch.numindices)
+		return;
+
+	qglVertexPointer (3, GL_FLOAT, VERTEXSIZE*sizeof(float), r_batch.verts);
+	qglTexCoordPointer (2, GL_FLOAT, VERTEXSIZE*sizeof(float), r_batch.verts + r_batch.texcoord);
+	qglDrawElements (GL_TRIANGLES, r_batch.numindices, GL_UNSIGNED_INT, r_batch.indices);
+
+	c_brush_draws++;
+	r_batch.numindices = 0;
+}
+
+/*
+================
+R_BatchPoly
+
+Returns false if the polygon has to be drawn immediately
+================
+*/
+static qboolean R_BatchPoly (glpoly_t *p, int texcoord)
+{
+	int			i, count;
+	unsigned	*index;
+
+	if (!gl_batchworld->value || p->firstvert < 0 || !currentmodel->polyverts)
+		return false;
+
+	count = (p->numverts - 2) * 3;
+
+	if (r_batch.verts != currentmodel->polyverts || r_batch.texcoord != texcoord
+		|| r_batch.numindices + count > MAX_BATCH_INDICES)
+	{
+		R_FlushBatch ();
+		r_batch.verts = currentmodel->polyverts;
+		r_batch.texcoord = texcoord;
+	}
+
+	index = r_batch.indices + r_batch.numindices;
+	for (i=2 ; i<p->numverts ; i++)
+	{
+		*index++ = p->firstvert;
+		*index++ = p->firstvert + i - 1;
+		*index++ = p->firstvert + i;
+	}
+	r_batch.numindices += count;
+
+	return true;
+}
+
+/*
+================
+GL_BuildPolygonVertexBuffer
+
+Copies the polygons built by GL_BuildPolygonFromSurface into one
+contiguous array so they can be drawn with indices alone
+================
+*/
+void GL_BuildPolygonVertexBuffer (model_t *m)
+{
+	int			i, numverts;
+	msurface_t	*surf;
+	glpoly_t	*p;
+	float		*out;
+
+	numverts = 0;
+	for (i=0, surf=m->surfaces ; i<m->numsurfaces ; i++, surf++)
+	{
+		if (surf->texinfo->flags & SURF_WARP)
+			continue;
+
+		for (p=surf->polys ; p ; p=p->next)
+			numverts += p->numverts;
+	}
+
+	m->numpolyverts = numverts;
+	m->polyverts = NULL;
+	if (!numverts)
+		return;
+
+	m->polyverts = out = Hunk_Alloc (numverts * VERTEXSIZE*sizeof(float));
+
+	numverts = 0;
+	for (i=0, surf=m->surfaces ; i<m->numsurfaces ; i++, surf++)
+	{
+		if (surf->texinfo->flags & SURF_WARP)
+			continue;
+
+		for (p=surf->polys ; p ; p=p->next)
+		{
+			memcpy (out, p->verts[0], p->numverts * VERTEXSIZE*sizeof(float));
+			out += p->numverts * VERTEXSIZE;
+			p->firstvert = numverts;
+			numverts += p->numverts;
+		}
+	}
+}
+
 /*
 ================
 DrawGLPoly
@@ -114,6 +254,8 @@ static void DrawGLPoly (glpoly_t *p)
    float* pnt = gTexCoordBuffer;
    float*   v = p->verts[0];
 
+   c_brush_draws++;
+
    for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
    {
       memcpy(gVertexBuffer, &v[0], sizeof(vec3_t));
@@ -143,6 +285,8 @@ static void DrawGLFlowingPoly (msurface_t *fa)
    if(scroll == 0.0)
       scroll = -64.0;
 
+   c_brush_draws++;
+
    v = p->verts[0];
    for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
    {
@@ -211,9 +355,15 @@ static void DrawGLPolyChain( glpoly_t *p, float soffset, float toffset )
       {
          float *v;
          int j;
+         float* pPos;
+         float* pTex;
 
-         float* pPos = gVertexBuffer;
-         float* pTex = gTexCoordBuffer;
+         if (R_BatchPoly (p, 5))
+            continue;
+
+         c_brush_draws++;
+         pPos = gVertexBuffer;
+         pTex = gTexCoordBuffer;
          v = p->verts[0];
          for (j=0 ; j<p->numverts ; j++, v+= VERTEXSIZE)
          {
@@ -237,6 +387,7 @@ static void DrawGLPolyChain( glpoly_t *p, float soffset, float toffset )
 
          float* pPos = gVertexBuffer;
          float* pTex = gTexCoordBuffer;
+         c_brush_draws++;
          v = p->verts[0];
          for (j=0 ; j<p->numverts ; j++, v+= VERTEXSIZE)
          {
@@ -270,6 +421,9 @@ static void R_BlendLightmaps (void)
    if (!r_worldmodel->lightdata)
       return;
 
+   /* lightstyle changes since the last call */
+   LM_UploadDirtyPages ();
+
    /* don't bother writing Z */
    qglDepthMask(GL_FALSE);
 
@@ -329,6 +483,8 @@ static void R_BlendLightmaps (void)
             if ( surf->polys )
                DrawGLPolyChain( surf->polys, 0, 0 );
          }
+
+         R_FlushBatch ();
       }
    }
 
@@ -366,6 +522,7 @@ static void R_BlendLightmaps (void)
             msurface_t *drawsurf;
 
             /* upload what we have so far */
+            R_FlushBatch ();
             LM_UploadBlock( true );
 
             /* draw all surfaces that use this lightmap */
@@ -406,6 +563,8 @@ static void R_BlendLightmaps (void)
          if ( surf->polys )
             DrawGLPolyChain( surf->polys, ( surf->light_s - surf->dlight_s ) * ( 1.0 / 128.0 ), ( surf->light_t - surf->dlight_t ) * ( 1.0 / 128.0 ) );
       }
+
+      R_FlushBatch ();
    }
 
    /*
@@ -433,6 +592,7 @@ static void R_RenderBrushPoly (msurface_t *fa)
 
 	if (fa->flags & SURF_DRAWTURB)
 	{	
+		R_FlushBatch ();
 		GL_Bind( image->texnum );
 
 		/* warp texture, no lightmaps */
@@ -448,6 +608,8 @@ static void R_RenderBrushPoly (msurface_t *fa)
 	}
 	else
 	{
+		if (gl_state.currenttextures[gl_state.currenttmu] != image->texnum)
+			R_FlushBatch ();
 		GL_Bind( image->texnum );
 
 		GL_TexEnv( GL_REPLACE );
@@ -458,7 +620,7 @@ static void R_RenderBrushPoly (msurface_t *fa)
     */
 	if(fa->texinfo->flags & SURF_FLOWING)
 		DrawGLFlowingPoly (fa);
-	else
+	else if (!R_BatchPoly (fa->polys, 3))
 		DrawGLPoly (fa->polys);
 
    /*PGM
@@ -493,20 +655,34 @@ dynamic:
 		{
 			unsigned	temp[34*34];
 			int			smax, tmax;
+			byte		*page = gl_lms.lightmap_pages[fa->lightmaptexturenum];
 
 			smax = (fa->extents[0]>>4)+1;
 			tmax = (fa->extents[1]>>4)+1;
 
-			R_BuildLightMap( fa, (void *)temp, smax*4 );
-			R_SetCacheState( fa );
-
-			GL_Bind( gl_state.lightmap_textures + fa->lightmaptexturenum );
-
-			qglTexSubImage2D( GL_TEXTURE_2D, 0,
-							  fa->light_s, fa->light_t, 
-							  smax, tmax, 
-							  GL_LIGHTMAP_FORMAT, 
-							  GL_UNSIGNED_BYTE, temp );
+			if ( page )
+			{
+				/* sent up by R_BlendLightmaps */
+				page += ( fa->light_t * BLOCK_WIDTH + fa->light_s ) * LIGHTMAP_BYTES;
+				R_BuildLightMap( fa, page, BLOCK_WIDTH*LIGHTMAP_BYTES );
+				R_SetCacheState( fa );
+				LM_MarkDirty( fa->lightmaptexturenum, fa->light_s, fa->light_t, smax, tmax );
+			}
+			else
+			{
+				R_BuildLightMap( fa, (void *)temp, smax*4 );
+				R_SetCacheState( fa );
+
+				R_FlushBatch ();
+				GL_Bind( gl_state.lightmap_textures + fa->lightmaptexturenum );
+
+				qglTexSubImage2D( GL_TEXTURE_2D, 0,
+								  fa->light_s, fa->light_t, 
+								  smax, tmax, 
+								  GL_LIGHTMAP_FORMAT, 
+								  GL_UNSIGNED_BYTE, temp );
+				c_lightmap_bytes += smax*tmax*LIGHTMAP_BYTES;
+			}
 
 			fa->lightmapchain = gl_lms.lightmap_surfaces[fa->lightmaptexturenum];
 			gl_lms.lightmap_surfaces[fa->lightmaptexturenum] = fa;
@@ -606,6 +782,8 @@ static void DrawTextureChains (void)
       }
    }
 
+   R_FlushBatch ();
+
    for ( i = 0, image=gltextures ; i<numgltextures ; i++,image++)
    {
       if (!image->registration_sequence)
@@ -685,6 +863,8 @@ static void R_DrawInlineBModel (void)
       }
    }
 
+   R_FlushBatch ();
+
 	if ( !(currententity->flags & RF_TRANSLUCENT) )
 	{
 		R_BlendLightmaps ();
@@ -1021,6 +1201,93 @@ static void LM_InitBlock( void )
 	memset( gl_lms.allocated, 0, sizeof( gl_lms.allocated ) );
 }
 
+/*
+================
+LM_MarkDirty
+
+Grows the rectangle of a static page that needs sending up
+================
+*/
+static void LM_MarkDirty( int page, int x, int y, int w, int h )
+{
+	lmrect_t	*r = &gl_lms.dirty[page];
+
+	if ( r->x1 <= r->x0 )
+	{
+		r->x0 = x;
+		r->y0 = y;
+		r->x1 = x + w;
+		r->y1 = y + h;
+		return;
+	}
+
+	if ( x < r->x0 )
+		r->x0 = x;
+	if ( y < r->y0 )
+		r->y0 = y;
+	if ( x + w > r->x1 )
+		r->x1 = x + w;
+	if ( y + h > r->y1 )
+		r->y1 = y + h;
+}
+
+/*
+================
+LM_UploadRect
+
+Sends part of a BLOCK_WIDTH wide buffer to the bound texture
+================
+*/
+static void LM_UploadRect( byte *buffer, lmrect_t *r )
+{
+	int		w = r->x1 - r->x0;
+	int		h = r->y1 - r->y0;
+
+	if ( w == BLOCK_WIDTH )
+	{
+		qglTexSubImage2D( GL_TEXTURE_2D, 0,
+						  0, r->y0,
+						  w, h,
+						  GL_LIGHTMAP_FORMAT,
+						  GL_UNSIGNED_BYTE,
+						  buffer + r->y0 * BLOCK_WIDTH * LIGHTMAP_BYTES );
+	}
+	else
+	{
+		qglPixelStorei( GL_UNPACK_ROW_LENGTH, BLOCK_WIDTH );
+		qglTexSubImage2D( GL_TEXTURE_2D, 0,
+						  r->x0, r->y0,
+						  w, h,
+						  GL_LIGHTMAP_FORMAT,
+						  GL_UNSIGNED_BYTE,
+						  buffer + ( r->y0 * BLOCK_WIDTH + r->x0 ) * LIGHTMAP_BYTES );
+		qglPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+	}
+
+	c_lightmap_bytes += w * h * LIGHTMAP_BYTES;
+}
+
+/*
+================
+LM_UploadDirtyPages
+================
+*/
+static void LM_UploadDirtyPages( void )
+{
+	int		i;
+
+	for ( i = 1; i < gl_lms.current_lightmap_texture; i++ )
+	{
+		if ( gl_lms.dirty[i].x1 <= gl_lms.dirty[i].x0 )
+			continue;
+
+		R_FlushBatch ();
+		GL_Bind( gl_state.lightmap_textures + i );
+		LM_UploadRect( gl_lms.lightmap_pages[i], &gl_lms.dirty[i] );
+		memset( &gl_lms.dirty[i], 0, sizeof( gl_lms.dirty[i] ) );
+	}
+}
+
 static void LM_UploadBlock( qboolean dynamic )
 {
 	int texture;
@@ -1042,20 +1309,26 @@ static void LM_UploadBlock( qboolean dynamic )
 	if ( dynamic )
 	{
 		int i;
+		lmrect_t r;
 
+		/* only the columns that were handed out */
+		r.x0 = BLOCK_WIDTH;
+		r.x1 = 0;
 		for ( i = 0; i < BLOCK_WIDTH; i++ )
 		{
+			if ( !gl_lms.allocated[i] )
+				continue;
 			if ( gl_lms.allocated[i] > height )
 				height = gl_lms.allocated[i];
+			if ( i < r.x0 )
+				r.x0 = i;
+			r.x1 = i + 1;
 		}
+		r.y0 = 0;
+		r.y1 = height;
 
-		qglTexSubImage2D( GL_TEXTURE_2D, 
-						  0,
-						  0, 0,
-						  BLOCK_WIDTH, height,
-						  GL_LIGHTMAP_FORMAT,
-						  GL_UNSIGNED_BYTE,
-						  gl_lms.lightmap_buffer );
+		if ( r.x1 > r.x0 )
+			LM_UploadRect( gl_lms.lightmap_buffer, &r );
 	}
 	else
 	{
@@ -1067,6 +1340,14 @@ static void LM_UploadBlock( qboolean dynamic )
 					   GL_LIGHTMAP_FORMAT, 
 					   GL_UNSIGNED_BYTE, 
 					   gl_lms.lightmap_buffer );
+
+		/* keep a copy for lightstyle updates */
+		if ( !gl_lms.lightmap_pages[texture] )
+			gl_lms.lightmap_pages[texture] = malloc( sizeof( gl_lms.lightmap_buffer ) );
+		if ( gl_lms.lightmap_pages[texture] )
+			memcpy( gl_lms.lightmap_pages[texture], gl_lms.lightmap_buffer, sizeof( gl_lms.lightmap_buffer ) );
+		memset( &gl_lms.dirty[texture], 0, sizeof( gl_lms.dirty[texture] ) );
+
 		if ( ++gl_lms.current_lightmap_texture == MAX_LIGHTMAPS )
 			ri.Sys_Error( ERR_DROP, "LM_UploadBlock() - MAX_LIGHTMAPS exceeded\n" );
 	}
@@ -1135,6 +1416,7 @@ void GL_BuildPolygonFromSurface(msurface_t *fa)
    poly->flags = fa->flags;
    fa->polys = poly;
    poly->numverts = lnumverts;
+   poly->firstvert = -1;
 
    for (i=0 ; i<lnumverts ; i++)
    {
@@ -1323,3 +1605,24 @@ void GL_EndBuildingLightmaps (void)
 	LM_UploadBlock( false );
 }
 
+/*
+=======================
+GL_FreeLightmapPages
+
+A surface whose page is gone still gets its lightstyle updates, each
+one sent up right away with its own glTexSubImage2D.  The next map
+allocates the pages again
+=======================
+*/
+void GL_FreeLightmapPages (void)
+{
+	int		i;
+
+	for ( i = 0; i < MAX_LIGHTMAPS; i++ )
+	{
+		free( gl_lms.lightmap_pages[i] );
+		gl_lms.lightmap_pages[i] = NULL;
+	}
+	memset( gl_lms.dirty, 0, sizeof( gl_lms.dirty ) );
+}
+
@@ -135,6 +135,7 @@ static void SubdividePolygon (int numverts, float *verts)
 	poly->next = warpface->polys;
 	warpface->polys = poly;
 	poly->numverts = numverts+2;
+	poly->firstvert = -1;
 	VectorClear (total);
 	total_s = 0;
 	total_t = 0;
@@ -104,6 +104,7 @@ extern  void ( APIENTRY * qglScalef )(GLfloat x, GLfloat y, GLfloat z);
 extern  void ( APIENTRY * qglDepthFunc )(GLenum func);
 extern  void ( APIENTRY * qglTexEnvi )(GLenum target, GLenum pname, GLint param);
 extern  void ( APIENTRY * qglAlphaFunc )(GLenum func,  GLclampf ref);
+extern  void ( APIENTRY * qglPixelStorei )(GLenum pname, GLint param);
 
 extern float *gVertexBuffer;
 extern float *gColorBuffer;
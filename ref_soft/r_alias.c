@@ -24,6 +24,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 #include "r_local.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ALIAS_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
 #define LIGHT_MIN	5		/* lowest light value we'll allow, to avoid the
 							    *  need for inner-loop light clamping */
 
@@ -418,42 +423,38 @@ void R_AliasSetUpTransform (void)
 
 
 /*
-================
-R_AliasTransformFinalVerts
-================
-*/
-void R_AliasTransformFinalVerts( int numpoints, finalvert_t *fv, dtrivertx_t *oldv, dtrivertx_t *newv )
-{
-	int i;
+=============================================================================
 
-	for ( i = 0; i < numpoints; i++, fv++, oldv++, newv++ )
-	{
-		int		temp;
-		float	lightcos, *plightnormal;
-		vec3_t  lerped_vert;
+VERTEX PASSES
 
-		lerped_vert[0] = r_lerp_move[0] + oldv->v[0]*r_lerp_backv[0] + newv->v[0]*r_lerp_frontv[0];
-		lerped_vert[1] = r_lerp_move[1] + oldv->v[1]*r_lerp_backv[1] + newv->v[1]*r_lerp_frontv[1];
-		lerped_vert[2] = r_lerp_move[2] + oldv->v[2]*r_lerp_backv[2] + newv->v[2]*r_lerp_frontv[2];
+The frame verts go through a series of passes over structure of arrays
+scratch buffers: lerp, transform, project and clip test.  Each pass does
+the same float operations in the same order as the per vertex code it
+replaced, so the finalverts come out bit for bit the same.
 
-		plightnormal = r_avertexnormals[newv->lightnormalindex];
+=============================================================================
+*/
 
-		// PMM - added double damage shell
-		if ( refsoft_currententity->flags & ( RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM) )
-		{
-			lerped_vert[0] += plightnormal[0] * POWERSUIT_SCALE;
-			lerped_vert[1] += plightnormal[1] * POWERSUIT_SCALE;
-			lerped_vert[2] += plightnormal[2] * POWERSUIT_SCALE;
-		}
+static float	s_lerped[3][MAXALIASVERTS + 3];	/* model space */
+static float	s_eye[3][MAXALIASVERTS + 3];		/* eye space */
+static int		s_shade[162];					/* light by normal index */
 
-		fv->xyz[0] = DotProduct(lerped_vert, aliastransform[0]) + aliastransform[0][3];
-		fv->xyz[1] = DotProduct(lerped_vert, aliastransform[1]) + aliastransform[1][3];
-		fv->xyz[2] = DotProduct(lerped_vert, aliastransform[2]) + aliastransform[2][3];
+/*
+================
+R_AliasShadeNormals
 
-		fv->flags = 0;
+The light only depends on the vertex normal, so it is worked out once
+per normal instead of once per vertex
+================
+*/
+static void R_AliasShadeNormals (void)
+{
+	int		i, temp;
+	float	lightcos;
 
-		// lighting
-		lightcos = DotProduct (plightnormal, r_plightvec);
+	for (i=0 ; i<162 ; i++)
+	{
+		lightcos = DotProduct (r_avertexnormals[i], r_plightvec);
 		temp = r_ambientlight;
 
 		if (lightcos < 0)
@@ -466,17 +467,207 @@ void R_AliasTransformFinalVerts( int numpoints, finalvert_t *fv, dtrivertx_t *ol
 				temp = 0;
 		}
 
-		fv->l = temp;
+		s_shade[i] = temp;
+	}
+}
+
+/*
+================
+R_AliasLerpVerts
+================
+*/
+static void R_AliasLerpVerts (int numpoints, dtrivertx_t *oldv, dtrivertx_t *newv)
+{
+	int		i = 0;
+	float	*x = s_lerped[0], *y = s_lerped[1], *z = s_lerped[2];
+#ifdef ALIAS_SIMD_SSE2
+	__m128	move0 = _mm_set1_ps (r_lerp_move[0]);
+	__m128	move1 = _mm_set1_ps (r_lerp_move[1]);
+	__m128	move2 = _mm_set1_ps (r_lerp_move[2]);
+	__m128	back0 = _mm_set1_ps (r_lerp_backv[0]);
+	__m128	back1 = _mm_set1_ps (r_lerp_backv[1]);
+	__m128	back2 = _mm_set1_ps (r_lerp_backv[2]);
+	__m128	front0 = _mm_set1_ps (r_lerp_frontv[0]);
+	__m128	front1 = _mm_set1_ps (r_lerp_frontv[1]);
+	__m128	front2 = _mm_set1_ps (r_lerp_frontv[2]);
+	__m128i	mask = _mm_set1_epi32 (0xff);
+	__m128i	o, n;
+
+	/* a dtrivertx_t is four bytes, so each lane holds one vertex */
+	for ( ; i+4 <= numpoints ; i+=4)
+	{
+		o = _mm_loadu_si128 ((__m128i *)(oldv + i));
+		n = _mm_loadu_si128 ((__m128i *)(newv + i));
+
+		_mm_storeu_ps (x+i, _mm_add_ps (_mm_add_ps (move0,
+				_mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (o, mask)), back0)),
+				_mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (n, mask)), front0)));
+		_mm_storeu_ps (y+i, _mm_add_ps (_mm_add_ps (move1,
+				_mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (o, 8), mask)), back1)),
+				_mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (n, 8), mask)), front1)));
+		_mm_storeu_ps (z+i, _mm_add_ps (_mm_add_ps (move2,
+				_mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (o, 16), mask)), back2)),
+				_mm_mul_ps (_mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (n, 16), mask)), front2)));
+	}
+#endif
 
-		if ( fv->xyz[2] < ALIAS_Z_CLIP_PLANE )
+	for ( ; i<numpoints ; i++)
+	{
+		x[i] = r_lerp_move[0] + oldv[i].v[0]*r_lerp_backv[0] + newv[i].v[0]*r_lerp_frontv[0];
+		y[i] = r_lerp_move[1] + oldv[i].v[1]*r_lerp_backv[1] + newv[i].v[1]*r_lerp_frontv[1];
+		z[i] = r_lerp_move[2] + oldv[i].v[2]*r_lerp_backv[2] + newv[i].v[2]*r_lerp_frontv[2];
+	}
+
+	// PMM - added double damage shell
+	if ( refsoft_currententity->flags & ( RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM) )
+	{
+		float	*plightnormal;
+
+		for (i=0 ; i<numpoints ; i++)
 		{
-			fv->flags |= ALIAS_Z_CLIP;
+			plightnormal = r_avertexnormals[newv[i].lightnormalindex];
+			x[i] += plightnormal[0] * POWERSUIT_SCALE;
+			y[i] += plightnormal[1] * POWERSUIT_SCALE;
+			z[i] += plightnormal[2] * POWERSUIT_SCALE;
 		}
-		else
+	}
+}
+
+/*
+================
+R_AliasTransformVerts
+
+Model space to eye space
+================
+*/
+static void R_AliasTransformVerts (int numpoints)
+{
+	int		i = 0, j;
+	float	*x = s_lerped[0], *y = s_lerped[1], *z = s_lerped[2];
+
+#ifdef ALIAS_SIMD_SSE2
+	for (j=0 ; j<3 ; j++)
+	{
+		__m128	m0 = _mm_set1_ps (aliastransform[j][0]);
+		__m128	m1 = _mm_set1_ps (aliastransform[j][1]);
+		__m128	m2 = _mm_set1_ps (aliastransform[j][2]);
+		__m128	m3 = _mm_set1_ps (aliastransform[j][3]);
+		float	*out = s_eye[j];
+
+		for (i=0 ; i+4 <= numpoints ; i+=4)
 		{
-			R_AliasProjectAndClipTestFinalVert( fv );
+			_mm_storeu_ps (out+i, _mm_add_ps (_mm_add_ps (_mm_add_ps (
+					_mm_mul_ps (_mm_loadu_ps (x+i), m0),
+					_mm_mul_ps (_mm_loadu_ps (y+i), m1)),
+					_mm_mul_ps (_mm_loadu_ps (z+i), m2)), m3));
 		}
 	}
+#endif
+
+	for ( ; i<numpoints ; i++)
+	{
+		for (j=0 ; j<3 ; j++)
+			s_eye[j][i] = x[i]*aliastransform[j][0] + y[i]*aliastransform[j][1]
+					+ z[i]*aliastransform[j][2] + aliastransform[j][3];
+	}
+}
+
+/*
+================
+R_AliasProjectVerts
+
+Projects and clip tests the eye space verts into the finalverts.  Verts
+behind the z clip plane only get their flag.
+================
+*/
+static void R_AliasProjectVerts (int numpoints, finalvert_t *fv, dtrivertx_t *newv)
+{
+	int		i = 0, j, n;
+	float	*x = s_eye[0], *y = s_eye[1], *z = s_eye[2];
+#ifdef ALIAS_SIMD_SSE2
+	__m128	one = _mm_set1_ps (1.0F);
+	__m128	zclip = _mm_set1_ps (ALIAS_Z_CLIP_PLANE);
+	__m128	ziscale = _mm_set1_ps (s_ziscale);
+	__m128	xscale = _mm_set1_ps (aliasxscale);
+	__m128	yscale = _mm_set1_ps (aliasyscale);
+	__m128	xcenter = _mm_set1_ps (aliasxcenter);
+	__m128	ycenter = _mm_set1_ps (aliasycenter);
+	__m128i	left = _mm_set1_epi32 (r_refdef.aliasvrect.x);
+	__m128i	top = _mm_set1_epi32 (r_refdef.aliasvrect.y);
+	__m128i	right = _mm_set1_epi32 (r_refdef.aliasvrectright);
+	__m128i	bottom = _mm_set1_epi32 (r_refdef.aliasvrectbottom);
+	__m128	vx, vy, vz, zi;
+	__m128i	u, v, izi, flags, behind;
+	int		lu[4], lv[4], lzi[4], lflags[4];
+
+	for ( ; i+4 <= numpoints ; i+=4)
+	{
+		vx = _mm_loadu_ps (x+i);
+		vy = _mm_loadu_ps (y+i);
+		vz = _mm_loadu_ps (z+i);
+
+		zi = _mm_div_ps (one, vz);
+		izi = _mm_cvttps_epi32 (_mm_mul_ps (zi, ziscale));
+		u = _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (_mm_mul_ps (vx, xscale), zi), xcenter));
+		v = _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (_mm_mul_ps (vy, yscale), zi), ycenter));
+
+		flags = _mm_and_si128 (_mm_cmplt_epi32 (u, left), _mm_set1_epi32 (ALIAS_LEFT_CLIP));
+		flags = _mm_or_si128 (flags, _mm_and_si128 (_mm_cmplt_epi32 (v, top), _mm_set1_epi32 (ALIAS_TOP_CLIP)));
+		flags = _mm_or_si128 (flags, _mm_and_si128 (_mm_cmpgt_epi32 (u, right), _mm_set1_epi32 (ALIAS_RIGHT_CLIP)));
+		flags = _mm_or_si128 (flags, _mm_and_si128 (_mm_cmpgt_epi32 (v, bottom), _mm_set1_epi32 (ALIAS_BOTTOM_CLIP)));
+
+		behind = _mm_castps_si128 (_mm_cmplt_ps (vz, zclip));
+		flags = _mm_or_si128 (_mm_and_si128 (behind, _mm_set1_epi32 (ALIAS_Z_CLIP)),
+				_mm_andnot_si128 (behind, flags));
+
+		_mm_storeu_si128 ((__m128i *)lu, u);
+		_mm_storeu_si128 ((__m128i *)lv, v);
+		_mm_storeu_si128 ((__m128i *)lzi, izi);
+		_mm_storeu_si128 ((__m128i *)lflags, flags);
+
+		for (j=0 ; j<4 ; j++)
+		{
+			n = i+j;
+			fv[n].xyz[0] = x[n];
+			fv[n].xyz[1] = y[n];
+			fv[n].xyz[2] = z[n];
+			fv[n].l = s_shade[newv[n].lightnormalindex];
+			fv[n].flags = lflags[j];
+			if (lflags[j] & ALIAS_Z_CLIP)
+				continue;
+			fv[n].u = lu[j];
+			fv[n].v = lv[j];
+			fv[n].zi = lzi[j];
+		}
+	}
+#endif
+
+	for ( ; i<numpoints ; i++)
+	{
+		fv[i].xyz[0] = x[i];
+		fv[i].xyz[1] = y[i];
+		fv[i].xyz[2] = z[i];
+		fv[i].l = s_shade[newv[i].lightnormalindex];
+		fv[i].flags = 0;
+
+		if ( fv[i].xyz[2] < ALIAS_Z_CLIP_PLANE )
+			fv[i].flags |= ALIAS_Z_CLIP;
+		else
+			R_AliasProjectAndClipTestFinalVert( &fv[i] );
+	}
+}
+
+/*
+================
+R_AliasTransformFinalVerts
+================
+*/
+void R_AliasTransformFinalVerts( int numpoints, finalvert_t *fv, dtrivertx_t *oldv, dtrivertx_t *newv )
+{
+	R_AliasShadeNormals ();
+	R_AliasLerpVerts (numpoints, oldv, newv);
+	R_AliasTransformVerts (numpoints);
+	R_AliasProjectVerts (numpoints, fv, newv);
 }
 
 /*
@@ -601,6 +601,22 @@ Each surface has a linked list of its visible spans
 ==============
 */
 byte	basespans[MAXSPANS*sizeof(espan_t)+CACHE_SIZE];
+
+static void R_DrawSurfacesTimed (void)
+{
+	unsigned	start;
+
+	if (!r_phasetiming)
+	{
+		D_DrawSurfaces ();
+		return;
+	}
+
+	start = R_PhaseClock ();
+	D_DrawSurfaces ();
+	r_phasetime[PHASE_SURFACES] += R_PhaseClock () - start;
+}
+
 void R_ScanEdges (void)
 {
 	int		iv, bottom;
@@ -664,7 +680,7 @@ void R_ScanEdges (void)
 	// the next scan
 		if (span_p > max_span_p)
 		{
-			D_DrawSurfaces ();
+			R_DrawSurfacesTimed ();
 
 		// clear the surface span pointers
 			for (s = &surfaces[1] ; s<surface_p ; s++)
@@ -694,7 +710,7 @@ void R_ScanEdges (void)
 	(*pdrawfunc) ();
 
 // draw whatever's left in the span list
-	D_DrawSurfaces ();
+	R_DrawSurfacesTimed ();
 }
 
 
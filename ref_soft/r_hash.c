@@ -0,0 +1,340 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+/* r_hash.c: frame hashes for checking renderer changes against a baseline
+ *
+ * "framehash record <name>" hashes every 3D view the renderer draws,
+ * at full, half and quarter size, along with the time spent in each
+ * rendering phase.  "framehash check <name>" draws the same frames and
+ * compares them with the recording.  Run it together with
+ * "timedemo 1" and a demo so that every run sees the same refdefs. */
+
+#include "r_local.h"
+
+#include <features/features_cpu.h>
+#include <libretro_file.h>
+
+#define FRAMEHASH_SIZES		3	/* full, half and quarter size */
+
+typedef struct
+{
+	int			width, height;
+	unsigned	hash;
+	unsigned	time[NUM_PHASES];
+} framehashline_t;
+
+typedef enum
+{
+	FH_OFF,
+	FH_RECORD,
+	FH_CHECK
+} framehashmode_t;
+
+qboolean	r_phasetiming;
+unsigned	r_phasetime[NUM_PHASES];
+
+static const char *phase_names[NUM_PHASES] =
+{
+	"edges", "surfaces", "alias", "particles", "alpha"
+};
+
+static struct
+{
+	framehashmode_t	mode;
+	char			name[MAX_QPATH];
+	RFILE			*file;
+
+	int				frames;		/* views hashed this run */
+	int				mismatches;
+	int				firstbad;	/* -1 while everything matches */
+	int				missing;	/* views past the end of the baseline */
+
+	unsigned		total[NUM_PHASES];
+	unsigned		basetotal[NUM_PHASES];
+} fh;
+
+/*
+================
+R_PhaseClock
+================
+*/
+unsigned R_PhaseClock (void)
+{
+	return (unsigned)cpu_features_get_time_usec ();
+}
+
+/*
+================
+R_HashView
+
+FNV-1a over the 3D view rectangle
+================
+*/
+static unsigned R_HashView (const refdef_t *fd)
+{
+	unsigned	hash = 2166136261u;
+	byte		*row;
+	int			x, y;
+
+	for (y=0 ; y<fd->height ; y++)
+	{
+		row = vid.buffer + (fd->y + y) * vid.rowbytes + fd->x;
+		for (x=0 ; x<fd->width ; x++)
+		{
+			hash ^= row[x];
+			hash *= 16777619u;
+		}
+	}
+
+	return hash;
+}
+
+static void R_FrameHashPath (char *path, int size, const char *name)
+{
+	Com_sprintf (path, size, "%s/framehash/%s.txt", ri.FS_Gamedir(), name);
+}
+
+/*
+================
+R_FrameHashReadLine
+
+Returns false at the end of the baseline
+================
+*/
+static qboolean R_FrameHashReadLine (framehashline_t *line)
+{
+	char	buf[256];
+	int		frame;
+
+	if (!rfgets (buf, sizeof(buf), fh.file))
+		return false;
+
+	return sscanf (buf, "%i %ix%i %x %u %u %u %u %u", &frame,
+			&line->width, &line->height, &line->hash,
+			&line->time[PHASE_EDGES], &line->time[PHASE_SURFACES],
+			&line->time[PHASE_ALIAS], &line->time[PHASE_PARTICLES],
+			&line->time[PHASE_ALPHA]) == 9;
+}
+
+/*
+================
+R_FrameHashView
+
+Draws one view and records or checks its hash
+================
+*/
+static void R_FrameHashView (refdef_t *fd)
+{
+	framehashline_t	line, base;
+	int				i;
+
+	memset (r_phasetime, 0, sizeof(r_phasetime));
+	r_phasetiming = true;
+	SWR_RenderView (fd);
+	r_phasetiming = false;
+
+	/* surfaces are drawn from inside the edge scan */
+	r_phasetime[PHASE_EDGES] -= r_phasetime[PHASE_SURFACES];
+
+	line.width = fd->width;
+	line.height = fd->height;
+	line.hash = R_HashView (fd);
+	for (i=0 ; i<NUM_PHASES ; i++)
+	{
+		line.time[i] = r_phasetime[i];
+		fh.total[i] += r_phasetime[i];
+	}
+
+	if (fh.mode == FH_RECORD)
+	{
+		rfprintf (fh.file, "%i %ix%i %08x %u %u %u %u %u\n", fh.frames,
+				line.width, line.height, line.hash,
+				line.time[PHASE_EDGES], line.time[PHASE_SURFACES],
+				line.time[PHASE_ALIAS], line.time[PHASE_PARTICLES],
+				line.time[PHASE_ALPHA]);
+	}
+	else if (!R_FrameHashReadLine (&base))
+	{
+		fh.missing++;
+	}
+	else
+	{
+		for (i=0 ; i<NUM_PHASES ; i++)
+			fh.basetotal[i] += base.time[i];
+
+		if (base.width != line.width || base.height != line.height
+				|| base.hash != line.hash)
+		{
+			if (fh.firstbad < 0)
+				fh.firstbad = fh.frames;
+			fh.mismatches++;
+		}
+	}
+
+	fh.frames++;
+}
+
+/*
+================
+R_FrameHashFrame
+
+Stands in for SWR_RenderFrame while a run is active.  The smaller sizes
+go first so the full size view is what ends up on screen.
+================
+*/
+void R_FrameHashFrame (refdef_t *fd)
+{
+	refdef_t	rd;
+	int			i;
+
+	for (i=FRAMEHASH_SIZES-1 ; i>=0 ; i--)
+	{
+		rd = *fd;
+		rd.width >>= i;
+		rd.height >>= i;
+		if (rd.width < 32 || rd.height < 24)
+			continue;
+		R_FrameHashView (&rd);
+	}
+}
+
+qboolean R_FrameHashActive (void)
+{
+	return fh.mode != FH_OFF;
+}
+
+/*
+================
+R_FrameHashStop
+================
+*/
+static void R_FrameHashStop (void)
+{
+	int		i;
+
+	if (fh.mode == FH_OFF)
+		return;
+
+	if (fh.file)
+		rfclose (fh.file);
+	fh.file = NULL;
+
+	if (fh.mode == FH_RECORD)
+	{
+		ri.Con_Printf (PRINT_ALL, "framehash: recorded %i views to %s\n",
+				fh.frames, fh.name);
+	}
+	else if (fh.mismatches || fh.missing)
+	{
+		ri.Con_Printf (PRINT_ALL, "framehash: %s FAILED, %i of %i views differ, first at %i, %i past the baseline\n",
+				fh.name, fh.mismatches, fh.frames, fh.firstbad, fh.missing);
+	}
+	else
+	{
+		ri.Con_Printf (PRINT_ALL, "framehash: %s passed, %i views match\n",
+				fh.name, fh.frames);
+	}
+
+	for (i=0 ; i<NUM_PHASES ; i++)
+	{
+		if (fh.mode == FH_CHECK)
+			ri.Con_Printf (PRINT_ALL, "%10s: %8.2f ms, baseline %8.2f ms\n",
+					phase_names[i], fh.total[i] * 0.001, fh.basetotal[i] * 0.001);
+		else
+			ri.Con_Printf (PRINT_ALL, "%10s: %8.2f ms\n",
+					phase_names[i], fh.total[i] * 0.001);
+	}
+
+	fh.mode = FH_OFF;
+}
+
+/*
+================
+R_FrameHash_f
+
+framehash record <name>
+framehash check <name>
+framehash stop
+================
+*/
+void R_FrameHash_f (void)
+{
+	char	path[MAX_OSPATH];
+	char	*cmd;
+
+	if (ri.Cmd_Argc () < 2)
+	{
+		ri.Con_Printf (PRINT_ALL, "usage: framehash <record|check> <name>, framehash stop\n");
+		return;
+	}
+
+	cmd = ri.Cmd_Argv (1);
+	if (!strcmp (cmd, "stop"))
+	{
+		R_FrameHashStop ();
+		return;
+	}
+
+	if (ri.Cmd_Argc () != 3 || (strcmp (cmd, "record") && strcmp (cmd, "check")))
+	{
+		ri.Con_Printf (PRINT_ALL, "usage: framehash <record|check> <name>, framehash stop\n");
+		return;
+	}
+
+	R_FrameHashStop ();
+
+	memset (&fh, 0, sizeof(fh));
+	fh.firstbad = -1;
+	Q_strlcpy (fh.name, ri.Cmd_Argv (2), sizeof(fh.name));
+	R_FrameHashPath (path, sizeof(path), fh.name);
+
+	if (!strcmp (cmd, "record"))
+	{
+		Com_sprintf (path, sizeof(path), "%s/framehash", ri.FS_Gamedir());
+		Sys_Mkdir (path);
+		R_FrameHashPath (path, sizeof(path), fh.name);
+		fh.file = rfopen (path, "w");
+		fh.mode = FH_RECORD;
+	}
+	else
+	{
+		fh.file = rfopen (path, "r");
+		fh.mode = FH_CHECK;
+	}
+
+	if (!fh.file)
+	{
+		ri.Con_Printf (PRINT_ALL, "framehash: couldn't open %s\n", path);
+		fh.mode = FH_OFF;
+		return;
+	}
+
+	ri.Con_Printf (PRINT_ALL, "framehash: %s %s\n",
+			fh.mode == FH_RECORD ? "recording" : "checking", path);
+}
+
+/*
+================
+R_FrameHashShutdown
+================
+*/
+void R_FrameHashShutdown (void)
+{
+	R_FrameHashStop ();
+}
@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 /* r_light.c */
 
 #include "r_local.h"
+#include "../ref_common/r_light_common.h"
 
 int	r_refsoft_dlightframecount;
 
@@ -275,6 +276,7 @@ void SWR_LightPoint (vec3_t p, vec3_t color)
 
 
 unsigned		blocklights[1024];	/* allow some very large lightmaps */
+static float	falloff[1024];
 
 /*
 ===============
@@ -285,12 +287,10 @@ static void SWR_AddDynamicLights (void)
 {
 	msurface_t *surf;
 	int			lnum;
-	int			sd, td;
 	float		dist, rad, minlight;
 	vec3_t		impact, local;
-	int			s, t;
 	int			i;
-	int			smax, tmax;
+	int			smax, tmax, size;
 	mtexinfo_t	*tex;
 	dlight_t	*dl;
 	int			negativeLight;	/*PGM */
@@ -298,6 +298,7 @@ static void SWR_AddDynamicLights (void)
 	surf = r_drawsurf.surf;
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
+	size = smax*tmax;
 	tex = surf->texinfo;
 
 	for (lnum=0 ; lnum<r_refsoft_newrefdef.num_dlights ; lnum++)
@@ -341,40 +342,32 @@ static void SWR_AddDynamicLights (void)
 		local[0] -= surf->texturemins[0];
 		local[1] -= surf->texturemins[1];
 		
-		for (t = 0 ; t<tmax ; t++)
+		RL_DlightFalloff (falloff, smax, tmax, local[0], local[1], rad, minlight);
+
+      /*====
+       *PGM
+       */
+		if(!negativeLight)
 		{
-			td = local[1] - t*16;
-			if (td < 0)
-				td = -td;
-			for (s=0 ; s<smax ; s++)
+			for (i=0 ; i<size ; i++)
 			{
-				sd = local[0] - s*16;
-				if (sd < 0)
-					sd = -sd;
-				if (sd > td)
-					dist = sd + (td>>1);
-				else
-					dist = td + (sd>>1);
-            /*====
-             *PGM
-             */
-				if(!negativeLight)
-				{
-					if (dist < minlight)
-						blocklights[t*smax + s] += (rad - dist)*256;
-				}
-				else
-				{
-					if (dist < minlight)
-						blocklights[t*smax + s] -= (rad - dist)*256;
-					if(blocklights[t*smax + s] < minlight)
-						blocklights[t*smax + s] = minlight;
-				}
-            /*PGM
-             *====
-             */
+				if (falloff[i] != 0)
+					blocklights[i] += falloff[i]*256;
 			}
 		}
+		else
+		{
+			for (i=0 ; i<size ; i++)
+			{
+				if (falloff[i] != 0)
+					blocklights[i] -= falloff[i]*256;
+				if(blocklights[i] < minlight)
+					blocklights[i] = minlight;
+			}
+		}
+      /*PGM
+       *====
+       */
 	}
 }
 
@@ -388,7 +381,6 @@ Combine and scale multiple lightmaps into the 8.8 format in blocklights
 void SWR_BuildLightMap (void)
 {
 	int			smax, tmax;
-	int			t;
 	int			i, size;
 	byte		*lightmap;
 	unsigned	scale;
@@ -420,8 +412,7 @@ void SWR_BuildLightMap (void)
 			 maps++)
 		{
 			scale = r_drawsurf.lightadj[maps];	/* 8.8 fraction */
-			for (i=0 ; i<size ; i++)
-				blocklights[i] += lightmap[i] * scale;
+			RL_ScaleLightmap88 (blocklights, lightmap, size, scale);
 			lightmap += size;	/* skip to next lightmap */
 		}
 
@@ -430,17 +421,6 @@ void SWR_BuildLightMap (void)
 		SWR_AddDynamicLights ();
 
    /* bound, invert, and shift */
-	for (i=0 ; i<size ; i++)
-	{
-		t = (int)blocklights[i];
-		if (t < 0)
-			t = 0;
-		t = (255*256 - t) >> (8 - VID_CBITS);
-
-		if (t < (1 << 6))
-			t = (1 << 6);
-
-		blocklights[i] = t;
-	}
+	RL_ShadeLightmap88 (blocklights, size, 8 - VID_CBITS);
 }
 
@@ -485,6 +485,9 @@ extern  fixed16_t       bbextents, bbextentt;
 
 void D_DrawSpans16 (espan_t *pspans);
 void D_DrawSpans16_Dither (espan_t *pspans);
+void D_DrawSpans32 (espan_t *pspans);
+void D_DrawSpansTiled (espan_t *pspans);
+extern void (*d_spankernel)(espan_t *pspan);
 void D_DrawZSpans (espan_t *pspans);
 void Turbulent8 (espan_t *pspan);
 void NonTurbulent8 (espan_t *pspan);	//PGM
@@ -563,6 +566,8 @@ extern cvar_t   *sw_waterwarp;
 
 /* Control kernel texture sampling */
 extern cvar_t   *sw_texfilt;
+extern cvar_t   *sw_spansubdiv;
+extern cvar_t   *sw_spantiles;
 
 extern cvar_t   *r_fullbright;
 extern cvar_t	*r_refsoft_lefthand;
@@ -712,6 +717,28 @@ extern float    r_time1;
 extern float	da_time1, da_time2;
 extern float	dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
 extern float	se_time1, se_time2, de_time1, de_time2, dv_time1, dv_time2;
+
+/* r_hash.c: per phase timings in microseconds, kept while a
+ * framehash run is active */
+typedef enum
+{
+	PHASE_EDGES,
+	PHASE_SURFACES,
+	PHASE_ALIAS,
+	PHASE_PARTICLES,
+	PHASE_ALPHA,
+	NUM_PHASES
+} rphase_t;
+
+extern qboolean	r_phasetiming;
+extern unsigned	r_phasetime[NUM_PHASES];
+
+unsigned R_PhaseClock (void);
+qboolean R_FrameHashActive (void);
+void R_FrameHashFrame (refdef_t *fd);
+void R_FrameHash_f (void);
+void R_FrameHashShutdown (void);
+void SWR_RenderView (refdef_t *fd);
 extern int              r_frustum_indexes[4*6];
 extern int              r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
 extern qboolean r_surfsonstack;
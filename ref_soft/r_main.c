@@ -20,6 +20,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // r_main.c
 
 #include "r_local.h"
+#include "../ref_common/r_light_common.h"
+
+#include <features/features_cpu.h>
 
 viddef_t	vid;
 
@@ -145,6 +148,13 @@ cvar_t	*sw_lockpvs;
 //PGM
 
 cvar_t	*sw_texfilt;
+cvar_t	*sw_spansubdiv;
+cvar_t	*sw_spantiles;
+
+static cvar_t	*sw_dynres;
+static cvar_t	*sw_dynres_target;
+static cvar_t	*sw_dynres_min;
+static cvar_t	*sw_dynres_log;
 
 #define	STRINGER(x) "x"
 
@@ -316,6 +326,8 @@ void SWR_Register (void)
 	ri.Cmd_AddCommand ("modellist", SWR_Mod_Modellist_f);
 	ri.Cmd_AddCommand( "screenshot", R_ScreenShot_f );
 	ri.Cmd_AddCommand( "imagelist", R_ImageList_f );
+	ri.Cmd_AddCommand( "lightmap_test", RL_LightmapTest_f );
+	ri.Cmd_AddCommand( "framehash", R_FrameHash_f );
 
 	sw_mode->modified = true; // force us to do mode specific stuff later
 	vid_gamma->modified = true; // force us to rebuild the gamma table later
@@ -325,6 +337,13 @@ void SWR_Register (void)
 //PGM
 
    sw_texfilt = ri.Cvar_Get ("sw_texfilt", "0", 0);
+	sw_spansubdiv = ri.Cvar_Get ("sw_spansubdiv", "16", CVAR_ARCHIVE);
+	sw_spantiles = ri.Cvar_Get ("sw_spantiles", "0", CVAR_ARCHIVE);
+
+	sw_dynres = ri.Cvar_Get ("sw_dynres", "0", CVAR_ARCHIVE);
+	sw_dynres_target = ri.Cvar_Get ("sw_dynres_target", "16", CVAR_ARCHIVE);
+	sw_dynres_min = ri.Cvar_Get ("sw_dynres_min", "0.5", CVAR_ARCHIVE);
+	sw_dynres_log = ri.Cvar_Get ("sw_dynres_log", "0", 0);
 }
 
 static void SWR_UnRegister (void)
@@ -332,6 +351,8 @@ static void SWR_UnRegister (void)
 	ri.Cmd_RemoveCommand( "screenshot" );
 	ri.Cmd_RemoveCommand ("modellist");
 	ri.Cmd_RemoveCommand( "imagelist" );
+	ri.Cmd_RemoveCommand( "lightmap_test" );
+	ri.Cmd_RemoveCommand( "framehash" );
 }
 
 /*
@@ -400,6 +421,7 @@ static void SWR_Shutdown (void)
 		vid.colormap = NULL;
 	}
    R_UninitTurb ();
+	R_FrameHashShutdown ();
 	SWR_UnRegister ();
 	SWR_Mod_FreeAll ();
 	R_ShutdownImages ();
@@ -1019,13 +1041,187 @@ static void SWR_SetLightLevel (void)
 
 
 /*
-@@@@@@@@@@@@@@@@
-SWR_RenderFrame
+=============================================================================
 
-@@@@@@@@@@@@@@@@
+DYNAMIC RESOLUTION
+
+The 3D view is rendered into the top left corner of its own rectangle at
+a fraction of its size and stretched back over the whole rectangle before
+any 2D drawing happens, so the hud and console stay at native resolution.
+The fraction follows the time the renderer spent on the previous frames.
+
+=============================================================================
 */
-static void SWR_RenderFrame (refdef_t *fd)
+
+#define DYNRES_STEP		0.05f	/* most the scale moves in one frame */
+#define DYNRES_SLACK	0.85f	/* grow only when this far under budget */
+
+static float		dynres_scale = 1.0f;
+static float		dynres_frametime;	/* smoothed, in ms */
+static retro_time_t	dynres_framestart;
+static int			dynres_width, dynres_height;	/* full view size */
+static int			dynres_colmap[MAXWIDTH];
+
+/*
+================
+R_DynResUpdate
+
+Picks the scale for the coming frame from the smoothed frame time.
+Cost is proportional to the pixel count, so the ratio is applied as a
+square root.
+================
+*/
+static void R_DynResUpdate (float frametime)
 {
+	float	target, lowest, want;
+
+	if (!dynres_frametime)
+		dynres_frametime = frametime;
+	else
+		dynres_frametime += (frametime - dynres_frametime) * 0.2f;
+
+	target = sw_dynres_target->value;
+	if (target <= 0)
+		return;
+
+	lowest = sw_dynres_min->value;
+	if (lowest < 0.25f)
+		lowest = 0.25f;
+	else if (lowest > 1.0f)
+		lowest = 1.0f;
+
+	want = dynres_scale;
+	if (dynres_frametime > target)
+		want = dynres_scale * sqrt (target / dynres_frametime);
+	else if (dynres_frametime < target * DYNRES_SLACK)
+		want = dynres_scale * sqrt (target * DYNRES_SLACK / dynres_frametime);
+
+	if (want > dynres_scale + DYNRES_STEP)
+		want = dynres_scale + DYNRES_STEP;
+	else if (want < dynres_scale - DYNRES_STEP)
+		want = dynres_scale - DYNRES_STEP;
+
+	if (want < lowest)
+		want = lowest;
+	else if (want > 1.0f)
+		want = 1.0f;
+
+	dynres_scale = want;
+}
+
+/*
+================
+R_DynResBeginView
+
+Shrinks the refdef rectangle before the view is set up
+================
+*/
+static void R_DynResBeginView (void)
+{
+	dynres_width = 0;
+
+	if (!sw_dynres->value || dynres_scale >= 1.0f)
+		return;
+	if (R_FrameHashActive ())
+		return;		/* hashes need the exact refdef */
+	if (r_refsoft_newrefdef.rdflags & RDF_NOWORLDMODEL)
+		return;		/* menu models are cheap and small */
+
+	dynres_width = r_refsoft_newrefdef.width;
+	dynres_height = r_refsoft_newrefdef.height;
+
+	r_refsoft_newrefdef.width = (int)(dynres_width * dynres_scale);
+	r_refsoft_newrefdef.height = (int)(dynres_height * dynres_scale);
+	if (r_refsoft_newrefdef.width < 32)
+		r_refsoft_newrefdef.width = 32;
+	if (r_refsoft_newrefdef.height < 24)
+		r_refsoft_newrefdef.height = 24;
+
+	if (r_refsoft_newrefdef.width >= dynres_width
+			|| r_refsoft_newrefdef.height >= dynres_height)
+	{
+		r_refsoft_newrefdef.width = dynres_width;
+		r_refsoft_newrefdef.height = dynres_height;
+		dynres_width = 0;
+	}
+}
+
+/*
+================
+R_DynResEndView
+
+Stretches the scaled view over the full rectangle.  Every source pixel
+lies at or before its destination, so walking backwards lets this run in
+place.
+================
+*/
+static void R_DynResEndView (void)
+{
+	int		x, y, sy, w, h;
+	byte	*base, *src, *dest;
+
+	if (!dynres_width)
+		return;
+
+	w = r_refsoft_newrefdef.width;
+	h = r_refsoft_newrefdef.height;
+	base = vid.buffer + r_refsoft_newrefdef.y * vid.rowbytes + r_refsoft_newrefdef.x;
+
+	for (x=0 ; x<dynres_width ; x++)
+		dynres_colmap[x] = x * w / dynres_width;
+
+	for (y=dynres_height-1 ; y>=0 ; y--)
+	{
+		sy = y * h / dynres_height;
+		src = base + sy * vid.rowbytes;
+		dest = base + y * vid.rowbytes;
+
+		for (x=dynres_width-1 ; x>=0 ; x--)
+			dest[x] = src[dynres_colmap[x]];
+	}
+
+	r_refsoft_newrefdef.width = dynres_width;
+	r_refsoft_newrefdef.height = dynres_height;
+}
+
+/*
+================
+SWR_EndFrame
+================
+*/
+static void SWR_EndFrame (void)
+{
+	float	frametime;
+
+	SWimp_EndFrame ();
+
+	if (!sw_dynres->value)
+	{
+		dynres_scale = 1.0f;
+		dynres_frametime = 0;
+		return;
+	}
+
+	if (!dynres_framestart)
+		return;
+
+	frametime = (cpu_features_get_time_usec () - dynres_framestart) * 0.001f;
+	R_DynResUpdate (frametime);
+
+	if (sw_dynres_log->value)
+		ri.Con_Printf (PRINT_ALL, "dynres: %.1f ms (avg %.1f), scale %.2f\n",
+				frametime, dynres_frametime, dynres_scale);
+}
+
+/*
+================
+SWR_RenderView
+================
+*/
+void SWR_RenderView (refdef_t *fd)
+{
+	unsigned	phasestart = 0;
+
 	r_refsoft_newrefdef = *fd;
 
 	if (!r_refsoft_worldmodel && !( r_refsoft_newrefdef.rdflags & RDF_NOWORLDMODEL ) )
@@ -1034,6 +1230,8 @@ static void SWR_RenderFrame (refdef_t *fd)
 	VectorCopy (fd->vieworg, r_refdef.vieworg);
 	VectorCopy (fd->viewangles, r_refdef.viewangles);
 
+	R_DynResBeginView ();
+
 	if (r_speeds->value || r_dspeeds->value)
 		r_time1 = Sys_Milliseconds ();
 
@@ -1043,8 +1241,17 @@ static void SWR_RenderFrame (refdef_t *fd)
 
 	SWR_PushDlights (r_refsoft_worldmodel);
 
+	if (r_phasetiming)
+		phasestart = R_PhaseClock ();
+
 	R_EdgeDrawing ();
 
+	if (r_phasetiming)
+	{
+		r_phasetime[PHASE_EDGES] += R_PhaseClock () - phasestart;
+		phasestart = R_PhaseClock ();
+	}
+
 	if (r_dspeeds->value)
 	{
 		se_time2 = Sys_Milliseconds ();
@@ -1053,6 +1260,12 @@ static void SWR_RenderFrame (refdef_t *fd)
 
 	SWR_DrawEntitiesOnList ();
 
+	if (r_phasetiming)
+	{
+		r_phasetime[PHASE_ALIAS] += R_PhaseClock () - phasestart;
+		phasestart = R_PhaseClock ();
+	}
+
 	if (r_dspeeds->value)
 	{
 		de_time2 = Sys_Milliseconds ();
@@ -1061,16 +1274,27 @@ static void SWR_RenderFrame (refdef_t *fd)
 
 	SWR_DrawParticles ();
 
+	if (r_phasetiming)
+	{
+		r_phasetime[PHASE_PARTICLES] += R_PhaseClock () - phasestart;
+		phasestart = R_PhaseClock ();
+	}
+
 	if (r_dspeeds->value)
 		dp_time2 = Sys_Milliseconds ();
 
 	SWR_DrawAlphaSurfaces();
 
+	if (r_phasetiming)
+		r_phasetime[PHASE_ALPHA] += R_PhaseClock () - phasestart;
+
 	SWR_SetLightLevel ();
 
 	if (r_dowarp)
 		D_WarpScreen ();
 
+	R_DynResEndView ();
+
 	if (r_dspeeds->value)
 		da_time1 = Sys_Milliseconds ();
 
@@ -1095,6 +1319,20 @@ static void SWR_RenderFrame (refdef_t *fd)
 		ri.Con_Printf (PRINT_ALL,"Short roughly %d edges\n", r_outofedges * 2 / 3);
 }
 
+/*
+@@@@@@@@@@@@@@@@
+SWR_RenderFrame
+
+@@@@@@@@@@@@@@@@
+*/
+static void SWR_RenderFrame (refdef_t *fd)
+{
+	if (R_FrameHashActive ())
+		R_FrameHashFrame (fd);
+	else
+		SWR_RenderView (fd);
+}
+
 /*
 ** R_InitGraphics
 */
@@ -1132,6 +1370,8 @@ static void SWR_BeginFrame( float camera_separation )
 {
 	extern void Draw_BuildGammaTable( void );
 
+	dynres_framestart = cpu_features_get_time_usec ();
+
 	/*
 	** rebuild the gamma correction palette if necessary
 	*/
@@ -1419,7 +1659,7 @@ refexport_t SWR_GetRefAPI (refimport_t rimp)
 
    re.CinematicSetPalette = SWR_CinematicSetPalette;
    re.BeginFrame          = SWR_BeginFrame;
-   re.EndFrame            = SWimp_EndFrame;
+   re.EndFrame            = SWR_EndFrame;
 
    re.AppActivate         = SWimp_AppActivate;
 
@@ -446,9 +446,16 @@ void SWR_SetupFrame (void)
 	d_aflatcolor = 0;													
 	
 	if (sw_texfilt->value == 1)
-		D_DrawSpans = D_DrawSpans16_Dither;
+		d_spankernel = D_DrawSpans16_Dither;
+	else if (sw_spansubdiv->value >= 32)
+		d_spankernel = D_DrawSpans32;
 	else
-		D_DrawSpans = D_DrawSpans16;
+		d_spankernel = D_DrawSpans16;
+
+	if (sw_spantiles->value)
+		D_DrawSpans = D_DrawSpansTiled;
+	else
+		D_DrawSpans = d_spankernel;
 }
 
 /* 
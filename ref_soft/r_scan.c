@@ -23,6 +23,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "r_local.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
 unsigned char	*r_turb_pbase, *r_turb_pdest;
 fixed16_t		r_turb_s, r_turb_t, r_turb_sstep, r_turb_tstep;
 int				*r_turb_turb;
@@ -578,6 +583,239 @@ void D_DrawSpans16(espan_t *pspan) //qb: up it from 8 to 16.  This + unroll = bi
    } while ((pspan = pspan->pnext) != NULL);
 }
 
+/*
+=============
+D_DrawSpanRun
+
+Affine steps one run of texels out of the surface cache.  With SSE2 the
+cache offsets for four pixels come out of one multiply-add: each lane
+holds the integer t in its high half and the integer s in its low half.
+=============
+*/
+static void D_DrawSpanRun (byte *dest, byte *base, int n, fixed16_t ss, fixed16_t tt, fixed16_t ssstep, fixed16_t ttstep)
+{
+   int i = 0;
+#ifdef SCAN_SIMD_SSE2
+   if (cachewidth < 0x8000 && bbextents < 0x7fff0000 && bbextentt < 0x7fff0000)
+   {
+      __m128i vs = _mm_setr_epi32 (ss, ss + ssstep, ss + 2*ssstep, ss + 3*ssstep);
+      __m128i vt = _mm_setr_epi32 (tt, tt + ttstep, tt + 2*ttstep, tt + 3*ttstep);
+      __m128i vsstep = _mm_set1_epi32 (4*ssstep);
+      __m128i vtstep = _mm_set1_epi32 (4*ttstep);
+      __m128i himask = _mm_set1_epi32 (0xffff0000);
+      __m128i rowmul = _mm_set1_epi32 ((cachewidth << 16) | 1);
+      int     ofs[4];
+
+      for ( ; i+4 <= n ; i+=4)
+      {
+         _mm_storeu_si128 ((__m128i *)ofs, _mm_madd_epi16 (_mm_or_si128 (
+               _mm_and_si128 (vt, himask), _mm_srli_epi32 (vs, 16)), rowmul));
+         dest[i+0] = base[ofs[0]];
+         dest[i+1] = base[ofs[1]];
+         dest[i+2] = base[ofs[2]];
+         dest[i+3] = base[ofs[3]];
+         vs = _mm_add_epi32 (vs, vsstep);
+         vt = _mm_add_epi32 (vt, vtstep);
+      }
+      ss += i*ssstep;
+      tt += i*ttstep;
+   }
+#endif
+
+   for ( ; i<n ; i++)
+   {
+      dest[i] = base[(ss >> 16) + (tt >> 16) * cachewidth];
+      ss += ssstep;
+      tt += ttstep;
+   }
+}
+
+/*
+=============
+D_DrawSpans32
+
+Same as D_DrawSpans16 with a perspective divide every 32 pixels, half
+as many divides for slightly more affine error
+=============
+*/
+void D_DrawSpans32 (espan_t *pspan)
+{
+   int         n, spans;
+   byte        *base, *dest;
+   fixed16_t   ss, tt, snext2, tnext2, ssstep = 0, ttstep = 0;
+   float       sdz, tdz, zinv, zz, last;
+   float       sdzstep = d_sdivzstepu * 32;
+   float       tdzstep = d_tdivzstepu * 32;
+   float       zistep = d_zistepu * 32;
+
+   base = (byte *)cacheblock;
+
+   do
+   {
+      dest = (byte *)d_viewbuffer + (r_screenwidth * pspan->v) + pspan->u;
+      spans = pspan->count >> 5;
+      n = pspan->count & 31;
+
+      // calculate the initial s/z, t/z, 1/z, s, and t and clamp
+      sdz = d_sdivzorigin + (float)pspan->v*d_sdivzstepv + (float)pspan->u*d_sdivzstepu;
+      tdz = d_tdivzorigin + (float)pspan->v*d_tdivzstepv + (float)pspan->u*d_tdivzstepu;
+      zinv = d_ziorigin + (float)pspan->v*d_zistepv + (float)pspan->u*d_zistepu;
+      zz = (float)0x10000 / zinv;   // prescale to 16.16 fixed-point
+
+      ss = (int)(sdz * zz) + sadjust;
+      if (ss < 0) ss = 0;
+      else if (ss > bbextents) ss = bbextents;
+
+      tt = (int)(tdz * zz) + tadjust;
+      if (tt < 0) tt = 0;
+      else if (tt > bbextentt) tt = bbextentt;
+
+      while (spans-- > 0)
+      {
+         sdz += sdzstep;
+         tdz += tdzstep;
+         zinv += zistep;
+         zz = (float)0x10000 / zinv;
+
+         snext2 = (int)(sdz * zz) + sadjust;
+         if (snext2 < 32) snext2 = 32;
+         else if (snext2 > bbextents) snext2 = bbextents;
+
+         tnext2 = (int)(tdz * zz) + tadjust;
+         if (tnext2 < 32) tnext2 = 32;
+         else if (tnext2 > bbextentt) tnext2 = bbextentt;
+
+         ssstep = (snext2 - ss) >> 5;
+         ttstep = (tnext2 - tt) >> 5;
+
+         D_DrawSpanRun (dest, base, 32, ss, tt, ssstep, ttstep);
+         dest += 32;
+
+         ss = snext2;
+         tt = tnext2;
+      }
+
+      if (n > 0)
+      {
+         last = (float)(n - 1);
+         sdz += d_sdivzstepu * last;
+         tdz += d_tdivzstepu * last;
+         zinv += d_zistepu * last;
+         zz = (float)0x10000 / zinv;
+
+         snext2 = (int)(sdz * zz) + sadjust;
+         if (snext2 < 32) snext2 = 32;
+         else if (snext2 > bbextents) snext2 = bbextents;
+
+         tnext2 = (int)(tdz * zz) + tadjust;
+         if (tnext2 < 32) tnext2 = 32;
+         else if (tnext2 > bbextentt) tnext2 = bbextentt;
+
+         if (n > 1)
+         {
+            ssstep = (snext2 - ss) / (n - 1);
+            ttstep = (tnext2 - tt) / (n - 1);
+         }
+
+         D_DrawSpanRun (dest, base, n, ss, tt, ssstep, ttstep);
+      }
+   } while ((pspan = pspan->pnext) != NULL);
+}
+
+/*
+=============
+D_DrawSpansTiled
+
+Cuts a surface's spans into screen tiles and hands them to the span
+kernel one tile at a time, so neighbouring rows read the same part of
+the surface cache while it is still in the data cache.  The span list
+itself is left alone, D_DrawZSpans walks it afterwards.
+
+Each span is cut at a multiple of SPAN_TILE_STEP pixels from its own
+start, at or after the tile edge, so the pieces keep the perspective
+divides where the whole span would have had them.  A piece does start
+from a fresh divide instead of the running sums, which can move a
+texel coordinate by its last bit, so the output matches the untiled
+kernel up to that rounding rather than exactly.
+=============
+*/
+#define SPAN_TILE_WIDTH		64
+#define SPAN_TILE_ROWS		16
+#define SPAN_TILE_STEP		32	/* multiple of every kernel's divide interval */
+
+static int D_SpanTileCut (espan_t *pspan, int x)
+{
+   if (x <= pspan->u)
+      return pspan->u;
+   return pspan->u + ((x - pspan->u + SPAN_TILE_STEP - 1) & ~(SPAN_TILE_STEP-1));
+}
+
+void (*d_spankernel)(espan_t *pspan) = D_DrawSpans16;
+
+void D_DrawSpansTiled (espan_t *pspan)
+{
+   espan_t  *band[SPAN_TILE_ROWS];
+   espan_t  pieces[SPAN_TILE_ROWS];
+   espan_t  *first, *prev;
+   int      numband, i, x, left, right, u0, u1;
+
+   while (pspan)
+   {
+      // gather a band of rows
+      numband = 0;
+      left = pspan->u;
+      right = pspan->u + pspan->count;
+      while (pspan && numband < SPAN_TILE_ROWS)
+      {
+         band[numband++] = pspan;
+         if (pspan->u < left)
+            left = pspan->u;
+         if (pspan->u + pspan->count > right)
+            right = pspan->u + pspan->count;
+         pspan = pspan->pnext;
+      }
+
+      // narrow bands gain nothing from cutting
+      if (right - left <= SPAN_TILE_WIDTH)
+      {
+         for (i=0 ; i<numband ; i++)
+         {
+            pieces[i] = *band[i];
+            pieces[i].pnext = i+1 < numband ? &pieces[i+1] : NULL;
+         }
+         d_spankernel (pieces);
+         continue;
+      }
+
+      for (x = left & ~(SPAN_TILE_WIDTH-1) ; x < right ; x += SPAN_TILE_WIDTH)
+      {
+         first = prev = NULL;
+         for (i=0 ; i<numband ; i++)
+         {
+            u0 = D_SpanTileCut (band[i], x);
+            u1 = D_SpanTileCut (band[i], x + SPAN_TILE_WIDTH);
+            if (u1 > band[i]->u + band[i]->count)
+               u1 = band[i]->u + band[i]->count;
+            if (u1 <= u0)
+               continue;
+
+            pieces[i].u = u0;
+            pieces[i].v = band[i]->v;
+            pieces[i].count = u1 - u0;
+            pieces[i].pnext = NULL;
+            if (prev)
+               prev->pnext = &pieces[i];
+            else
+               first = &pieces[i];
+            prev = &pieces[i];
+         }
+
+         if (first)
+            d_spankernel (first);
+      }
+   }
+}
+
 extern surfcache_t		*pcurrentcache;
 void D_DrawSpans16_Dither (espan_t *pspan) //qbism up it from 8 to 16. This + unroll = big speed gain!
 {
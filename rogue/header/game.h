@@ -210,6 +210,13 @@ typedef struct
 	int edict_size;
 	int num_edicts;             /* current number, <= max_edicts */
 	int max_edicts;
+
+	/* savestates keep the game and level in memory, these are
+	   NULL if the game doesn't support them. StateSize is an
+	   upper bound, WriteState returns the bytes used or 0 */
+	int (*StateSize)(void);
+	int (*WriteState)(byte *buf, int size);
+	qboolean (*ReadState)(const byte *buf, int size);
 } game_export_t;
 
 #endif /* ROGUE_GAME_H */
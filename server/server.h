@@ -64,7 +64,7 @@ typedef struct
 	byte		multicast_buf[MAX_MSGLEN];
 
 	// demo server information
-	RFILE		*demofile;
+	demoreader_t	*demofile;
 	qboolean	timedemo;		// don't time sync
 } server_t;
 
@@ -133,6 +133,12 @@ typedef struct client_s
 
 	int				challenge;			// challenge of this user, randomly generated
 
+	// where the edict was last found in the map, for multicasts
+	int				leafspawncount;		// svs.spawncount the leaf is from
+	vec3_t			leaforigin;
+	int				leafcluster;
+	int				leafarea;
+
 	netchan_t		netchan;
 } client_t;
 
@@ -177,7 +183,7 @@ typedef struct
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 
 	// serverrecord values
-	RFILE		*demofile;
+	demowriter_t	*demofile;
 	sizebuf_t	demo_multicast;
 	byte		demo_multicast_buf[MAX_MSGLEN];
 } server_static_t;
@@ -289,6 +295,7 @@ extern	game_export_t	*ge;
 void SV_InitGameProgs (void);
 void SV_ShutdownGameProgs (void);
 void SV_InitEdict (edict_t *e);
+void PF_Configstring (int index, char *val);
 
 
 
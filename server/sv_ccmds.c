@@ -345,6 +345,153 @@ void SV_ReadLevelFile (void)
 	ge->ReadLevel (name);
 }
 
+/*
+==============================================================================
+
+SAVESTATES
+
+The running level kept in memory for the frontend's save states, rewind
+and run-ahead.  Only the server side is stored, the local client is sent
+full frames afterwards and catches up by itself.
+
+==============================================================================
+*/
+
+#define	SVSTATE_IDENT	(('1'<<24)+('V'<<16)+('S'<<8)+'Q')
+
+typedef struct
+{
+	int		ident;
+	int		length;				// of the whole state
+	char	mapname[MAX_QPATH];
+	int		framenum;
+	int		time;
+	int		realtime;
+} svstate_t;
+
+/*
+==============
+SV_StateSize
+
+Upper bound for SV_WriteState, 0 if there is no level to save
+==============
+*/
+int SV_StateSize (void)
+{
+	if (sv.state != ss_game || !ge || !ge->StateSize)
+		return 0;
+
+	return sizeof(svstate_t) + sizeof(sv.configstrings) + CM_PortalStateSize ()
+		+ ge->StateSize ();
+}
+
+/*
+==============
+SV_WriteState
+
+Returns the bytes used, 0 if the state didn't fit
+==============
+*/
+int SV_WriteState (byte *buf, int size)
+{
+	svstate_t	state;
+	int			ofs, len;
+
+	if (!SV_StateSize ())
+		return 0;
+
+	ofs = sizeof(state) + sizeof(sv.configstrings) + CM_PortalStateSize ();
+	if (size < ofs)
+		return 0;
+
+	memcpy (buf + sizeof(state), sv.configstrings, sizeof(sv.configstrings));
+	CM_WritePortalStateBuffer (buf + sizeof(state) + sizeof(sv.configstrings));
+
+	len = ge->WriteState (buf + ofs, size - ofs);
+	if (!len)
+		return 0;
+
+	memset (&state, 0, sizeof(state));
+	state.ident = SVSTATE_IDENT;
+	state.length = ofs + len;
+	Q_strlcpy (state.mapname, sv.name, sizeof(state.mapname));
+	state.framenum = sv.framenum;
+	state.time = sv.time;
+	state.realtime = svs.realtime;
+	memcpy (buf, &state, sizeof(state));
+
+	return state.length;
+}
+
+/*
+==============
+SV_ReadState
+
+Only loads into the level the state was taken from
+==============
+*/
+qboolean SV_ReadState (const byte *buf, int size)
+{
+	svstate_t	state;
+	const char	*configstrings;
+	int			ofs;
+	int			i;
+	client_t	*cl;
+	edict_t		*ent;
+
+	if (!SV_StateSize () || !ge->ReadState || size < (int)sizeof(state))
+		return false;
+
+	memcpy (&state, buf, sizeof(state));
+	ofs = sizeof(state) + sizeof(sv.configstrings) + CM_PortalStateSize ();
+	if (state.ident != SVSTATE_IDENT || state.length < ofs || state.length > size)
+		return false;
+	state.mapname[sizeof(state.mapname)-1] = 0;
+	if (strcmp (state.mapname, sv.name))
+		return false;
+
+	configstrings = (const char *)buf + sizeof(state);
+	for (i=0 ; i<MAX_CONFIGSTRINGS ; i++)
+		if (!memchr (configstrings + i*MAX_QPATH, 0, MAX_QPATH))
+			return false;
+
+	// the game relinks everything it reads
+	SV_ClearWorld ();
+	if (!ge->ReadState (buf + ofs, state.length - ofs))
+	{
+		for (i=1 ; i<ge->num_edicts ; i++)
+		{
+			ent = EDICT_NUM(i);
+			if (!ent->inuse)
+				continue;
+			memset (&ent->area, 0, sizeof(ent->area));
+			SV_LinkEdict (ent);
+		}
+		return false;
+	}
+
+	CM_ReadPortalStateBuffer (buf + sizeof(state) + sizeof(sv.configstrings));
+
+	// clients only hear about configstrings that changed
+	if (memcmp (sv.configstrings, configstrings, sizeof(sv.configstrings)))
+	{
+		for (i=0 ; i<MAX_CONFIGSTRINGS ; i++)
+			if (strcmp (sv.configstrings[i], configstrings + i*MAX_QPATH))
+				PF_Configstring (i, (char *)configstrings + i*MAX_QPATH);
+	}
+
+	sv.framenum = state.framenum;
+	sv.time = state.time;
+	svs.realtime = state.realtime;
+
+	// the frames the clients have acknowledged are from another
+	// timeline, so don't delta compress against them
+	for (i=0, cl=svs.clients ; i<maxclients->value ; i++, cl++)
+		cl->lastframe = -1;
+
+	return true;
+}
+
 /*
 ==============
 SV_WriteServerFile
@@ -936,7 +1083,6 @@ void SV_ServerRecord_f (void)
 	char	name[MAX_OSPATH];
 	char	buf_data[32768];
 	sizebuf_t	buf;
-	int		len;
 	int		i;
 	char  *savedir = g_save_dir;
 
@@ -967,13 +1113,15 @@ void SV_ServerRecord_f (void)
 	Com_sprintf (name, sizeof(name), "%s/demos/%s.dm2", savedir, Cmd_Argv(1));
 
 	Com_Printf ("recording to %s.\n", name);
-	FS_CreatePath (name);
-	svs.demofile = rfopen (name, "wb");
+	// server demo frames have no player state, so the client can't play
+	// them and there is nothing for demo_seek to use
+	svs.demofile = Demo_OpenWrite (name, false);
 	if (!svs.demofile)
 	{
 		Com_Printf ("ERROR: couldn't open.\n");
 		return;
 	}
+	FS_FlushMissCache ();
 
 	// setup a buffer to catch all multicasts
 	SZ_Init (&svs.demo_multicast, svs.demo_multicast_buf, sizeof(svs.demo_multicast_buf));
@@ -1008,9 +1156,7 @@ void SV_ServerRecord_f (void)
 
 	// write it to the demo file
 	Com_DPrintf ("signon message length: %i\n", buf.cursize);
-	len = LittleLong (buf.cursize);
-	rfwrite (&len, 4, 1, svs.demofile);
-	rfwrite (buf.data, buf.cursize, 1, svs.demofile);
+	Demo_WriteMessage (svs.demofile, buf.data, buf.cursize);
 
 	// the rest of the demo file will be individual frames
 }
@@ -1030,12 +1176,58 @@ void SV_ServerStop_f (void)
 		Com_Printf ("Not doing a serverrecord.\n");
 		return;
 	}
-	rfclose (svs.demofile);
+	Demo_CloseWrite (svs.demofile);
 	svs.demofile = NULL;
 	Com_Printf ("Recording completed.\n");
 }
 
 
+/*
+==============
+SV_DemoSeek_f
+
+demo_seek <seconds | minutes:seconds>
+
+Jumps demo playback to the nearest keyframe before the given time into
+the level being played
+==============
+*/
+void SV_DemoSeek_f (void)
+{
+	char	*s, *colon;
+	int		msec;
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf ("demo_seek <seconds | minutes:seconds>\n");
+		return;
+	}
+
+	if (sv.state != ss_demo || !sv.demofile)
+	{
+		Com_Printf ("Not playing a demo.\n");
+		return;
+	}
+
+	s = Cmd_Argv(1);
+	colon = strchr (s, ':');
+	if (colon)
+		msec = (atoi (s) * 60 + atof (colon + 1)) * 1000;
+	else
+		msec = atof (s) * 1000;
+	if (msec < 0)
+		msec = 0;
+
+	msec = Demo_Seek (sv.demofile, msec);
+	if (msec < 0)
+	{
+		Com_Printf ("%s has no seek index.\n", sv.name);
+		return;
+	}
+
+	Com_Printf ("demo at %i:%02i\n", msec / 60000, (msec / 1000) % 60);
+}
+
 /*
 ===============
 SV_KillServer_f
@@ -1095,6 +1287,7 @@ void SV_InitOperatorCommands (void)
 
 	Cmd_AddCommand ("serverrecord", SV_ServerRecord_f);
 	Cmd_AddCommand ("serverstop", SV_ServerStop_f);
+	Cmd_AddCommand ("demo_seek", SV_DemoSeek_f);
 
 	Cmd_AddCommand ("save", SV_Savegame_f);
 	Cmd_AddCommand ("load", SV_Loadgame_f);
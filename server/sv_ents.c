@@ -686,7 +686,6 @@ void SV_RecordDemoMessage (void)
 	entity_state_t	nostate;
 	sizebuf_t	buf;
 	byte		buf_data[32768];
-	int			len;
 
 	if (!svs.demofile)
 		return;
@@ -722,8 +721,6 @@ void SV_RecordDemoMessage (void)
 	SZ_Clear (&svs.demo_multicast);
 
 	// now write the entire message to the file, prefixed by the length
-	len = LittleLong (buf.cursize);
-	rfwrite (&len, 4, 1, svs.demofile);
-	rfwrite (buf.data, buf.cursize, 1, svs.demofile);
+	Demo_WriteMessage (svs.demofile, buf.data, buf.cursize);
 }
 
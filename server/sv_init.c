@@ -185,7 +185,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 
 	Com_DPrintf ("SpawnServer: %s\n",server);
 	if (sv.demofile)
-		rfclose (sv.demofile);
+		Demo_CloseRead (sv.demofile);
 
 	svs.spawncount++;		// any partially connected client will be
 							// restarted
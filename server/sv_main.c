@@ -255,8 +255,13 @@ void SVC_GetChallenge (void)
 		i = oldest;
 	}
 
-	// send it back
-	Netchan_OutOfBandPrint (NS_SERVER, net_from, "challenge %i", svs.challenges[i].challenge);
+	// send it back, with the protocols we take; old clients only look
+	// at the challenge
+	if (net_fragment->value)
+		Netchan_OutOfBandPrint (NS_SERVER, net_from, "challenge %i p=%i,%i",
+			svs.challenges[i].challenge, PROTOCOL_VERSION, PROTOCOL_VERSION_EXT);
+	else
+		Netchan_OutOfBandPrint (NS_SERVER, net_from, "challenge %i", svs.challenges[i].challenge);
 }
 
 /*
@@ -284,7 +289,8 @@ void SVC_DirectConnect (void)
 	Com_DPrintf ("SVC_DirectConnect ()\n");
 
 	version = atoi(Cmd_Argv(1));
-	if (version != PROTOCOL_VERSION)
+	if (version != PROTOCOL_VERSION
+		&& (version != PROTOCOL_VERSION_EXT || !net_fragment->value))
 	{
 		Netchan_OutOfBandPrint (NS_SERVER, adr, "print\nServer is version %4.2f.\n", VERSION);
 		Com_DPrintf ("    rejected connect from version %i\n", version);
@@ -403,6 +409,7 @@ gotnewcl:
 	Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect");
 
 	Netchan_Setup (NS_SERVER, &newcl->netchan , adr, qport);
+	newcl->netchan.protocol = version;
 
 	newcl->state = cs_connected;
 	
@@ -1041,7 +1048,7 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 
 	// free current level
 	if (sv.demofile)
-		rfclose (sv.demofile);
+		Demo_CloseRead (sv.demofile);
 	memset (&sv, 0, sizeof(sv));
 	Com_SetServerState (sv.state);
 
@@ -1051,7 +1058,7 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 	if (svs.client_entities)
 		Z_Free (svs.client_entities);
 	if (svs.demofile)
-		rfclose (svs.demofile);
+		Demo_CloseWrite (svs.demofile);
 	memset (&svs, 0, sizeof(svs));
 }
 
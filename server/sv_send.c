@@ -148,6 +148,105 @@ void SV_BroadcastCommand (char *fmt, ...)
 }
 
 
+/*
+=================
+SV_UpdateClientLeafs
+
+Finds the cluster and area of every client that moved since it was last
+looked at.
+=================
+*/
+static int		multicast_clientgen;	// bumped when a client changes cluster
+
+static void SV_UpdateClientLeafs (void)
+{
+	client_t	*client;
+	int			j, leafnum, cluster;
+
+	for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
+	{
+		if (client->state == cs_free || client->state == cs_zombie)
+			continue;
+		if (client->leafspawncount == svs.spawncount
+			&& VectorCompare (client->leaforigin, client->edict->s.origin))
+			continue;
+
+		leafnum = CM_PointLeafnum (client->edict->s.origin);
+		cluster = CM_LeafCluster (leafnum);
+		if (client->leafspawncount != svs.spawncount || cluster != client->leafcluster)
+			multicast_clientgen++;
+
+		client->leafspawncount = svs.spawncount;
+		VectorCopy (client->edict->s.origin, client->leaforigin);
+		client->leafcluster = cluster;
+		client->leafarea = CM_LeafArea (leafnum);
+	}
+}
+
+/*
+=================
+SV_MulticastClients
+
+Returns the set of client slots whose cluster the PVS or PHS of a source
+cluster reaches.  The sets are kept for the rest of the frame, so a run
+of multicasts from the same place only decompresses the row and tests the
+clients once.
+=================
+*/
+#define	MULTICAST_ROWS	16
+
+typedef struct
+{
+	int			framenum;
+	int			spawncount;
+	int			clientgen;
+	qboolean	phs;
+	int			cluster;
+	byte		clients[MAX_CLIENTS/8];
+} multicastrow_t;
+
+static multicastrow_t	multicast_rows[MULTICAST_ROWS];
+static int				multicast_nextrow;
+
+static byte *SV_MulticastClients (int cluster, qboolean phs)
+{
+	multicastrow_t	*row;
+	client_t		*client;
+	byte			*mask;
+	int				i, j;
+
+	for (i=0, row=multicast_rows ; i<MULTICAST_ROWS ; i++, row++)
+	{
+		if (row->cluster == cluster && row->phs == phs
+			&& row->framenum == sv.framenum && row->spawncount == svs.spawncount
+			&& row->clientgen == multicast_clientgen)
+			return row->clients;
+	}
+
+	row = &multicast_rows[multicast_nextrow];
+	multicast_nextrow = (multicast_nextrow + 1) & (MULTICAST_ROWS-1);
+
+	row->framenum = sv.framenum;
+	row->spawncount = svs.spawncount;
+	row->clientgen = multicast_clientgen;
+	row->phs = phs;
+	row->cluster = cluster;
+	memset (row->clients, 0, sizeof(row->clients));
+
+	mask = phs ? CM_ClusterPHS (cluster) : CM_ClusterPVS (cluster);
+	// free slots are tested too, their leaf is refreshed before they can
+	// receive anything and a new cluster invalidates the row
+	for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
+	{
+		if (client->leafspawncount != svs.spawncount || client->leafcluster < 0)
+			continue;
+		if (mask[client->leafcluster>>3] & (1<<(client->leafcluster&7)))
+			row->clients[j>>3] |= 1<<(j&7);
+	}
+
+	return row->clients;
+}
+
 /*
 =================
 SV_Multicast
@@ -163,25 +262,14 @@ MULTICAST_PHS	send to clients potentially hearable from org
 void SV_Multicast (vec3_t origin, multicast_t to)
 {
 	client_t	*client;
-	byte		*mask;
+	byte		*clients;
 	int			leafnum, cluster;
 	int			j;
 	qboolean	reliable;
-	int			area1, area2;
+	int			area1;
 
 	reliable = false;
 
-	if (to != MULTICAST_ALL_R && to != MULTICAST_ALL)
-	{
-		leafnum = CM_PointLeafnum (origin);
-		area1 = CM_LeafArea (leafnum);
-	}
-	else
-	{
-		leafnum = 0;	// just to avoid compiler warnings
-		area1 = 0;
-	}
-
 	// if doing a serverrecord, store everything
 	if (svs.demofile)
 		SZ_Write (&svs.demo_multicast, sv.multicast.data, sv.multicast.cursize);
@@ -191,28 +279,27 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 	case MULTICAST_ALL_R:
 		reliable = true;	// intentional fallthrough
 	case MULTICAST_ALL:
-		leafnum = 0;
-		mask = NULL;
+		clients = NULL;
+		area1 = 0;
 		break;
 
 	case MULTICAST_PHS_R:
 		reliable = true;	// intentional fallthrough
 	case MULTICAST_PHS:
-		leafnum = CM_PointLeafnum (origin);
-		cluster = CM_LeafCluster (leafnum);
-		mask = CM_ClusterPHS (cluster);
-		break;
-
 	case MULTICAST_PVS_R:
-		reliable = true;	// intentional fallthrough
 	case MULTICAST_PVS:
+		if (to == MULTICAST_PVS_R)
+			reliable = true;
 		leafnum = CM_PointLeafnum (origin);
 		cluster = CM_LeafCluster (leafnum);
-		mask = CM_ClusterPVS (cluster);
+		area1 = CM_LeafArea (leafnum);
+		SV_UpdateClientLeafs ();
+		clients = SV_MulticastClients (cluster, to == MULTICAST_PHS || to == MULTICAST_PHS_R);
 		break;
 
 	default:
-		mask = NULL;
+		clients = NULL;
+		area1 = 0;
 		Com_Error (ERR_FATAL, "SV_Multicast: bad to:%i", to);
 	}
 
@@ -224,14 +311,12 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 		if (client->state != cs_spawned && !reliable)
 			continue;
 
-		if (mask)
+		if (clients)
 		{
-			leafnum = CM_PointLeafnum (client->edict->s.origin);
-			cluster = CM_LeafCluster (leafnum);
-			area2 = CM_LeafArea (leafnum);
-			if (!CM_AreasConnected (area1, area2))
+			if (!(clients[j>>3] & (1<<(j&7))))
 				continue;
-			if ( mask && (!(mask[cluster>>3] & (1<<(cluster&7)) ) ) )
+			// portals can open and close during the frame
+			if (!CM_AreasConnected (area1, client->leafarea))
 				continue;
 		}
 
@@ -396,12 +481,17 @@ SV_SendClientDatagram
 */
 qboolean SV_SendClientDatagram (client_t *client)
 {
-	byte		msg_buf[MAX_MSGLEN];
+	byte		msg_buf[MAX_MSGLEN_EXT];
 	sizebuf_t	msg;
 
 	SV_BuildClientFrame (client);
 
-	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+	// protocol 35 clients take frames larger than a datagram,
+	// unless they are writing them to a demo
+	if (client->netchan.protocol == PROTOCOL_VERSION_EXT && !client->netchan.demolimit)
+		SZ_Init (&msg, msg_buf, MAX_MSGLEN_EXT - 16);
+	else
+		SZ_Init (&msg, msg_buf, MAX_MSGLEN);
 	msg.allowoverflow = true;
 
 	// send over all the relevant entity_state_t
@@ -427,8 +517,12 @@ qboolean SV_SendClientDatagram (client_t *client)
 	// send the datagram
 	Netchan_Transmit (&client->netchan, msg.cursize, msg.data);
 
-	// record the size for rate estimation
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	// record the size for rate estimation, as it went out when it was
+	// packed
+	if (client->netchan.protocol == PROTOCOL_VERSION_EXT)
+		client->message_size[sv.framenum % RATE_MESSAGES] = client->netchan.sent_length;
+	else
+		client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
 
 	return true;
 }
@@ -443,9 +537,10 @@ void SV_DemoCompleted (void)
 {
 	if (sv.demofile)
 	{
-		rfclose (sv.demofile);
+		Demo_CloseRead (sv.demofile);
 		sv.demofile = NULL;
 	}
+	CL_DemoCompleted ();
 	SV_Nextserver ();
 }
 
@@ -494,8 +589,8 @@ void SV_SendClientMessages (void)
 	int			i;
 	client_t	*c;
 	int			msglen;
-	byte		msgbuf[MAX_MSGLEN];
-	int			r;
+	byte		msgbuf[MAX_MSGLEN_EXT];
+	sizebuf_t	seek;
 
 	msglen = 0;
 
@@ -506,27 +601,19 @@ void SV_SendClientMessages (void)
 			msglen = 0;
 		else
 		{
-			// get the next message
-			r = rfread (&msglen, 4, 1, sv.demofile);
-			if (r != 1)
-			{
-				SV_DemoCompleted ();
-				return;
-			}
-			msglen = LittleLong (msglen);
+			// after a demo_seek, restore configstrings before going on
+			SZ_Init (&seek, msgbuf, MAX_MSGLEN);
+			if (Demo_SeekConfigstrings (sv.demofile, &seek))
+				msglen = seek.cursize;
+			else
+				msglen = Demo_ReadMessage (sv.demofile, msgbuf, sizeof(msgbuf));
 			if (msglen == -1)
 			{
 				SV_DemoCompleted ();
 				return;
 			}
-			if (msglen > MAX_MSGLEN)
-				Com_Error (ERR_DROP, "SV_SendClientMessages: msglen > MAX_MSGLEN");
-			r = rfread (msgbuf, msglen, 1, sv.demofile);
-			if (r != 1)
-			{
-				SV_DemoCompleted ();
-				return;
-			}
+			if (msglen > MAX_MSGLEN_EXT)
+				Com_Error (ERR_DROP, "SV_SendClientMessages: msglen > MAX_MSGLEN_EXT");
 		}
 	}
 
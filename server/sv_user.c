@@ -40,11 +40,16 @@ SV_BeginDemoServer
 void SV_BeginDemoserver (void)
 {
 	char		name[MAX_OSPATH];
+	RFILE		*f;
 
 	Com_sprintf (name, sizeof(name), "demos/%s", sv.name);
-	FS_FOpenFile (name, &sv.demofile);
-	if (!sv.demofile)
+	FS_FOpenFile (name, &f);
+	if (!f)
 		Com_Error (ERR_DROP, "Couldn't open %s\n", name);
+	sv.demofile = Demo_OpenRead (f);
+	if (!sv.demofile)
+		Com_Error (ERR_DROP, "Couldn't play %s\n", name);
+	Demo_LoadIndex (sv.demofile, name);
 }
 
 /*
@@ -442,6 +447,18 @@ void SV_Nextserver_f (void)
 	SV_Nextserver ();
 }
 
+/*
+==================
+SV_Recording_f
+
+A protocol 35 client recording a demo needs messages that fit in a .dm2
+==================
+*/
+void SV_Recording_f (void)
+{
+	sv_client->netchan.demolimit = atoi (Cmd_Argv(1)) != 0;
+}
+
 typedef struct
 {
 	char	*name;
@@ -460,6 +477,8 @@ ucmd_t ucmds[] =
 
 	{"disconnect", SV_Disconnect_f},
 
+	{"recording", SV_Recording_f},
+
 	// issued by hand at client consoles	
 	{"info", SV_ShowServerinfo_f},
 